@@ -1,32 +1,104 @@
 #pragma once
 
+#include "ALUTables.h"
 #include "CPUDefs.h"
 #include "Nibble.h"
+#include "RippleCarry.h"
 
-namespace alu {
+#include <iostream>
+
+// CPU4_ALU_TABLES picks the backend new ALUs start with. The ripple-carry
+// model stays the reference; the table backend is generated from it.
+#ifndef CPU4_ALU_TABLES
+#define CPU4_ALU_TABLES 0
+#endif
 
-struct Flags {
-  bool Overflow{};
-  bool Zero{};
-  bool Negative{};
+namespace alu {
 
-  void Clear();
+enum class Backend {
+  RippleCarry, // Gate level model, one full adder per bit.
+  Table        // Precomputed results, see ALUTables.h.
 };
 
-class ALU {
+inline constexpr Backend DefaultBackend{CPU4_ALU_TABLES ? Backend::Table
+                                                        : Backend::RippleCarry};
+
+// BasicALU is the ALU of a Bits wide machine. The table backend exists for
+// 4 bit words only; wider ALUs always use the ripple-carry model.
+// It is constexpr throughout so a CPU can run in constant expressions.
+template <unsigned Bits>
+class BasicALU {
 public:
-  ALU(cpu::Register& result);
+  using Word = cpu::uintN<Bits>;
+
+  constexpr BasicALU(Word& result, const Backend backend = DefaultBackend)
+      : m_result(result), m_backend{backend} {}
 
-  void DoOperation(cpu::uint4 inputA, cpu::uint4 inputB, cpu::OpCode op);
+  constexpr void DoOperation(const Word inputA, const Word inputB,
+                             const cpu::OpCode op) {
+    m_flags.Clear();
 
-  const Flags& GetFlags() const;
+    switch (op) {
+    case cpu::OpCode::Add:
+    case cpu::OpCode::Sub:
+      if (m_hasTable && m_backend == Backend::Table) {
+        m_lookup(inputA, inputB, op);
+      } else if (op == cpu::OpCode::Add) {
+        m_add(inputA, inputB);
+      } else {
+        m_sub(inputA, inputB);
+      }
+      break;
+    default:
+      // No op if it's an OpCode we don't support.
+      if !consteval {
+        std::cerr << "ALU: Unknown OpCode: " << static_cast<uint>(op) << '\n';
+      }
+    }
+  }
+
+  constexpr const Flags& GetFlags() const {
+    return m_flags;
+  }
+  constexpr void SetFlags(const Flags& flags) {
+    m_flags = flags;
+  }
+
+  constexpr Backend GetBackend() const {
+    return m_backend;
+  }
+  constexpr void SetBackend(const Backend backend) {
+    m_backend = backend;
+  }
 
 private:
-  cpu::Register& m_result;
+  static constexpr bool m_hasTable{Bits == 4};
+
+  Word& m_result;
   Flags m_flags{};
+  Backend m_backend{};
 
-  void m_add(cpu::uint4 inputA, cpu::uint4 inputB);
-  void m_sub(cpu::uint4 inputA, cpu::uint4 inputB);
+  constexpr void m_add(const Word inputA, const Word inputB) {
+    const BasicOutput<Bits> out{RippleCarryAdd(inputA, inputB)};
+    m_result = out.Result;
+    m_flags = out.Flags;
+  }
+  constexpr void m_sub(const Word inputA, const Word inputB) {
+    const BasicOutput<Bits> out{RippleCarrySub(inputA, inputB)};
+    m_result = out.Result;
+    m_flags = out.Flags;
+  }
+
+  constexpr void m_lookup(const Word inputA, const Word inputB,
+                          const cpu::OpCode op) {
+    if constexpr (m_hasTable) {
+      const uint8_t entry{Lookup(inputA, inputB, op)};
+      m_result = entry & 0xF;
+      m_flags = UnpackFlags(entry >> 4);
+    }
+  }
 };
 
+using ALU = BasicALU<4>;
+
 } // namespace alu
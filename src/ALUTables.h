@@ -0,0 +1,108 @@
+#pragma once
+
+#include "CPUDefs.h"
+#include "Nibble.h"
+#include "RippleCarry.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+namespace alu {
+
+// The table backend precomputes every Add and Sub from the ripple-carry
+// reference at compile time. Each entry packs the result into the low nibble
+// and the flags, laid out as cpu::flagBit, into the high nibble. Tables are
+// indexed by (inputA << 4) | inputB.
+using Table = std::array<uint8_t, 256>;
+
+constexpr Table MakeTable(const cpu::OpCode op) {
+  Table table{};
+  for (uint8_t a = 0; a < 16; a++) {
+    for (uint8_t b = 0; b < 16; b++) {
+      const Output out{op == cpu::OpCode::Sub
+                           ? RippleCarrySub(cpu::uint4(a), cpu::uint4(b))
+                           : RippleCarryAdd(cpu::uint4(a), cpu::uint4(b))};
+      table[(a << 4) | b] =
+          static_cast<uint8_t>(out.Result.Raw() | (PackFlags(out.Flags) << 4));
+    }
+  }
+  return table;
+}
+
+inline constexpr Table AddTable{MakeTable(cpu::OpCode::Add)};
+inline constexpr Table SubTable{MakeTable(cpu::OpCode::Sub)};
+
+// Lookup returns the packed entry for Add or Sub.
+constexpr uint8_t Lookup(const cpu::uint4 inputA, const cpu::uint4 inputB,
+                         const cpu::OpCode op) {
+  const size_t index = (inputA.Raw() << 4) | inputB.Raw();
+  return op == cpu::OpCode::Sub ? SubTable[index] : AddTable[index];
+}
+
+// Register-only transitions cover Mov, Add and Sub when both register
+// arguments name A or B. One entry gives the new A and B and, for Add and
+// Sub, the new flags, so executing one of these instructions is a single
+// load. Arguments that name IS or PC are marked Fallback and must be
+// executed normally.
+namespace transition {
+constexpr uint16_t WritesALU{1 << 11}; // Flags and ALU result are updated.
+constexpr uint16_t Fallback{1 << 15};
+
+constexpr uint8_t NewA(const uint16_t entry) {
+  return entry & 0xF;
+}
+constexpr uint8_t NewB(const uint16_t entry) {
+  return (entry >> 4) & 0xF;
+}
+constexpr uint8_t NewFlags(const uint16_t entry) {
+  return (entry >> 8) & 0x7;
+}
+} // namespace transition
+
+using RegisterTable = std::array<uint16_t, 3 * 16 * 256>;
+
+constexpr size_t RegisterTableIndex(const cpu::OpCode op, const uint8_t args,
+                                    const uint8_t a, const uint8_t b) {
+  const size_t row =
+      std::to_underlying(op) - std::to_underlying(cpu::OpCode::Mov);
+  return (((row << 4) | args) << 8) | (a << 4) | b;
+}
+
+constexpr RegisterTable MakeRegisterTable() {
+  RegisterTable table{};
+  for (const cpu::OpCode op :
+       {cpu::OpCode::Mov, cpu::OpCode::Add, cpu::OpCode::Sub}) {
+    for (uint8_t args = 0; args < 16; args++) {
+      const uint8_t src = args >> 2;
+      const uint8_t dest = args & 0x3;
+      for (uint8_t a = 0; a < 16; a++) {
+        for (uint8_t b = 0; b < 16; b++) {
+          uint16_t& entry{table[RegisterTableIndex(op, args, a, b)]};
+          if (src > cpu::regID::B || dest > cpu::regID::B) {
+            entry = transition::Fallback;
+            continue;
+          }
+
+          std::array<uint8_t, 2> regs{a, b};
+          if (op == cpu::OpCode::Mov) {
+            regs[dest] = regs[src];
+            entry = static_cast<uint16_t>(regs[0] | (regs[1] << 4));
+            continue;
+          }
+          const uint8_t out{Lookup(cpu::uint4(regs[src]),
+                                   cpu::uint4(regs[dest]), op)};
+          entry = static_cast<uint16_t>((out & 0xF) | (regs[1] << 4) |
+                                        ((out >> 4) << 8) |
+                                        transition::WritesALU);
+        }
+      }
+    }
+  }
+  return table;
+}
+
+inline constexpr RegisterTable RegisterTransitions{MakeRegisterTable()};
+
+} // namespace alu
@@ -0,0 +1,104 @@
+#include "Async.h"
+
+#include <cstddef>
+#include <exception>
+#include <new>
+
+namespace cpu {
+
+FramePool::~FramePool() {
+  for (void* const chunk : m_chunks) {
+    ::operator delete(chunk);
+  }
+}
+
+void* FramePool::Allocate(const size_t size) {
+  m_stats.Allocations++;
+  const size_t sizeClass{(size + m_granule - 1) / m_granule};
+  if (sizeClass == 0 || sizeClass > m_classes) {
+    m_stats.Oversized++;
+    return ::operator new(size);
+  }
+
+  FreeFrame*& head{m_free[sizeClass - 1]};
+  if (head == nullptr) {
+    // Carve a new chunk into frames of this class.
+    const size_t frameSize{sizeClass * m_granule};
+    auto* const chunk{static_cast<std::byte*>(
+        ::operator new(frameSize * m_framesPerChunk))};
+    m_chunks.push_back(chunk);
+    m_stats.Chunks++;
+    for (size_t i = m_framesPerChunk; i-- > 0;) {
+      head = new (chunk + i * frameSize) FreeFrame{head};
+    }
+  }
+  FreeFrame* const frame{head};
+  head = frame->next;
+  return frame;
+}
+
+void FramePool::Deallocate(void* const frame, const size_t size) noexcept {
+  const size_t sizeClass{(size + m_granule - 1) / m_granule};
+  if (sizeClass == 0 || sizeClass > m_classes) {
+    ::operator delete(frame);
+    return;
+  }
+  FreeFrame*& head{m_free[sizeClass - 1]};
+  head = new (frame) FreeFrame{head};
+}
+
+const FramePool::Stats& FramePool::GetStats() const {
+  return m_stats;
+}
+
+FramePool& FramePool::Local() {
+  thread_local FramePool pool{};
+  return pool;
+}
+
+void Task::promise_type::unhandled_exception() {
+  std::terminate();
+}
+
+size_t Executor::Spawn(Task task) {
+  const size_t id{m_tasks.size()};
+  m_tasks.push_back(std::move(task));
+  if (!m_tasks.back().Done()) {
+    m_active.push_back(static_cast<uint32_t>(id));
+  }
+  return id;
+}
+
+size_t Executor::RunRound() {
+  // Resume in order, compacting the unfinished ids in place.
+  size_t kept{0};
+  for (const uint32_t id : m_active) {
+    Task& task{m_tasks[id]};
+    task.Resume();
+    m_switches++;
+    if (!task.Done()) {
+      m_active[kept++] = id;
+    }
+  }
+  m_active.resize(kept);
+  return kept;
+}
+
+void Executor::Run() {
+  while (RunRound() != 0) {
+  }
+}
+
+size_t Executor::Size() const {
+  return m_tasks.size();
+}
+
+const Task& Executor::Get(const size_t id) const {
+  return m_tasks[id];
+}
+
+uint64_t Executor::Switches() const {
+  return m_switches;
+}
+
+} // namespace cpu
@@ -0,0 +1,155 @@
+#pragma once
+
+#include "RunResult.h"
+
+#include <array>
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace cpu {
+
+// FramePool hands out coroutine frames from per-thread free lists, one per
+// 64 byte size class, carved from chunks that are kept until the thread
+// exits. After warmup, starting and finishing a Task does not touch the
+// heap. Frames larger than the biggest class go to the global heap. A frame
+// must be freed on the thread that allocated it.
+class FramePool {
+public:
+  struct Stats {
+    uint64_t Allocations{};
+    uint64_t Chunks{}; // Chunks taken from the heap.
+    uint64_t Oversized{};
+  };
+
+  FramePool() = default;
+  FramePool(const FramePool&) = delete;
+  FramePool& operator=(const FramePool&) = delete;
+  ~FramePool();
+
+  void* Allocate(size_t size);
+  void Deallocate(void* frame, size_t size) noexcept;
+
+  const Stats& GetStats() const;
+
+  // Local is the calling thread's pool.
+  static FramePool& Local();
+
+private:
+  static constexpr size_t m_granule{64};
+  static constexpr size_t m_classes{16};
+  static constexpr size_t m_framesPerChunk{64};
+
+  struct FreeFrame {
+    FreeFrame* next{};
+  };
+
+  std::array<FreeFrame*, m_classes> m_free{};
+  std::vector<void*> m_chunks{};
+  Stats m_stats{};
+};
+
+// Task is a resumable run of a CPU, returned by BasicCPU::RunAsync. It
+// starts suspended; each Resume runs it to its next yield, and once Done it
+// holds the RunResult of the whole run. A Task owns its frame and is
+// move-only.
+class Task {
+public:
+  struct promise_type {
+    RunResult result{};
+
+    static void* operator new(const size_t size) {
+      return FramePool::Local().Allocate(size);
+    }
+    static void operator delete(void* const frame, const size_t size) {
+      FramePool::Local().Deallocate(frame, size);
+    }
+
+    Task get_return_object() {
+      return Task{std::coroutine_handle<promise_type>::from_promise(*this)};
+    }
+    std::suspend_always initial_suspend() noexcept {
+      return {};
+    }
+    std::suspend_always final_suspend() noexcept {
+      return {};
+    }
+    void return_value(const RunResult& value) {
+      result = value;
+    }
+    [[noreturn]] void unhandled_exception();
+  };
+
+  Task() = default;
+  Task(Task&& other) noexcept
+      : m_handle{std::exchange(other.m_handle, nullptr)} {}
+  Task& operator=(Task&& other) noexcept {
+    if (this != &other) {
+      m_destroy();
+      m_handle = std::exchange(other.m_handle, nullptr);
+    }
+    return *this;
+  }
+  Task(const Task&) = delete;
+  Task& operator=(const Task&) = delete;
+  ~Task() {
+    m_destroy();
+  }
+
+  bool Done() const {
+    return !m_handle || m_handle.done();
+  }
+  void Resume() {
+    if (!Done()) {
+      m_handle.resume();
+    }
+  }
+  // Result is the outcome of the run once Done.
+  const RunResult& Result() const {
+    return m_handle.promise().result;
+  }
+
+private:
+  explicit Task(const std::coroutine_handle<promise_type> handle)
+      : m_handle{handle} {}
+
+  void m_destroy() {
+    if (m_handle) {
+      m_handle.destroy();
+      m_handle = nullptr;
+    }
+  }
+
+  std::coroutine_handle<promise_type> m_handle{};
+};
+
+// Executor interleaves Tasks on the calling thread. It resumes them round
+// robin, one slice each per round, so every machine gets the same share of
+// the thread whatever the others do. Finished tasks keep their results
+// until the executor is destroyed.
+class Executor {
+public:
+  // Spawn takes ownership of a task and returns its id.
+  size_t Spawn(Task task);
+
+  // RunRound resumes every unfinished task once and returns how many are
+  // still unfinished.
+  size_t RunRound();
+  // Run repeats rounds until every task has finished. Tasks blocked on a
+  // port the host never serves keep it going forever.
+  void Run();
+
+  size_t Size() const;
+  const Task& Get(size_t id) const;
+  // Switches counts resumes since construction.
+  uint64_t Switches() const;
+
+private:
+  std::vector<Task> m_tasks{};
+  std::vector<uint32_t> m_active{}; // Unfinished task ids, in spawn order.
+  uint64_t m_switches{};
+};
+
+} // namespace cpu
@@ -0,0 +1,411 @@
+#pragma once
+
+#include "CPUDefs.h"
+#include "CPUState.h"
+#include "Nibble.h"
+
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+namespace cpu {
+
+namespace batch {
+
+// Each lane of a vector holds one machine's nibble in a byte. Masks are
+// 0xFF for true and 0x00 for false so they can be used directly for blends.
+// The kernel in BatchCPU is written once against this interface and
+// instantiated for every supported vector width.
+struct ScalarOps {
+  using V = uint8_t;
+  static constexpr size_t Width = 1;
+
+  static V Load(const uint8_t* p) {
+    return *p;
+  }
+  static void Store(uint8_t* p, const V v) {
+    *p = v;
+  }
+  static V Set(const uint8_t v) {
+    return v;
+  }
+  static V And(const V a, const V b) {
+    return a & b;
+  }
+  static V Or(const V a, const V b) {
+    return a | b;
+  }
+  static V AndNot(const V a, const V b) { // ~a & b
+    return static_cast<V>(~a & b);
+  }
+  static V Add(const V a, const V b) {
+    return static_cast<V>(a + b);
+  }
+  static V Sub(const V a, const V b) {
+    return static_cast<V>(a - b);
+  }
+  static V Eq(const V a, const V b) {
+    return a == b ? 0xFF : 0x00;
+  }
+  static V Shr2(const V a) {
+    return static_cast<V>(a >> 2);
+  }
+  static V Blend(const V mask, const V a, const V b) { // mask ? b : a
+    return static_cast<V>((mask & b) | (~mask & a));
+  }
+  static uint32_t MoveMask(const V mask) {
+    return mask & 1;
+  }
+};
+
+#if defined(__SSE2__)
+struct SSEOps {
+  using V = __m128i;
+  static constexpr size_t Width = 16;
+
+  static V Load(const uint8_t* p) {
+    return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+  }
+  static void Store(uint8_t* p, const V v) {
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(p), v);
+  }
+  static V Set(const uint8_t v) {
+    return _mm_set1_epi8(static_cast<char>(v));
+  }
+  static V And(const V a, const V b) {
+    return _mm_and_si128(a, b);
+  }
+  static V Or(const V a, const V b) {
+    return _mm_or_si128(a, b);
+  }
+  static V AndNot(const V a, const V b) {
+    return _mm_andnot_si128(a, b);
+  }
+  static V Add(const V a, const V b) {
+    return _mm_add_epi8(a, b);
+  }
+  static V Sub(const V a, const V b) {
+    return _mm_sub_epi8(a, b);
+  }
+  static V Eq(const V a, const V b) {
+    return _mm_cmpeq_epi8(a, b);
+  }
+  // There is no byte shift, bits shifted in from the neighbouring byte are
+  // dropped by the callers' nibble masks.
+  static V Shr2(const V a) {
+    return _mm_srli_epi16(a, 2);
+  }
+  static V Blend(const V mask, const V a, const V b) {
+    return _mm_or_si128(_mm_and_si128(mask, b), _mm_andnot_si128(mask, a));
+  }
+  static uint32_t MoveMask(const V mask) {
+    return static_cast<uint32_t>(_mm_movemask_epi8(mask));
+  }
+};
+#endif
+
+#if defined(__AVX2__)
+struct AVX2Ops {
+  using V = __m256i;
+  static constexpr size_t Width = 32;
+
+  static V Load(const uint8_t* p) {
+    return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+  }
+  static void Store(uint8_t* p, const V v) {
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(p), v);
+  }
+  static V Set(const uint8_t v) {
+    return _mm256_set1_epi8(static_cast<char>(v));
+  }
+  static V And(const V a, const V b) {
+    return _mm256_and_si256(a, b);
+  }
+  static V Or(const V a, const V b) {
+    return _mm256_or_si256(a, b);
+  }
+  static V AndNot(const V a, const V b) {
+    return _mm256_andnot_si256(a, b);
+  }
+  static V Add(const V a, const V b) {
+    return _mm256_add_epi8(a, b);
+  }
+  static V Sub(const V a, const V b) {
+    return _mm256_sub_epi8(a, b);
+  }
+  static V Eq(const V a, const V b) {
+    return _mm256_cmpeq_epi8(a, b);
+  }
+  static V Shr2(const V a) {
+    return _mm256_srli_epi16(a, 2);
+  }
+  static V Blend(const V mask, const V a, const V b) {
+    return _mm256_blendv_epi8(a, b, mask);
+  }
+  static uint32_t MoveMask(const V mask) {
+    return static_cast<uint32_t>(_mm256_movemask_epi8(mask));
+  }
+};
+#endif
+
+#if defined(__AVX2__)
+using VectorOps = AVX2Ops;
+#elif defined(__SSE2__)
+using VectorOps = SSEOps;
+#else
+using VectorOps = ScalarOps;
+#endif
+
+} // namespace batch
+
+// BatchCPU runs N independent machines in lock step. State is kept in
+// structure-of-arrays form, one byte per nibble, so a single vector
+// instruction touches the same register of many machines at once.
+//
+// Every lane follows CPU::Cycle exactly, including register ids 2 and 3
+// selecting IS and PC and Jump reading its target without advancing PC.
+// Unknown opcodes are skipped silently instead of being reported on stderr.
+template <size_t N, typename Ops = batch::VectorOps> class BatchCPU {
+public:
+  static constexpr size_t Lanes = N;
+
+  BatchCPU() {
+    // Empty lanes start halted so they never execute.
+    m_halted.fill(0xFF);
+  }
+
+  // Load places a machine into a lane and restarts its cycle count.
+  void Load(const size_t lane, const CPUState& state) {
+    for (uint8_t addr = 0; addr < MemSizeWords; addr++) {
+      m_memory[addr][lane] = state.Load(uint4(addr)).Raw();
+    }
+    m_A[lane] = state.Registers[regID::A];
+    m_B[lane] = state.Registers[regID::B];
+    m_IS[lane] = state.Registers[regID::IS];
+    m_PC[lane] = state.Registers[regID::PC];
+    m_aluResult[lane] = state.ALUResult;
+    m_flags[lane] = state.Flags;
+    m_halted[lane] = state.Halted ? 0xFF : 0x00;
+    m_startStep[lane] = m_steps;
+    m_haltStep[lane] = m_steps;
+  }
+
+  CPUState Get(const size_t lane) const {
+    CPUState state{};
+    for (uint8_t addr = 0; addr < MemSizeWords; addr++) {
+      state.Store(uint4(m_memory[addr][lane]), uint4(addr));
+    }
+    state.Registers[regID::A] = m_A[lane];
+    state.Registers[regID::B] = m_B[lane];
+    state.Registers[regID::IS] = m_IS[lane];
+    state.Registers[regID::PC] = m_PC[lane];
+    state.ALUResult = m_aluResult[lane];
+    state.Flags = m_flags[lane];
+    state.Halted = m_halted[lane] ? 1 : 0;
+    return state;
+  }
+
+  bool IsHalted(const size_t lane) const {
+    return m_halted[lane] != 0;
+  }
+
+  // Cycles returns how many instructions a lane has executed since Load,
+  // counting its Halt.
+  uint64_t Cycles(const size_t lane) const {
+    const uint64_t end{m_halted[lane] ? m_haltStep[lane] : m_steps};
+    return end - m_startStep[lane];
+  }
+
+  // Cycle executes one instruction on every lane that has not halted and
+  // returns the number of lanes still running.
+  size_t Cycle() {
+    m_steps++;
+    size_t running{0};
+    size_t lane{0};
+    for (; lane + Ops::Width <= N; lane += Ops::Width) {
+      running += m_step<Ops>(lane);
+    }
+    for (; lane < N; lane++) {
+      running += m_step<batch::ScalarOps>(lane);
+    }
+    return running;
+  }
+
+  // Run steps until every lane has halted or maxCycles steps have been taken.
+  // Returns the number of steps taken.
+  uint64_t Run(const uint64_t maxCycles) {
+    uint64_t steps{0};
+    bool running{m_anyRunning()};
+    while (running && steps < maxCycles) {
+      running = Cycle() != 0;
+      steps++;
+    }
+    return steps;
+  }
+
+private:
+  template <size_t Size> using Column = std::array<uint8_t, Size>;
+  static constexpr size_t Align{64};
+
+  alignas(Align) std::array<Column<N>, MemSizeWords> m_memory{};
+  alignas(Align) Column<N> m_A{};
+  alignas(Align) Column<N> m_B{};
+  alignas(Align) Column<N> m_IS{};
+  alignas(Align) Column<N> m_PC{};
+  alignas(Align) Column<N> m_aluResult{};
+  alignas(Align) Column<N> m_flags{};
+  alignas(Align) Column<N> m_halted{};
+
+  uint64_t m_steps{};
+  std::array<uint64_t, N> m_startStep{};
+  std::array<uint64_t, N> m_haltStep{};
+
+  bool m_anyRunning() const {
+    for (const uint8_t halted : m_halted) {
+      if (halted == 0) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // m_gather reads memory at a per-lane address by selecting across the
+  // sixteen memory columns.
+  template <typename O>
+  typename O::V m_gather(const size_t lane, const typename O::V addr) const {
+    typename O::V result{O::Set(0)};
+    for (uint8_t k = 0; k < MemSizeWords; k++) {
+      result = O::Blend(O::Eq(addr, O::Set(k)), result,
+                        O::Load(&m_memory[k][lane]));
+    }
+    return result;
+  }
+
+  // m_select4 picks one of A, B, IS and PC by a 2 bit register id.
+  template <typename O>
+  static typename O::V m_select4(const typename O::V id, const typename O::V a,
+                                 const typename O::V b, const typename O::V is,
+                                 const typename O::V pc) {
+    typename O::V result{O::Blend(O::Eq(id, O::Set(regID::B)), a, b)};
+    result = O::Blend(O::Eq(id, O::Set(regID::IS)), result, is);
+    return O::Blend(O::Eq(id, O::Set(regID::PC)), result, pc);
+  }
+
+  template <typename O> size_t m_step(const size_t lane) {
+    using V = typename O::V;
+    const V nibble{O::Set(0xF)};
+    const auto is = [](const V op, const OpCode code) {
+      return O::Eq(op, O::Set(std::to_underlying(code)));
+    };
+
+    const V halted{O::Load(&m_halted[lane])};
+    if (O::MoveMask(halted) == O::MoveMask(O::Set(0xFF))) {
+      return 0;
+    }
+    const V active{O::AndNot(halted, O::Set(0xFF))};
+
+    const V a{O::Load(&m_A[lane])};
+    const V b{O::Load(&m_B[lane])};
+    const V aluResult{O::Load(&m_aluResult[lane])};
+    const V flags{O::Load(&m_flags[lane])};
+
+    // Fetch and decode. Every lane fetches one argument word even if its
+    // instruction ignores it.
+    const V pc{O::Load(&m_PC[lane])};
+    const V pc1{O::And(O::Add(pc, O::Set(1)), nibble)};
+    const V pc2{O::And(O::Add(pc, O::Set(2)), nibble)};
+    const V op{m_gather<O>(lane, pc)};
+    const V arg{m_gather<O>(lane, pc1)};
+    const V loaded{m_gather<O>(lane, arg)};
+
+    // Two 2 bit register arguments, resolved against A, B, IS and PC as they
+    // are once the argument has been fetched.
+    const V src{O::And(O::Shr2(arg), O::Set(0x3))};
+    const V dest{O::And(arg, O::Set(0x3))};
+    const V x{m_select4<O>(src, a, b, op, pc2)};
+    const V y{m_select4<O>(dest, a, b, op, pc2)};
+
+    // ALU. Sub negates its second input with ~y + 1 before the add, so the
+    // overflow check sees the sign of the negated value.
+    const V isAdd{is(op, OpCode::Add)};
+    const V isSub{is(op, OpCode::Sub)};
+    const V isALU{O::Or(isAdd, isSub)};
+    const V inB{O::Blend(isSub, y, O::And(O::Sub(O::Set(0), y), nibble))};
+    const V sum{O::And(O::Add(x, inB), nibble)};
+    const V signMask{O::Set(0x8)};
+    const V signA{O::And(x, signMask)};
+    const V signB{O::And(inB, signMask)};
+    const V signR{O::And(sum, signMask)};
+    const V overflow{O::AndNot(O::Eq(signA, signR), O::Eq(signA, signB))};
+    const V zero{O::Eq(sum, O::Set(0))};
+    const V negative{O::Eq(signR, signMask)};
+    const V aluFlags{O::Or(O::Or(O::And(overflow, O::Set(flagBit::Overflow)),
+                                 O::And(zero, O::Set(flagBit::Zero))),
+                           O::And(negative, O::Set(flagBit::Negative)))};
+
+    // Register writes.
+    const V isMov{is(op, OpCode::Mov)};
+    const auto movTo = [&](const size_t id) {
+      return O::And(isMov, O::Eq(dest, O::Set(static_cast<uint8_t>(id))));
+    };
+
+    V newA{O::Blend(is(op, OpCode::LoadA), a, loaded)};
+    newA = O::Blend(is(op, OpCode::LoadAI), newA, arg);
+    newA = O::Blend(isALU, newA, sum);
+    newA = O::Blend(movTo(regID::A), newA, x);
+
+    V newB{O::Blend(is(op, OpCode::LoadB), b, loaded)};
+    newB = O::Blend(movTo(regID::B), newB, x);
+
+    const V newIS{O::Blend(movTo(regID::IS), op, x)};
+
+    // Opcodes without an argument only advance past the opcode.
+    const V isHalt{is(op, OpCode::Halt)};
+    const V isUnknown{O::Eq(O::And(O::Add(op, O::Set(5)), O::Set(0x10)),
+                            O::Set(0x10))}; // op >= 0xB
+    V newPC{O::Blend(O::Or(isHalt, isUnknown), pc2, pc1)};
+    const V flagZero{O::Eq(O::And(flags, O::Set(flagBit::Zero)),
+                           O::Set(flagBit::Zero))};
+    const V jump{O::Or(is(op, OpCode::Jump),
+                       O::Or(O::And(is(op, OpCode::JumpZ), flagZero),
+                             O::AndNot(flagZero, is(op, OpCode::JumpNZ))))};
+    newPC = O::Blend(jump, newPC, arg);
+    newPC = O::Blend(movTo(regID::PC), newPC, x);
+
+    // Commit, leaving halted lanes untouched.
+    O::Store(&m_A[lane], O::Blend(active, a, newA));
+    O::Store(&m_B[lane], O::Blend(active, b, newB));
+    O::Store(&m_IS[lane], O::Blend(active, O::Load(&m_IS[lane]), newIS));
+    O::Store(&m_PC[lane], O::Blend(active, pc, newPC));
+    const V aluActive{O::And(active, isALU)};
+    O::Store(&m_aluResult[lane], O::Blend(aluActive, aluResult, sum));
+    O::Store(&m_flags[lane], O::Blend(aluActive, flags, aluFlags));
+
+    const V storeActive{O::And(active, is(op, OpCode::StoreA))};
+    if (O::MoveMask(storeActive) != 0) {
+      for (uint8_t k = 0; k < MemSizeWords; k++) {
+        const V hit{O::And(storeActive, O::Eq(arg, O::Set(k)))};
+        const V word{O::Load(&m_memory[k][lane])};
+        O::Store(&m_memory[k][lane], O::Blend(hit, word, a));
+      }
+    }
+
+    const V halting{O::And(active, isHalt)};
+    O::Store(&m_halted[lane], O::Or(halted, halting));
+    uint32_t newlyHalted{O::MoveMask(halting)};
+    while (newlyHalted != 0) {
+      m_haltStep[lane + std::countr_zero(newlyHalted)] = m_steps;
+      newlyHalted &= newlyHalted - 1;
+    }
+
+    return std::popcount(O::MoveMask(O::AndNot(halting, active)));
+  }
+};
+
+} // namespace cpu
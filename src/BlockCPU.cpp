@@ -0,0 +1,119 @@
+#include "BlockCPU.h"
+
+#include "ALUTables.h"
+#include "CPUDefs.h"
+#include "CPUState.h"
+#include "Nibble.h"
+#include "Step.h"
+
+#include <cstdint>
+
+namespace cpu {
+
+BlockCPU::BlockCPU(const CPUState& state, TranslationCache& cache)
+    : m_state{state}, m_cache{cache} {}
+
+const CPUState& BlockCPU::GetState() const {
+  return m_state;
+}
+
+void BlockCPU::SetState(const CPUState& state) {
+  m_state = state;
+  m_translation.reset();
+}
+
+uint64_t BlockCPU::Run(const uint64_t maxCycles) {
+  CPUState& s{m_state};
+  uint64_t cycles{0};
+
+  while (!s.Halted && cycles < maxCycles) {
+    const uint8_t pc{s.Registers[regID::PC]};
+    if (!m_translation) {
+      m_translation = m_cache.Get(s.Image, pc);
+    }
+
+    const Block* block{m_translation->BlockAt(pc)};
+    const uint64_t codeMask{m_translation->CodeMask()};
+    if (block != nullptr && block->length <= maxCycles - cycles) {
+      cycles += m_runBlock(*block, codeMask);
+      continue;
+    }
+
+    // No block here, or not enough budget left to run the whole block.
+    const uint64_t before{s.Image};
+    Step(s);
+    cycles++;
+    if ((s.Image ^ before) & codeMask) {
+      m_translation.reset();
+    }
+  }
+  return cycles;
+}
+
+// m_runBlock executes a block and returns the number of instructions run. It
+// stops early when a store rewrites one of the translation's code words, and
+// drops the translation so the rest runs from the new image.
+uint8_t BlockCPU::m_runBlock(const Block& block, const uint64_t codeMask) {
+  CPUState& s{m_state};
+  std::array<uint8_t, 4>& regs{s.Registers};
+
+  for (uint8_t i = 0; i < block.length; i++) {
+    const Block::Op& op{block.ops[i]};
+    regs[regID::IS] = op.raw;
+    regs[regID::PC] = op.next;
+
+    switch (op.opcode) {
+    case OpCode::LoadA:
+      regs[regID::A] = s.Load(uint4(op.arg)).Raw();
+      break;
+    case OpCode::LoadAI:
+      regs[regID::A] = op.arg;
+      break;
+    case OpCode::LoadB:
+      regs[regID::B] = s.Load(uint4(op.arg)).Raw();
+      break;
+    case OpCode::StoreA: {
+      const uint64_t before{s.Image};
+      s.Store(uint4(regs[regID::A]), uint4(op.arg));
+      if ((s.Image ^ before) & codeMask) {
+        m_translation.reset();
+        return i + 1;
+      }
+      break;
+    }
+    case OpCode::Mov:
+      regs[op.dest] = regs[op.src];
+      break;
+    case OpCode::Add:
+    case OpCode::Sub: {
+      const uint8_t entry{
+          alu::Lookup(uint4(regs[op.src]), uint4(regs[op.dest]), op.opcode)};
+      regs[regID::A] = entry & 0xF;
+      s.ALUResult = entry & 0xF;
+      s.Flags = entry >> 4;
+      break;
+    }
+    case OpCode::Jump:
+      regs[regID::PC] = op.arg;
+      break;
+    case OpCode::JumpZ:
+      if (s.Flags & flagBit::Zero) {
+        regs[regID::PC] = op.arg;
+      }
+      break;
+    case OpCode::JumpNZ:
+      if (!(s.Flags & flagBit::Zero)) {
+        regs[regID::PC] = op.arg;
+      }
+      break;
+    case OpCode::Halt:
+      s.Halted = 1;
+      break;
+    default:
+      break;
+    }
+  }
+  return block.length;
+}
+
+} // namespace cpu
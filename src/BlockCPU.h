@@ -0,0 +1,39 @@
+#pragma once
+
+#include "CPUState.h"
+#include "TranslationCache.h"
+
+#include <cstdint>
+#include <memory>
+
+namespace cpu {
+
+// BlockCPU runs a CPUState one translated basic block at a time. Blocks come
+// from a TranslationCache keyed by memory image, so a later run of an image
+// that was seen before goes straight to its cached blocks.
+//
+// Stores outside the translation's code words leave it in use. A store that
+// changes a code word ends the block and the next block is looked up for the
+// new image. Addresses reached only through Mov into PC have no block and
+// are interpreted one instruction at a time.
+class BlockCPU {
+public:
+  explicit BlockCPU(const CPUState& state,
+                    TranslationCache& cache = TranslationCache::Global());
+
+  // Run executes until Halt or until maxCycles instructions have run and
+  // returns the number executed.
+  uint64_t Run(uint64_t maxCycles);
+
+  const CPUState& GetState() const;
+  void SetState(const CPUState& state);
+
+private:
+  CPUState m_state{};
+  TranslationCache& m_cache;
+  std::shared_ptr<const Translation> m_translation{};
+
+  uint8_t m_runBlock(const Block& block, uint64_t codeMask);
+};
+
+} // namespace cpu
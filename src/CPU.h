@@ -1,45 +1,581 @@
 #pragma once
 
+#include <algorithm>
 #include <array>
+#include <concepts>
+#include <cstdint>
+#include <iostream>
+#include <type_traits>
+#include <utility>
 
 #include "ALU.h"
+#include "Async.h"
 #include "CPUDefs.h"
+#include "CPUState.h"
+#include "DeviceBus.h"
+#include "Instrumentation.h"
 #include "Memory.h"
 #include "Nibble.h"
+#include "RunResult.h"
 
 namespace cpu {
-class CPU {
+
+// BasicCPU is the reference interpreter. Probe is its instrumentation policy,
+// see Instrumentation.h; CPU is the uninstrumented machine. Config is a
+// MachineConfig giving the word width, register count and memory size; every
+// configuration is compiled separately, so the standard 4 bit machine pays
+// nothing for the others. CPUState describes the standard machine only, so
+// the members that take or return one need StandardConfig. Every member is
+// constexpr, so programs can run in constant expressions.
+//
+// A CPU with a device bus attached executes the port instructions In, Out
+// and Poll. In waits for a sample on an empty port and Out for room on a
+// full one: the instruction does not retire, PC stays on it and a budgeted
+// Run returns Blocked, so the host can serve the port and call Run again.
+// The loop check is skipped while a bus is attached, since polling an idle
+// port repeats the machine state without being stuck.
+template <typename Probe, typename Config = StandardConfig>
+class BasicCPU {
+  static constexpr bool m_standard{std::same_as<Config, StandardConfig>};
+
 public:
-  CPU();
+  using Word = typename Config::Word;
+  using MemoryType = BasicMemory<Config::WordBits, Config::MemSizeWords>;
+  using BusType = BasicDeviceBus<typename Word::Storage>;
+
+  constexpr BasicCPU();
+  constexpr explicit BasicCPU(const CPUState& state)
+    requires(m_standard);
+
+  // Copies rebind the ALU to the new result buffer. Moves fall back to
+  // these. The copy starts with a fresh probe and no bus, since a bus
+  // channel has a single consumer.
+  constexpr BasicCPU(const BasicCPU& other);
+  constexpr BasicCPU& operator=(const BasicCPU& other);
+
+  constexpr void Run();
+  // Run executes at most budget cycles and reports why it stopped.
+  constexpr RunResult Run(uint64_t budget, LoopCheck loops = LoopCheck::Off);
+  constexpr void Cycle();
 
-  void Run();
-  void Cycle();
+  // RunAsync is Run(budget) as a coroutine. It yields after every slice
+  // cycles and whenever it blocks on a port, so an Executor can interleave
+  // many machines on one thread. The CPU must outlive the task.
+  Task RunAsync(uint64_t budget, uint64_t slice = 1024);
 
-  Register GetRegisterA() const;
-  Register GetRegisterB() const;
+  constexpr Word GetRegisterA() const;
+  constexpr Word GetRegisterB() const;
 
-  const alu::Flags& GetFlags() const;
-  Memory& GetMemory();
+  constexpr const alu::Flags& GetFlags() const;
+  constexpr MemoryType& GetMemory();
+  constexpr void SetALUBackend(alu::Backend backend);
+  constexpr bool IsHalted() const;
+  // IsFaulted is true when the last cycle executed an unknown opcode.
+  constexpr bool IsFaulted() const;
+  // IsBlocked is true when the last cycle waited on a port.
+  constexpr bool IsBlocked() const;
+
+  // AttachBus connects the port instructions to bus, or disconnects them
+  // when bus is null. The bus must outlive the CPU or be detached first.
+  constexpr void AttachBus(BusType* bus);
+
+  constexpr CPUState GetState() const
+    requires(m_standard);
+  constexpr void SetState(const CPUState& state)
+    requires(m_standard);
+
+  constexpr Probe& GetProbe();
+  constexpr const Probe& GetProbe() const;
 
 private:
-  static std::array<uint4, 2> m_parse2Args(uint4 value);
+  // Snapshot is the full state of a non-standard machine, for loop checks.
+  struct Snapshot {
+    MemoryType memory{};
+    std::array<Word, Config::NumRegisters> registers{};
+    Word IS{};
+    Word PC{};
+    Word aluResult{};
+    uint8_t flags{};
+    bool halt{};
+
+    constexpr bool operator==(const Snapshot&) const = default;
+  };
 
-  alu::ALU m_alu;
-  Memory m_memory;
-  std::array<Register, NumRegisters> m_registers{};
+  static constexpr std::array<Word, 2> m_parse2Args(Word value);
+  static constexpr OpCode m_decode(Word value);
 
-  Register m_IS{};        // Instruction store.
-  Register m_PC{};        // Program counter.
-  Register m_aluResult{}; // aluResult buffers the output of the ALU.
+  alu::BasicALU<Config::WordBits> m_alu;
+  MemoryType m_memory;
+  std::array<Word, Config::NumRegisters> m_registers{};
 
-  void m_loadRegister(size_t regID, uint4 address);
-  void m_loadIntermediate(size_t regID, uint4 value);
-  void m_storeRegister(size_t regID, uint4 address);
-  void m_moveRegister(uint4 srcID, uint4 destID);
+  Word m_IS{};        // Instruction store.
+  Word m_PC{};        // Program counter.
+  Word m_aluResult{}; // aluResult buffers the output of the ALU.
 
-  void m_aluOperation(uint4 inputA, uint4 inputB, OpCode op);
+  constexpr Word& m_register(size_t id);
+  constexpr auto m_snapshot() const;
 
+  constexpr void m_loadRegister(size_t regID, Word address);
+  constexpr void m_loadIntermediate(size_t regID, Word value);
+  constexpr void m_storeRegister(size_t regID, Word address);
+  constexpr void m_moveRegister(Word srcID, Word destID);
+
+  constexpr void m_aluOperation(Word inputA, Word inputB, OpCode op);
+  void m_portOperation(OpCode op, Word pc);
+
+  BusType* m_bus{};
   bool m_halt{};
+  bool m_fault{};   // Set when the last cycle hit an unknown opcode.
+  bool m_blocked{}; // Set when the last cycle waited on a port.
+
+  // Hooks whose arguments cost a call are skipped for empty probes.
+  static constexpr bool m_instrumented{!std::is_empty_v<Probe>};
+  [[no_unique_address]] Probe m_probe{};
+};
+
+using CPU = BasicCPU<NullProbe>;
+using ProfilingCPU = BasicCPU<ExecutionStats>;
+
+// CPUN is an uninstrumented machine of another shape, e.g. CPUN<8, 256> has
+// 8 bit words and 256 words of memory.
+template <unsigned WordBits, size_t MemWords, size_t Registers = NumRegisters>
+using CPUN = BasicCPU<NullProbe, MachineConfig<WordBits, Registers, MemWords>>;
+
+// m_parse2Args takes in a word and splits its low bits into two register
+// arguments of Config::ArgBits each.
+// Example: A 4 bit number 0000 would have args stored as AABB.
+// They would be split into two args {00AA, 00BB}.
+// Note that there is no two bit custom type.
+template <typename Probe, typename Config>
+constexpr std::array<typename Config::Word, 2>
+BasicCPU<Probe, Config>::m_parse2Args(const Word value) {
+
+  constexpr typename Word::Storage argMask{(1u << Config::ArgBits) - 1};
+
+  const Word arg0 = (value >> Config::ArgBits) & argMask;
+  const Word arg1 = (value & argMask);
+  return {arg0, arg1};
+}
+
+// m_decode maps an instruction word to its opcode. Words too large for the
+// opcode type decode as an unknown opcode rather than wrapping around.
+template <typename Probe, typename Config>
+constexpr OpCode BasicCPU<Probe, Config>::m_decode(const Word value) {
+  if constexpr (Config::WordBits > 8) {
+    if (value.Raw() > 0xFF) {
+      return OpCode{0xFF};
+    }
+  }
+  return OpCode{static_cast<uint8_t>(value.Raw())};
+}
+
+template <typename Probe, typename Config>
+constexpr BasicCPU<Probe, Config>::BasicCPU()
+    : m_alu{m_aluResult}, m_memory{Config::MemSizeWords} {}
+
+template <typename Probe, typename Config>
+constexpr BasicCPU<Probe, Config>::BasicCPU(const CPUState& state)
+  requires(m_standard)
+    : BasicCPU() {
+  SetState(state);
+}
+
+template <typename Probe, typename Config>
+constexpr BasicCPU<Probe, Config>::BasicCPU(const BasicCPU& other)
+    : BasicCPU() {
+  *this = other;
+}
+
+template <typename Probe, typename Config>
+constexpr BasicCPU<Probe, Config>&
+BasicCPU<Probe, Config>::operator=(const BasicCPU& other) {
+  if (this != &other) {
+    m_memory = other.m_memory;
+    m_registers = other.m_registers;
+    m_IS = other.m_IS;
+    m_PC = other.m_PC;
+    m_aluResult = other.m_aluResult;
+    m_alu.SetFlags(other.m_alu.GetFlags());
+    m_alu.SetBackend(other.m_alu.GetBackend());
+    m_halt = other.m_halt;
+    m_fault = false;
+    m_blocked = false;
+  }
+  return *this;
+}
+
+template <typename Probe, typename Config>
+constexpr void BasicCPU<Probe, Config>::Run() {
+  while (!m_halt) {
+    Cycle();
+  }
+}
+
+template <typename Probe, typename Config>
+constexpr RunResult BasicCPU<Probe, Config>::Run(const uint64_t budget,
+                                                 const LoopCheck loops) {
+  LoopDetector detector{m_snapshot()};
+  RunResult result{.Status = RunStatus::BudgetExhausted};
+
+  while (result.Cycles < budget) {
+    if (m_halt) {
+      result.Status = RunStatus::Halted;
+      return result;
+    }
+    Cycle();
+    if (m_blocked) {
+      result.Status = RunStatus::Blocked;
+      return result;
+    }
+    result.Cycles++;
+
+    if (m_fault) {
+      result.Status = RunStatus::Fault;
+      return result;
+    }
+    if (loops == LoopCheck::Brent && m_bus == nullptr &&
+        detector.Observe(m_snapshot())) {
+      result.Status = RunStatus::Looping;
+      result.Period = detector.Period();
+      return result;
+    }
+  }
+  if (m_halt) {
+    result.Status = RunStatus::Halted;
+  }
+  return result;
+}
+
+template <typename Probe, typename Config>
+Task BasicCPU<Probe, Config>::RunAsync(const uint64_t budget,
+                                      const uint64_t slice) {
+  RunResult total{.Status = RunStatus::BudgetExhausted};
+  while (total.Cycles < budget) {
+    const RunResult part{
+        Run(std::min(std::max<uint64_t>(slice, 1), budget - total.Cycles))};
+    total.Cycles += part.Cycles;
+    if (part.Status == RunStatus::Halted || part.Status == RunStatus::Fault) {
+      total.Status = part.Status;
+      co_return total;
+    }
+    if (total.Cycles < budget) {
+      co_await std::suspend_always{};
+    }
+  }
+  if (m_halt) {
+    total.Status = RunStatus::Halted;
+  }
+  co_return total;
+}
+
+// Cycle reads the next instruction from RAM and executes it fully.
+// Instructions that use more than one line of memory will read in the
+// additional number of required lines.
+template <typename Probe, typename Config>
+constexpr void BasicCPU<Probe, Config>::Cycle() {
+  m_fault = false;
+  m_blocked = false;
+
+  // Fetch.
+  const Word pc{m_PC};
+  m_IS = m_memory.Load(m_PC++);
+  m_probe.Fetch(pc, m_IS);
+
+  // Decode.
+  const OpCode op{m_decode(m_IS)};
+
+  // Execute.
+  std::array<Word, 2> args{}; // Some instructions take two register arguments.
+  Word& arg0 = args[0];       // Others only use a single word argument.
+
+  switch (op) {
+  case OpCode::LoadA:
+    arg0 = m_memory.Load(m_PC++);
+    m_loadRegister(regID::A, arg0);
+    break;
+
+  case OpCode::LoadAI:
+    arg0 = m_memory.Load(m_PC++);
+    m_loadIntermediate(regID::A, arg0);
+    break;
+
+  case OpCode::LoadB:
+    arg0 = m_memory.Load(m_PC++);
+    m_loadRegister(regID::B, arg0);
+    break;
+
+  case OpCode::StoreA:
+    arg0 = m_memory.Load(m_PC++);
+    m_storeRegister(regID::A, arg0);
+    break;
+
+  case OpCode::Mov:
+    args = m_parse2Args(m_memory.Load(m_PC++));
+    m_moveRegister(args[0], args[1]);
+    break;
+
+  case OpCode::Add:
+    args = m_parse2Args(m_memory.Load(m_PC++));
+    m_aluOperation(args[0], args[1], OpCode::Add);
+    m_registers[regID::A] = m_aluResult;
+    if constexpr (m_instrumented) {
+      m_probe.ALU(OpCode::Add, m_alu.GetFlags());
+    }
+    break;
+
+  case OpCode::Sub:
+    args = m_parse2Args(m_memory.Load(m_PC++));
+    m_aluOperation(args[0], args[1], OpCode::Sub);
+    m_registers[0] = m_aluResult;
+    if constexpr (m_instrumented) {
+      m_probe.ALU(OpCode::Sub, m_alu.GetFlags());
+    }
+    break;
+
+  case OpCode::Jump:
+    arg0 = m_memory.Load(m_PC);
+    m_PC = arg0;
+    break;
+
+  case OpCode::JumpZ: {
+    arg0 = m_memory.Load(m_PC++);
+    const bool taken{m_alu.GetFlags().Zero};
+    m_probe.Branch(OpCode::JumpZ, taken);
+    if (taken) {
+      m_PC = arg0;
+    }
+    break;
+  }
+
+  case OpCode::JumpNZ: {
+    arg0 = m_memory.Load(m_PC++);
+    const bool taken{!m_alu.GetFlags().Zero};
+    m_probe.Branch(OpCode::JumpNZ, taken);
+    if (taken) {
+      m_PC = arg0;
+    }
+    break;
+  }
+
+  case OpCode::Halt:
+    m_halt = true;
+    break;
+
+  case OpCode::In:
+  case OpCode::Out:
+  case OpCode::Poll:
+    if !consteval {
+      if (m_bus != nullptr) {
+        m_portOperation(op, pc);
+        break;
+      }
+    }
+    [[fallthrough]];
+
+  default:
+    if !consteval {
+      std::cerr << "Unknown opcode: " << m_IS << '\n';
+    }
+    m_fault = true;
+  }
+}
+
+// m_portOperation executes a port instruction once Cycle has fetched it. A
+// port that cannot be served rewinds PC to the instruction.
+template <typename Probe, typename Config>
+void BasicCPU<Probe, Config>::m_portOperation(const OpCode op, const Word pc) {
+  const Word port{m_memory.Load(m_PC++)};
+  switch (op) {
+  case OpCode::In:
+    if (const auto sample{m_bus->Read(port.Raw())}) {
+      m_registers[regID::A] = Word{*sample};
+      return;
+    }
+    break;
+  case OpCode::Out:
+    if (m_bus->Write(port.Raw(), m_registers[regID::A].Raw())) {
+      return;
+    }
+    break;
+  default:
+    // Poll sets Zero when no input is waiting, so Poll p; JumpZ spins until
+    // a sample arrives.
+    m_alu.SetFlags({.Zero = !m_bus->Ready(port.Raw())});
+    return;
+  }
+  m_PC = pc;
+  m_blocked = true;
+}
+
+template <typename Probe, typename Config>
+constexpr typename Config::Word BasicCPU<Probe, Config>::GetRegisterA() const {
+  return m_registers[0];
+}
+
+template <typename Probe, typename Config>
+constexpr typename Config::Word BasicCPU<Probe, Config>::GetRegisterB() const {
+  return m_registers[1];
+}
+
+template <typename Probe, typename Config>
+constexpr const alu::Flags& BasicCPU<Probe, Config>::GetFlags() const {
+  return m_alu.GetFlags();
+}
+
+template <typename Probe, typename Config>
+constexpr typename BasicCPU<Probe, Config>::MemoryType&
+BasicCPU<Probe, Config>::GetMemory() {
+  return m_memory;
+}
+
+template <typename Probe, typename Config>
+constexpr void
+BasicCPU<Probe, Config>::SetALUBackend(const alu::Backend backend) {
+  m_alu.SetBackend(backend);
+}
+
+template <typename Probe, typename Config>
+constexpr bool BasicCPU<Probe, Config>::IsHalted() const {
+  return m_halt;
+}
+
+template <typename Probe, typename Config>
+constexpr bool BasicCPU<Probe, Config>::IsFaulted() const {
+  return m_fault;
+}
+
+template <typename Probe, typename Config>
+constexpr bool BasicCPU<Probe, Config>::IsBlocked() const {
+  return m_blocked;
+}
+
+template <typename Probe, typename Config>
+constexpr void BasicCPU<Probe, Config>::AttachBus(BusType* const bus) {
+  m_bus = bus;
+}
+
+template <typename Probe, typename Config>
+constexpr CPUState BasicCPU<Probe, Config>::GetState() const
+  requires(m_standard)
+{
+  CPUState state{};
+  state.Image = m_memory.DumpImage();
+  state.SetRegister(regID::A, m_registers[regID::A]);
+  state.SetRegister(regID::B, m_registers[regID::B]);
+  state.SetRegister(regID::IS, m_IS);
+  state.SetRegister(regID::PC, m_PC);
+  state.ALUResult = m_aluResult.Raw();
+  state.SetFlags(m_alu.GetFlags());
+  state.Halted = m_halt;
+  return state;
+}
+
+template <typename Probe, typename Config>
+constexpr Probe& BasicCPU<Probe, Config>::GetProbe() {
+  return m_probe;
+}
+
+template <typename Probe, typename Config>
+constexpr const Probe& BasicCPU<Probe, Config>::GetProbe() const {
+  return m_probe;
+}
+
+template <typename Probe, typename Config>
+constexpr void BasicCPU<Probe, Config>::SetState(const CPUState& state)
+  requires(m_standard)
+{
+  m_memory.LoadImage(state.Image);
+  m_registers[regID::A] = state.GetRegister(regID::A);
+  m_registers[regID::B] = state.GetRegister(regID::B);
+  m_IS = state.GetRegister(regID::IS);
+  m_PC = state.GetRegister(regID::PC);
+  m_aluResult = state.ALUResult;
+  m_alu.SetFlags(state.GetFlags());
+  m_halt = state.Halted != 0;
+}
+
+// m_register resolves a register id from an instruction argument. Ids past
+// PC, which only wider configurations can encode, also select PC.
+template <typename Probe, typename Config>
+constexpr typename Config::Word&
+BasicCPU<Probe, Config>::m_register(const size_t id) {
+  if (id < Config::NumRegisters) {
+    return m_registers[id];
+  }
+  if (id == Config::IS) {
+    return m_IS;
+  }
+  return m_PC;
+}
+
+// m_snapshot captures the whole machine for loop detection.
+template <typename Probe, typename Config>
+constexpr auto BasicCPU<Probe, Config>::m_snapshot() const {
+  if constexpr (m_standard) {
+    return GetState();
+  } else {
+    return Snapshot{m_memory,
+                    m_registers,
+                    m_IS,
+                    m_PC,
+                    m_aluResult,
+                    alu::PackFlags(m_alu.GetFlags()),
+                    m_halt};
+  }
+}
+
+template <typename Probe, typename Config>
+constexpr void BasicCPU<Probe, Config>::m_loadRegister(const size_t regID,
+                                                       const Word address) {
+  const auto reg = static_cast<uint8_t>(regID);
+  m_probe.Read(address);
+  m_registers[reg] = m_memory.Load(address);
+}
+template <typename Probe, typename Config>
+constexpr void BasicCPU<Probe, Config>::m_loadIntermediate(size_t regID,
+                                                           Word value) {
+  m_registers[regID] = value;
+}
+
+template <typename Probe, typename Config>
+constexpr void BasicCPU<Probe, Config>::m_storeRegister(const size_t regID,
+                                                        const Word address) {
+  const auto reg = static_cast<uint8_t>(regID);
+  m_probe.Write(address, m_registers[reg]);
+  m_memory.Store(m_registers[reg], address);
+}
+
+template <typename Probe, typename Config>
+constexpr void BasicCPU<Probe, Config>::m_moveRegister(const Word srcID,
+                                                       const Word destID) {
+  m_register(destID.Raw()) = m_register(srcID.Raw());
+}
+
+template <typename Probe, typename Config>
+constexpr void BasicCPU<Probe, Config>::m_aluOperation(const Word inputA,
+                                                       const Word inputB,
+                                                       const OpCode op) {
+  m_alu.DoOperation(m_register(inputA.Raw()), m_register(inputB.Raw()), op);
+}
+
+// Execution is the outcome of running a program from a given state.
+struct Execution {
+  CPUState Final{};
+  RunResult Result{};
+
+  constexpr bool operator==(const Execution&) const = default;
 };
 
-} // namespace cpu
\ No newline at end of file
+// Execute runs a fresh CPU from initial for at most budget cycles. It is
+// usable in constant expressions, so a program's result can be checked with
+// static_assert. Compilers cap constant evaluation, so keep the budget within
+// a few hundred thousand cycles there.
+constexpr Execution Execute(const CPUState& initial,
+                            const uint64_t budget = 1 << 16,
+                            const LoopCheck loops = LoopCheck::Brent) {
+  CPU cpu{initial};
+  const RunResult result{cpu.Run(budget, loops)};
+  return {cpu.GetState(), result};
+}
+
+} // namespace cpu
@@ -1,19 +1,64 @@
 #pragma once
 #include "Nibble.h"
 
+#include <cstddef>
+#include <string_view>
+
 namespace cpu {
 using Register = uint4;
 
 // regID refers to the index of a register when stored in an array of registers.
+// Register arguments are 2 bits wide but there are only two general purpose
+// registers, so ids 2 and 3 select the internal IS and PC registers.
 namespace regID {
 constexpr size_t A{0};
 constexpr size_t B{1};
+constexpr size_t IS{2};
+constexpr size_t PC{3};
 } // namespace regID
 
+// flagBit holds the bit positions of the ALU flags when packed into a byte.
+namespace flagBit {
+constexpr uint8_t Overflow{1 << 0};
+constexpr uint8_t Zero{1 << 1};
+constexpr uint8_t Negative{1 << 2};
+} // namespace flagBit
+
+// The standard machine. BasicCPU, BasicMemory and BasicALU take these as
+// template parameters, so wider variants share the same code; CPUState, the
+// packed engines and the tools are built for this configuration.
+// With R general purpose registers, register ids R and R + 1 select IS and
+// PC, which gives the regID layout above for R = 2.
 inline constexpr uint8_t WordSizeBits = 4;
 inline constexpr uint8_t NumRegisters = 2;
 inline constexpr uint8_t MemSizeWords = 16;
 
+// MachineConfig fixes the shape of a machine at compile time. Register
+// arguments are half a word wide, so Mov, Add and Sub can name two of them.
+template <unsigned Bits, size_t Registers, size_t MemWords>
+struct MachineConfig {
+  static constexpr unsigned WordBits{Bits};
+  static constexpr size_t NumRegisters{Registers};
+  static constexpr size_t MemSizeWords{MemWords};
+  static constexpr unsigned ArgBits{Bits / 2};
+
+  using Word = uintN<Bits>;
+  using SignedWord = intN<Bits>;
+
+  // Register ids past the general purpose ones.
+  static constexpr size_t IS{Registers};
+  static constexpr size_t PC{Registers + 1};
+
+  static_assert(Registers >= 2, "LoadA and LoadB need registers A and B");
+  static_assert(PC < (size_t{1} << ArgBits),
+                "every register id must fit in a register argument");
+};
+
+using StandardConfig = MachineConfig<WordSizeBits, NumRegisters, MemSizeWords>;
+
+static_assert(StandardConfig::IS == regID::IS &&
+              StandardConfig::PC == regID::PC);
+
 enum class OpCode : uint8_t {
   Halt = 0x0,
   LoadA = 0x1,
@@ -25,7 +70,47 @@ enum class OpCode : uint8_t {
   Sub = 0x7,
   Jump = 0x8,
   JumpZ = 0x9,
-  JumpNZ = 0xA
+  JumpNZ = 0xA,
+  // Port I/O, which needs a DeviceBus attached to the CPU. Without one, and
+  // in every engine other than BasicCPU, these fault like 0xE and 0xF.
+  In = 0xB,
+  Out = 0xC,
+  Poll = 0xD
 };
 
+// OpCodeName returns the mnemonic used in listings and reports.
+constexpr std::string_view OpCodeName(const OpCode op) {
+  switch (op) {
+  case OpCode::Halt:
+    return "Halt";
+  case OpCode::LoadA:
+    return "LoadA";
+  case OpCode::LoadAI:
+    return "LoadAI";
+  case OpCode::LoadB:
+    return "LoadB";
+  case OpCode::StoreA:
+    return "StoreA";
+  case OpCode::Mov:
+    return "Mov";
+  case OpCode::Add:
+    return "Add";
+  case OpCode::Sub:
+    return "Sub";
+  case OpCode::Jump:
+    return "Jump";
+  case OpCode::JumpZ:
+    return "JumpZ";
+  case OpCode::JumpNZ:
+    return "JumpNZ";
+  case OpCode::In:
+    return "In";
+  case OpCode::Out:
+    return "Out";
+  case OpCode::Poll:
+    return "Poll";
+  }
+  return "Unknown";
+}
+
 } // namespace cpu
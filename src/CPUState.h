@@ -0,0 +1,143 @@
+#pragma once
+
+#include "CPUDefs.h"
+#include "Nibble.h"
+#include "RippleCarry.h"
+
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <optional>
+#include <string_view>
+#include <type_traits>
+
+namespace cpu {
+
+// CPUState is the full architectural state of a CPU packed into one aligned
+// 128-bit block. It is trivially copyable, so snapshotting or forking a
+// machine is a 16 byte copy.
+//
+// The memory image keeps Memory's byte layout: byte i of the image holds
+// words 2i (high nibble) and 2i+1 (low nibble). Read as a little-endian
+// uint64_t that puts word addr at bit (addr ^ 1) * 4.
+struct alignas(16) CPUState {
+  uint64_t Image{};
+
+  // Registers are indexed by their 2 bit register id. Only A and B are
+  // general purpose; ids 2 and 3 select IS and PC.
+  std::array<uint8_t, 4> Registers{};
+
+  uint8_t ALUResult{};
+  uint8_t Flags{}; // See flagBit.
+  uint8_t Halted{};
+  uint8_t Reserved{}; // Always zero, keeps the block free of padding.
+
+  static constexpr uint8_t ShiftOf(const uint4 addr) noexcept {
+    return static_cast<uint8_t>((addr.Raw() ^ 1) << 2);
+  }
+
+  constexpr uint4 Load(const uint4 addr) const noexcept {
+    return uint4{static_cast<uint8_t>((Image >> ShiftOf(addr)) & 0xF)};
+  }
+  constexpr void Store(const uint4 value, const uint4 addr) noexcept {
+    const uint8_t shift{ShiftOf(addr)};
+    Image = (Image & ~(uint64_t{0xF} << shift)) |
+            (static_cast<uint64_t>(value.Raw()) << shift);
+  }
+
+  constexpr uint4 GetRegister(const size_t id) const noexcept {
+    return uint4{Registers[id]};
+  }
+  constexpr void SetRegister(const size_t id, const uint4 value) noexcept {
+    Registers[id] = value.Raw();
+  }
+
+  constexpr alu::Flags GetFlags() const noexcept {
+    return alu::UnpackFlags(Flags);
+  }
+  constexpr void SetFlags(const alu::Flags& flags) noexcept {
+    Flags = alu::PackFlags(flags);
+  }
+
+  // IsValid is true when every field is in range: the registers and the ALU
+  // result are nibbles, Flags holds only flagBit bits, Halted is 0 or 1 and
+  // Reserved is zero. The engines only ever produce valid states, and may
+  // disagree on states that are not.
+  constexpr bool IsValid() const noexcept {
+    constexpr uint8_t flagBits{flagBit::Overflow | flagBit::Zero |
+                               flagBit::Negative};
+    for (const uint8_t reg : Registers) {
+      if (reg > 0xF) {
+        return false;
+      }
+    }
+    return ALUResult <= 0xF && (Flags & ~flagBits) == 0 && Halted <= 1 &&
+           Reserved == 0;
+  }
+
+  constexpr bool operator==(const CPUState&) const = default;
+};
+
+static_assert(sizeof(CPUState) == 16);
+static_assert(alignof(CPUState) == 16);
+static_assert(std::is_trivially_copyable_v<CPUState>);
+static_assert(std::has_unique_object_representations_v<CPUState>);
+
+// splitmix64 is the hash and random source used throughout. GoldenGamma is
+// its increment, Mix64 its finaliser and SplitMix64 one step of the
+// generator, which advances seed.
+constexpr uint64_t GoldenGamma{0x9E3779B97F4A7C15};
+
+constexpr uint64_t Mix64(uint64_t z) noexcept {
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EB;
+  return z ^ (z >> 31);
+}
+
+constexpr uint64_t SplitMix64(uint64_t& seed) noexcept {
+  return Mix64(seed += GoldenGamma);
+}
+
+// MixIn folds value into the running hash z.
+constexpr uint64_t MixIn(const uint64_t z, const uint64_t value) noexcept {
+  return Mix64((z ^ value) + GoldenGamma);
+}
+
+// Hash mixes both halves of the packed state, so it can key hash maps and
+// caches of machine states.
+constexpr uint64_t Hash(const CPUState& state) noexcept {
+  const auto words{std::bit_cast<std::array<uint64_t, 2>>(state)};
+  return Mix64(words[0] ^ (words[1] * GoldenGamma));
+}
+
+struct CPUStateHash {
+  size_t operator()(const CPUState& state) const noexcept {
+    return static_cast<size_t>(Hash(state));
+  }
+};
+
+// ParseImage reads an image written as 16 hex digits, word 0 first, into an
+// otherwise zeroed state. It returns nothing for malformed input.
+constexpr std::optional<CPUState> ParseImage(const std::string_view hex) {
+  if (hex.size() != MemSizeWords) {
+    return std::nullopt;
+  }
+  CPUState state{};
+  for (uint8_t addr = 0; addr < MemSizeWords; addr++) {
+    const char c{hex[addr]};
+    uint8_t value{};
+    if (c >= '0' && c <= '9') {
+      value = c - '0';
+    } else if (c >= 'a' && c <= 'f') {
+      value = c - 'a' + 10;
+    } else if (c >= 'A' && c <= 'F') {
+      value = c - 'A' + 10;
+    } else {
+      return std::nullopt;
+    }
+    state.Store(uint4(value), uint4(addr));
+  }
+  return state;
+}
+
+} // namespace cpu
@@ -0,0 +1,236 @@
+#include "Corpus.h"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace cpu {
+
+namespace {
+
+constexpr uint64_t columnAlign{64};
+constexpr size_t registerBytes{8}; // CPUState bytes after the image.
+
+constexpr uint64_t alignUp(const uint64_t offset) {
+  return (offset + columnAlign - 1) / columnAlign * columnAlign;
+}
+
+// layout fills in the column offsets for a header's count and columns and
+// returns the file size.
+uint64_t layout(CorpusHeader& header) {
+  uint64_t end{sizeof(CorpusHeader)};
+  header.ImageOffset = end;
+  end = alignUp(end + header.Count * sizeof(uint64_t));
+  header.RegisterOffset = 0;
+  if (header.Columns & CorpusHeader::Registers) {
+    header.RegisterOffset = end;
+    end = alignUp(end + header.Count * registerBytes);
+  }
+  header.ResultOffset = 0;
+  if (header.Columns & CorpusHeader::Results) {
+    header.ResultOffset = end;
+    end = alignUp(end + header.Count * sizeof(CorpusResult));
+  }
+  return end;
+}
+
+} // namespace
+
+CorpusResult CorpusResult::From(const CPUState& final,
+                                const RunResult& result) {
+  constexpr uint64_t maxPeriod{std::numeric_limits<uint32_t>::max()};
+  CorpusResult out{};
+  out.Final = final;
+  out.Cycles = result.Cycles;
+  out.Period = static_cast<uint32_t>(std::min(result.Period, maxPeriod));
+  out.Status = static_cast<uint8_t>(result.Status);
+  return out;
+}
+
+RunResult CorpusResult::ToRunResult() const {
+  return {static_cast<RunStatus>(Status), Cycles, Period};
+}
+
+std::optional<CorpusReader> CorpusReader::Open(const std::string& path) {
+  const int fd{::open(path.c_str(), O_RDONLY | O_CLOEXEC)};
+  if (fd < 0) {
+    return std::nullopt;
+  }
+  struct stat info{};
+  if (::fstat(fd, &info) != 0 ||
+      static_cast<size_t>(info.st_size) < sizeof(CorpusHeader)) {
+    ::close(fd);
+    return std::nullopt;
+  }
+
+  CorpusReader reader{};
+  reader.m_bytes = static_cast<size_t>(info.st_size);
+  void* base{::mmap(nullptr, reader.m_bytes, PROT_READ, MAP_SHARED, fd, 0)};
+  ::close(fd); // The mapping keeps the file open.
+  if (base == MAP_FAILED) {
+    return std::nullopt;
+  }
+  reader.m_base = static_cast<const std::byte*>(base);
+  ::madvise(base, reader.m_bytes, MADV_SEQUENTIAL);
+
+  // Check the header against the layout a writer would have produced.
+  std::memcpy(&reader.m_header, reader.m_base, sizeof(CorpusHeader));
+  CorpusHeader expected{};
+  expected.Columns = reader.m_header.Columns;
+  expected.Count = reader.m_header.Count;
+  constexpr uint32_t knownColumns{CorpusHeader::Registers |
+                                  CorpusHeader::Results};
+  constexpr uint64_t maxCount{std::numeric_limits<uint64_t>::max() /
+                              (2 * sizeof(CorpusResult))};
+  if (expected.Count > maxCount || (expected.Columns & ~knownColumns) != 0 ||
+      layout(expected) > reader.m_bytes ||
+      std::memcmp(&expected, &reader.m_header, sizeof(CorpusHeader)) != 0) {
+    return std::nullopt;
+  }
+  return reader;
+}
+
+CorpusReader::CorpusReader(CorpusReader&& other) noexcept
+    : m_base{std::exchange(other.m_base, nullptr)},
+      m_bytes{std::exchange(other.m_bytes, 0)}, m_header{other.m_header} {}
+
+CorpusReader& CorpusReader::operator=(CorpusReader&& other) noexcept {
+  if (this != &other) {
+    if (m_base != nullptr) {
+      ::munmap(const_cast<std::byte*>(m_base), m_bytes);
+    }
+    m_base = std::exchange(other.m_base, nullptr);
+    m_bytes = std::exchange(other.m_bytes, 0);
+    m_header = other.m_header;
+  }
+  return *this;
+}
+
+CorpusReader::~CorpusReader() {
+  if (m_base != nullptr) {
+    ::munmap(const_cast<std::byte*>(m_base), m_bytes);
+  }
+}
+
+size_t CorpusReader::Size() const {
+  return m_header.Count;
+}
+
+bool CorpusReader::HasRegisters() const {
+  return (m_header.Columns & CorpusHeader::Registers) != 0;
+}
+
+bool CorpusReader::HasResults() const {
+  return (m_header.Columns & CorpusHeader::Results) != 0;
+}
+
+std::span<const uint64_t> CorpusReader::Images() const {
+  return {reinterpret_cast<const uint64_t*>(m_base + m_header.ImageOffset),
+          Size()};
+}
+
+std::span<const CorpusResult> CorpusReader::Results() const {
+  if (!HasResults()) {
+    return {};
+  }
+  return {
+      reinterpret_cast<const CorpusResult*>(m_base + m_header.ResultOffset),
+      Size()};
+}
+
+CPUState CorpusReader::State(const size_t i) const {
+  CPUState state{};
+  state.Image = Images()[i];
+  if (HasRegisters()) {
+    std::memcpy(reinterpret_cast<std::byte*>(&state) + sizeof(state.Image),
+                m_base + m_header.RegisterOffset + i * registerBytes,
+                registerBytes);
+  }
+  return state;
+}
+
+CorpusWriter::CorpusWriter(const std::string& path, const size_t count,
+                           const uint32_t columns) {
+  m_header.Columns = columns;
+  m_header.Count = count;
+  m_bytes = static_cast<size_t>(layout(m_header));
+
+  const int fd{
+      ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644)};
+  if (fd < 0) {
+    return;
+  }
+  if (::ftruncate(fd, static_cast<off_t>(m_bytes)) == 0) {
+    void* base{::mmap(nullptr, m_bytes, PROT_READ | PROT_WRITE, MAP_SHARED,
+                      fd, 0)};
+    if (base != MAP_FAILED) {
+      m_base = static_cast<std::byte*>(base);
+      std::memcpy(m_base, &m_header, sizeof(CorpusHeader));
+      m_good = true;
+    }
+  }
+  ::close(fd);
+}
+
+CorpusWriter::~CorpusWriter() {
+  Close();
+}
+
+bool CorpusWriter::Good() const {
+  return m_good;
+}
+
+size_t CorpusWriter::Size() const {
+  return m_header.Count;
+}
+
+void CorpusWriter::SetState(const size_t i, const CPUState& state) {
+  if (m_base == nullptr) {
+    return;
+  }
+  std::memcpy(m_base + m_header.ImageOffset + i * sizeof(uint64_t),
+              &state.Image, sizeof(uint64_t));
+  if (m_header.Columns & CorpusHeader::Registers) {
+    std::memcpy(m_base + m_header.RegisterOffset + i * registerBytes,
+                reinterpret_cast<const std::byte*>(&state) +
+                    sizeof(state.Image),
+                registerBytes);
+  }
+}
+
+void CorpusWriter::SetResult(const size_t i, const CorpusResult& result) {
+  if (m_base == nullptr || !(m_header.Columns & CorpusHeader::Results)) {
+    return;
+  }
+  std::memcpy(m_base + m_header.ResultOffset + i * sizeof(CorpusResult),
+              &result, sizeof(CorpusResult));
+}
+
+bool CorpusWriter::Close() {
+  if (m_base != nullptr) {
+    if (::msync(m_base, m_bytes, MS_SYNC) != 0) {
+      m_good = false;
+    }
+    ::munmap(m_base, m_bytes);
+    m_base = nullptr;
+  }
+  return m_good;
+}
+
+bool WriteCorpus(const std::string& path,
+                 const std::span<const CPUState> states,
+                 const uint32_t columns) {
+  CorpusWriter writer{path, states.size(), columns};
+  for (size_t i = 0; i < states.size(); i++) {
+    writer.SetState(i, states[i]);
+  }
+  return writer.Close();
+}
+
+} // namespace cpu
@@ -0,0 +1,138 @@
+#pragma once
+
+#include "CPUState.h"
+#include "RunResult.h"
+
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string>
+#include <type_traits>
+
+namespace cpu {
+
+// A corpus file holds many programs laid out for bulk loading.
+//
+// It starts with a 64 byte CorpusHeader, followed by one column per enabled
+// field, each starting at a 64 byte boundary:
+//
+//   images:    Count little-endian uint64s, the CPUState::Image of each
+//              program, so byte i holds words 2i (high) and 2i+1 (low)
+//              exactly as Memory packs them
+//   registers: Count blocks of 8 bytes, the rest of the initial CPUState
+//              (registers, ALUResult, Flags, Halted, Reserved); programs
+//              start from zeroed registers when absent
+//   results:   Count CorpusResults
+//
+// Columns are read in place through a memory map, so the host must be
+// little-endian.
+static_assert(std::endian::native == std::endian::little);
+
+struct CorpusHeader {
+  static constexpr uint8_t Version{1};
+
+  enum Column : uint32_t {
+    Registers = 1,
+    Results = 2,
+  };
+
+  char Magic[7]{'C', 'P', 'U', '4', 'C', 'R', 'P'};
+  uint8_t FormatVersion{Version};
+  uint32_t Columns{}; // Column bits.
+  uint32_t Reserved{};
+  uint64_t Count{};
+  // Byte offsets of the columns, zero for absent ones.
+  uint64_t ImageOffset{};
+  uint64_t RegisterOffset{};
+  uint64_t ResultOffset{};
+  uint64_t Padding[2]{};
+};
+
+static_assert(sizeof(CorpusHeader) == 64);
+static_assert(std::is_trivially_copyable_v<CorpusHeader>);
+
+// CorpusResult is the outcome of running one program.
+struct alignas(16) CorpusResult {
+  CPUState Final{};
+  uint64_t Cycles{};
+  uint32_t Period{}; // Saturates at UINT32_MAX.
+  uint8_t Status{};  // A RunStatus.
+  uint8_t Reserved[3]{};
+
+  static CorpusResult From(const CPUState& final, const RunResult& result);
+  RunResult ToRunResult() const;
+};
+
+static_assert(sizeof(CorpusResult) == 32);
+static_assert(std::has_unique_object_representations_v<CorpusResult>);
+
+// CorpusReader maps a corpus file read-only. Spans it hands out point into
+// the mapping and stay valid for the reader's lifetime.
+class CorpusReader {
+public:
+  // Open returns nothing if the file cannot be mapped or is not a well
+  // formed corpus.
+  static std::optional<CorpusReader> Open(const std::string& path);
+
+  CorpusReader(CorpusReader&& other) noexcept;
+  CorpusReader& operator=(CorpusReader&& other) noexcept;
+  ~CorpusReader();
+
+  size_t Size() const;
+  bool HasRegisters() const;
+  bool HasResults() const;
+
+  std::span<const uint64_t> Images() const;
+  // Results is empty when the corpus has no result column.
+  std::span<const CorpusResult> Results() const;
+
+  // State returns the initial state of program i, ready for a CPU or Step.
+  CPUState State(size_t i) const;
+
+private:
+  const std::byte* m_base{};
+  size_t m_bytes{};
+  CorpusHeader m_header{};
+
+  CorpusReader() = default;
+};
+
+// CorpusWriter creates a corpus of a fixed size and fills it in place
+// through a shared memory map. Distinct programs can be set from different
+// threads concurrently, so results land in input order whatever order they
+// finish in.
+class CorpusWriter {
+public:
+  CorpusWriter(const std::string& path, size_t count, uint32_t columns);
+  ~CorpusWriter();
+
+  CorpusWriter(const CorpusWriter&) = delete;
+  CorpusWriter& operator=(const CorpusWriter&) = delete;
+
+  // Good is false if the file could not be created or mapped; the setters
+  // are then no-ops.
+  bool Good() const;
+  size_t Size() const;
+
+  // SetState writes the image and, if the corpus has them, the registers.
+  void SetState(size_t i, const CPUState& state);
+  void SetResult(size_t i, const CorpusResult& result);
+
+  // Close flushes the mapping to disk and unmaps it. It returns Good().
+  bool Close();
+
+private:
+  std::byte* m_base{};
+  size_t m_bytes{};
+  CorpusHeader m_header{};
+  bool m_good{};
+};
+
+// WriteCorpus writes states as a corpus with the given columns. It returns
+// false if the file could not be written.
+bool WriteCorpus(const std::string& path, std::span<const CPUState> states,
+                 uint32_t columns = 0);
+
+} // namespace cpu
@@ -0,0 +1,150 @@
+#include "CorpusRunner.h"
+
+#include "Step.h"
+#include "WorkStealingPool.h"
+
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <cmath>
+#include <utility>
+
+namespace cpu {
+
+size_t LatencyHistogram::m_bucket(const uint64_t nanos) {
+  // Values below 2^subBits get a bucket each; above that, the bucket is the
+  // power of two plus the next subBits bits.
+  if (nanos < (uint64_t{1} << m_subBits)) {
+    return static_cast<size_t>(nanos);
+  }
+  const size_t power{static_cast<size_t>(std::bit_width(nanos)) - 1};
+  const size_t sub{static_cast<size_t>(nanos >> (power - m_subBits)) &
+                   ((size_t{1} << m_subBits) - 1)};
+  return ((power - m_subBits + 1) << m_subBits) + sub;
+}
+
+uint64_t LatencyHistogram::m_upperBound(const size_t bucket) {
+  if (bucket < (size_t{1} << m_subBits)) {
+    return bucket;
+  }
+  const size_t power{(bucket >> m_subBits) + m_subBits - 1};
+  const uint64_t sub{bucket & ((size_t{1} << m_subBits) - 1)};
+  const uint64_t low{(uint64_t{1} << power) | (sub << (power - m_subBits))};
+  return low + (uint64_t{1} << (power - m_subBits)) - 1;
+}
+
+void LatencyHistogram::Record(const uint64_t nanos) {
+  m_counts[m_bucket(nanos)]++;
+  m_count++;
+  m_max = std::max(m_max, nanos);
+}
+
+void LatencyHistogram::Merge(const LatencyHistogram& other) {
+  for (size_t i = 0; i < m_buckets; i++) {
+    m_counts[i] += other.m_counts[i];
+  }
+  m_count += other.m_count;
+  m_max = std::max(m_max, other.m_max);
+}
+
+uint64_t LatencyHistogram::Count() const {
+  return m_count;
+}
+
+uint64_t LatencyHistogram::Max() const {
+  return m_max;
+}
+
+uint64_t LatencyHistogram::Percentile(const double q) const {
+  if (m_count == 0) {
+    return 0;
+  }
+  const auto rank{static_cast<uint64_t>(
+      std::ceil(std::clamp(q, 0.0, 1.0) * static_cast<double>(m_count)))};
+  uint64_t seen{0};
+  for (size_t i = 0; i < m_buckets; i++) {
+    seen += m_counts[i];
+    if (seen >= std::max<uint64_t>(rank, 1)) {
+      return std::min(m_upperBound(i), m_max);
+    }
+  }
+  return m_max;
+}
+
+namespace {
+
+// Each worker accumulates into its own cache lines.
+struct alignas(64) workerTotals {
+  uint64_t programs{};
+  uint64_t cycles{};
+  std::array<uint64_t, RunStatusCount> statuses{};
+  LatencyHistogram latency{};
+};
+
+} // namespace
+
+CorpusReport RunCorpus(const CorpusReader& input, CorpusWriter& output,
+                       const CorpusRunOptions& options) {
+  using clock = std::chrono::steady_clock;
+
+  WorkStealingPool pool{options.Threads};
+  std::vector<workerTotals> totals(pool.Threads());
+
+  const size_t count{std::min(input.Size(), output.Size())};
+  const size_t batch{std::max<size_t>(options.Batch, 1)};
+
+  std::vector<WorkStealingPool::Task> tasks{};
+  tasks.reserve((count + batch - 1) / batch);
+  for (size_t first = 0; first < count; first += batch) {
+    const size_t last{std::min(first + batch, count)};
+    tasks.emplace_back([&, first, last](const size_t worker) {
+      workerTotals& local{totals[worker]};
+      auto start{clock::now()};
+      for (size_t i = first; i < last; i++) {
+        const CPUState initial{input.State(i)};
+        CPUState state{initial};
+        const RunResult result{
+            RunBounded(state, options.Budget, options.Loops)};
+        output.SetState(i, initial);
+        output.SetResult(i, CorpusResult::From(state, result));
+
+        // The end of one program is the start of the next.
+        const auto end{clock::now()};
+        local.latency.Record(static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(end - start)
+                .count()));
+        start = end;
+
+        local.programs++;
+        local.cycles += result.Cycles;
+        local.statuses[std::to_underlying(result.Status)]++;
+      }
+    });
+  }
+
+  const auto start{clock::now()};
+  pool.Run(std::move(tasks));
+  const auto end{clock::now()};
+
+  CorpusReport report{};
+  report.WallNanos = static_cast<uint64_t>(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(end - start)
+          .count());
+  const auto& stats{pool.GetStats()};
+  for (size_t worker = 0; worker < totals.size(); worker++) {
+    const workerTotals& local{totals[worker]};
+    report.Programs += local.programs;
+    report.Cycles += local.cycles;
+    for (size_t status = 0; status < local.statuses.size(); status++) {
+      report.Statuses[status] += local.statuses[status];
+    }
+    report.Latency.Merge(local.latency);
+    report.Workers.push_back({.Programs = local.programs,
+                              .Batches = stats[worker].Executed,
+                              .Stolen = stats[worker].Stolen,
+                              .BusyNanos = stats[worker].BusyNanos});
+  }
+  return report;
+}
+
+} // namespace cpu
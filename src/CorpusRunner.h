@@ -0,0 +1,69 @@
+#pragma once
+
+#include "Corpus.h"
+#include "RunResult.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace cpu {
+
+// LatencyHistogram counts durations in log-linear buckets: eight buckets per
+// power of two, so percentiles are accurate to within 12.5%.
+class LatencyHistogram {
+public:
+  void Record(uint64_t nanos);
+  void Merge(const LatencyHistogram& other);
+
+  uint64_t Count() const;
+  uint64_t Max() const;
+  // Percentile returns an upper bound on the q-quantile, 0 <= q <= 1.
+  uint64_t Percentile(double q) const;
+
+private:
+  static constexpr size_t m_subBits{3};
+  static constexpr size_t m_buckets{64 << m_subBits};
+
+  std::array<uint64_t, m_buckets> m_counts{};
+  uint64_t m_count{};
+  uint64_t m_max{};
+
+  static size_t m_bucket(uint64_t nanos);
+  static uint64_t m_upperBound(size_t bucket);
+};
+
+struct CorpusRunOptions {
+  size_t Threads{}; // Zero picks one per hardware thread.
+  uint64_t Budget{1 << 16};
+  LoopCheck Loops{LoopCheck::Brent};
+  // Programs per scheduled task. Smaller batches balance better, larger
+  // ones cost less to schedule.
+  size_t Batch{256};
+};
+
+struct CorpusReport {
+  struct Worker {
+    uint64_t Programs{};
+    uint64_t Batches{};
+    uint64_t Stolen{}; // Batches taken from other workers.
+    uint64_t BusyNanos{};
+  };
+
+  uint64_t Programs{};
+  uint64_t Cycles{};
+  uint64_t WallNanos{};
+  std::array<uint64_t, RunStatusCount> Statuses{}; // Programs per RunStatus.
+  std::vector<Worker> Workers{};
+  LatencyHistogram Latency{}; // Wall time per program.
+};
+
+// RunCorpus runs every program of input on all threads with work stealing
+// and stores the outcome of program i as result i of output, so the output
+// is the same whatever the scheduling. Output must have the input's size and
+// a result column; a register column is filled from the input's states.
+CorpusReport RunCorpus(const CorpusReader& input, CorpusWriter& output,
+                       const CorpusRunOptions& options);
+
+} // namespace cpu
@@ -0,0 +1,505 @@
+#include "Daemon.h"
+
+#include "RunResult.h"
+#include "Step.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <ctime>
+#include <unordered_map>
+#include <utility>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace cpu::daemon {
+
+namespace {
+
+constexpr size_t readChunk{64 * 1024};
+
+// address fills a Unix socket address, failing when the path is too long.
+bool address(const std::string& path, sockaddr_un& addr) {
+  addr = {};
+  addr.sun_family = AF_UNIX;
+  if (path.empty() || path.size() >= sizeof(addr.sun_path)) {
+    return false;
+  }
+  std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+  return true;
+}
+
+// inFlight counts the requests a connection has taken and not yet answered.
+uint64_t inFlight(const uint64_t accepted, const uint64_t written) {
+  return accepted - written / sizeof(Response);
+}
+
+// retryable is true for errors that only mean "not now".
+bool retryable(const int error) {
+  return error == EAGAIN || error == EWOULDBLOCK || error == EINTR;
+}
+
+} // namespace
+
+Server::Server(ServerOptions options) : m_options{std::move(options)} {
+  m_options.MaxBatch = std::max<size_t>(m_options.MaxBatch, 1);
+  m_options.MaxInFlight = std::max<size_t>(m_options.MaxInFlight, 1);
+  if (pipe2(m_wake.data(), O_NONBLOCK | O_CLOEXEC) != 0) {
+    m_wake = {-1, -1};
+  }
+
+  size_t threads{m_options.Threads};
+  if (threads == 0) {
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+  m_workers.reserve(threads);
+  for (size_t i = 0; i < threads; i++) {
+    m_workers.emplace_back([this] { m_work(); });
+  }
+}
+
+Server::~Server() {
+  {
+    const std::scoped_lock lock{m_batchMutex};
+    m_shutdown = true;
+  }
+  m_batchReady.notify_all();
+  m_workers.clear();
+
+  if (m_listen >= 0) {
+    close(m_listen);
+    unlink(m_options.Path.c_str());
+  }
+  for (const int fd : m_wake) {
+    if (fd >= 0) {
+      close(fd);
+    }
+  }
+}
+
+bool Server::Listen() {
+  sockaddr_un addr{};
+  if (m_wake[0] < 0 || !address(m_options.Path, addr)) {
+    return false;
+  }
+  m_listen = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (m_listen < 0) {
+    return false;
+  }
+  unlink(m_options.Path.c_str());
+  if (bind(m_listen, reinterpret_cast<const sockaddr*>(&addr),
+           sizeof(addr)) != 0 ||
+      listen(m_listen, SOMAXCONN) != 0) {
+    close(m_listen);
+    m_listen = -1;
+    return false;
+  }
+  return true;
+}
+
+void Server::Stop() {
+  m_stop.store(true, std::memory_order_release);
+  m_wakeUp();
+}
+
+ServerStats Server::GetStats() const {
+  return {.Connections = m_connections.load(std::memory_order_relaxed),
+          .Requests = m_requests.load(std::memory_order_relaxed),
+          .Batches = m_batchCount.load(std::memory_order_relaxed),
+          .Cycles = m_cycles.load(std::memory_order_relaxed)};
+}
+
+// Serve is the I/O loop. Each pass waits for socket activity, a finished
+// batch or the batch deadline, then reads, answers and dispatches.
+void Server::Serve() {
+  using clock = std::chrono::steady_clock;
+  const std::chrono::microseconds delay{m_options.MaxDelayMicros};
+
+  std::unordered_map<uint64_t, Connection> connections{};
+  uint64_t nextID{0};
+  std::vector<Job> pending{};
+  clock::time_point oldest{};
+  std::vector<pollfd> fds{};
+  std::vector<Connection*> polled{};
+  std::vector<Done> done{};
+
+  while (m_listen >= 0 && !m_stop.load(std::memory_order_acquire)) {
+    fds.clear();
+    polled.clear();
+    fds.push_back({.fd = m_wake[0], .events = POLLIN, .revents = 0});
+    fds.push_back({.fd = m_listen, .events = POLLIN, .revents = 0});
+    for (auto& [id, connection] : connections) {
+      short events{0};
+      if (!connection.readClosed &&
+          inFlight(connection.accepted, connection.written) <
+              m_options.MaxInFlight) {
+        events |= POLLIN;
+      }
+      if (connection.outOffset < connection.out.size()) {
+        events |= POLLOUT;
+      }
+      // A half-closed socket keeps reporting end of file, so it is only
+      // polled while it has responses to write.
+      const bool idle{connection.readClosed && events == 0};
+      fds.push_back({.fd = idle ? -1 : connection.fd,
+                     .events = events,
+                     .revents = 0});
+      polled.push_back(&connection);
+    }
+
+    timespec timeout{};
+    const timespec* wait{nullptr};
+    if (!pending.empty()) {
+      const auto left{std::max(clock::duration::zero(),
+                               oldest + delay - clock::now())};
+      const auto nanos{
+          std::chrono::duration_cast<std::chrono::nanoseconds>(left).count()};
+      timeout.tv_sec = static_cast<time_t>(nanos / 1'000'000'000);
+      timeout.tv_nsec = static_cast<long>(nanos % 1'000'000'000);
+      wait = &timeout;
+    }
+    if (ppoll(fds.data(), fds.size(), wait, nullptr) < 0 && errno != EINTR) {
+      break;
+    }
+
+    if (fds[0].revents & POLLIN) {
+      char drain[256];
+      while (read(m_wake[0], drain, sizeof(drain)) > 0) {
+      }
+    }
+    if (fds[1].revents & POLLIN) {
+      int fd{};
+      while ((fd = accept4(m_listen, nullptr, nullptr,
+                           SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+        connections.emplace(nextID, Connection{.fd = fd, .id = nextID});
+        nextID++;
+        m_connections.fetch_add(1, std::memory_order_relaxed);
+      }
+    }
+    for (size_t i = 0; i < polled.size(); i++) {
+      if ((fds[i + 2].revents & (POLLIN | POLLHUP | POLLERR)) &&
+          !polled[i]->readClosed) {
+        m_read(*polled[i]);
+      }
+    }
+
+    {
+      const std::scoped_lock lock{m_doneMutex};
+      done.swap(m_done);
+    }
+    for (const Done& result : done) {
+      const auto found{connections.find(result.connection)};
+      if (found != connections.end()) {
+        const auto* bytes{
+            reinterpret_cast<const uint8_t*>(&result.response)};
+        found->second.out.insert(found->second.out.end(), bytes,
+                                 bytes + sizeof(Response));
+      }
+    }
+    done.clear();
+
+    // Writing frees in-flight slots, so parse afterwards.
+    for (auto& [id, connection] : connections) {
+      m_write(connection);
+      const bool wasEmpty{pending.empty()};
+      m_parse(connection, pending);
+      if (wasEmpty && !pending.empty()) {
+        oldest = clock::now();
+      }
+    }
+
+    while (pending.size() >= m_options.MaxBatch) {
+      const auto split{pending.begin() +
+                       static_cast<std::ptrdiff_t>(m_options.MaxBatch)};
+      m_submit({pending.begin(), split});
+      pending.erase(pending.begin(), split);
+    }
+    if (!pending.empty() && clock::now() >= oldest + delay) {
+      m_submit(std::move(pending));
+      pending.clear();
+    }
+
+    // A peer that has stopped sending still gets every response to the
+    // requests it sent before the connection is dropped.
+    std::erase_if(connections, [](const auto& entry) {
+      const Connection& connection{entry.second};
+      const bool answered{
+          connection.readClosed && connection.in.size() < sizeof(Request) &&
+          inFlight(connection.accepted, connection.written) == 0};
+      if (connection.closed || answered) {
+        close(connection.fd);
+        return true;
+      }
+      return false;
+    });
+  }
+
+  for (auto& [id, connection] : connections) {
+    close(connection.fd);
+  }
+}
+
+void Server::m_work() {
+  std::vector<Done> results{};
+  while (true) {
+    std::vector<Job> batch{};
+    {
+      std::unique_lock lock{m_batchMutex};
+      m_batchReady.wait(lock,
+                        [this] { return m_shutdown || !m_batches.empty(); });
+      if (m_batches.empty()) {
+        return;
+      }
+      batch = std::move(m_batches.front());
+      m_batches.pop_front();
+    }
+
+    results.clear();
+    uint64_t cycles{0};
+    for (const Job& job : batch) {
+      const Request& request{job.request};
+      CPUState state{request.Initial};
+      const RunResult result{RunBounded(
+          state, request.Budget != 0 ? request.Budget : m_options.Budget,
+          request.Loops == 1 ? LoopCheck::Brent : LoopCheck::Off)};
+      cycles += result.Cycles;
+      results.push_back(
+          {.connection = job.connection,
+           .response = {.Id = request.Id,
+                        .Result = CorpusResult::From(state, result)}});
+    }
+    m_cycles.fetch_add(cycles, std::memory_order_relaxed);
+
+    {
+      const std::scoped_lock lock{m_doneMutex};
+      m_done.insert(m_done.end(), results.begin(), results.end());
+    }
+    m_wakeUp();
+  }
+}
+
+// m_wakeUp interrupts ppoll in Serve. It only writes to a pipe, so it is
+// safe in a signal handler.
+void Server::m_wakeUp() {
+  if (m_wake[1] >= 0) {
+    const char byte{1};
+    [[maybe_unused]] const ssize_t written{write(m_wake[1], &byte, 1)};
+  }
+}
+
+void Server::m_submit(std::vector<Job> batch) {
+  m_batchCount.fetch_add(1, std::memory_order_relaxed);
+  {
+    const std::scoped_lock lock{m_batchMutex};
+    m_batches.push_back(std::move(batch));
+  }
+  m_batchReady.notify_one();
+}
+
+void Server::m_read(Connection& connection) {
+  uint8_t buffer[readChunk];
+  const ssize_t count{recv(connection.fd, buffer, sizeof(buffer), 0)};
+  if (count > 0) {
+    connection.in.insert(connection.in.end(), buffer, buffer + count);
+  } else if (count == 0) {
+    connection.readClosed = true;
+  } else if (!retryable(errno)) {
+    connection.closed = true;
+  }
+}
+
+// m_parse turns buffered bytes into jobs while the connection has in-flight
+// slots left. A request with an invalid initial state is answered with an
+// error here rather than run, since the engines disagree on such states.
+void Server::m_parse(Connection& connection, std::vector<Job>& pending) {
+  size_t offset{0};
+  while (connection.in.size() - offset >= sizeof(Request) &&
+         inFlight(connection.accepted, connection.written) <
+             m_options.MaxInFlight) {
+    Job job{.connection = connection.id};
+    std::memcpy(&job.request, connection.in.data() + offset, sizeof(Request));
+    if (job.request.Initial.IsValid()) {
+      pending.push_back(job);
+    } else {
+      const Response response{
+          .Id = job.request.Id,
+          .Error = std::to_underlying(ResponseError::InvalidState)};
+      const auto* bytes{reinterpret_cast<const uint8_t*>(&response)};
+      connection.out.insert(connection.out.end(), bytes,
+                            bytes + sizeof(Response));
+    }
+    offset += sizeof(Request);
+    connection.accepted++;
+    m_requests.fetch_add(1, std::memory_order_relaxed);
+  }
+  connection.in.erase(connection.in.begin(),
+                      connection.in.begin() +
+                          static_cast<std::ptrdiff_t>(offset));
+}
+
+void Server::m_write(Connection& connection) {
+  while (connection.outOffset < connection.out.size()) {
+    const ssize_t count{send(connection.fd,
+                             connection.out.data() + connection.outOffset,
+                             connection.out.size() - connection.outOffset,
+                             MSG_NOSIGNAL)};
+    if (count > 0) {
+      connection.outOffset += static_cast<size_t>(count);
+      connection.written += static_cast<uint64_t>(count);
+    } else if (count < 0 && errno == EINTR) {
+      continue;
+    } else {
+      if (count == 0 || !retryable(errno)) {
+        connection.closed = true;
+      }
+      break;
+    }
+  }
+  if (connection.outOffset == connection.out.size()) {
+    connection.out.clear();
+    connection.outOffset = 0;
+  }
+}
+
+Client::Client(const int fd) : m_fd{fd} {}
+
+std::optional<Client> Client::Connect(const std::string& path) {
+  sockaddr_un addr{};
+  if (!address(path, addr)) {
+    return std::nullopt;
+  }
+  const int fd{socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)};
+  if (fd < 0) {
+    return std::nullopt;
+  }
+  if (connect(fd, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) !=
+      0) {
+    close(fd);
+    return std::nullopt;
+  }
+  return Client{fd};
+}
+
+Client::Client(Client&& other) noexcept
+    : m_fd{std::exchange(other.m_fd, -1)}, m_in{std::move(other.m_in)} {}
+
+Client& Client::operator=(Client&& other) noexcept {
+  if (this != &other) {
+    if (m_fd >= 0) {
+      close(m_fd);
+    }
+    m_fd = std::exchange(other.m_fd, -1);
+    m_in = std::move(other.m_in);
+  }
+  return *this;
+}
+
+Client::~Client() {
+  if (m_fd >= 0) {
+    close(m_fd);
+  }
+}
+
+bool Client::Send(const Request& request) {
+  const auto* bytes{reinterpret_cast<const uint8_t*>(&request)};
+  size_t sent{0};
+  while (sent < sizeof(Request)) {
+    const ssize_t count{
+        send(m_fd, bytes + sent, sizeof(Request) - sent, MSG_NOSIGNAL)};
+    if (count > 0) {
+      sent += static_cast<size_t>(count);
+    } else if (count < 0 && errno == EINTR) {
+      continue;
+    } else {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool Client::Finish() {
+  return shutdown(m_fd, SHUT_WR) == 0;
+}
+
+std::optional<Response> Client::Receive() {
+  uint8_t buffer[readChunk];
+  while (true) {
+    if (m_in.size() >= sizeof(Response)) {
+      Response response{};
+      std::memcpy(&response, m_in.data(), sizeof(Response));
+      m_in.erase(m_in.begin(), m_in.begin() + sizeof(Response));
+      return response;
+    }
+    const ssize_t count{recv(m_fd, buffer, sizeof(buffer), 0)};
+    if (count > 0) {
+      m_in.insert(m_in.end(), buffer, buffer + count);
+    } else if (count == 0 || errno != EINTR) {
+      return std::nullopt;
+    }
+  }
+}
+
+std::vector<Response> Client::Call(const std::span<const Request> requests,
+                                   const size_t window) {
+  const auto bytes{std::as_bytes(requests)};
+  const size_t limit{std::max<size_t>(window, 1)};
+  size_t sent{0};
+  std::vector<Response> responses{};
+  responses.reserve(requests.size());
+  uint8_t buffer[readChunk];
+
+  m_take(responses);
+  while (responses.size() < requests.size()) {
+    // Never let more than window requests go unanswered.
+    const size_t allowed{
+        std::min(bytes.size(), (responses.size() + limit) * sizeof(Request))};
+    pollfd fd{.fd = m_fd, .events = POLLIN, .revents = 0};
+    if (sent < allowed) {
+      fd.events |= POLLOUT;
+    }
+    if (poll(&fd, 1, -1) < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      break;
+    }
+
+    if (fd.revents & POLLOUT) {
+      const ssize_t count{send(m_fd, bytes.data() + sent, allowed - sent,
+                               MSG_NOSIGNAL | MSG_DONTWAIT)};
+      if (count > 0) {
+        sent += static_cast<size_t>(count);
+      } else if (count < 0 && !retryable(errno)) {
+        break;
+      }
+    }
+    if (fd.revents & (POLLIN | POLLHUP | POLLERR)) {
+      const ssize_t count{recv(m_fd, buffer, sizeof(buffer), MSG_DONTWAIT)};
+      if (count > 0) {
+        m_in.insert(m_in.end(), buffer, buffer + count);
+        m_take(responses);
+      } else if (count == 0 || !retryable(errno)) {
+        break;
+      }
+    }
+  }
+  return responses;
+}
+
+void Client::m_take(std::vector<Response>& responses) {
+  size_t offset{0};
+  while (m_in.size() - offset >= sizeof(Response)) {
+    Response response{};
+    std::memcpy(&response, m_in.data() + offset, sizeof(Response));
+    responses.push_back(response);
+    offset += sizeof(Response);
+  }
+  m_in.erase(m_in.begin(), m_in.begin() + static_cast<std::ptrdiff_t>(offset));
+}
+
+} // namespace cpu::daemon
@@ -0,0 +1,180 @@
+#pragma once
+
+#include "CPUState.h"
+#include "Corpus.h"
+
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// The cpu4d daemon runs programs for local clients over a Unix domain
+// socket. Requests and responses are fixed size little-endian frames written
+// back to back on a stream socket, so a client may pipeline as many requests
+// as it likes and match the responses by id.
+namespace cpu::daemon {
+
+struct Request {
+  uint64_t Id{};                    // Echoed in the response.
+  uint32_t Budget{};                // Cycles; zero takes the server default.
+  uint8_t Loops{};                  // 1 enables LoopCheck::Brent.
+  std::array<uint8_t, 3> Reserved{};
+  CPUState Initial{};
+};
+
+static_assert(sizeof(Request) == 32);
+static_assert(std::is_trivially_copyable_v<Request>);
+
+// ResponseError says why a request was not run.
+enum class ResponseError : uint8_t {
+  None,
+  InvalidState, // Initial failed CPUState::IsValid.
+};
+
+struct Response {
+  uint64_t Id{};
+  uint8_t Error{}; // A ResponseError; Result is zero unless it is None.
+  std::array<uint8_t, 7> Reserved{};
+  CorpusResult Result{};
+};
+
+static_assert(sizeof(Response) == 48);
+static_assert(std::is_trivially_copyable_v<Response>);
+
+struct ServerOptions {
+  std::string Path{};
+  size_t Threads{}; // Workers; zero picks one per hardware thread.
+  // A batch is dispatched once it holds MaxBatch requests or its oldest
+  // request has waited MaxDelayMicros. Bigger batches cost less per
+  // request, shorter delays answer sooner under light load.
+  size_t MaxBatch{64};
+  uint64_t MaxDelayMicros{200};
+  // A connection with this many unanswered requests is not read from until
+  // responses have been written, which pushes back on the client.
+  size_t MaxInFlight{1024};
+  uint64_t Budget{1 << 16};
+};
+
+struct ServerStats {
+  uint64_t Connections{};
+  uint64_t Requests{};
+  uint64_t Batches{};
+  uint64_t Cycles{};
+};
+
+// Server accepts connections and reads requests on the thread that calls
+// Serve, and runs batches of them on a pool of worker threads that live as
+// long as the server.
+class Server {
+public:
+  explicit Server(ServerOptions options);
+  Server(const Server&) = delete;
+  Server& operator=(const Server&) = delete;
+  ~Server();
+
+  // Listen creates the socket, replacing any stale file at the path. It
+  // returns false when the socket cannot be created.
+  bool Listen();
+  // Serve handles clients until Stop is called.
+  void Serve();
+  // Stop may be called from any thread or a signal handler.
+  void Stop();
+
+  ServerStats GetStats() const;
+
+private:
+  struct Connection {
+    int fd{-1};
+    uint64_t id{};
+    std::vector<uint8_t> in{};
+    std::vector<uint8_t> out{};
+    size_t outOffset{};
+    uint64_t accepted{}; // Requests taken from in.
+    uint64_t written{};  // Response bytes sent.
+    bool readClosed{};   // The peer has sent everything it will send.
+    bool closed{};
+  };
+
+  struct Job {
+    uint64_t connection{};
+    Request request{};
+  };
+
+  struct Done {
+    uint64_t connection{};
+    Response response{};
+  };
+
+  ServerOptions m_options{};
+  int m_listen{-1};
+  std::array<int, 2> m_wake{-1, -1}; // Self-pipe that interrupts Serve.
+  std::atomic<bool> m_stop{};
+
+  // Batches waiting for a worker.
+  std::mutex m_batchMutex{};
+  std::condition_variable m_batchReady{};
+  std::deque<std::vector<Job>> m_batches{};
+  bool m_shutdown{};
+
+  // Responses waiting for the I/O thread.
+  std::mutex m_doneMutex{};
+  std::vector<Done> m_done{};
+
+  std::vector<std::jthread> m_workers{};
+
+  std::atomic<uint64_t> m_connections{};
+  std::atomic<uint64_t> m_requests{};
+  std::atomic<uint64_t> m_batchCount{};
+  std::atomic<uint64_t> m_cycles{};
+
+  void m_work();
+  void m_wakeUp();
+  void m_submit(std::vector<Job> batch);
+  void m_read(Connection& connection);
+  void m_parse(Connection& connection, std::vector<Job>& pending);
+  void m_write(Connection& connection);
+};
+
+// Client is a blocking connection to a server.
+class Client {
+public:
+  static std::optional<Client> Connect(const std::string& path);
+
+  Client(Client&& other) noexcept;
+  Client& operator=(Client&& other) noexcept;
+  Client(const Client&) = delete;
+  Client& operator=(const Client&) = delete;
+  ~Client();
+
+  bool Send(const Request& request);
+  // Finish tells the server no more requests are coming. Responses to those
+  // already sent can still be received.
+  bool Finish();
+  std::optional<Response> Receive();
+
+  // Call pipelines requests with at most window of them unanswered and
+  // returns the responses in the order they arrived. It returns fewer
+  // responses than requests when the connection fails.
+  std::vector<Response> Call(std::span<const Request> requests,
+                             size_t window = 256);
+
+private:
+  explicit Client(int fd);
+
+  // m_take moves complete responses from m_in to responses.
+  void m_take(std::vector<Response>& responses);
+
+  int m_fd{-1};
+  std::vector<uint8_t> m_in{};
+};
+
+} // namespace cpu::daemon
@@ -0,0 +1,412 @@
+#include "DecodedCPU.h"
+
+#include "ALUTables.h"
+#include "CPUDefs.h"
+#include "CPUState.h"
+#include "Nibble.h"
+
+#include <cstdint>
+#include <utility>
+
+// Handlers are chained with computed gotos where the compiler supports them,
+// so every handler ends in its own indirect jump to the next one. Other
+// compilers get a switch in a loop.
+#if defined(__GNUC__)
+#define CPU4_THREADED_DISPATCH 1
+#else
+#define CPU4_THREADED_DISPATCH 0
+#endif
+
+namespace cpu {
+
+FusionSet ChooseFusions(const PairCounts& profile, const double minShare) {
+  uint64_t total{0};
+  for (const uint64_t count : profile.Pairs) {
+    total += count;
+  }
+  FusionSet chosen{};
+  for (const FusionRule& rule : FusionRules) {
+    const uint64_t count{profile.Count(rule.First, rule.Second)};
+    if (count != 0 &&
+        static_cast<double>(count) >= minShare * static_cast<double>(total)) {
+      chosen.set(std::to_underlying(rule.Fused));
+    }
+  }
+  return chosen;
+}
+
+DecodedCPU::DecodedCPU() : DecodedCPU(CPUState{}) {}
+
+DecodedCPU::DecodedCPU(const CPUState& state, const FusionSet fusions)
+    : m_state{state} {
+  SetFusions(fusions);
+}
+
+const CPUState& DecodedCPU::GetState() const {
+  return m_state;
+}
+
+void DecodedCPU::SetState(const CPUState& state) {
+  m_state = state;
+  m_ops.fill({});
+}
+
+void DecodedCPU::Store(const uint4 value, const uint4 addr) {
+  m_state.Store(value, addr);
+  m_invalidate(addr.Raw());
+}
+
+uint64_t DecodedCPU::GetDecodeCount() const {
+  return m_decodes;
+}
+
+void DecodedCPU::SetFusions(const FusionSet fusions) {
+  m_fusions = fusions;
+  m_pairs.fill(NoFusion);
+  for (const FusionRule& rule : FusionRules) {
+    if (fusions.test(std::to_underlying(rule.Fused))) {
+      m_pairs[std::to_underlying(rule.First) << 4 |
+              std::to_underlying(rule.Second)] = std::to_underlying(rule.Fused);
+    }
+  }
+  m_ops.fill({});
+}
+
+FusionSet DecodedCPU::GetFusions() const {
+  return m_fusions;
+}
+
+const std::array<uint64_t, FusionCount>& DecodedCPU::GetFusionCounts() const {
+  return m_fired;
+}
+
+void DecodedCPU::Cycle() {
+  // A halted CPU still executes when cycled directly, as CPU::Cycle does.
+  const uint8_t halted{m_state.Halted};
+  m_state.Halted = 0;
+  Run(1);
+  m_state.Halted |= halted;
+}
+
+void DecodedCPU::m_decode(const uint8_t addr) {
+  MicroOp& op{m_ops[addr]};
+  const uint8_t word{m_state.Load(uint4(addr)).Raw()};
+  const uint8_t arg{m_state.Load(uint4(addr + 1)).Raw()};
+
+  op.opcode = word;
+  op.arg = arg;
+  op.src = arg >> 2;
+  op.dest = arg & 0x3;
+  op.next = (addr + 2) & 0xF;
+
+  switch (static_cast<OpCode>(word)) {
+  case OpCode::Halt:
+    op.handler = Handler::Halt;
+    op.next = (addr + 1) & 0xF;
+    break;
+  case OpCode::LoadA:
+    op.handler = Handler::LoadA;
+    break;
+  case OpCode::LoadAI:
+    op.handler = Handler::LoadAI;
+    break;
+  case OpCode::LoadB:
+    op.handler = Handler::LoadB;
+    break;
+  case OpCode::StoreA:
+    op.handler = Handler::StoreA;
+    break;
+  case OpCode::Mov:
+    op.handler = Handler::Mov;
+    break;
+  case OpCode::Add:
+    op.handler = Handler::Add;
+    break;
+  case OpCode::Sub:
+    op.handler = Handler::Sub;
+    break;
+  case OpCode::Jump:
+    op.handler = Handler::Jump;
+    break;
+  case OpCode::JumpZ:
+    op.handler = Handler::JumpZ;
+    break;
+  case OpCode::JumpNZ:
+    op.handler = Handler::JumpNZ;
+    break;
+  default:
+    op.handler = Handler::Skip;
+    op.next = (addr + 1) & 0xF;
+  }
+  op.single = op.handler;
+  m_decodes++;
+
+  // Only the first opcodes of rules can start a fused pair, and those are
+  // all two words long.
+  const uint8_t word2{m_state.Load(uint4(op.next)).Raw()};
+  const uint8_t fusion{m_pairs[word << 4 | word2]};
+  if (fusion == NoFusion) {
+    return;
+  }
+  const uint8_t arg2{m_state.Load(uint4(op.next + 1)).Raw()};
+  op.opcode2 = word2;
+  op.arg2 = arg2;
+  op.src2 = arg2 >> 2;
+  op.dest2 = arg2 & 0x3;
+  op.next2 = (op.next + 2) & 0xF;
+  op.handler = static_cast<Handler>(std::to_underlying(Handler::LoadAIMov) +
+                                    fusion);
+  m_decodes++;
+}
+
+// m_invalidate marks the entries that read the word at addr: the instruction
+// starting there, the one whose argument it is, and fused pairs whose second
+// instruction covers it.
+void DecodedCPU::m_invalidate(const uint8_t addr) {
+  m_ops[addr].handler = Handler::Decode;
+  m_ops[(addr - 1) & 0xF].handler = Handler::Decode;
+  for (const uint8_t back : {2, 3}) {
+    MicroOp& op{m_ops[(addr - back) & 0xF]};
+    if (op.handler >= Handler::LoadAIMov) {
+      op.handler = Handler::Decode;
+    }
+  }
+}
+
+uint64_t DecodedCPU::Run(const uint64_t maxCycles) {
+  CPUState& s{m_state};
+  std::array<uint8_t, 4>& regs{s.Registers};
+  uint8_t pc{regs[regID::PC]};
+  uint64_t cycles{0};
+  const MicroOp* op{};
+
+  if (s.Halted) {
+    return 0;
+  }
+
+#if CPU4_THREADED_DISPATCH
+  static void* const labels[] = {
+      &&do_Decode, &&do_Halt, &&do_LoadA, &&do_LoadAI, &&do_LoadB,
+      &&do_StoreA, &&do_Mov,  &&do_Add,   &&do_Sub,    &&do_Jump,
+      &&do_JumpZ,  &&do_JumpNZ, &&do_Skip, &&do_LoadAIMov,
+      &&do_AddStoreA, &&do_SubStoreA, &&do_SubJumpNZ};
+#define CPU4_HANDLER(name) do_##name:
+#define CPU4_NEXT()                                                            \
+  do {                                                                         \
+    if (cycles == maxCycles) {                                                 \
+      goto done;                                                               \
+    }                                                                          \
+    op = &m_ops[pc];                                                           \
+    goto* labels[std::to_underlying(op->handler)];                            \
+  } while (0)
+// A fused pair with a single cycle left runs its first instruction alone.
+#define CPU4_FUSED()                                                           \
+  do {                                                                         \
+    if (maxCycles - cycles == 1) {                                             \
+      goto* labels[std::to_underlying(op->single)];                           \
+    }                                                                          \
+  } while (0)
+
+  CPU4_NEXT();
+#else
+#define CPU4_HANDLER(name) case Handler::name:
+#define CPU4_NEXT() continue
+#define CPU4_FUSED()
+
+  while (true) {
+    if (cycles == maxCycles) {
+      goto done;
+    }
+    op = &m_ops[pc];
+    const bool fused{op->handler >= Handler::LoadAIMov};
+    switch (fused && maxCycles - cycles == 1 ? op->single : op->handler) {
+#endif
+
+  // Decoding does not count as a cycle, the entry is simply re-dispatched.
+  CPU4_HANDLER(Decode) {
+    m_decode(pc);
+  }
+  CPU4_NEXT();
+
+  CPU4_HANDLER(Halt) {
+    regs[regID::IS] = op->opcode;
+    pc = op->next;
+    s.Halted = 1;
+    cycles++;
+  }
+  goto done;
+
+  CPU4_HANDLER(LoadA) {
+    regs[regID::IS] = op->opcode;
+    regs[regID::A] = s.Load(uint4(op->arg)).Raw();
+    pc = op->next;
+    cycles++;
+  }
+  CPU4_NEXT();
+
+  CPU4_HANDLER(LoadAI) {
+    regs[regID::IS] = op->opcode;
+    regs[regID::A] = op->arg;
+    pc = op->next;
+    cycles++;
+  }
+  CPU4_NEXT();
+
+  CPU4_HANDLER(LoadB) {
+    regs[regID::IS] = op->opcode;
+    regs[regID::B] = s.Load(uint4(op->arg)).Raw();
+    pc = op->next;
+    cycles++;
+  }
+  CPU4_NEXT();
+
+  CPU4_HANDLER(StoreA) {
+    regs[regID::IS] = op->opcode;
+    s.Store(uint4(regs[regID::A]), uint4(op->arg));
+    m_invalidate(op->arg);
+    pc = op->next;
+    cycles++;
+  }
+  CPU4_NEXT();
+
+  // Mov, Add and Sub may name IS or PC, so those are in place before the
+  // registers are read.
+  CPU4_HANDLER(Mov) {
+    regs[regID::IS] = op->opcode;
+    regs[regID::PC] = op->next;
+    regs[op->dest] = regs[op->src];
+    pc = regs[regID::PC];
+    cycles++;
+  }
+  CPU4_NEXT();
+
+  CPU4_HANDLER(Add) {
+    regs[regID::IS] = op->opcode;
+    regs[regID::PC] = op->next;
+    const uint8_t entry{alu::AddTable[(regs[op->src] << 4) | regs[op->dest]]};
+    regs[regID::A] = entry & 0xF;
+    s.ALUResult = entry & 0xF;
+    s.Flags = entry >> 4;
+    pc = op->next;
+    cycles++;
+  }
+  CPU4_NEXT();
+
+  CPU4_HANDLER(Sub) {
+    regs[regID::IS] = op->opcode;
+    regs[regID::PC] = op->next;
+    const uint8_t entry{alu::SubTable[(regs[op->src] << 4) | regs[op->dest]]};
+    regs[regID::A] = entry & 0xF;
+    s.ALUResult = entry & 0xF;
+    s.Flags = entry >> 4;
+    pc = op->next;
+    cycles++;
+  }
+  CPU4_NEXT();
+
+  CPU4_HANDLER(Jump) {
+    regs[regID::IS] = op->opcode;
+    pc = op->arg;
+    cycles++;
+  }
+  CPU4_NEXT();
+
+  CPU4_HANDLER(JumpZ) {
+    regs[regID::IS] = op->opcode;
+    pc = (s.Flags & flagBit::Zero) ? op->arg : op->next;
+    cycles++;
+  }
+  CPU4_NEXT();
+
+  CPU4_HANDLER(JumpNZ) {
+    regs[regID::IS] = op->opcode;
+    pc = (s.Flags & flagBit::Zero) ? op->next : op->arg;
+    cycles++;
+  }
+  CPU4_NEXT();
+
+  CPU4_HANDLER(Skip) {
+    regs[regID::IS] = op->opcode;
+    pc = op->next;
+    cycles++;
+  }
+  CPU4_NEXT();
+
+  // Fused pairs run both halves as the handlers above would, one after the
+  // other; only the dispatch between them is saved.
+  CPU4_HANDLER(LoadAIMov) {
+    CPU4_FUSED();
+    regs[regID::A] = op->arg;
+    regs[regID::IS] = op->opcode2;
+    regs[regID::PC] = op->next2;
+    regs[op->dest2] = regs[op->src2];
+    pc = regs[regID::PC];
+    cycles += 2;
+    m_fired[std::to_underlying(Fusion::LoadAIMov)]++;
+  }
+  CPU4_NEXT();
+
+  CPU4_HANDLER(AddStoreA) {
+    CPU4_FUSED();
+    regs[regID::IS] = op->opcode;
+    regs[regID::PC] = op->next;
+    const uint8_t entry{alu::AddTable[(regs[op->src] << 4) | regs[op->dest]]};
+    regs[regID::A] = entry & 0xF;
+    s.ALUResult = entry & 0xF;
+    s.Flags = entry >> 4;
+    regs[regID::IS] = op->opcode2;
+    s.Store(uint4(regs[regID::A]), uint4(op->arg2));
+    m_invalidate(op->arg2);
+    pc = op->next2;
+    cycles += 2;
+    m_fired[std::to_underlying(Fusion::AddStoreA)]++;
+  }
+  CPU4_NEXT();
+
+  CPU4_HANDLER(SubStoreA) {
+    CPU4_FUSED();
+    regs[regID::IS] = op->opcode;
+    regs[regID::PC] = op->next;
+    const uint8_t entry{alu::SubTable[(regs[op->src] << 4) | regs[op->dest]]};
+    regs[regID::A] = entry & 0xF;
+    s.ALUResult = entry & 0xF;
+    s.Flags = entry >> 4;
+    regs[regID::IS] = op->opcode2;
+    s.Store(uint4(regs[regID::A]), uint4(op->arg2));
+    m_invalidate(op->arg2);
+    pc = op->next2;
+    cycles += 2;
+    m_fired[std::to_underlying(Fusion::SubStoreA)]++;
+  }
+  CPU4_NEXT();
+
+  CPU4_HANDLER(SubJumpNZ) {
+    CPU4_FUSED();
+    regs[regID::IS] = op->opcode;
+    regs[regID::PC] = op->next;
+    const uint8_t entry{alu::SubTable[(regs[op->src] << 4) | regs[op->dest]]};
+    regs[regID::A] = entry & 0xF;
+    s.ALUResult = entry & 0xF;
+    s.Flags = entry >> 4;
+    regs[regID::IS] = op->opcode2;
+    pc = (s.Flags & flagBit::Zero) ? op->next2 : op->arg2;
+    cycles += 2;
+    m_fired[std::to_underlying(Fusion::SubJumpNZ)]++;
+  }
+  CPU4_NEXT();
+
+#if !CPU4_THREADED_DISPATCH
+    }
+  }
+#endif
+
+#undef CPU4_HANDLER
+#undef CPU4_NEXT
+#undef CPU4_FUSED
+
+done:
+  regs[regID::PC] = pc;
+  return cycles;
+}
+
+} // namespace cpu
@@ -0,0 +1,146 @@
+#pragma once
+
+#include "CPUDefs.h"
+#include "CPUState.h"
+#include "Instrumentation.h"
+#include "Nibble.h"
+
+#include <array>
+#include <bitset>
+#include <cstddef>
+#include <cstdint>
+
+namespace cpu {
+
+// Fusion names a superinstruction: a pair of adjacent instructions that the
+// decoder turns into one micro-op. A fused pair leaves exactly the state the
+// two instructions would, IS and flags included, and counts as two cycles.
+enum class Fusion : uint8_t {
+  LoadAIMov,  // Loads a constant into a register other than A.
+  AddStoreA,  // Accumulates into memory.
+  SubStoreA,
+  SubJumpNZ,  // Decrements a loop counter and branches on it.
+};
+
+inline constexpr size_t FusionCount{4};
+
+// FusionRule is the pair of opcodes a fusion replaces. New fusions add a
+// rule here and a handler to DecodedCPU::Run.
+struct FusionRule {
+  OpCode First{};
+  OpCode Second{};
+  Fusion Fused{};
+};
+
+inline constexpr std::array<FusionRule, FusionCount> FusionRules{{
+    {OpCode::LoadAI, OpCode::Mov, Fusion::LoadAIMov},
+    {OpCode::Add, OpCode::StoreA, Fusion::AddStoreA},
+    {OpCode::Sub, OpCode::StoreA, Fusion::SubStoreA},
+    {OpCode::Sub, OpCode::JumpNZ, Fusion::SubJumpNZ},
+}};
+
+// FusionSet selects fusions by their Fusion value.
+using FusionSet = std::bitset<FusionCount>;
+
+inline constexpr FusionSet AllFusions{(1u << FusionCount) - 1};
+
+// ChooseFusions enables the rules whose pair makes up at least minShare of
+// the adjacent pairs in a profile.
+FusionSet ChooseFusions(const PairCounts& profile, double minShare = 0.01);
+
+// DecodedCPU runs a CPUState from a pre-decoded instruction stream. Each
+// address has a micro-op holding its handler and already parsed operands, and
+// execution dispatches from one micro-op straight to the next.
+//
+// Decoding is lazy: an entry is decoded the first time execution reaches it.
+// The instruction at addr is made of words addr and addr+1, so a StoreA to a
+// word invalidates exactly the two entries that cover it. Programs that never
+// write to their own code never decode an instruction twice.
+//
+// An entry whose instruction and the one after it form the pair of an
+// enabled FusionRule is decoded as one fused micro-op over four words, and a
+// store invalidates the fused entries two and three words before it as well.
+class DecodedCPU {
+public:
+  DecodedCPU();
+  explicit DecodedCPU(const CPUState& state, FusionSet fusions = AllFusions);
+
+  // Run executes until Halt or until maxCycles instructions have run and
+  // returns the number executed.
+  uint64_t Run(uint64_t maxCycles);
+  void Cycle();
+
+  const CPUState& GetState() const;
+  void SetState(const CPUState& state);
+
+  // Store writes a word from the host side, invalidating affected entries.
+  void Store(uint4 value, uint4 addr);
+
+  // GetDecodeCount returns how many instructions have been decoded so far;
+  // a fused pair counts as two.
+  uint64_t GetDecodeCount() const;
+
+  // SetFusions changes which pairs are fused from the next decode on, and
+  // drops the entries decoded so far.
+  void SetFusions(FusionSet fusions);
+  FusionSet GetFusions() const;
+
+  // GetFusionCounts returns how many times each fusion has run, by Fusion
+  // value.
+  const std::array<uint64_t, FusionCount>& GetFusionCounts() const;
+
+private:
+  enum class Handler : uint8_t {
+    Decode, // Entry is stale and must be decoded before running.
+    Halt,
+    LoadA,
+    LoadAI,
+    LoadB,
+    StoreA,
+    Mov,
+    Add,
+    Sub,
+    Jump,
+    JumpZ,
+    JumpNZ,
+    Skip, // Unknown opcode, advances past the opcode only.
+    // Fused pairs, in Fusion order.
+    LoadAIMov,
+    AddStoreA,
+    SubStoreA,
+    SubJumpNZ,
+  };
+
+  static constexpr uint8_t NoFusion{0xFF};
+
+  struct MicroOp {
+    Handler handler{Handler::Decode};
+    uint8_t opcode{}; // Raw opcode word, loaded into IS.
+    uint8_t arg{};    // Address, value or jump target.
+    uint8_t src{};    // Register ids for Mov, Add and Sub.
+    uint8_t dest{};
+    uint8_t next{}; // PC after the instruction when it does not jump.
+    // The second instruction of a fused pair, which starts at next.
+    uint8_t opcode2{};
+    uint8_t arg2{};
+    uint8_t src2{};
+    uint8_t dest2{};
+    uint8_t next2{};
+    // Handler of the first instruction alone, for when a single cycle is
+    // left to run.
+    Handler single{Handler::Decode};
+  };
+
+  CPUState m_state{};
+  std::array<MicroOp, MemSizeWords> m_ops{};
+  uint64_t m_decodes{};
+  FusionSet m_fusions{AllFusions};
+  // Fusion of each opcode pair, by first << 4 | second, or NoFusion.
+  std::array<uint8_t, 256> m_pairs{};
+  std::array<uint64_t, FusionCount> m_fired{};
+
+  void m_decode(uint8_t addr);
+  void m_invalidate(uint8_t addr);
+};
+
+} // namespace cpu
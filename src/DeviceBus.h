@@ -0,0 +1,88 @@
+#pragma once
+
+#include "SPSCQueue.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <span>
+
+namespace cpu {
+
+// BasicDeviceBus connects a CPU to host devices through numbered ports. Each
+// port has an input channel that the host fills and the CPU drains with In,
+// and an output channel that the CPU fills with Out and the host drains.
+// Channels are SPSCQueues, so one host thread may feed a port's input and
+// one may drain its output while the CPU runs on another, without locks or
+// system calls on either side. Sample is the storage type of a machine word;
+// the CPU masks samples to the word width as it reads them.
+template <typename Sample>
+class BasicDeviceBus {
+public:
+  static constexpr size_t Ports{16};
+
+  // Every channel holds capacity samples, rounded up to a power of two.
+  explicit BasicDeviceBus(const size_t capacity = 1024) {
+    for (size_t port = 0; port < Ports; port++) {
+      m_inputs[port] = std::make_unique<SPSCQueue<Sample>>(capacity);
+      m_outputs[port] = std::make_unique<SPSCQueue<Sample>>(capacity);
+    }
+  }
+
+  // Host side. Send queues input for the CPU and fails when the channel is
+  // full; Receive takes the CPU's output. The span forms move as many
+  // samples as they can and return the count, which is the fast way to
+  // stream.
+  bool Send(const size_t port, const Sample value) {
+    return m_inputs[m_index(port)]->TryPush(value);
+  }
+  size_t Send(const size_t port, const std::span<const Sample> values) {
+    return m_inputs[m_index(port)]->TryPushMany(values);
+  }
+  std::optional<Sample> Receive(const size_t port) {
+    return m_outputs[m_index(port)]->TryPop();
+  }
+  size_t Receive(const size_t port, const std::span<Sample> out) {
+    return m_outputs[m_index(port)]->TryPopMany(out);
+  }
+
+  // CPU side, used by In, Out and Poll.
+  std::optional<Sample> Read(const size_t port) {
+    return m_inputs[m_index(port)]->TryPop();
+  }
+  bool Write(const size_t port, const Sample value) {
+    return m_outputs[m_index(port)]->TryPush(value);
+  }
+  bool Ready(const size_t port) const {
+    return m_inputs[m_index(port)]->Size() != 0;
+  }
+
+  // Pending returns the samples waiting in a port's input channel, Available
+  // those waiting in its output channel.
+  size_t Pending(const size_t port) const {
+    return m_inputs[m_index(port)]->Size();
+  }
+  size_t Available(const size_t port) const {
+    return m_outputs[m_index(port)]->Size();
+  }
+
+  size_t Capacity() const {
+    return m_inputs[0]->Capacity();
+  }
+
+private:
+  // Port numbers wrap, so every word a program can name is a valid port.
+  static constexpr size_t m_index(const size_t port) {
+    return port % Ports;
+  }
+
+  std::array<std::unique_ptr<SPSCQueue<Sample>>, Ports> m_inputs;
+  std::array<std::unique_ptr<SPSCQueue<Sample>>, Ports> m_outputs;
+};
+
+// DeviceBus carries 4 bit samples for the standard machine.
+using DeviceBus = BasicDeviceBus<uint8_t>;
+
+} // namespace cpu
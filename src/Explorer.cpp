@@ -0,0 +1,287 @@
+#include "Explorer.h"
+
+#include "CPUDefs.h"
+#include "Step.h"
+
+#include <algorithm>
+#include <array>
+#include <barrier>
+#include <bit>
+#include <chrono>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+
+namespace cpu {
+
+StateSet::StateSet(const size_t maxStates)
+    : m_maxStates{maxStates},
+      m_mask{std::bit_ceil(std::max<size_t>(maxStates + maxStates / 3, 16)) -
+             1},
+      m_images{std::make_unique<std::atomic<uint64_t>[]>(m_mask + 1)},
+      m_metas{std::make_unique<std::atomic<uint64_t>[]>(m_mask + 1)} {}
+
+StateSet::InsertResult StateSet::Insert(const CPUState& state,
+                                        const uint32_t tag) {
+  const uint64_t packed{uint64_t{Pack(state)} << 32};
+  for (size_t slot = Hash(state) & m_mask;; slot = (slot + 1) & m_mask) {
+    uint64_t meta{m_metas[slot].load(std::memory_order_acquire)};
+    if ((meta & StateMask) == 0) {
+      if (m_size.fetch_add(1, std::memory_order_relaxed) >= m_maxStates) {
+        m_size.fetch_sub(1, std::memory_order_relaxed);
+        return {.Kind = Insertion::Full};
+      }
+      if (m_metas[slot].compare_exchange_strong(meta, Writing | packed | tag,
+                                                std::memory_order_acquire)) {
+        m_images[slot].store(state.Image, std::memory_order_relaxed);
+        m_metas[slot].store(Filled | packed | tag, std::memory_order_release);
+        return {.Kind = Insertion::Inserted, .Tag = tag};
+      }
+      // Another thread claimed the slot first; meta is now its word.
+      m_size.fetch_sub(1, std::memory_order_relaxed);
+    }
+    if ((meta & PackedMask) == packed) {
+      while ((meta & StateMask) == Writing) {
+        meta = m_metas[slot].load(std::memory_order_acquire);
+      }
+      if (m_images[slot].load(std::memory_order_relaxed) == state.Image) {
+        return {.Kind = Insertion::Present, .Tag = static_cast<uint32_t>(meta)};
+      }
+    }
+  }
+}
+
+bool StateSet::Contains(const CPUState& state) const {
+  const uint64_t packed{uint64_t{Pack(state)} << 32};
+  for (size_t slot = Hash(state) & m_mask;; slot = (slot + 1) & m_mask) {
+    uint64_t meta{m_metas[slot].load(std::memory_order_acquire)};
+    if ((meta & StateMask) == 0) {
+      return false;
+    }
+    if ((meta & PackedMask) == packed) {
+      while ((meta & StateMask) == Writing) {
+        meta = m_metas[slot].load(std::memory_order_acquire);
+      }
+      if (m_images[slot].load(std::memory_order_relaxed) == state.Image) {
+        return true;
+      }
+    }
+  }
+}
+
+size_t StateSet::Size() const {
+  return std::min(m_size.load(std::memory_order_relaxed), m_maxStates);
+}
+
+size_t StateSet::MaxStates() const {
+  return m_maxStates;
+}
+
+size_t StateSet::Capacity() const {
+  return m_mask + 1;
+}
+
+size_t StateSet::MemoryBytes() const {
+  return Capacity() * 2 * sizeof(uint64_t);
+}
+
+namespace {
+// A run is followed from each initial state, its root. Until it ends the
+// run has one state, its head, waiting in the frontier.
+struct Head {
+  CPUState state{};
+  uint32_t root{};
+};
+
+enum class End : uint8_t {
+  Open,
+  Halted,
+  Fault,
+  Looping,
+  Merged,   // Reached a state of the run from root into.
+  Truncated // The state set was full.
+};
+
+struct RunEnd {
+  End end{End::Open};
+  uint32_t into{};
+  CPUState final{};
+};
+
+// resolve replaces every Merged end with the end of the run it merged into.
+// Merges can chain, and a chain that comes back on itself is a loop shared
+// by several runs.
+void resolve(std::vector<RunEnd>& ends) {
+  std::vector<uint8_t> onChain(ends.size());
+  std::vector<uint32_t> chain{};
+  for (uint32_t root = 0; root < ends.size(); root++) {
+    chain.clear();
+    uint32_t at{root};
+    bool loops{false};
+    while (ends[at].end == End::Merged) {
+      if (onChain[at]) {
+        loops = true;
+        break;
+      }
+      onChain[at] = 1;
+      chain.push_back(at);
+      at = ends[at].into;
+    }
+    const RunEnd resolved{loops ? RunEnd{.end = End::Looping} : ends[at]};
+    for (const uint32_t member : chain) {
+      ends[member] = resolved;
+    }
+  }
+}
+} // namespace
+
+ExploreReport Explore(const std::span<const CPUState> initial,
+                      const ExploreOptions& options) {
+  using clock = std::chrono::steady_clock;
+  const auto start{clock::now()};
+
+  size_t threads{options.Threads};
+  if (threads == 0) {
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+  threads = std::clamp<size_t>(threads, 1, std::max<size_t>(initial.size(), 1));
+
+  StateSet visited{options.MaxStates};
+  std::vector<RunEnd> ends(initial.size());
+  std::vector<Head> frontier(initial.size());
+  for (uint32_t root = 0; root < initial.size(); root++) {
+    frontier[root] = {.state = initial[root], .root = root};
+  }
+  std::vector<std::vector<Head>> next(threads);
+  std::vector<uint64_t> depths(threads);
+  std::atomic<size_t> cursor{};
+  uint64_t level{0};
+  bool done{initial.empty()};
+
+  // Heads of a level are handed out in chunks. A head that is new to the
+  // set either ends its run or steps into the next level; one that is not
+  // ends the run in a merge or a loop.
+  const auto expand{[&](const Head& head, std::vector<Head>& out,
+                        uint64_t& depth) {
+    RunEnd& runEnd{ends[head.root]};
+    const StateSet::InsertResult insert{visited.Insert(head.state, head.root)};
+    switch (insert.Kind) {
+    case StateSet::Insertion::Full:
+      runEnd.end = End::Truncated;
+      return;
+    case StateSet::Insertion::Present:
+      runEnd.end = insert.Tag == head.root ? End::Looping : End::Merged;
+      runEnd.into = insert.Tag;
+      return;
+    case StateSet::Insertion::Inserted:
+      break;
+    }
+    depth = level;
+    if (head.state.Halted) {
+      runEnd = {.end = End::Halted, .final = head.state};
+      return;
+    }
+    CPUState after{head.state};
+    const uint8_t op{after.Load(uint4(after.Registers[regID::PC])).Raw()};
+    Step(after);
+    if (op > std::to_underlying(OpCode::JumpNZ)) {
+      runEnd = {.end = End::Fault, .final = after};
+      return;
+    }
+    out.push_back({.state = after, .root = head.root});
+  }};
+
+  const auto work{[&](const size_t id, auto&& sync) {
+    constexpr size_t chunk{1024};
+    while (!done) {
+      for (size_t first = cursor.fetch_add(chunk); first < frontier.size();
+           first = cursor.fetch_add(chunk)) {
+        const size_t last{std::min(first + chunk, frontier.size())};
+        for (size_t i = first; i < last; i++) {
+          expand(frontier[i], next[id], depths[id]);
+        }
+      }
+      sync();
+      if (id == 0) {
+        frontier.clear();
+        for (std::vector<Head>& heads : next) {
+          frontier.insert(frontier.end(), heads.begin(), heads.end());
+          heads.clear();
+        }
+        cursor = 0;
+        level++;
+        done = frontier.empty();
+      }
+      sync();
+    }
+  }};
+
+  if (threads == 1) {
+    work(0, [] {});
+  } else {
+    std::barrier<> barrier{static_cast<std::ptrdiff_t>(threads)};
+    const auto sync{[&barrier] { barrier.arrive_and_wait(); }};
+    std::vector<std::jthread> pool{};
+    pool.reserve(threads - 1);
+    for (size_t id = 1; id < threads; id++) {
+      pool.emplace_back([&work, &sync, id] { work(id, sync); });
+    }
+    work(0, sync);
+  }
+
+  resolve(ends);
+
+  ExploreReport report{};
+  report.States = visited.Size();
+  report.Depth = *std::max_element(depths.begin(), depths.end());
+  std::unordered_map<CPUState, uint64_t, CPUStateHash> finals{};
+  for (const RunEnd& runEnd : ends) {
+    switch (runEnd.end) {
+    case End::Halted:
+      report.Halting++;
+      finals[runEnd.final]++;
+      break;
+    case End::Fault:
+      report.Faulting++;
+      finals[runEnd.final]++;
+      break;
+    case End::Looping:
+      report.Looping++;
+      break;
+    default:
+      report.Unresolved++;
+      report.Truncated = true;
+    }
+  }
+  for (const auto& [state, count] : finals) {
+    report.Finals.push_back({.State = state, .Count = count});
+  }
+  std::sort(report.Finals.begin(), report.Finals.end(),
+            [](const FinalState& a, const FinalState& b) {
+              if (a.Count != b.Count) {
+                return a.Count > b.Count;
+              }
+              return std::bit_cast<std::array<uint64_t, 2>>(a.State) <
+                     std::bit_cast<std::array<uint64_t, 2>>(b.State);
+            });
+  report.WallNanos = static_cast<uint64_t>(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() -
+                                                           start)
+          .count());
+  return report;
+}
+
+std::vector<CPUState> EveryValue(const CPUState& program,
+                                 const std::span<const uint4> words) {
+  const size_t count{size_t{1} << (4 * words.size())};
+  std::vector<CPUState> states(count, program);
+  for (size_t i = 0; i < count; i++) {
+    for (size_t w = 0; w < words.size(); w++) {
+      states[i].Store(uint4(static_cast<uint8_t>((i >> (4 * w)) & 0xF)),
+                      words[w]);
+    }
+  }
+  return states;
+}
+
+} // namespace cpu
@@ -0,0 +1,128 @@
+#pragma once
+
+#include "CPUState.h"
+#include "Nibble.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <vector>
+
+namespace cpu {
+
+// StateSet is a fixed-capacity concurrent set of machine states. A state
+// packs into 88 bits: the 64 bit image and 24 bits of registers, ALU
+// result, flags and halt bit. Each slot of the open-addressed table keeps
+// the image in one word and those 24 bits, a 32 bit tag and the slot's
+// fill state in another, 16 bytes in all, and inserts claim slots with a
+// compare-and-swap. A thread that meets a slot claimed by another with the
+// same 24 bits waits only for the image to be stored next to them.
+class StateSet {
+public:
+  enum class Insertion : uint8_t {
+    Inserted,
+    Present,
+    Full // MaxStates states are in the set already.
+  };
+
+  struct InsertResult {
+    Insertion Kind{};
+    uint32_t Tag{}; // Tag the state was inserted with.
+  };
+
+  // The table has room for maxStates states at a load factor of at most
+  // three quarters.
+  explicit StateSet(size_t maxStates);
+
+  // Insert adds state with tag unless an equal state is present already,
+  // and reports the tag of the one in the set either way.
+  InsertResult Insert(const CPUState& state, uint32_t tag);
+  bool Contains(const CPUState& state) const;
+
+  size_t Size() const;
+  size_t MaxStates() const;
+  size_t Capacity() const;
+  // MemoryBytes is the size of the table, which never grows.
+  size_t MemoryBytes() const;
+
+  // Pack and Unpack convert the 24 bits besides the image.
+  static constexpr uint32_t Pack(const CPUState& state) noexcept {
+    return state.Registers[regID::A] | state.Registers[regID::B] << 4 |
+           state.Registers[regID::IS] << 8 | state.Registers[regID::PC] << 12 |
+           state.ALUResult << 16 | state.Flags << 20 | state.Halted << 23;
+  }
+  static constexpr CPUState Unpack(const uint64_t image,
+                                   const uint32_t packed) noexcept {
+    CPUState state{};
+    state.Image = image;
+    state.Registers[regID::A] = packed & 0xF;
+    state.Registers[regID::B] = (packed >> 4) & 0xF;
+    state.Registers[regID::IS] = (packed >> 8) & 0xF;
+    state.Registers[regID::PC] = (packed >> 12) & 0xF;
+    state.ALUResult = (packed >> 16) & 0xF;
+    state.Flags = (packed >> 20) & 0x7;
+    state.Halted = (packed >> 23) & 0x1;
+    return state;
+  }
+
+private:
+  // The meta word holds the fill state in its top two bits, then the packed
+  // bits above the tag.
+  static constexpr uint64_t Writing{uint64_t{1} << 62};
+  static constexpr uint64_t Filled{uint64_t{2} << 62};
+  static constexpr uint64_t StateMask{uint64_t{3} << 62};
+  static constexpr uint64_t PackedMask{uint64_t{0xFFFFFF} << 32};
+
+  size_t m_maxStates{};
+  size_t m_mask{};
+  std::unique_ptr<std::atomic<uint64_t>[]> m_images{};
+  std::unique_ptr<std::atomic<uint64_t>[]> m_metas{};
+  std::atomic<size_t> m_size{};
+};
+
+struct ExploreOptions {
+  size_t Threads{};                  // Zero picks one per hardware thread.
+  size_t MaxStates{size_t{1} << 22}; // Bounds memory at 16 bytes a slot.
+};
+
+// FinalState is a state that runs ended in and how many initial states end
+// there.
+struct FinalState {
+  CPUState State{};
+  uint64_t Count{};
+};
+
+struct ExploreReport {
+  uint64_t States{}; // Distinct states reached, initial ones included.
+  uint64_t Depth{};  // Largest distance of a state from the initial ones.
+  // Initial states by how their runs end. A run halts, faults on an
+  // unknown opcode, or loops when it reaches a state it passed before.
+  // Runs cut short by MaxStates are unresolved.
+  uint64_t Halting{};
+  uint64_t Faulting{};
+  uint64_t Looping{};
+  uint64_t Unresolved{};
+  bool Truncated{}; // The state set filled up before the search ended.
+  // Distinct final states of halting and faulting runs, most common first.
+  // A faulting run ends after its unknown opcode, like RunBounded.
+  std::vector<FinalState> Finals{};
+  uint64_t WallNanos{};
+};
+
+// Explore runs a breadth-first search over every state reachable from the
+// initial states with Step semantics. Each level of the search is split
+// between the threads, and a run stops being followed as soon as it reaches
+// a state another run or an earlier level has visited; what happens after
+// that is resolved once the search is done. There may be up to 2^32 initial
+// states.
+ExploreReport Explore(std::span<const CPUState> initial,
+                      const ExploreOptions& options = {});
+
+// EveryValue returns program with every combination of values in words,
+// the first of them varying fastest.
+std::vector<CPUState> EveryValue(const CPUState& program,
+                                 std::span<const uint4> words);
+
+} // namespace cpu
@@ -0,0 +1,504 @@
+#include "Fuzzer.h"
+
+#include "BatchCPU.h"
+#include "BlockCPU.h"
+#include "CPU.h"
+#include "DecodedCPU.h"
+#include "JitCPU.h"
+#include "Step.h"
+
+#include <algorithm>
+#include <bit>
+#include <utility>
+
+namespace cpu::fuzz {
+
+namespace {
+using Batch = BatchCPU<Fuzzer::BatchSize>;
+
+// counted is the outcome of an engine that only counts cycles. lastOp is
+// the opcode word of the last instruction run, which faulted if it is
+// outside the instruction set; IS cannot tell, since Mov may write it.
+Outcome counted(const CPUState& final, const uint64_t cycles,
+                const uint8_t lastOp) {
+  RunStatus status{RunStatus::BudgetExhausted};
+  if (final.Halted) {
+    status = RunStatus::Halted;
+  } else if (cycles > 0 && lastOp > std::to_underlying(OpCode::JumpNZ)) {
+    status = RunStatus::Fault;
+  }
+  return {.Final = final, .Result = {.Status = status, .Cycles = cycles}};
+}
+
+uint8_t nextOp(const CPUState& state) {
+  return state.Load(uint4(state.Registers[regID::PC])).Raw();
+}
+
+// runCounted runs cycles instructions on cpu, the last one on its own so
+// its opcode can be read first.
+template <typename Machine>
+Outcome runCounted(Machine& cpu, const uint64_t cycles) {
+  if (cycles == 0) {
+    return counted(cpu.GetState(), 0, 0);
+  }
+  uint64_t ran{cpu.Run(cycles - 1)};
+  const uint8_t lastOp{nextOp(cpu.GetState())};
+  if (ran == cycles - 1) {
+    ran += cpu.Run(1);
+  }
+  return counted(cpu.GetState(), ran, lastOp);
+}
+
+// Lane is a single machine of a batch, for runCounted.
+struct Lane {
+  Batch batch{};
+
+  uint64_t Run(const uint64_t cycles) {
+    const uint64_t before{batch.Cycles(0)};
+    batch.Run(cycles);
+    return batch.Cycles(0) - before;
+  }
+  CPUState GetState() const {
+    return batch.Get(0);
+  }
+};
+
+// Fields Minimise shrinks: the memory words, then A, B, IS, PC, the ALU
+// result and the flags.
+constexpr size_t fieldCount{MemSizeWords + 6};
+
+uint8_t getField(const CPUState& state, const size_t field) {
+  if (field < MemSizeWords) {
+    return state.Load(uint4(static_cast<uint8_t>(field))).Raw();
+  }
+  switch (field - MemSizeWords) {
+  case 4:
+    return state.ALUResult;
+  case 5:
+    return state.Flags;
+  default:
+    return state.Registers[field - MemSizeWords];
+  }
+}
+
+void setField(CPUState& state, const size_t field, const uint8_t value) {
+  if (field < MemSizeWords) {
+    state.Store(uint4(value), uint4(static_cast<uint8_t>(field)));
+    return;
+  }
+  switch (field - MemSizeWords) {
+  case 4:
+    state.ALUResult = value;
+    break;
+  case 5:
+    state.Flags = value;
+    break;
+  default:
+    state.Registers[field - MemSizeWords] = value;
+  }
+}
+
+// sizeOf orders candidates for Minimise: fewer non-zero fields first, then
+// smaller values.
+std::pair<size_t, size_t> sizeOf(const CPUState& state) {
+  std::pair<size_t, size_t> size{};
+  for (size_t field = 0; field < fieldCount; field++) {
+    const uint8_t value{getField(state, field)};
+    size.first += value != 0 ? 1 : 0;
+    size.second += value;
+  }
+  return size;
+}
+
+// deleteWords removes count words from addr on and moves the ones above
+// them down, filling the top of memory with zeros.
+CPUState deleteWords(CPUState state, const uint8_t addr, const uint8_t count) {
+  for (uint8_t to = addr; to < MemSizeWords; to++) {
+    const uint8_t from{static_cast<uint8_t>(to + count)};
+    state.Store(from < MemSizeWords ? state.Load(uint4(from)) : uint4(0),
+                uint4(to));
+  }
+  return state;
+}
+
+// storeSelf writes LoadAI value; StoreA target from addr on, so the program
+// patches one of its own words when it gets there.
+void storeSelf(CPUState& state, const uint4 addr, const uint4 value,
+               const uint4 target) {
+  state.Store(uint4(std::to_underlying(OpCode::LoadAI)), addr);
+  state.Store(value, addr + uint4(1));
+  state.Store(uint4(std::to_underlying(OpCode::StoreA)), addr + uint4(2));
+  state.Store(target, addr + uint4(3));
+}
+} // namespace
+
+std::string_view EngineName(const Engine engine) {
+  switch (engine) {
+  case Engine::TableALU:
+    return "table-alu";
+  case Engine::Step:
+    return "step";
+  case Engine::Decoded:
+    return "decoded";
+  case Engine::Block:
+    return "block";
+  case Engine::Batch:
+    return "batch";
+#if CPU4_JIT
+  case Engine::Jit:
+    return "jit";
+#endif
+  }
+  return "unknown";
+}
+
+bool Coverage::Merge(const Coverage& other) {
+  bool added{(other.OpCodes & ~OpCodes) != 0 ||
+             (other.Branches & ~Branches) != 0 ||
+             (other.Writes & ~Writes) != 0 ||
+             (other.Statuses & ~Statuses) != 0};
+  OpCodes |= other.OpCodes;
+  Branches |= other.Branches;
+  Writes |= other.Writes;
+  Statuses |= other.Statuses;
+  for (size_t i = 0; i < Edges.size(); i++) {
+    added = added || (other.Edges[i] & ~Edges[i]) != 0;
+    Edges[i] |= other.Edges[i];
+  }
+  for (size_t i = 0; i < ALUFlags.size(); i++) {
+    added = added || (other.ALUFlags[i] & ~ALUFlags[i]) != 0;
+    ALUFlags[i] |= other.ALUFlags[i];
+  }
+  return added;
+}
+
+size_t Coverage::Count() const {
+  size_t count = std::popcount(OpCodes) + std::popcount(Branches) +
+                 std::popcount(Writes) + std::popcount(Statuses);
+  for (const uint64_t edges : Edges) {
+    count += std::popcount(edges);
+  }
+  for (const uint8_t flags : ALUFlags) {
+    count += std::popcount(flags);
+  }
+  return count;
+}
+
+Outcome Reference(const CPUState& input, const uint64_t budget,
+                  Coverage* coverage) {
+  BasicCPU<CoverageProbe> cpu{input};
+  cpu.SetALUBackend(alu::Backend::RippleCarry);
+  const RunResult result{cpu.Run(budget)};
+  if (coverage != nullptr) {
+    *coverage = cpu.GetProbe().Hits;
+    coverage->Statuses |= static_cast<uint8_t>(
+        1u << std::to_underlying(result.Status));
+  }
+  return {.Final = cpu.GetState(), .Result = result};
+}
+
+Outcome RunEngine(const Engine engine, const CPUState& input,
+                  const uint64_t budget, const Outcome& expected,
+                  TranslationCache& cache) {
+  const uint64_t cycles{expected.Result.Cycles};
+  switch (engine) {
+  case Engine::TableALU: {
+    CPU cpu{input};
+    cpu.SetALUBackend(alu::Backend::Table);
+    const RunResult result{cpu.Run(budget)};
+    return {.Final = cpu.GetState(), .Result = result};
+  }
+  case Engine::Step: {
+    CPUState state{input};
+    const RunResult result{RunBounded(state, budget)};
+    return {.Final = state, .Result = result};
+  }
+  case Engine::Decoded: {
+    DecodedCPU cpu{input};
+    return runCounted(cpu, cycles);
+  }
+  case Engine::Block: {
+    BlockCPU cpu{input, cache};
+    return runCounted(cpu, cycles);
+  }
+  case Engine::Batch: {
+    // Lane 0 takes the vector path when the batch has one.
+    Lane lane{};
+    lane.batch.Load(0, input);
+    return runCounted(lane, cycles);
+  }
+#if CPU4_JIT
+  case Engine::Jit: {
+    JitCPU cpu{input};
+    const RunResult result{cpu.Run(budget)};
+    return {.Final = cpu.GetState(), .Result = result};
+  }
+#endif
+  }
+  return {};
+}
+
+std::optional<Divergence> Check(const CPUState& input, const uint64_t budget) {
+  TranslationCache cache{16};
+  const Outcome expected{Reference(input, budget)};
+  for (size_t e = 0; e < EngineCount; e++) {
+    const auto engine{static_cast<Engine>(e)};
+    const Outcome actual{RunEngine(engine, input, budget, expected, cache)};
+    if (actual != expected) {
+      return Divergence{.Failing = engine,
+                        .Input = input,
+                        .Original = input,
+                        .Expected = expected,
+                        .Actual = actual};
+    }
+  }
+  return std::nullopt;
+}
+
+CPUState Minimise(CPUState input,
+                  const std::function<bool(const CPUState&)>& diverges) {
+  // Each pass tries deleting every word and every pair of words, which
+  // takes out a whole instruction, and lowering every field, and keeps
+  // each change that still diverges and makes the candidate smaller. Size
+  // only goes down, so this ends.
+  bool shrunk{true};
+  const auto tryCandidate{[&](const CPUState& candidate) {
+    if (sizeOf(candidate) < sizeOf(input) && diverges(candidate)) {
+      input = candidate;
+      shrunk = true;
+      return true;
+    }
+    return false;
+  }};
+
+  while (shrunk) {
+    shrunk = false;
+    for (uint8_t count = 2; count >= 1; count--) {
+      for (uint8_t addr = 0; addr < MemSizeWords; addr++) {
+        tryCandidate(deleteWords(input, addr, count));
+      }
+    }
+    for (size_t field = 0; field < fieldCount; field++) {
+      for (uint8_t smaller = 0; smaller < getField(input, field); smaller++) {
+        CPUState candidate{input};
+        setField(candidate, field, smaller);
+        if (tryCandidate(candidate)) {
+          break;
+        }
+      }
+    }
+  }
+  return input;
+}
+
+Fuzzer::Fuzzer(FuzzOptions options)
+    : m_options{options}, m_seed{options.Seed}, m_cache{1024} {}
+
+std::vector<Divergence> Fuzzer::Run(const uint64_t programs) {
+  std::vector<Divergence> found{};
+  const uint64_t budget{m_options.Budget};
+
+  for (uint64_t done = 0; done < programs;) {
+    const size_t count{
+        static_cast<size_t>(std::min<uint64_t>(BatchSize, programs - done))};
+
+    for (size_t i = 0; i < count; i++) {
+      m_inputs[i] = m_candidate();
+      Coverage reached{};
+      m_expected[i] = Reference(m_inputs[i], budget, &reached);
+      m_stats.Cycles += m_expected[i].Result.Cycles;
+      if (m_coverage.Merge(reached)) {
+        if (m_corpus.size() < m_options.MaxCorpus) {
+          m_corpus.push_back(m_inputs[i]);
+        } else if (!m_corpus.empty()) {
+          m_corpus[m_next() % m_corpus.size()] = m_inputs[i];
+        }
+      }
+    }
+
+    for (size_t e = 0; e < EngineCount; e++) {
+      const auto engine{static_cast<Engine>(e)};
+      if (engine == Engine::Batch) {
+        continue;
+      }
+      for (size_t i = 0; i < count; i++) {
+        const Outcome actual{
+            RunEngine(engine, m_inputs[i], budget, m_expected[i], m_cache)};
+        if (actual != m_expected[i]) {
+          m_report(engine, i, actual, found);
+        }
+      }
+    }
+
+    // The whole batch shares one BatchCPU. Each lane is read back once it
+    // has run as many cycles as the reference did, and its last opcode just
+    // before that.
+    Batch batch{};
+    std::array<uint8_t, BatchSize> lastOps{};
+    uint64_t longest{0};
+    for (size_t i = 0; i < count; i++) {
+      batch.Load(i, m_inputs[i]);
+      longest = std::max(longest, m_expected[i].Result.Cycles);
+    }
+    for (uint64_t step = 0;; step++) {
+      for (size_t i = 0; i < count; i++) {
+        const uint64_t cycles{m_expected[i].Result.Cycles};
+        if (cycles == step + 1) {
+          lastOps[i] = nextOp(batch.Get(i));
+        } else if (cycles == step) {
+          const Outcome actual{
+              counted(batch.Get(i), batch.Cycles(i), lastOps[i])};
+          if (actual != m_expected[i]) {
+            m_report(Engine::Batch, i, actual, found);
+          }
+        }
+      }
+      if (step == longest) {
+        break;
+      }
+      batch.Cycle();
+    }
+
+    done += count;
+    m_stats.Programs += count;
+  }
+  return found;
+}
+
+const Coverage& Fuzzer::GetCoverage() const {
+  return m_coverage;
+}
+
+const std::vector<CPUState>& Fuzzer::GetCorpus() const {
+  return m_corpus;
+}
+
+FuzzStats Fuzzer::GetStats() const {
+  FuzzStats stats{m_stats};
+  stats.Corpus = m_corpus.size();
+  stats.Coverage = m_coverage.Count();
+  return stats;
+}
+
+// m_next is splitmix64.
+uint64_t Fuzzer::m_next() {
+  return SplitMix64(m_seed);
+}
+
+// m_candidate makes a fresh random machine one time in eight, and otherwise
+// mutates a corpus entry one to four times.
+CPUState Fuzzer::m_candidate() {
+  const uint64_t choice{m_next()};
+  if (m_corpus.empty() || choice % 8 == 0) {
+    CPUState state{};
+    state.Image = m_next();
+    const uint64_t bits{m_next()};
+    if (choice & 0x10) {
+      storeSelf(state, uint4(static_cast<uint8_t>(bits)),
+                uint4(static_cast<uint8_t>(bits >> 4)),
+                uint4(static_cast<uint8_t>(bits >> 8)));
+    }
+    if (choice & 0x20) {
+      state.Registers[regID::A] = (bits >> 12) & 0xF;
+      state.Registers[regID::B] = (bits >> 16) & 0xF;
+      state.Registers[regID::PC] = (bits >> 20) & 0xF;
+      state.ALUResult = (bits >> 24) & 0xF;
+      state.Flags = (bits >> 28) & 0x7;
+    }
+    return state;
+  }
+
+  CPUState state{m_corpus[m_next() % m_corpus.size()]};
+  const uint64_t mutations{1 + (choice >> 8) % 4};
+  for (uint64_t i = 0; i < mutations; i++) {
+    m_mutate(state);
+  }
+  return state;
+}
+
+void Fuzzer::m_mutate(CPUState& state) {
+  const uint64_t bits{m_next()};
+  const uint4 addr{static_cast<uint8_t>(bits >> 8)};
+  const uint4 value{static_cast<uint8_t>(bits >> 12)};
+  const uint4 other{static_cast<uint8_t>(bits >> 16)};
+
+  switch (bits % 8) {
+  case 0: // Set a word.
+    state.Store(value, addr);
+    break;
+  case 1: // Flip a bit.
+    state.Store(uint4(static_cast<uint8_t>(state.Load(addr).Raw() ^
+                                         (1u << (value.Raw() % 4)))),
+                addr);
+    break;
+  case 2: // Write an instruction with its operand.
+    state.Store(value, addr);
+    state.Store(other, addr + uint4(1));
+    break;
+  case 3: // Patch a word of the program from the program.
+    storeSelf(state, addr, value, other);
+    break;
+  case 4: { // Swap two words.
+    const uint4 word{state.Load(addr)};
+    state.Store(state.Load(other), addr);
+    state.Store(word, other);
+    break;
+  }
+  case 5: { // Splice in four words from another corpus entry.
+    const CPUState& donor{m_corpus[m_next() % m_corpus.size()]};
+    for (uint8_t i = 0; i < 4; i++) {
+      const uint4 at{addr + uint4(i)};
+      state.Store(donor.Load(at), at);
+    }
+    break;
+  }
+  case 6: // Set a register, the ALU result or the flags.
+    switch (other.Raw() % 5) {
+    case 0:
+      state.Registers[regID::A] = value.Raw();
+      break;
+    case 1:
+      state.Registers[regID::B] = value.Raw();
+      break;
+    case 2:
+      state.Registers[regID::PC] = value.Raw();
+      break;
+    case 3:
+      state.ALUResult = value.Raw();
+      break;
+    default:
+      state.Flags = value.Raw() & 0x7;
+    }
+    break;
+  default: // Rotate the image by one word.
+    state.Image = std::rotl(state.Image, 4);
+  }
+}
+
+// m_report minimises a divergence and adds it to found. A divergence that
+// does not reproduce on its own, which only a batch can cause, is reported
+// as found.
+void Fuzzer::m_report(const Engine engine, const size_t index,
+                      const Outcome& actual, std::vector<Divergence>& found) {
+  m_stats.Divergences++;
+  const uint64_t budget{m_options.Budget};
+  const auto diverges{[&](const CPUState& state) {
+    const Outcome expected{Reference(state, budget)};
+    return RunEngine(engine, state, budget, expected, m_cache) != expected;
+  }};
+
+  Divergence divergence{.Failing = engine,
+                        .Input = m_inputs[index],
+                        .Original = m_inputs[index],
+                        .Expected = m_expected[index],
+                        .Actual = actual};
+  if (diverges(divergence.Input)) {
+    divergence.Input = Minimise(divergence.Input, diverges);
+    divergence.Expected = Reference(divergence.Input, budget);
+    divergence.Actual = RunEngine(engine, divergence.Input, budget,
+                                  divergence.Expected, m_cache);
+  }
+  found.push_back(divergence);
+}
+
+} // namespace cpu::fuzz
@@ -0,0 +1,177 @@
+#pragma once
+
+#include "ALU.h"
+#include "CPUDefs.h"
+#include "CPUState.h"
+#include "JitCPU.h"
+#include "Nibble.h"
+#include "RunResult.h"
+#include "TranslationCache.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <string_view>
+#include <vector>
+
+// The differential fuzzer checks the fast execution paths against the
+// reference interpreter, a CPU with the ripple-carry ALU. A candidate is a
+// whole initial CPUState; it runs on the reference and on every engine, and
+// any difference in final state, cycle count or run status is a divergence.
+// Candidates are random images and mutations of earlier candidates that
+// reached new coverage, many of them storing into their own code.
+//
+// The reference reports unknown opcodes on std::cerr like any CPU, so
+// callers running large campaigns silence it first.
+namespace cpu::fuzz {
+
+// Engine is an execution path checked against the reference.
+enum class Engine : uint8_t {
+  TableALU, // CPU with the table ALU backend.
+  Step,     // RunBounded on a packed CPUState.
+  Decoded,  // DecodedCPU.
+  Block,    // BlockCPU with its own translation cache.
+  Batch,    // BatchCPU, one lane per candidate.
+#if CPU4_JIT
+  Jit // JitCPU, where it compiles to native code.
+#endif
+};
+
+inline constexpr size_t EngineCount{CPU4_JIT ? 6 : 5};
+
+std::string_view EngineName(Engine engine);
+
+// Coverage is the set of behaviours a run reached, one bit each.
+struct Coverage {
+  uint16_t OpCodes{};                // Opcode words fetched.
+  std::array<uint64_t, 4> Edges{};   // Instruction pairs, bit from * 16 + to.
+  uint8_t Branches{};                // JumpZ then JumpNZ, not taken and taken.
+  std::array<uint8_t, 2> ALUFlags{}; // Add and Sub by alu::PackFlags value.
+  uint16_t Writes{};                 // Addresses stored to.
+  uint8_t Statuses{};                // RunStatus of whole runs.
+
+  // Merge adds the bits of other and returns true when any of them is new.
+  bool Merge(const Coverage& other);
+  size_t Count() const;
+};
+
+// CoverageProbe records Coverage from the hooks of a BasicCPU.
+struct CoverageProbe {
+  static constexpr uint8_t NoPrevious{0xFF};
+
+  Coverage Hits{};
+  uint8_t Previous{NoPrevious}; // Address of the last instruction fetched.
+
+  constexpr void Fetch(const uint4 pc, const uint4 opcode) noexcept {
+    Hits.OpCodes |= static_cast<uint16_t>(1u << opcode.Raw());
+    if (Previous != NoPrevious) {
+      const unsigned edge{Previous * 16u + pc.Raw()};
+      Hits.Edges[edge / 64] |= uint64_t{1} << (edge % 64);
+    }
+    Previous = pc.Raw();
+  }
+  constexpr void Read(uint4) noexcept {}
+  constexpr void Write(const uint4 addr, uint4) noexcept {
+    Hits.Writes |= static_cast<uint16_t>(1u << addr.Raw());
+  }
+  constexpr void Branch(const OpCode op, const bool taken) noexcept {
+    const unsigned bit{(op == OpCode::JumpZ ? 0u : 2u) + (taken ? 1u : 0u)};
+    Hits.Branches |= static_cast<uint8_t>(1u << bit);
+  }
+  constexpr void ALU(const OpCode op, const alu::Flags& flags) noexcept {
+    Hits.ALUFlags[op == OpCode::Add ? 0 : 1] |=
+        static_cast<uint8_t>(1u << alu::PackFlags(flags));
+  }
+};
+
+// Outcome is where a run ended and why.
+struct Outcome {
+  CPUState Final{};
+  RunResult Result{};
+
+  bool operator==(const Outcome&) const = default;
+};
+
+struct Divergence {
+  Engine Failing{};
+  CPUState Input{};    // Minimised candidate.
+  CPUState Original{}; // Candidate as generated.
+  Outcome Expected{};  // Reference run of Input.
+  Outcome Actual{};    // Failing engine run of Input.
+};
+
+// Reference runs input on the reference interpreter for at most budget
+// cycles, adding what it reached to coverage when that is not null.
+Outcome Reference(const CPUState& input, uint64_t budget,
+                  Coverage* coverage = nullptr);
+
+// RunEngine runs input on engine the way Check compares it with expected,
+// the reference outcome. Engines whose Run only counts cycles run exactly
+// as many as the reference did, and their status is read off the final
+// state.
+Outcome RunEngine(Engine engine, const CPUState& input, uint64_t budget,
+                  const Outcome& expected, TranslationCache& cache);
+
+// Check runs input on the reference and every engine and returns the first
+// divergence, not minimised.
+std::optional<Divergence> Check(const CPUState& input, uint64_t budget);
+
+// Minimise shrinks input for as long as diverges stays true, deleting words
+// and lowering words and registers towards zero. input must diverge to begin
+// with.
+CPUState Minimise(CPUState input,
+                  const std::function<bool(const CPUState&)>& diverges);
+
+struct FuzzOptions {
+  uint64_t Seed{1};
+  uint64_t Budget{64};    // Cycles per candidate.
+  size_t MaxCorpus{4096}; // Candidates kept for mutation.
+};
+
+struct FuzzStats {
+  uint64_t Programs{};
+  uint64_t Cycles{}; // Reference cycles.
+  uint64_t Divergences{};
+  size_t Corpus{};
+  size_t Coverage{}; // Coverage bits reached.
+};
+
+// Fuzzer runs a coverage-guided campaign on one thread. Candidates go
+// through the engines a batch at a time, so the batch engine runs many of
+// them side by side. Independent fuzzers with different seeds may run on
+// separate threads.
+class Fuzzer {
+public:
+  static constexpr size_t BatchSize{32};
+
+  explicit Fuzzer(FuzzOptions options = {});
+
+  // Run checks programs candidates and returns the divergences found among
+  // them, minimised.
+  std::vector<Divergence> Run(uint64_t programs);
+
+  const Coverage& GetCoverage() const;
+  const std::vector<CPUState>& GetCorpus() const;
+  FuzzStats GetStats() const;
+
+private:
+  FuzzOptions m_options{};
+  uint64_t m_seed{};
+  TranslationCache m_cache;
+  Coverage m_coverage{};
+  std::vector<CPUState> m_corpus{};
+  FuzzStats m_stats{};
+
+  std::array<CPUState, BatchSize> m_inputs{};
+  std::array<Outcome, BatchSize> m_expected{};
+
+  uint64_t m_next();
+  CPUState m_candidate();
+  void m_mutate(CPUState& state);
+  void m_report(Engine engine, size_t index, const Outcome& actual,
+                std::vector<Divergence>& found);
+};
+
+} // namespace cpu::fuzz
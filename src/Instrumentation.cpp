@@ -0,0 +1,117 @@
+#include "Instrumentation.h"
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <utility>
+
+namespace cpu {
+
+namespace {
+
+// opcodeKey names an opcode word, or gives it in hex when it is unknown.
+std::string opcodeKey(const size_t word) {
+  if (word <= std::to_underlying(OpCode::Poll)) {
+    return std::string{OpCodeName(static_cast<OpCode>(word))};
+  }
+  constexpr std::string_view digits{"0123456789ABCDEF"};
+  return std::string{"0x"} + digits[word];
+}
+
+// flagsKey lists the set flags as O, Z and N, or "-" when none are set.
+std::string flagsKey(const size_t packed) {
+  std::string key{};
+  if (packed & flagBit::Overflow) {
+    key += 'O';
+  }
+  if (packed & flagBit::Zero) {
+    key += 'Z';
+  }
+  if (packed & flagBit::Negative) {
+    key += 'N';
+  }
+  return key.empty() ? "-" : key;
+}
+
+template <size_t N>
+void writeArray(std::ostream& out, const std::array<uint64_t, N>& counts) {
+  out << '[';
+  for (size_t i = 0; i < N; i++) {
+    out << (i ? ", " : "") << counts[i];
+  }
+  out << ']';
+}
+
+void writeFlags(std::ostream& out, const std::array<uint64_t, 8>& counts) {
+  out << '{';
+  for (size_t i = 0; i < counts.size(); i++) {
+    out << (i ? ", " : "") << '"' << flagsKey(i) << "\": " << counts[i];
+  }
+  out << '}';
+}
+
+void writeBranch(std::ostream& out, const ExecutionStats::BranchCounts& b) {
+  out << "{\"taken\": " << b.Taken << ", \"not_taken\": " << b.NotTaken
+      << '}';
+}
+
+} // namespace
+
+void ExecutionStats::Clear() {
+  *this = {};
+}
+
+void PairCounts::Clear() {
+  *this = {};
+}
+
+void WriteJSON(std::ostream& out, const ExecutionStats& stats) {
+  out << "{\n  \"opcodes\": {";
+  for (size_t i = 0; i < stats.OpCodes.size(); i++) {
+    out << (i ? ", " : "") << '"' << opcodeKey(i)
+        << "\": " << stats.OpCodes[i];
+  }
+  out << "},\n  \"pc\": ";
+  writeArray(out, stats.PC);
+  out << ",\n  \"reads\": ";
+  writeArray(out, stats.Reads);
+  out << ",\n  \"writes\": ";
+  writeArray(out, stats.Writes);
+  out << ",\n  \"branches\": {\"JumpZ\": ";
+  writeBranch(out, stats.JumpZ);
+  out << ", \"JumpNZ\": ";
+  writeBranch(out, stats.JumpNZ);
+  out << "},\n  \"alu_flags\": {\"Add\": ";
+  writeFlags(out, stats.AddFlags);
+  out << ", \"Sub\": ";
+  writeFlags(out, stats.SubFlags);
+  out << "}\n}\n";
+}
+
+void WriteCSV(std::ostream& out, const ExecutionStats& stats) {
+  out << "kind,key,count\n";
+  for (size_t i = 0; i < stats.OpCodes.size(); i++) {
+    out << "opcode," << opcodeKey(i) << ',' << stats.OpCodes[i] << '\n';
+  }
+  for (size_t i = 0; i < MemSizeWords; i++) {
+    out << "pc," << i << ',' << stats.PC[i] << '\n';
+  }
+  for (size_t i = 0; i < MemSizeWords; i++) {
+    out << "read," << i << ',' << stats.Reads[i] << '\n';
+  }
+  for (size_t i = 0; i < MemSizeWords; i++) {
+    out << "write," << i << ',' << stats.Writes[i] << '\n';
+  }
+  out << "branch,JumpZ.taken," << stats.JumpZ.Taken << '\n'
+      << "branch,JumpZ.not_taken," << stats.JumpZ.NotTaken << '\n'
+      << "branch,JumpNZ.taken," << stats.JumpNZ.Taken << '\n'
+      << "branch,JumpNZ.not_taken," << stats.JumpNZ.NotTaken << '\n';
+  for (size_t i = 0; i < stats.AddFlags.size(); i++) {
+    out << "alu,Add." << flagsKey(i) << ',' << stats.AddFlags[i] << '\n';
+  }
+  for (size_t i = 0; i < stats.SubFlags.size(); i++) {
+    out << "alu,Sub." << flagsKey(i) << ',' << stats.SubFlags[i] << '\n';
+  }
+}
+
+} // namespace cpu
@@ -0,0 +1,139 @@
+#pragma once
+
+#include "ALU.h"
+#include "CPUDefs.h"
+#include "Nibble.h"
+
+#include <array>
+#include <cstdint>
+#include <ostream>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace cpu {
+
+// A probe is the instrumentation policy of a BasicCPU. The CPU calls its
+// hooks from Cycle:
+//   Fetch(pc, opcode)    once per instruction, with the address it started at
+//   Read(addr)           for each data load (LoadA, LoadB)
+//   Write(addr, value)   for each data store (StoreA)
+//   Branch(op, taken)    for JumpZ and JumpNZ
+//   ALU(op, flags)       after Add and Sub, with the flags they produced
+// Operand and instruction fetches are not reads; Fetch covers them.
+
+// NullProbe records nothing. Its hooks are empty and it takes no space, so a
+// CPU built with it compiles to the uninstrumented hot path. It accepts words
+// of any width; the other probes are written for the standard machine.
+struct NullProbe {
+  constexpr void Fetch(auto, auto) noexcept {}
+  constexpr void Read(auto) noexcept {}
+  constexpr void Write(auto, auto) noexcept {}
+  constexpr void Branch(OpCode, bool) noexcept {}
+  constexpr void ALU(OpCode, const alu::Flags&) noexcept {}
+};
+
+static_assert(std::is_empty_v<NullProbe>);
+
+// ExecutionStats counts where a CPU spends its cycles.
+struct ExecutionStats {
+  struct BranchCounts {
+    uint64_t Taken{};
+    uint64_t NotTaken{};
+  };
+
+  std::array<uint64_t, 16> OpCodes{}; // By opcode word, unknown ones included.
+  std::array<uint64_t, MemSizeWords> PC{};
+  std::array<uint64_t, MemSizeWords> Reads{};
+  std::array<uint64_t, MemSizeWords> Writes{};
+  BranchCounts JumpZ{};
+  BranchCounts JumpNZ{};
+  // Flag outcomes by alu::PackFlags value.
+  std::array<uint64_t, 8> AddFlags{};
+  std::array<uint64_t, 8> SubFlags{};
+
+  constexpr void Fetch(const uint4 pc, const uint4 opcode) noexcept {
+    OpCodes[opcode.Raw()]++;
+    PC[pc.Raw()]++;
+  }
+  constexpr void Read(const uint4 addr) noexcept {
+    Reads[addr.Raw()]++;
+  }
+  constexpr void Write(const uint4 addr, uint4) noexcept {
+    Writes[addr.Raw()]++;
+  }
+  constexpr void Branch(const OpCode op, const bool taken) noexcept {
+    BranchCounts& counts{op == OpCode::JumpZ ? JumpZ : JumpNZ};
+    (taken ? counts.Taken : counts.NotTaken)++;
+  }
+  constexpr void ALU(const OpCode op, const alu::Flags& flags) noexcept {
+    (op == OpCode::Add ? AddFlags : SubFlags)[alu::PackFlags(flags)]++;
+  }
+
+  void Clear();
+};
+
+// PairCounts counts adjacent instruction pairs: an instruction followed by
+// the one that starts right after it, as the decoder would fuse them. Pairs
+// split by a taken branch are not counted.
+struct PairCounts {
+  // Counts by first opcode << 4 | second opcode.
+  std::array<uint64_t, 256> Pairs{};
+
+  constexpr void Fetch(const uint4 pc, const uint4 opcode) noexcept {
+    if (m_fetched && pc == m_fallThrough) {
+      Pairs[m_previous << 4 | opcode.Raw()]++;
+    }
+    const bool oneWord{opcode == std::to_underlying(OpCode::Halt) ||
+                       opcode > std::to_underlying(OpCode::JumpNZ)};
+    m_previous = opcode.Raw();
+    m_fallThrough = pc + uint4(oneWord ? 1 : 2);
+    m_fetched = true;
+  }
+  constexpr void Read(uint4) noexcept {}
+  constexpr void Write(uint4, uint4) noexcept {}
+  constexpr void Branch(OpCode, bool) noexcept {}
+  constexpr void ALU(OpCode, const alu::Flags&) noexcept {}
+
+  constexpr uint64_t Count(const OpCode first, const OpCode second) const {
+    return Pairs[std::to_underlying(first) << 4 | std::to_underlying(second)];
+  }
+
+  void Clear();
+
+private:
+  uint8_t m_previous{};
+  uint4 m_fallThrough{};
+  bool m_fetched{};
+};
+
+// StoreLog records every data store with the cycle that made it. Cycle counts
+// fetches, so a store logged with cycle c is visible from the state after c
+// steps. Owners that rewind the CPU reset Cycle to match.
+struct StoreLog {
+  struct Entry {
+    uint64_t Cycle{};
+    uint4 Addr{};
+    uint4 Value{};
+  };
+
+  uint64_t Cycle{};
+  std::vector<Entry> Entries{};
+
+  constexpr void Fetch(uint4, uint4) noexcept {
+    Cycle++;
+  }
+  constexpr void Read(uint4) noexcept {}
+  constexpr void Write(const uint4 addr, const uint4 value) {
+    Entries.push_back({Cycle, addr, value});
+  }
+  constexpr void Branch(OpCode, bool) noexcept {}
+  constexpr void ALU(OpCode, const alu::Flags&) noexcept {}
+};
+
+// WriteJSON and WriteCSV export collected stats. The CSV has one
+// "kind,key,count" row per counter.
+void WriteJSON(std::ostream& out, const ExecutionStats& stats);
+void WriteCSV(std::ostream& out, const ExecutionStats& stats);
+
+} // namespace cpu
@@ -0,0 +1,698 @@
+#include "JitCPU.h"
+
+#include "ALUTables.h"
+#include "CPUDefs.h"
+#include "CPUState.h"
+#include "Nibble.h"
+#include "RunResult.h"
+#include "Step.h"
+#include "TranslationCache.h"
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <new>
+#include <utility>
+#include <vector>
+
+#if CPU4_JIT
+#include <sys/mman.h>
+#endif
+
+namespace cpu {
+
+namespace {
+// Why compiled code returned to the host.
+enum class Exit : uint32_t {
+  Budget,   // Too few cycles left for the next block; PC is its start.
+  Halted,   // Ran Halt.
+  Fault,    // Ran an unknown opcode.
+  Dispatch, // Mov into PC; the host finds the code for the new PC.
+  Guard     // A store rewrote a code word; PC is after the store.
+};
+
+// Interpreted stretches after a guard exit start at minBackoff cycles and
+// double up to maxBackoff. A native run of maxBackoff cycles resets them.
+constexpr uint64_t minBackoff{16};
+constexpr uint64_t maxBackoff{4096};
+
+#if CPU4_JIT
+// Translations are copied into the arena until the next one does not fit,
+// and the arena is then emptied. A translation of 16 blocks of 16 ops, each
+// with its own exits, stays well under 64 KiB.
+constexpr size_t arenaBytes{size_t{1} << 20};
+
+// The Add table followed by the Sub table, so compiled code reaches both
+// from one base register.
+alignas(64) constexpr std::array<uint8_t, 512> aluTables{[] {
+  std::array<uint8_t, 512> tables{};
+  std::copy(alu::AddTable.begin(), alu::AddTable.end(), tables.begin());
+  std::copy(alu::SubTable.begin(), alu::SubTable.end(), tables.begin() + 256);
+  return tables;
+}()};
+
+// Host registers. The machine's A, B, IS and ALU result are kept in r8d to
+// r11d, its flags in ebx, the image in rdx and the remaining budget in rcx;
+// r12 points at aluTables. rdi and rsi keep the Entry arguments.
+enum Reg : uint8_t {
+  rax = 0,
+  rcx = 1,
+  rdx = 2,
+  rbx = 3,
+  rsi = 6,
+  rdi = 7,
+  r8 = 8,
+  r9 = 9,
+  r10 = 10,
+  r11 = 11,
+  r12 = 12,
+};
+
+constexpr Reg regA{r8};
+constexpr Reg regB{r9};
+constexpr Reg regIS{r10};
+constexpr Reg regALU{r11};
+
+// Offsets of the CPUState fields the code reads and writes.
+constexpr uint8_t offRegisters{offsetof(CPUState, Registers)};
+constexpr uint8_t offALUResult{offsetof(CPUState, ALUResult)};
+constexpr uint8_t offFlags{offsetof(CPUState, Flags)};
+constexpr uint8_t offHalted{offsetof(CPUState, Halted)};
+// Load64 and Store64 reach the image at [rdi] with no displacement.
+static_assert(offsetof(CPUState, Image) == 0);
+
+// Assembler emits the few x86-64 instructions the compiler needs. Jumps go
+// to labels and are patched once all code is emitted.
+class Assembler {
+public:
+  using Label = size_t;
+
+  Label NewLabel() {
+    m_labels.push_back(unbound);
+    return m_labels.size() - 1;
+  }
+  void Bind(const Label label) {
+    m_labels[label] = m_code.size();
+  }
+
+  void Push(const Reg reg) {
+    rex(false, 0, reg);
+    byte(0x50 + (reg & 7));
+  }
+  void Pop(const Reg reg) {
+    rex(false, 0, reg);
+    byte(0x58 + (reg & 7));
+  }
+  void Ret() {
+    byte(0xC3);
+  }
+
+  // mov dst32, imm32
+  void MovImm(const Reg dst, const uint32_t imm) {
+    rex(false, 0, dst);
+    byte(0xB8 + (dst & 7));
+    imm32(imm);
+  }
+  // mov dst64, imm64
+  void MovImm64(const Reg dst, const uint64_t imm) {
+    rex(true, 0, dst);
+    byte(0xB8 + (dst & 7));
+    for (int i = 0; i < 8; i++) {
+      byte(static_cast<uint8_t>(imm >> (8 * i)));
+    }
+  }
+  // mov dst, src, 32 or 64 bits wide
+  void Mov(const Reg dst, const Reg src, const bool wide = false) {
+    binary(0x89, dst, src, wide);
+  }
+  void And(const Reg dst, const Reg src, const bool wide = false) {
+    binary(0x21, dst, src, wide);
+  }
+  void Or(const Reg dst, const Reg src, const bool wide = false) {
+    binary(0x09, dst, src, wide);
+  }
+  void Cmp(const Reg dst, const Reg src) {
+    binary(0x39, dst, src, false);
+  }
+  // Group 1 with an 8 bit immediate: add /0, or /1, and /4, sub /5.
+  void AddImm(const Reg dst, const uint8_t imm, const bool wide = false) {
+    group1(0, dst, imm, wide);
+  }
+  void OrImm(const Reg dst, const uint8_t imm) {
+    group1(1, dst, imm, false);
+  }
+  void AndImm(const Reg dst, const uint8_t imm) {
+    group1(4, dst, imm, false);
+  }
+  void SubImm(const Reg dst, const uint8_t imm, const bool wide = false) {
+    group1(5, dst, imm, wide);
+  }
+  void Shl(const Reg dst, const uint8_t count, const bool wide = false) {
+    shift(4, dst, count, wide);
+  }
+  void Shr(const Reg dst, const uint8_t count, const bool wide = false) {
+    shift(5, dst, count, wide);
+  }
+  // test bl, imm8
+  void TestFlags(const uint8_t imm) {
+    byte(0xF6);
+    byte(modrm(3, 0, rbx));
+    byte(imm);
+  }
+
+  // mov dst64, [base]
+  void Load64(const Reg dst, const Reg base) {
+    rex(true, dst, base);
+    byte(0x8B);
+    byte(modrm(0, dst, base));
+  }
+  // mov [base], src64
+  void Store64(const Reg base, const Reg src) {
+    rex(true, src, base);
+    byte(0x89);
+    byte(modrm(0, src, base));
+  }
+  // movzx dst32, byte [rdi + disp]
+  void LoadByte(const Reg dst, const uint8_t disp) {
+    rex(false, dst, rdi);
+    byte(0x0F);
+    byte(0xB6);
+    byte(modrm(1, dst, rdi));
+    byte(disp);
+  }
+  // mov byte [rdi + disp], src8; the REX prefix selects bl, not bh, for rbx.
+  void StoreByte(const uint8_t disp, const Reg src) {
+    byte(static_cast<uint8_t>(0x40 | ((src >> 3) << 2)));
+    byte(0x88);
+    byte(modrm(1, src, rdi));
+    byte(disp);
+  }
+  // mov byte [rdi + disp], imm8
+  void StoreByteImm(const uint8_t disp, const uint8_t imm) {
+    byte(0xC6);
+    byte(modrm(1, 0, rdi));
+    byte(disp);
+    byte(imm);
+  }
+  // movzx eax, byte [r12 + rax + disp]
+  void LoadTableByte(const uint32_t disp) {
+    byte(0x41);
+    byte(0x0F);
+    byte(0xB6);
+    byte(modrm(2, rax, 4));
+    byte(0x04); // SIB: index rax, base r12.
+    imm32(disp);
+  }
+
+  void Jmp(const Label label) {
+    byte(0xE9);
+    fixup(label);
+  }
+  // Condition codes for Jcc.
+  static constexpr uint8_t Below{0x2};
+  static constexpr uint8_t Equal{0x4};
+  static constexpr uint8_t NotEqual{0x5};
+  void Jcc(const uint8_t condition, const Label label) {
+    byte(0x0F);
+    byte(0x80 | condition);
+    fixup(label);
+  }
+
+  // Finish patches every jump and returns the code.
+  const std::vector<uint8_t>& Finish() {
+    for (const auto& [at, label] : m_fixups) {
+      assert(m_labels[label] != unbound);
+      const auto target{static_cast<int64_t>(m_labels[label])};
+      const auto rel{
+          static_cast<int32_t>(target - static_cast<int64_t>(at + 4))};
+      std::memcpy(&m_code[at], &rel, sizeof(rel));
+    }
+    return m_code;
+  }
+
+private:
+  static constexpr size_t unbound{~size_t{0}};
+
+  std::vector<uint8_t> m_code{};
+  std::vector<size_t> m_labels{};
+  std::vector<std::pair<size_t, Label>> m_fixups{};
+
+  static constexpr uint8_t modrm(const uint8_t mod, const uint8_t reg,
+                                 const uint8_t rm) {
+    return static_cast<uint8_t>(mod << 6 | (reg & 7) << 3 | (rm & 7));
+  }
+
+  void byte(const uint8_t value) {
+    m_code.push_back(value);
+  }
+  void imm32(const uint32_t value) {
+    for (int i = 0; i < 4; i++) {
+      byte(static_cast<uint8_t>(value >> (8 * i)));
+    }
+  }
+  void rex(const bool wide, const uint8_t reg, const uint8_t rm) {
+    const uint8_t prefix{static_cast<uint8_t>(0x40 | (wide ? 0x8 : 0) |
+                                              ((reg >> 3) << 2) | (rm >> 3))};
+    if (prefix != 0x40) {
+      byte(prefix);
+    }
+  }
+  void binary(const uint8_t opcode, const Reg dst, const Reg src,
+              const bool wide) {
+    rex(wide, src, dst);
+    byte(opcode);
+    byte(modrm(3, src, dst));
+  }
+  void group1(const uint8_t ext, const Reg dst, const uint8_t imm,
+              const bool wide) {
+    rex(wide, 0, dst);
+    byte(0x83);
+    byte(modrm(3, ext, dst));
+    byte(imm);
+  }
+  void shift(const uint8_t ext, const Reg dst, const uint8_t count,
+             const bool wide) {
+    rex(wide, 0, dst);
+    byte(0xC1);
+    byte(modrm(3, ext, dst));
+    byte(count);
+  }
+  void fixup(const Label label) {
+    m_fixups.emplace_back(m_code.size(), label);
+    imm32(0);
+  }
+};
+
+// Operand is where Mov, Add and Sub find a register: A and B in host
+// registers, IS and PC as constants, since both are known statically by the
+// time the instruction reads them.
+struct Operand {
+  bool constant{};
+  Reg reg{};
+  uint8_t value{};
+};
+
+Operand operand(const Block::Op& op, const uint8_t id) {
+  switch (id) {
+  case regID::A:
+    return {.reg = regA};
+  case regID::B:
+    return {.reg = regB};
+  case regID::IS:
+    return {.constant = true, .value = op.raw};
+  default:
+    return {.constant = true, .value = op.next};
+  }
+}
+
+// compile translates every block of translation. The code saves rbx and r12,
+// loads the machine into host registers, jumps to the entry's block and
+// writes the machine back on every exit.
+std::vector<uint8_t> compile(const Translation& translation,
+                             const uint8_t entry) {
+  Assembler a{};
+  std::array<Assembler::Label, MemSizeWords> blocks{};
+  for (Assembler::Label& label : blocks) {
+    label = a.NewLabel();
+  }
+  const Assembler::Label epilogue{a.NewLabel()};
+
+  // Exits are emitted after the blocks. Refund is the budget taken for ops
+  // of the block that did not run; a Dispatch exit's PC is in eax.
+  struct ExitStub {
+    Assembler::Label label{};
+    Exit exit{};
+    uint8_t pc{};
+    uint8_t refund{};
+  };
+  std::vector<ExitStub> exits{};
+  const auto exitTo{[&](const Exit exit, const uint8_t pc,
+                        const uint8_t refund) {
+    exits.push_back({a.NewLabel(), exit, pc, refund});
+    return exits.back().label;
+  }};
+
+  a.Push(rbx);
+  a.Push(r12);
+  a.MovImm64(r12, reinterpret_cast<uint64_t>(aluTables.data()));
+  a.Load64(rcx, rsi);
+  a.Load64(rdx, rdi);
+  a.LoadByte(regA, offRegisters + regID::A);
+  a.LoadByte(regB, offRegisters + regID::B);
+  a.LoadByte(regIS, offRegisters + regID::IS);
+  a.LoadByte(regALU, offALUResult);
+  a.LoadByte(rbx, offFlags);
+  a.Jmp(blocks[entry]);
+
+  const uint64_t codeMask{translation.CodeMask()};
+  for (uint8_t start = 0; start < MemSizeWords; start++) {
+    const Block* const block{translation.BlockAt(start)};
+    if (block == nullptr) {
+      continue;
+    }
+    a.Bind(blocks[start]);
+    a.SubImm(rcx, block->length, true);
+    a.Jcc(Assembler::Below, exitTo(Exit::Budget, start, block->length));
+
+    bool ended{false};
+    for (uint8_t i = 0; i < block->length && !ended; i++) {
+      const Block::Op& op{block->ops[i]};
+      const auto refund{static_cast<uint8_t>(block->length - i - 1)};
+      const uint8_t shift{CPUState::ShiftOf(uint4(op.arg))};
+      a.MovImm(regIS, op.raw);
+
+      switch (op.raw) {
+      case std::to_underlying(OpCode::LoadA):
+      case std::to_underlying(OpCode::LoadB):
+        a.Mov(rax, rdx, true);
+        if (shift != 0) {
+          a.Shr(rax, shift, true);
+        }
+        a.AndImm(rax, 0xF);
+        a.Mov(op.opcode == OpCode::LoadA ? regA : regB, rax);
+        break;
+      case std::to_underlying(OpCode::LoadAI):
+        a.MovImm(regA, op.arg);
+        break;
+      case std::to_underlying(OpCode::StoreA): {
+        // A store into code is a no-op unless it changes the word, and
+        // leaves the compiled code if it does.
+        const bool guarded{((codeMask >> shift) & 0xF) != 0};
+        const Assembler::Label same{a.NewLabel()};
+        if (guarded) {
+          a.Mov(rax, rdx, true);
+          if (shift != 0) {
+            a.Shr(rax, shift, true);
+          }
+          a.AndImm(rax, 0xF);
+          a.Cmp(rax, regA);
+          a.Jcc(Assembler::Equal, same);
+        }
+        a.MovImm64(rax, ~(uint64_t{0xF} << shift));
+        a.And(rdx, rax, true);
+        a.Mov(rax, regA);
+        if (shift != 0) {
+          a.Shl(rax, shift, true);
+        }
+        a.Or(rdx, rax, true);
+        if (guarded) {
+          a.Jmp(exitTo(Exit::Guard, op.next, refund));
+        }
+        a.Bind(same);
+        break;
+      }
+      case std::to_underlying(OpCode::Mov): {
+        const Operand src{operand(op, op.src)};
+        if (op.dest == regID::PC) {
+          if (src.constant) {
+            a.MovImm(rax, src.value);
+          } else {
+            a.Mov(rax, src.reg);
+          }
+          a.Jmp(exitTo(Exit::Dispatch, 0, refund));
+          ended = true;
+          break;
+        }
+        const Reg dest{op.dest == regID::A   ? regA
+                       : op.dest == regID::B ? regB
+                                             : regIS};
+        if (src.constant) {
+          a.MovImm(dest, src.value);
+        } else if (src.reg != dest) {
+          a.Mov(dest, src.reg);
+        }
+        break;
+      }
+      case std::to_underlying(OpCode::Add):
+      case std::to_underlying(OpCode::Sub): {
+        const Operand x{operand(op, op.src)};
+        const Operand y{operand(op, op.dest)};
+        if (x.constant) {
+          a.MovImm(rax, static_cast<uint32_t>(x.value) << 4);
+        } else {
+          a.Mov(rax, x.reg);
+          a.Shl(rax, 4);
+        }
+        if (y.constant) {
+          a.OrImm(rax, y.value);
+        } else {
+          a.Or(rax, y.reg);
+        }
+        a.LoadTableByte(op.opcode == OpCode::Sub ? 256 : 0);
+        a.Mov(rbx, rax);
+        a.Shr(rbx, 4);
+        a.AndImm(rax, 0xF);
+        a.Mov(regA, rax);
+        a.Mov(regALU, rax);
+        break;
+      }
+      case std::to_underlying(OpCode::Jump):
+        a.Jmp(blocks[op.arg]);
+        ended = true;
+        break;
+      case std::to_underlying(OpCode::JumpZ):
+      case std::to_underlying(OpCode::JumpNZ):
+        a.TestFlags(flagBit::Zero);
+        a.Jcc(op.opcode == OpCode::JumpZ ? Assembler::NotEqual
+                                         : Assembler::Equal,
+              blocks[op.arg]);
+        a.Jmp(blocks[op.next]);
+        ended = true;
+        break;
+      case std::to_underlying(OpCode::Halt):
+        a.StoreByteImm(offHalted, 1);
+        a.Jmp(exitTo(Exit::Halted, op.next, refund));
+        ended = true;
+        break;
+      default:
+        a.Jmp(exitTo(Exit::Fault, op.next, refund));
+        ended = true;
+      }
+    }
+    if (!ended) {
+      a.Jmp(blocks[block->fallthrough]);
+    }
+  }
+
+  for (const ExitStub& stub : exits) {
+    a.Bind(stub.label);
+    if (stub.refund != 0) {
+      a.AddImm(rcx, stub.refund, true);
+    }
+    if (stub.exit == Exit::Dispatch) {
+      a.StoreByte(offRegisters + regID::PC, rax);
+    } else {
+      a.StoreByteImm(offRegisters + regID::PC, stub.pc);
+    }
+    a.MovImm(rax, std::to_underlying(stub.exit));
+    a.Jmp(epilogue);
+  }
+
+  a.Bind(epilogue);
+  a.Store64(rdi, rdx);
+  a.StoreByte(offRegisters + regID::A, regA);
+  a.StoreByte(offRegisters + regID::B, regB);
+  a.StoreByte(offRegisters + regID::IS, regIS);
+  a.StoreByte(offALUResult, regALU);
+  a.StoreByte(offFlags, rbx);
+  a.Store64(rsi, rcx);
+  a.Pop(r12);
+  a.Pop(rbx);
+  a.Ret();
+  return a.Finish();
+}
+#endif
+
+// masked keeps the registers and the ALU result to nibbles, as the engine
+// itself does, so neither compiled code nor the tables it indexes see a
+// value above 0xF.
+CPUState masked(CPUState state) {
+  for (uint8_t& reg : state.Registers) {
+    reg &= 0xF;
+  }
+  state.ALUResult &= 0xF;
+  return state;
+}
+} // namespace
+
+size_t JitCPU::KeyHash::operator()(const Key& key) const {
+  return std::hash<uint64_t>{}(key.image ^
+                               (uint64_t{key.entry} * GoldenGamma));
+}
+
+JitCPU::JitCPU() : JitCPU(CPUState{}) {}
+
+JitCPU::JitCPU(const CPUState& state)
+    : m_state{masked(state)}, m_backoff{minBackoff} {
+#if CPU4_JIT
+  void* const arena{mmap(nullptr, arenaBytes, PROT_READ | PROT_EXEC,
+                         MAP_PRIVATE | MAP_ANONYMOUS, -1, 0)};
+  if (arena == MAP_FAILED) {
+    throw std::bad_alloc{};
+  }
+  m_arena = static_cast<uint8_t*>(arena);
+#endif
+}
+
+JitCPU::~JitCPU() {
+#if CPU4_JIT
+  munmap(m_arena, arenaBytes);
+#endif
+}
+
+void JitCPU::Run() {
+  while (!m_state.Halted) {
+    Run(UINT64_MAX);
+  }
+}
+
+RunResult JitCPU::Run(const uint64_t budget) {
+  CPUState& s{m_state};
+  RunResult result{.Status = RunStatus::BudgetExhausted};
+
+  while (result.Cycles < budget) {
+    if (s.Halted) {
+      result.Status = RunStatus::Halted;
+      return result;
+    }
+
+#if CPU4_JIT
+    if (m_interpret == 0) {
+      const Current code{m_lookup()};
+      if (code.entry == nullptr) {
+        // Nothing could be compiled, so interpret for a stretch.
+        m_interpret = m_backoff;
+        continue;
+      }
+      const uint64_t before{budget - result.Cycles};
+      uint64_t left{before};
+      const auto exit{static_cast<Exit>(code.entry(&s, &left))};
+      const uint64_t ran{before - left};
+      result.Cycles += ran;
+      m_stats.NativeCycles += ran;
+
+      switch (exit) {
+      case Exit::Halted:
+        result.Status = RunStatus::Halted;
+        return result;
+      case Exit::Fault:
+        result.Status = RunStatus::Fault;
+        return result;
+      case Exit::Budget:
+        // The next block is longer than what is left of the budget.
+        m_interpret = left;
+        break;
+      case Exit::Dispatch:
+        break;
+      case Exit::Guard:
+        m_stats.GuardExits++;
+        m_interpret = m_backoff;
+        m_backoff = std::min(m_backoff * 2, maxBackoff);
+        break;
+      }
+      if (ran >= maxBackoff) {
+        m_backoff = minBackoff;
+      }
+      continue;
+    }
+    m_interpret--;
+#endif
+
+    const uint8_t op{s.Load(uint4(s.Registers[regID::PC])).Raw()};
+    Step(s);
+    result.Cycles++;
+    m_stats.InterpretedCycles++;
+    if (op > std::to_underlying(OpCode::JumpNZ)) {
+      result.Status = RunStatus::Fault;
+      return result;
+    }
+  }
+  if (s.Halted) {
+    result.Status = RunStatus::Halted;
+  }
+  return result;
+}
+
+bool JitCPU::IsHalted() const {
+  return m_state.Halted != 0;
+}
+
+const CPUState& JitCPU::GetState() const {
+  return m_state;
+}
+
+void JitCPU::SetState(const CPUState& state) {
+  m_state = masked(state);
+  m_interpret = 0;
+  m_backoff = minBackoff;
+}
+
+const JitCPU::Stats& JitCPU::GetStats() const {
+  return m_stats;
+}
+
+// m_lookup returns code for the current PC and image, or no entry when it
+// cannot be compiled. Stores outside the
+// code words leave the last code usable.
+JitCPU::Current JitCPU::m_lookup() {
+  const uint64_t image{m_state.Image};
+  const uint8_t pc{m_state.Registers[regID::PC]};
+  if (m_current.entry != nullptr && m_current.pc == pc &&
+      (image & m_current.codeMask) == m_current.code) {
+    return m_current;
+  }
+  if (const auto found{m_code.find({image, pc})}; found != m_code.end()) {
+    m_current = found->second;
+    return m_current;
+  }
+  m_current = m_compile(image, pc);
+  if (m_current.entry != nullptr) {
+    m_code.emplace(Key{image, pc}, m_current);
+  }
+  return m_current;
+}
+
+JitCPU::Current JitCPU::m_compile([[maybe_unused]] const uint64_t image,
+                                  [[maybe_unused]] const uint8_t entry) {
+#if CPU4_JIT
+  const Translation translation{image, entry};
+  const std::vector<uint8_t> code{compile(translation, entry)};
+  if (code.size() > arenaBytes) {
+    return {};
+  }
+
+  // A full arena is emptied along with everything compiled into it.
+  if (m_used + code.size() > arenaBytes) {
+    m_code.clear();
+    m_used = 0;
+  }
+  uint8_t* const at{m_arena + m_used};
+  if (mprotect(m_arena, arenaBytes, PROT_READ | PROT_WRITE) != 0) {
+    return {};
+  }
+  std::memcpy(at, code.data(), code.size());
+  if (mprotect(m_arena, arenaBytes, PROT_READ | PROT_EXEC) != 0) {
+    // None of the arena can run until a later compile protects it again.
+    m_code.clear();
+    m_used = 0;
+    return {};
+  }
+  // Keep entries 16 byte aligned.
+  m_used += (code.size() + 15) & ~size_t{15};
+
+  m_stats.Compiles++;
+  m_stats.CodeBytes += code.size();
+  return {.entry = reinterpret_cast<Entry>(at),
+          .codeMask = translation.CodeMask(),
+          .code = image & translation.CodeMask(),
+          .pc = entry};
+#else
+  return {};
+#endif
+}
+
+} // namespace cpu
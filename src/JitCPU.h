@@ -0,0 +1,107 @@
+#pragma once
+
+#include "CPUState.h"
+#include "RunResult.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+
+// The JIT emits x86-64 code into memory it maps itself, so it is built on
+// Linux x86-64 only. Elsewhere JitCPU interprets every instruction.
+#if defined(__x86_64__) && defined(__linux__)
+#define CPU4_JIT 1
+#else
+#define CPU4_JIT 0
+#endif
+
+namespace cpu {
+
+// JitCPU compiles program images to x86-64 machine code and runs them
+// natively. The blocks reachable from an entry address, found as for
+// BlockCPU, become one function per image and entry. A, B, IS, the ALU
+// result and the flags live in host registers for the whole call, and the
+// cycle budget is checked once per block.
+//
+// A store into a word the code was compiled from is guarded: when it changes
+// the word, the code returns right after it and the interpreter runs for a
+// stretch before the new image is compiled. The stretch doubles while the
+// program keeps rewriting itself, so code that patches itself on every pass
+// is interpreted rather than compiled once per pass. Mov into PC also
+// returns, and the host dispatches to the code for the new PC.
+//
+// Registers and the ALU result are taken modulo 16 when a state is loaded.
+// Code that cannot be compiled or made executable is interpreted instead.
+class JitCPU {
+public:
+  struct Stats {
+    uint64_t Compiles{};
+    uint64_t CodeBytes{}; // Machine code emitted by those compiles.
+    uint64_t NativeCycles{};
+    uint64_t InterpretedCycles{};
+    uint64_t GuardExits{}; // Stores that rewrote compiled code.
+  };
+
+  JitCPU();
+  explicit JitCPU(const CPUState& state);
+  ~JitCPU();
+
+  JitCPU(const JitCPU&) = delete;
+  JitCPU& operator=(const JitCPU&) = delete;
+
+  // Available is true when this build compiles to native code.
+  static constexpr bool Available() {
+    return CPU4_JIT != 0;
+  }
+
+  void Run();
+  // Run executes at most budget cycles and reports why it stopped, as
+  // CPU::Run does without a bus: the port instructions fault like unknown
+  // opcodes.
+  RunResult Run(uint64_t budget);
+
+  bool IsHalted() const;
+  const CPUState& GetState() const;
+  // SetState keeps the compiled code, which depends only on the image.
+  void SetState(const CPUState& state);
+
+  const Stats& GetStats() const;
+
+private:
+  // Entry runs compiled code on state until it leaves it, counting cycles
+  // down from *budget, and returns an Exit.
+  using Entry = uint32_t (*)(CPUState* state, uint64_t* budget);
+
+  struct Key {
+    uint64_t image{};
+    uint8_t entry{};
+
+    bool operator==(const Key&) const = default;
+  };
+  struct KeyHash {
+    size_t operator()(const Key& key) const;
+  };
+
+  // Compiled code for the last entry used, valid for every image that
+  // agrees with it on the code words.
+  struct Current {
+    Entry entry{};
+    uint64_t codeMask{};
+    uint64_t code{}; // Image & codeMask.
+    uint8_t pc{};
+  };
+
+  CPUState m_state{};
+  Stats m_stats{};
+  std::unordered_map<Key, Current, KeyHash> m_code{};
+  Current m_current{};
+  uint8_t* m_arena{}; // Executable except while code is being copied in.
+  size_t m_used{};
+  uint64_t m_interpret{}; // Cycles left to interpret before compiling.
+  uint64_t m_backoff{};
+
+  Current m_lookup();
+  Current m_compile(uint64_t image, uint8_t entry);
+};
+
+} // namespace cpu
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <optional>
+#include <unordered_map>
+#include <utility>
+
+namespace cpu {
+
+// LRUCache is a bounded map that evicts the least recently used entry once
+// it is full. It does no locking of its own; callers that share one between
+// threads guard it with a mutex.
+template <typename Key, typename Value, typename Hash = std::hash<Key>>
+class LRUCache {
+public:
+  explicit LRUCache(const size_t capacity) : m_capacity{capacity} {}
+
+  // Find returns a copy of the value for key and marks it most recently used.
+  std::optional<Value> Find(const Key& key) {
+    const auto it{m_index.find(key)};
+    if (it == m_index.end()) {
+      return std::nullopt;
+    }
+    m_order.splice(m_order.begin(), m_order, it->second);
+    return it->second->second;
+  }
+
+  // Insert stores value under key unless the key is already present, and
+  // returns whichever value the cache now holds for it.
+  Value Insert(const Key& key, Value value) {
+    if (const auto it{m_index.find(key)}; it != m_index.end()) {
+      return it->second->second;
+    }
+    if (m_capacity == 0) {
+      return value;
+    }
+    m_order.emplace_front(key, std::move(value));
+    m_index.emplace(key, m_order.begin());
+    m_evict();
+    return m_order.front().second;
+  }
+
+  void SetCapacity(const size_t capacity) {
+    m_capacity = capacity;
+    m_evict();
+  }
+
+  size_t Size() const {
+    return m_order.size();
+  }
+
+  uint64_t Evictions() const {
+    return m_evictions;
+  }
+
+  void Clear() {
+    m_order.clear();
+    m_index.clear();
+    m_evictions = 0;
+  }
+
+private:
+  using Entry = std::pair<Key, Value>;
+
+  size_t m_capacity{};
+  std::list<Entry> m_order{}; // Most recently used first.
+  std::unordered_map<Key, typename std::list<Entry>::iterator, Hash> m_index{};
+  uint64_t m_evictions{};
+
+  void m_evict() {
+    while (m_order.size() > m_capacity) {
+      m_index.erase(m_order.back().first);
+      m_order.pop_back();
+      m_evictions++;
+    }
+  }
+};
+
+} // namespace cpu
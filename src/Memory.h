@@ -1,19 +1,144 @@
 #pragma once
 
+#include "CPUDefs.h"
+#include "CPUState.h"
 #include "Nibble.h"
 
+#include <array>
+#include <bit>
 #include <cstddef>
 #include <cstdint>
-#include <vector>
+#include <iostream>
+
+// BasicMemory represents (and actually is) volatile memory. It is used to
+// simulate the RAM space that the CPU interacts with. It holds Words words
+// of WordBits bits each.
+// For 4 bit words the memories size must be an even number as 2 uint4s are
+// stored per byte. A byte is the smallest size of data that most modern
+// systems can work with. If an odd size is specified then the actual
+// capacity will be the next even number.
+//
+// The words live inline in an array of uint64_t limbs, so a memory never
+// allocates. Read as little-endian bytes a 4 bit image holds two words per
+// byte in the format HHHH LLLL, where H is the value stored at the lower
+// index, which puts word addr at bit (addr ^ 1) * 4. This is the same layout
+// as CPUState::Image and corpus files, so whole images move in one
+// operation. Wider words are stored in address order.
+//
+// BasicMemory is constexpr throughout so a CPU can run in constant
+// expressions.
+template <unsigned WordBits, size_t Words>
+class BasicMemory {
+  static_assert(64 % WordBits == 0, "words must tile a uint64_t");
+  static_assert(std::has_single_bit(Words) && Words >= 2 &&
+                    Words <= (uint64_t{1} << WordBits),
+                "memory must be a power of two words, all addressable");
+
+  static constexpr size_t m_perLimb{64 / WordBits};
+  static constexpr size_t m_limbs{(Words + m_perLimb - 1) / m_perLimb};
 
-class Memory {
 public:
-  explicit Memory(size_t size);
+  using Word = cpu::uintN<WordBits>;
+  static constexpr size_t Capacity{Words};
+
+  constexpr explicit BasicMemory(const size_t size = Words)
+      : m_size{size + size % 2 > Capacity ? Capacity : size + size % 2} {
+    if !consteval {
+      if (size > Capacity) {
+        std::cerr << "Memory is larger than maximum usable size of "
+                  << Capacity << '\n';
+      }
+    }
+  }
+
+  // Implementation specifics are hidden and the interface allows storing a
+  // number by simply specifying a value and address.
+  constexpr void Store(const Word value, const Word addr) {
+    uint64_t& limb{m_limb(addr)};
+    const unsigned shift{m_shift(addr)};
+    limb = (limb & ~(uint64_t{Word::Mask} << shift)) |
+           (static_cast<uint64_t>(value.Raw()) << shift);
+  }
+
+  // Load works the opposite of store. All values are initialized to zero so a
+  // cpu that reads a value it hasn't interacted with will receive a zero.
+  constexpr Word Load(const Word addr) const {
+    return Word{static_cast<typename Word::Storage>(
+        (m_limb(addr) >> m_shift(addr)) & Word::Mask)};
+  }
+
+  // LoadImage replaces every word at once; DumpImage returns them all. They
+  // exist when the whole memory fits in one uint64_t.
+  constexpr void LoadImage(const uint64_t image)
+    requires(m_limbs == 1)
+  {
+    m_image[0] = image;
+  }
+  constexpr uint64_t DumpImage() const
+    requires(m_limbs == 1)
+  {
+    return m_image[0];
+  }
 
-  void Store(cpu::uint4 value, cpu::uint4 addr);
-  cpu::uint4 Load(cpu::uint4 addr) const;
-  size_t Size() const;
+  // Fill sets every word to value, Clear sets them to zero.
+  constexpr void Fill(const Word value) {
+    constexpr uint64_t ones{~uint64_t{0} / Word::Mask};
+    m_image.fill(ones * value.Raw());
+  }
+  constexpr void Clear() {
+    m_image.fill(0);
+  }
+
+  // Hash mixes the image (splitmix64 finaliser) for hash maps of memories.
+  constexpr uint64_t Hash() const {
+    uint64_t z{};
+    for (const uint64_t limb : m_image) {
+      z = cpu::MixIn(z, limb);
+    }
+    return z;
+  }
+
+  constexpr bool operator==(const BasicMemory&) const = default;
+
+  // Size returns the simulated capacity of the memory space. The size may
+  // be size+1 of the amount specified in the constructor due to rounding up
+  // to the nearest even number.
+  constexpr size_t Size() const {
+    return m_size;
+  }
 
 private:
-  std::vector<uint8_t> m_data{};
+  std::array<uint64_t, m_limbs> m_image{};
+  size_t m_size{};
+
+  // Addresses wrap at the memory size.
+  static constexpr size_t m_index(const Word addr) {
+    return addr.Raw() & (Words - 1);
+  }
+  static constexpr unsigned m_shift(const Word addr) {
+    const auto slot{static_cast<unsigned>(m_index(addr) % m_perLimb)};
+    if constexpr (WordBits < 8) {
+      // Lower addresses take the high bits of each byte.
+      constexpr unsigned perByte{8 / WordBits};
+      return (slot ^ (perByte - 1)) * WordBits;
+    } else {
+      return slot * WordBits;
+    }
+  }
+  constexpr uint64_t& m_limb(const Word addr) {
+    if constexpr (m_limbs == 1) {
+      return m_image[0];
+    } else {
+      return m_image[m_index(addr) / m_perLimb];
+    }
+  }
+  constexpr const uint64_t& m_limb(const Word addr) const {
+    if constexpr (m_limbs == 1) {
+      return m_image[0];
+    } else {
+      return m_image[m_index(addr) / m_perLimb];
+    }
+  }
 };
+
+using Memory = BasicMemory<cpu::WordSizeBits, cpu::MemSizeWords>;
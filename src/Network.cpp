@@ -0,0 +1,317 @@
+#include "Network.h"
+
+#include "CPUDefs.h"
+#include "Nibble.h"
+#include "RippleCarry.h"
+#include "Step.h"
+
+#include <algorithm>
+#include <barrier>
+#include <chrono>
+#include <thread>
+#include <utility>
+
+namespace cpu {
+
+Topology::Topology(const size_t nodes)
+    : m_nodes{nodes}, m_outUsed(nodes), m_inUsed(nodes) {}
+
+bool Topology::Connect(const uint32_t from, const uint8_t outPort,
+                       const uint32_t to, const uint8_t inPort) {
+  if (from >= m_nodes || to >= m_nodes || outPort >= Ports ||
+      inPort >= Ports) {
+    return false;
+  }
+  const auto outBit{static_cast<uint16_t>(1u << outPort)};
+  const auto inBit{static_cast<uint16_t>(1u << inPort)};
+  if ((m_outUsed[from] & outBit) || (m_inUsed[to] & inBit)) {
+    return false;
+  }
+  m_outUsed[from] |= outBit;
+  m_inUsed[to] |= inBit;
+  m_links.push_back(
+      {.From = from, .To = to, .OutPort = outPort, .InPort = inPort});
+  return true;
+}
+
+size_t Topology::Nodes() const {
+  return m_nodes;
+}
+
+const std::vector<Topology::Link>& Topology::Links() const {
+  return m_links;
+}
+
+Topology Topology::Ring(const size_t nodes) {
+  Topology ring{nodes};
+  for (size_t i = 0; i < nodes; i++) {
+    ring.Connect(static_cast<uint32_t>(i), 1,
+                 static_cast<uint32_t>((i + 1) % nodes), 0);
+  }
+  return ring;
+}
+
+Topology Topology::Torus(const size_t width, const size_t height) {
+  Topology torus{width * height};
+  for (size_t y = 0; y < height; y++) {
+    for (size_t x = 0; x < width; x++) {
+      const auto node{static_cast<uint32_t>(y * width + x)};
+      const std::array<size_t, 4> neighbours{
+          ((y + height - 1) % height) * width + x, // North.
+          y * width + (x + 1) % width,             // East.
+          ((y + 1) % height) * width + x,          // South.
+          y * width + (x + width - 1) % width};    // West.
+      for (uint8_t port = 0; port < 4; port++) {
+        torus.Connect(node, port, static_cast<uint32_t>(neighbours[port]),
+                      static_cast<uint8_t>((port + 2) % 4));
+      }
+    }
+  }
+  return torus;
+}
+
+Network::Network(const Topology& topology, const CPUState& program,
+                 const NetworkOptions& options)
+    : m_options{options}, m_states(topology.Nodes(), program),
+      m_status(topology.Nodes(), NodeStatus::Running),
+      m_inStart(topology.Nodes() + 1), m_outStart(topology.Nodes() + 1) {
+  const auto& links{topology.Links()};
+
+  // Counting sort the links by destination to lay out the channels, and by
+  // source for the output index.
+  for (const Topology::Link& link : links) {
+    m_inStart[link.To + 1]++;
+    m_outStart[link.From + 1]++;
+  }
+  for (size_t node = 0; node < topology.Nodes(); node++) {
+    m_inStart[node + 1] += m_inStart[node];
+    m_outStart[node + 1] += m_outStart[node];
+  }
+
+  m_channels.resize(links.size());
+  m_outLinks.resize(links.size());
+  std::vector<uint32_t> nextIn(m_inStart.begin(), m_inStart.end() - 1);
+  std::vector<uint32_t> nextOut(m_outStart.begin(), m_outStart.end() - 1);
+  for (const Topology::Link& link : links) {
+    const uint32_t channel{nextIn[link.To]++};
+    m_channels[channel].InPort = link.InPort;
+    m_outLinks[nextOut[link.From]++] = {.Channel = channel,
+                                        .Port = link.OutPort};
+  }
+}
+
+size_t Network::Nodes() const {
+  return m_states.size();
+}
+
+uint64_t Network::Epoch() const {
+  return m_epoch;
+}
+
+const CPUState& Network::State(const size_t node) const {
+  return m_states[node];
+}
+
+void Network::SetState(const size_t node, const CPUState& state) {
+  m_states[node] = state;
+  m_status[node] = NodeStatus::Running;
+}
+
+NodeStatus Network::Status(const size_t node) const {
+  return m_status[node];
+}
+
+size_t Network::Pending(const size_t node, const uint8_t port) const {
+  for (uint32_t i = m_inStart[node]; i < m_inStart[node + 1]; i++) {
+    if (m_channels[i].InPort == port) {
+      return m_channels[i].Queued;
+    }
+  }
+  return 0;
+}
+
+NetworkStats Network::Run(const uint64_t epochs) {
+  using clock = std::chrono::steady_clock;
+
+  size_t threads{m_options.Threads};
+  if (threads == 0) {
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+  threads = std::clamp<size_t>(threads, 1, std::max<size_t>(Nodes(), 1));
+  std::vector<Totals> totals(threads);
+
+  // Each thread delivers to and then runs its own nodes. The barriers keep
+  // every thread in the same phase of the same epoch.
+  const auto work{[this, epochs, threads, &totals](const size_t id,
+                                                   auto&& sync) {
+    const size_t first{Nodes() * id / threads};
+    const size_t last{Nodes() * (id + 1) / threads};
+    for (uint64_t epoch = 0; epoch < epochs; epoch++) {
+      m_deliver(first, last, totals[id]);
+      sync();
+      m_execute(first, last, totals[id]);
+      sync();
+    }
+  }};
+
+  const auto start{clock::now()};
+  if (threads == 1) {
+    work(0, [] {});
+  } else {
+    std::barrier<> barrier{static_cast<std::ptrdiff_t>(threads)};
+    const auto sync{[&barrier] { barrier.arrive_and_wait(); }};
+    std::vector<std::jthread> pool{};
+    pool.reserve(threads - 1);
+    for (size_t id = 1; id < threads; id++) {
+      pool.emplace_back([&work, &sync, id] { work(id, sync); });
+    }
+    work(0, sync);
+  }
+  const auto end{clock::now()};
+  m_epoch += epochs;
+
+  NetworkStats stats{};
+  stats.Epochs = epochs;
+  stats.WallNanos = static_cast<uint64_t>(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(end - start)
+          .count());
+  for (const Totals& local : totals) {
+    stats.Cycles += local.cycles;
+    stats.Messages += local.messages;
+  }
+  for (const NodeStatus status : m_status) {
+    stats.Statuses[std::to_underlying(status)]++;
+  }
+  return stats;
+}
+
+uint64_t Network::Hash() const {
+  // splitmix64 finaliser over everything in node and channel order.
+  uint64_t z{m_epoch};
+  const auto mix{[&z](const uint64_t value) { z = MixIn(z, value); }};
+  for (size_t node = 0; node < Nodes(); node++) {
+    mix(cpu::Hash(m_states[node]) ^ std::to_underlying(m_status[node]));
+  }
+  for (const Channel& channel : m_channels) {
+    mix(channel.Queue);
+    mix(channel.Sent);
+    mix(uint64_t{channel.Queued} << 8 | channel.SentCount);
+  }
+  return z;
+}
+
+Network::Channel* Network::m_input(const size_t node, const uint8_t port) {
+  for (uint32_t i = m_inStart[node]; i < m_inStart[node + 1]; i++) {
+    if (m_channels[i].InPort == port) {
+      return &m_channels[i];
+    }
+  }
+  return nullptr;
+}
+
+Network::Channel* Network::m_output(const size_t node, const uint8_t port) {
+  for (uint32_t i = m_outStart[node]; i < m_outStart[node + 1]; i++) {
+    if (m_outLinks[i].Port == port) {
+      return &m_channels[m_outLinks[i].Channel];
+    }
+  }
+  return nullptr;
+}
+
+// m_deliver appends what was sent last epoch to the queues of nodes first to
+// last. Their channels are contiguous.
+void Network::m_deliver(const size_t first, const size_t last,
+                        Totals& totals) {
+  for (uint32_t i = m_inStart[first]; i < m_inStart[last]; i++) {
+    Channel& channel{m_channels[i]};
+    if (channel.SentCount != 0) {
+      channel.Queue |= channel.Sent << (4 * channel.Queued);
+      channel.Queued += channel.SentCount;
+      totals.messages += channel.SentCount;
+      channel.Sent = 0;
+      channel.SentCount = 0;
+    }
+    channel.Reserved = channel.Queued;
+  }
+}
+
+void Network::m_execute(const size_t first, const size_t last,
+                        Totals& totals) {
+  for (size_t node = first; node < last; node++) {
+    totals.cycles += m_runNode(node);
+  }
+}
+
+// m_runNode runs a node for up to one epoch's cycles. Instructions outside
+// the port range go to Step; a fault counts as a cycle, as in RunBounded.
+uint64_t Network::m_runNode(const size_t node) {
+  NodeStatus& status{m_status[node]};
+  if (status == NodeStatus::Halted || status == NodeStatus::Fault) {
+    return 0;
+  }
+
+  CPUState& state{m_states[node]};
+  status = NodeStatus::Running;
+  uint64_t cycles{0};
+  while (cycles < m_options.EpochCycles && !state.Halted) {
+    const uint8_t op{state.Load(uint4(state.Registers[regID::PC])).Raw()};
+    if (op <= std::to_underlying(OpCode::JumpNZ)) {
+      Step(state);
+    } else if (op <= std::to_underlying(OpCode::Poll)) {
+      if (!m_portOperation(node, state, op)) {
+        status = NodeStatus::Blocked;
+        return cycles;
+      }
+    } else {
+      Step(state);
+      status = NodeStatus::Fault;
+      return cycles + 1;
+    }
+    cycles++;
+  }
+  if (state.Halted) {
+    status = NodeStatus::Halted;
+  }
+  return cycles;
+}
+
+// m_portOperation executes In, Out or Poll. It returns false, with PC left
+// on the instruction, when the node has to wait.
+bool Network::m_portOperation(const size_t node, CPUState& state,
+                              const uint8_t op) {
+  uint8_t& pc{state.Registers[regID::PC]};
+  const uint8_t port{state.Load(uint4((pc + 1) & 0xF)).Raw()};
+  state.Registers[regID::IS] = op;
+
+  switch (static_cast<OpCode>(op)) {
+  case OpCode::In: {
+    Channel* const channel{m_input(node, port)};
+    if (channel == nullptr || channel->Queued == 0) {
+      return false;
+    }
+    state.Registers[regID::A] = channel->Queue & 0xF;
+    channel->Queue >>= 4;
+    channel->Queued--;
+    break;
+  }
+  case OpCode::Out:
+    if (Channel* const channel{m_output(node, port)}) {
+      if (channel->Reserved + channel->SentCount == ChannelCapacity) {
+        return false;
+      }
+      channel->Sent |= uint64_t{state.Registers[regID::A]}
+                       << (4 * channel->SentCount);
+      channel->SentCount++;
+    }
+    break;
+  default: {
+    const Channel* const channel{m_input(node, port)};
+    state.SetFlags({.Zero = channel == nullptr || channel->Queued == 0});
+    break;
+  }
+  }
+  pc = (pc + 2) & 0xF;
+  return true;
+}
+
+} // namespace cpu
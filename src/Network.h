@@ -0,0 +1,163 @@
+#pragma once
+
+#include "CPUState.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace cpu {
+
+// Topology lists the nodes of a network and the links between their ports.
+// A link carries the samples one node writes with Out on an output port to
+// In on an input port of another node, or of itself. Each output port and
+// each input port takes part in at most one link.
+class Topology {
+public:
+  struct Link {
+    uint32_t From{};
+    uint32_t To{};
+    uint8_t OutPort{};
+    uint8_t InPort{};
+  };
+
+  static constexpr size_t Ports{16};
+
+  explicit Topology(size_t nodes);
+
+  // Connect adds a link. It returns false and leaves the topology unchanged
+  // when a node or port is out of range or a port is already linked.
+  bool Connect(uint32_t from, uint8_t outPort, uint32_t to, uint8_t inPort);
+
+  size_t Nodes() const;
+  const std::vector<Link>& Links() const;
+
+  // Ring links port 1 of every node to port 0 of the next, wrapping around.
+  static Topology Ring(size_t nodes);
+  // Torus lays the nodes out row by row on a width by height grid that
+  // wraps at the edges. Out on ports 0 to 3 reaches the neighbour to the
+  // north, east, south and west, which reads it on the port facing back,
+  // (port + 2) % 4.
+  static Topology Torus(size_t width, size_t height);
+
+private:
+  size_t m_nodes{};
+  std::vector<Link> m_links{};
+  std::vector<uint16_t> m_outUsed{}; // Linked output ports, one bit each.
+  std::vector<uint16_t> m_inUsed{};
+};
+
+struct NetworkOptions {
+  size_t Threads{}; // Zero picks one per hardware thread.
+  // Cycles each node may run per epoch. Shorter epochs deliver messages
+  // sooner, longer ones synchronise the threads less often.
+  uint64_t EpochCycles{64};
+};
+
+enum class NodeStatus : uint8_t {
+  Running, // Used up its cycles for the epoch.
+  Blocked, // Waiting on an empty input or a full link.
+  Halted,
+  Fault
+};
+
+struct NetworkStats {
+  uint64_t Epochs{};
+  uint64_t Cycles{};
+  uint64_t Messages{}; // Samples delivered over links.
+  uint64_t WallNanos{};
+  std::array<uint64_t, 4> Statuses{}; // Nodes per NodeStatus at the end.
+};
+
+// Network runs one packed machine per node of a topology, with links
+// between them, in lockstep epochs. Within an epoch every node runs for up
+// to EpochCycles cycles and only sees the samples delivered to it before the
+// epoch began; what it sends is delivered at the start of the next one. No
+// node can observe another one mid-epoch, so the result depends only on the
+// topology, the programs and the number of epochs, never on the threads or
+// their timing. Each thread owns a contiguous range of nodes, and two
+// barriers per epoch separate delivery from execution.
+//
+// Nodes execute In, Out and Poll like a CPU with a DeviceBus attached. A
+// link holds ChannelCapacity samples, counting those sent this epoch, and
+// Out on a full link blocks the node until the next epoch. Out on an
+// unlinked port drops the sample, and In on one waits forever.
+class Network {
+public:
+  static constexpr size_t ChannelCapacity{16};
+
+  // Every node starts from program.
+  Network(const Topology& topology, const CPUState& program,
+          const NetworkOptions& options = {});
+
+  size_t Nodes() const;
+  uint64_t Epoch() const;
+
+  const CPUState& State(size_t node) const;
+  // SetState replaces a node's machine and lets it run again if it had
+  // halted or faulted.
+  void SetState(size_t node, const CPUState& state);
+  NodeStatus Status(size_t node) const;
+  // Pending is the number of samples delivered to an input port and not
+  // yet read.
+  size_t Pending(size_t node, uint8_t port) const;
+
+  // Run advances the network by epochs epochs.
+  NetworkStats Run(uint64_t epochs);
+
+  // Hash covers every node and link, for comparing runs.
+  uint64_t Hash() const;
+
+private:
+  // Channel is the state of one link. Samples are nibbles packed oldest
+  // first from the low bits. Queue and Queued belong to the destination,
+  // Sent and SentCount to the source, and Reserved, the queue length at the
+  // start of the epoch, is only written between epochs. So the two ends
+  // never write the same field, and a source sees the same free space
+  // whatever its destination has read so far.
+  struct Channel {
+    uint64_t Queue{};
+    uint64_t Sent{};
+    uint8_t Queued{};
+    uint8_t Reserved{};
+    uint8_t SentCount{};
+    uint8_t InPort{};
+  };
+
+  struct OutLink {
+    uint32_t Channel{};
+    uint8_t Port{};
+  };
+
+  // Per thread totals live on their own cache lines.
+  struct alignas(64) Totals {
+    uint64_t cycles{};
+    uint64_t messages{};
+    std::array<uint64_t, 4> statuses{};
+  };
+
+  NetworkOptions m_options{};
+  uint64_t m_epoch{};
+
+  std::vector<CPUState> m_states{};
+  std::vector<NodeStatus> m_status{};
+
+  // Channels are sorted by destination, so node n reads channels
+  // m_inStart[n] to m_inStart[n + 1] and a range of nodes owns a contiguous
+  // range of channels.
+  std::vector<Channel> m_channels{};
+  std::vector<uint32_t> m_inStart{};
+  std::vector<OutLink> m_outLinks{};
+  std::vector<uint32_t> m_outStart{};
+
+  Channel* m_input(size_t node, uint8_t port);
+  Channel* m_output(size_t node, uint8_t port);
+
+  void m_deliver(size_t first, size_t last, Totals& totals);
+  void m_execute(size_t first, size_t last, Totals& totals);
+  uint64_t m_runNode(size_t node);
+  bool m_portOperation(size_t node, CPUState& state, uint8_t op);
+};
+
+} // namespace cpu
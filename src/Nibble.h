@@ -3,204 +3,245 @@
 #include <cstdint>
 #include <iosfwd>
 #include <iostream>
+#include <type_traits>
 
 namespace cpu {
 
-struct int4;
-struct uint4;
+// wordStorage picks the smallest built-in integers that hold a Bits wide
+// word.
+template <unsigned Bits>
+struct wordStorage {
+  static_assert(Bits >= 1 && Bits <= 32, "words are 1 to 32 bits wide");
+  using Unsigned = std::conditional_t<
+      (Bits <= 8), uint8_t,
+      std::conditional_t<(Bits <= 16), uint16_t, uint32_t>>;
+  using Signed = std::make_signed_t<Unsigned>;
+};
+
+template <unsigned Bits>
+struct intN;
+
+// uintN simulates a Bits wide unsigned number. The underlying data type is
+// the smallest unsigned integer that fits, a byte for uint4.
+template <unsigned Bits>
+struct uintN {
+  using Storage = typename wordStorage<Bits>::Unsigned;
+  static constexpr unsigned Width{Bits};
+  static constexpr Storage Mask{static_cast<Storage>((uint64_t{1} << Bits) -
+                                                     1)};
 
-// uint4 simulates a 4 bit unsigned number. The underlying data type is a byte.
-struct uint4 {
   // Constructors.
-  uint4() = default;
+  uintN() = default;
 
-  explicit constexpr uint4(const int4& rhs);
+  explicit constexpr uintN(const intN<Bits>& rhs);
 
-  explicit constexpr uint4(const uint8_t v)
-      : m_value{static_cast<uint8_t>(m_mask4(v))} {}
+  explicit constexpr uintN(const Storage v)
+      : m_value{static_cast<Storage>(m_mask(v))} {}
 
-  explicit constexpr uint4(const int v)
-      : m_value{static_cast<uint8_t>(m_mask4(v))} {}
+  explicit constexpr uintN(const int v)
+      : m_value{static_cast<Storage>(m_mask(static_cast<Storage>(v)))} {}
 
   // Assignment, Comparison
-  constexpr bool operator==(const uint4 v) const noexcept {
-    return m_value == v;
+  constexpr bool operator==(const uintN v) const noexcept {
+    return m_value == v.m_value;
   }
 
-  // Assignment, Comparison (uint8_t).
-  constexpr uint4& operator=(const uint8_t v) noexcept {
-    m_value = m_mask4(v);
+  // Assignment, Comparison (Storage).
+  constexpr uintN& operator=(const Storage v) noexcept {
+    m_value = m_mask(v);
     return *this;
   }
-  constexpr bool operator==(const uint8_t v) const noexcept {
+  constexpr bool operator==(const Storage v) const noexcept {
     return m_value == v;
   }
 
   // Non-mutating operations.
-  constexpr uint4 operator+(const uint4 n) const noexcept {
-    return uint4{m_mask4(m_value + n.Raw())};
+  constexpr uintN operator+(const uintN n) const noexcept {
+    return uintN{m_mask(m_value + n.Raw())};
   }
-  constexpr uint4 operator-(const uint4 n) const noexcept {
-    return uint4{m_mask4(m_value - n.Raw())};
+  constexpr uintN operator-(const uintN n) const noexcept {
+    return uintN{m_mask(m_value - n.Raw())};
   }
-  constexpr uint4 operator*(const uint4 n) const noexcept {
-    return uint4{m_mask4(m_value * n.Raw())};
+  constexpr uintN operator*(const uintN n) const noexcept {
+    return uintN{m_mask(m_value * n.Raw())};
   }
-  constexpr uint4 operator/(const uint4 n) const noexcept {
-    return uint4{static_cast<uint8_t>(m_value / n.Raw())};
+  constexpr uintN operator/(const uintN n) const noexcept {
+    return uintN{static_cast<Storage>(m_value / n.Raw())};
   }
-  constexpr uint4 operator%(const uint4 n) const noexcept {
-    return uint4{static_cast<uint8_t>(m_value % n.Raw())};
+  constexpr uintN operator%(const uintN n) const noexcept {
+    return uintN{static_cast<Storage>(m_value % n.Raw())};
   }
 
-  // Non-mutating operations (uint8_t).
-  constexpr uint4 operator*(const uint8_t n) const noexcept {
-    return uint4{m_mask4(m_value * n)};
+  // Non-mutating operations (Storage).
+  constexpr uintN operator*(const Storage n) const noexcept {
+    return uintN{m_mask(m_value * n)};
   }
-  constexpr uint4 operator/(const uint8_t n) const noexcept {
-    return uint4{static_cast<uint8_t>(m_value / n)};
+  constexpr uintN operator/(const Storage n) const noexcept {
+    return uintN{static_cast<Storage>(m_value / n)};
   }
-  constexpr uint4 operator%(const uint8_t n) const noexcept {
-    return uint4{static_cast<uint8_t>(m_value % n)};
+  constexpr uintN operator%(const Storage n) const noexcept {
+    return uintN{static_cast<Storage>(m_value % n)};
   }
 
-  constexpr bool operator<(const uint8_t n) const noexcept {
+  constexpr bool operator<(const Storage n) const noexcept {
     return m_value < n;
   }
-  constexpr bool operator>(const uint8_t n) const noexcept {
+  constexpr bool operator>(const Storage n) const noexcept {
     return m_value > n;
   }
 
   // Non-mutating bit wise operations.
-  constexpr uint4 operator&(const uint4& v) const noexcept {
-    return uint4{static_cast<uint8_t>(m_value & v.Raw())};
+  constexpr uintN operator&(const uintN& v) const noexcept {
+    return uintN{static_cast<Storage>(m_value & v.Raw())};
   }
-  constexpr uint4 operator|(const uint4& v) const noexcept {
-    return uint4{static_cast<uint8_t>(m_value | v.Raw())};
+  constexpr uintN operator|(const uintN& v) const noexcept {
+    return uintN{static_cast<Storage>(m_value | v.Raw())};
   }
 
-  // Non-mutating bit-wise operations (uint8_t).
-  constexpr uint4 operator>>(const uint8_t n) const noexcept {
-    return uint4{static_cast<uint8_t>(m_value >> n)};
+  // Non-mutating bit-wise operations (Storage).
+  constexpr uintN operator>>(const uint8_t n) const noexcept {
+    return uintN{static_cast<Storage>(m_value >> n)};
   }
-  constexpr uint4 operator<<(const uint8_t& n) const noexcept {
-    return uint4{m_mask4(static_cast<uint8_t>(m_value << n))};
+  constexpr uintN operator<<(const uint8_t& n) const noexcept {
+    return uintN{m_mask(static_cast<Storage>(m_value << n))};
   }
-  constexpr uint4 operator&(const uint8_t& v) const noexcept {
-    return uint4{static_cast<uint8_t>(m_value & v)};
+  constexpr uintN operator&(const Storage& v) const noexcept {
+    return uintN{static_cast<Storage>(m_value & v)};
   }
-  constexpr uint4 operator|(const uint8_t& v) const noexcept {
-    return uint4{m_mask4(static_cast<uint8_t>(m_value | v))};
+  constexpr uintN operator|(const Storage& v) const noexcept {
+    return uintN{m_mask(static_cast<Storage>(m_value | v))};
   }
 
   // Mutating operations.
-  constexpr uint4 operator++() noexcept {
-    m_value = m_mask4(m_value + 1);
+  constexpr uintN operator++() noexcept {
+    m_value = m_mask(m_value + 1);
     return *this;
   }
-  constexpr uint4 operator++(int) noexcept {
-    const uint4 temp{*this};
+  constexpr uintN operator++(int) noexcept {
+    const uintN temp{*this};
     ++(*this);
     return temp;
   }
 
-  constexpr uint4 operator--() noexcept {
-    m_value = m_mask4(m_value - 1);
+  constexpr uintN operator--() noexcept {
+    m_value = m_mask(m_value - 1);
     return *this;
   }
-  constexpr uint4 operator--(int) noexcept {
-    const uint4 temp{*this};
+  constexpr uintN operator--(int) noexcept {
+    const uintN temp{*this};
     --(*this);
     return temp;
   }
 
   // Mutating bit-wise operations.
-  constexpr uint4& operator&=(const uint8_t v) noexcept {
+  constexpr uintN& operator&=(const Storage v) noexcept {
     m_value &= v;
     return *this;
   }
-  constexpr uint4& operator|=(const uint8_t& v) noexcept {
-    m_value = m_mask4(m_value | v);
+  constexpr uintN& operator|=(const Storage& v) noexcept {
+    m_value = m_mask(m_value | v);
     return *this;
   }
-  constexpr uint4& operator~() noexcept {
-    m_value = m_mask4(~m_value);
+  constexpr uintN& operator~() noexcept {
+    m_value = m_mask(~m_value);
     return *this;
   }
 
   // Type Conversion.
-  explicit constexpr operator uint8_t() const noexcept {
+  explicit constexpr operator Storage() const noexcept {
     return m_value;
   }
 
-  constexpr uint8_t Raw() const noexcept {
+  constexpr Storage Raw() const noexcept {
     return m_value;
   }
 
 private:
-  uint8_t m_value{};
+  Storage m_value{};
 
-  static constexpr uint8_t m_mask4(const uint8_t v) noexcept {
-    return v & 0xF;
+  static constexpr Storage m_mask(const uint64_t v) noexcept {
+    return static_cast<Storage>(v & Mask);
   }
 };
 
-// int4 simulates a 4 bit signed number. The underlying data type is a byte.
-struct int4 {
+// intN simulates a Bits wide signed number. It keeps the two's complement
+// bits of the value and sign extends when converted.
+template <unsigned Bits>
+struct intN {
+  using Storage = typename wordStorage<Bits>::Signed;
+  static constexpr unsigned Width{Bits};
+
   // Constructors.
-  int4() = default;
+  intN() = default;
 
-  explicit constexpr int4(const int8_t v) : m_value{m_mask4(v)} {}
+  explicit constexpr intN(const Storage v) : m_value{m_mask(v)} {}
 
-  explicit constexpr int4(const uint4& v);
+  explicit constexpr intN(const uintN<Bits>& v);
 
   // Comparison.
-  constexpr bool operator==(const int4& rhs) const noexcept {
+  constexpr bool operator==(const intN& rhs) const noexcept {
     return m_value == rhs.m_value;
   }
 
-  // Assignment, Comparison (int8_t).
-  constexpr int4& operator=(const int8_t& other) noexcept {
-    m_value = static_cast<int8_t>(other & 0xF);
+  // Assignment, Comparison (Storage).
+  constexpr intN& operator=(const Storage& other) noexcept {
+    m_value = m_mask(other);
     return *this;
   }
-  constexpr bool operator==(const int8_t v) const noexcept {
+  constexpr bool operator==(const Storage v) const noexcept {
     return m_value == v;
   }
 
   // Type Conversion.
-  explicit constexpr operator int8_t() const noexcept {
-    if (m_value & 0x08) {
-      return static_cast<int8_t>(m_value | 0xF0);
+  explicit constexpr operator Storage() const noexcept {
+    if (m_value & m_signBit) {
+      return static_cast<Storage>(m_value | ~m_bits);
     }
     return m_value;
   }
 
-  constexpr int8_t Raw() const noexcept {
+  constexpr Storage Raw() const noexcept {
     return m_value;
   }
 
 private:
-  int8_t m_value{};
+  static constexpr Storage m_bits{
+      static_cast<Storage>((uint64_t{1} << Bits) - 1)};
+  static constexpr Storage m_signBit{
+      static_cast<Storage>(uint64_t{1} << (Bits - 1))};
+
+  Storage m_value{};
 
-  static constexpr int8_t m_mask4(const int8_t v) noexcept {
-    return static_cast<int8_t>(v & 0xF);
+  static constexpr Storage m_mask(const Storage v) noexcept {
+    return static_cast<Storage>(v & m_bits);
   }
 };
 
-// uint4
-constexpr uint4::uint4(const int4& rhs)
-    : m_value{static_cast<uint8_t>(rhs.Raw())} {}
+// uintN
+template <unsigned Bits>
+constexpr uintN<Bits>::uintN(const intN<Bits>& rhs)
+    : m_value{static_cast<Storage>(rhs.Raw())} {}
 
-inline std::ostream& operator<<(std::ostream& os, const uint4& v) {
-  return os << static_cast<int16_t>(v.Raw());
+template <unsigned Bits>
+std::ostream& operator<<(std::ostream& os, const uintN<Bits>& v) {
+  return os << static_cast<uint32_t>(v.Raw());
 }
 
-// int4
-constexpr int4::int4(const uint4& v) : m_value{static_cast<int8_t>(v.Raw())} {}
+// intN
+template <unsigned Bits>
+constexpr intN<Bits>::intN(const uintN<Bits>& v)
+    : m_value{static_cast<Storage>(v.Raw())} {}
 
-inline std::ostream& operator<<(std::ostream& os, const int4& v) {
-  return os << static_cast<int16_t>(static_cast<int8_t>(v));
+template <unsigned Bits>
+std::ostream& operator<<(std::ostream& os, const intN<Bits>& v) {
+  return os << static_cast<int32_t>(
+                   static_cast<typename intN<Bits>::Storage>(v));
 }
 
+// The simulated machine is 4 bits wide.
+using uint4 = uintN<4>;
+using int4 = intN<4>;
+
+static_assert(sizeof(uint4) == 1 && std::is_trivially_copyable_v<uint4>);
+
 } // namespace cpu
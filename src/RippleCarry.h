@@ -0,0 +1,97 @@
+#pragma once
+
+#include "CPUDefs.h"
+#include "Nibble.h"
+
+#include <cstdint>
+
+// The ripple-carry adder is the reference model of the ALU. The table
+// backend and every fast engine are generated from or checked against it.
+
+namespace alu {
+
+struct Flags {
+  bool Overflow{};
+  bool Zero{};
+  bool Negative{};
+
+  constexpr void Clear() {
+    Negative = false;
+    Zero = false;
+    Overflow = false;
+  }
+};
+
+// Flags are packed into a byte as laid out by cpu::flagBit.
+constexpr uint8_t PackFlags(const Flags& flags) {
+  return static_cast<uint8_t>((flags.Overflow ? cpu::flagBit::Overflow : 0) |
+                              (flags.Zero ? cpu::flagBit::Zero : 0) |
+                              (flags.Negative ? cpu::flagBit::Negative : 0));
+}
+
+constexpr Flags UnpackFlags(const uint8_t bits) {
+  return {.Overflow = (bits & cpu::flagBit::Overflow) != 0,
+          .Zero = (bits & cpu::flagBit::Zero) != 0,
+          .Negative = (bits & cpu::flagBit::Negative) != 0};
+}
+
+// BasicOutput is the result and flags of a single Bits wide ALU operation.
+template <unsigned Bits>
+struct BasicOutput {
+  cpu::uintN<Bits> Result{};
+  alu::Flags Flags{};
+};
+
+using Output = BasicOutput<4>;
+
+// RippleCarryAdd is the gate level reference adder.
+template <unsigned Bits>
+constexpr BasicOutput<Bits> RippleCarryAdd(const cpu::uintN<Bits> inputA,
+                                           const cpu::uintN<Bits> inputB) {
+  using Word = cpu::uintN<Bits>;
+  BasicOutput<Bits> out{};
+
+  // Full adder ripple style addition.
+  bool carry = false;
+  for (unsigned i = 0; i < Bits; i++) {
+    const bool bitA = ((inputA >> i) & 1) == 1;
+    const bool bitB = ((inputB >> i) & 1) == 1;
+
+    const bool sum = static_cast<bool>(bitA ^ bitB ^ carry);
+    carry = (bitA & bitB) | (bitA & carry) | (bitB & carry);
+
+    out.Result |= static_cast<typename Word::Storage>(sum) << i;
+  }
+
+  // Check for overflow and set flags.
+  constexpr unsigned sign{Bits - 1};
+  const bool signA = ((inputA >> sign) & 1) == 1;
+  const bool signB = ((inputB >> sign) & 1) == 1;
+  const bool signR = ((out.Result >> sign) & 1) == 1;
+
+  // Overflow if two positive numbers give a negative, or two negative numbers
+  // a positive.
+  // A positive and negative number can never overflow so no check for that.
+  if ((signA == signB) && (signA != signR)) {
+    out.Flags.Overflow = true;
+  }
+  if (signR) { // Twos compliment binary: 1xxx == negative, 0xxx = positive.
+    out.Flags.Negative = true;
+  }
+  if (out.Result == 0) {
+    out.Flags.Zero = true;
+  }
+  return out;
+}
+
+template <unsigned Bits>
+constexpr BasicOutput<Bits> RippleCarrySub(const cpu::uintN<Bits> inputA,
+                                           cpu::uintN<Bits> inputB) {
+  // Subtraction is done via addition: A - B == A + (-B)
+  // -B is found by taking ~B + 1 in 2s compliment.
+
+  inputB = ~inputB + cpu::uintN<Bits>(1);
+  return RippleCarryAdd(inputA, inputB);
+}
+
+} // namespace alu
@@ -0,0 +1,85 @@
+#include "RunCache.h"
+
+#include "Step.h"
+
+#include <algorithm>
+#include <memory>
+
+namespace cpu {
+
+RunCache::RunCache(const Options& options)
+    : m_budget{options.Budget}, m_loops{options.Loops},
+      m_bypass{options.Bypass},
+      m_shardCount{std::max<size_t>(options.Shards, 1)} {
+  // Round up so the shards together hold at least Capacity entries.
+  const size_t perShard{(options.Capacity + m_shardCount - 1) / m_shardCount};
+  m_shards = std::make_unique<Shard[]>(m_shardCount);
+  for (size_t i = 0; i < m_shardCount; i++) {
+    m_shards[i].lru.SetCapacity(perShard);
+  }
+}
+
+RunCache::Outcome RunCache::Run(const CPUState& initial) {
+  if (m_bypass.load(std::memory_order_relaxed)) {
+    m_bypassed.fetch_add(1, std::memory_order_relaxed);
+    return m_run(initial);
+  }
+
+  // The low bits pick the bucket inside the shard's map, so take the shard
+  // from the high bits.
+  Shard& shard{m_shards[(Hash(initial) >> 32) % m_shardCount]};
+  {
+    const std::scoped_lock lock{shard.mutex};
+    if (const auto found{shard.lru.Find(initial)}) {
+      shard.hits++;
+      return *found;
+    }
+    shard.misses++;
+  }
+
+  // Run outside the lock. Runs are deterministic, so if another thread
+  // raced us both computed the same outcome.
+  const Outcome outcome{m_run(initial)};
+  const std::scoped_lock lock{shard.mutex};
+  return shard.lru.Insert(initial, outcome);
+}
+
+void RunCache::SetBypass(const bool bypass) {
+  m_bypass = bypass;
+}
+
+bool RunCache::IsBypassed() const {
+  return m_bypass;
+}
+
+RunCache::Stats RunCache::GetStats() const {
+  Stats stats{.Bypassed = m_bypassed};
+  for (size_t i = 0; i < m_shardCount; i++) {
+    const Shard& shard{m_shards[i]};
+    const std::scoped_lock lock{shard.mutex};
+    stats.Hits += shard.hits;
+    stats.Misses += shard.misses;
+    stats.Evictions += shard.lru.Evictions();
+    stats.Size += shard.lru.Size();
+  }
+  return stats;
+}
+
+void RunCache::Clear() {
+  for (size_t i = 0; i < m_shardCount; i++) {
+    Shard& shard{m_shards[i]};
+    const std::scoped_lock lock{shard.mutex};
+    shard.lru.Clear();
+    shard.hits = 0;
+    shard.misses = 0;
+  }
+  m_bypassed = 0;
+}
+
+RunCache::Outcome RunCache::m_run(const CPUState& initial) const {
+  Outcome outcome{.Final = initial};
+  outcome.Result = RunBounded(outcome.Final, m_budget, m_loops);
+  return outcome;
+}
+
+} // namespace cpu
@@ -0,0 +1,77 @@
+#pragma once
+
+#include "CPUState.h"
+#include "LRUCache.h"
+#include "RunResult.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+
+namespace cpu {
+
+// RunCache memoizes bounded runs: it maps an initial CPUState (memory image,
+// registers and flags) to the state RunBounded leaves it in and how the run
+// ended. The budget and loop check are fixed per cache, so they need not be
+// part of the key.
+//
+// Entries are spread over independently locked shards by state hash, each an
+// LRU of Capacity / Shards entries. All members are safe to call from
+// multiple threads.
+class RunCache {
+public:
+  struct Options {
+    size_t Capacity{1 << 16};
+    size_t Shards{16};
+    uint64_t Budget{1 << 16};
+    LoopCheck Loops{LoopCheck::Brent};
+    bool Bypass{}; // Run every request without consulting the cache.
+  };
+
+  struct Outcome {
+    CPUState Final{};
+    RunResult Result{};
+  };
+
+  struct Stats {
+    uint64_t Hits{};
+    uint64_t Misses{};
+    uint64_t Bypassed{};
+    uint64_t Evictions{};
+    size_t Size{};
+  };
+
+  explicit RunCache(const Options& options);
+  RunCache() : RunCache(Options{}) {}
+
+  // Run returns the outcome of running initial, from the cache if it has
+  // been run before.
+  Outcome Run(const CPUState& initial);
+
+  void SetBypass(bool bypass);
+  bool IsBypassed() const;
+
+  Stats GetStats() const;
+  void Clear();
+
+private:
+  struct Shard {
+    mutable std::mutex mutex{};
+    LRUCache<CPUState, Outcome, CPUStateHash> lru{0};
+    uint64_t hits{};
+    uint64_t misses{};
+  };
+
+  uint64_t m_budget{};
+  LoopCheck m_loops{};
+  std::atomic<bool> m_bypass{};
+  std::atomic<uint64_t> m_bypassed{};
+  size_t m_shardCount{};
+  std::unique_ptr<Shard[]> m_shards{};
+
+  Outcome m_run(const CPUState& initial) const;
+};
+
+} // namespace cpu
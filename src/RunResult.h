@@ -0,0 +1,74 @@
+#pragma once
+
+#include "CPUState.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+namespace cpu {
+
+enum class RunStatus {
+  Halted,          // Reached a Halt instruction.
+  BudgetExhausted, // Used up the cycle budget while still running.
+  Looping,         // Returned to an earlier state, so it can never halt.
+  Fault,           // Executed an opcode outside the instruction set.
+  Blocked // Waiting on an empty input or full output port; run again once
+          // the host has served it.
+};
+
+// RunStatusCount sizes arrays indexed by RunStatus.
+constexpr size_t RunStatusCount{std::to_underlying(RunStatus::Blocked) + 1};
+
+struct RunResult {
+  RunStatus Status{};
+  uint64_t Cycles{}; // Instructions executed by this run.
+  uint64_t Period{}; // Length of the loop when Status is Looping.
+
+  constexpr bool operator==(const RunResult&) const = default;
+};
+
+enum class LoopCheck {
+  Off,
+  Brent // Exact detection of repeated states, see LoopDetector.
+};
+
+// LoopDetector finds a repeated machine state with Brent's algorithm. State
+// is the whole machine state, normally a CPUState, so a repeat proves the
+// program loops forever. It keeps one saved state and compares every new
+// state with it; the saved state moves forward each time the step count
+// reaches the next power of two, so a loop of period p is caught within
+// about p steps once the saved state is inside it and the power has grown
+// past p.
+template <typename State>
+class LoopDetector {
+public:
+  constexpr explicit LoopDetector(const State& start) : m_saved{start} {}
+
+  // Observe takes the state after each step and returns true on a repeat.
+  constexpr bool Observe(const State& state) {
+    m_steps++;
+    if (state == m_saved) {
+      m_period = m_steps;
+      return true;
+    }
+    if (m_steps == m_power) {
+      m_saved = state;
+      m_power *= 2;
+      m_steps = 0;
+    }
+    return false;
+  }
+
+  constexpr uint64_t Period() const {
+    return m_period;
+  }
+
+private:
+  State m_saved{};
+  uint64_t m_power{1};
+  uint64_t m_steps{};
+  uint64_t m_period{};
+};
+
+} // namespace cpu
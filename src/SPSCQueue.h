@@ -0,0 +1,120 @@
+#pragma once
+
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <optional>
+#include <span>
+#include <type_traits>
+
+namespace cpu {
+
+// SPSCQueue is a bounded lock-free ring for exactly one producer thread and
+// one consumer thread. The capacity is rounded up to a power of two. Head and
+// tail live on separate cache lines, and each side caches the other side's
+// index so that most operations touch only their own line.
+template <typename T>
+class SPSCQueue {
+  static_assert(std::is_trivially_copyable_v<T>);
+
+public:
+  explicit SPSCQueue(const size_t capacity)
+      : m_mask{std::bit_ceil(capacity < 2 ? size_t{2} : capacity) - 1},
+        m_slots{std::make_unique<T[]>(m_mask + 1)} {}
+
+  SPSCQueue(const SPSCQueue&) = delete;
+  SPSCQueue& operator=(const SPSCQueue&) = delete;
+
+  // TryPush is called by the producer. It fails when the ring is full.
+  bool TryPush(const T& value) {
+    const size_t tail{m_tail.value.load(std::memory_order_relaxed)};
+    if (tail - m_headCache == m_mask + 1) {
+      m_headCache = m_head.value.load(std::memory_order_acquire);
+      if (tail - m_headCache == m_mask + 1) {
+        return false;
+      }
+    }
+    m_slots[tail & m_mask] = value;
+    m_tail.value.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  // TryPop is called by the consumer. It returns nothing when the ring is
+  // empty.
+  std::optional<T> TryPop() {
+    const size_t head{m_head.value.load(std::memory_order_relaxed)};
+    if (head == m_tailCache) {
+      m_tailCache = m_tail.value.load(std::memory_order_acquire);
+      if (head == m_tailCache) {
+        return std::nullopt;
+      }
+    }
+    const T value{m_slots[head & m_mask]};
+    m_head.value.store(head + 1, std::memory_order_release);
+    return value;
+  }
+
+  // TryPushMany pushes as many leading values as fit and returns how many
+  // it pushed. A batch publishes with one release store, so streaming in
+  // blocks costs far less per value than TryPush.
+  size_t TryPushMany(const std::span<const T> values) {
+    const size_t tail{m_tail.value.load(std::memory_order_relaxed)};
+    size_t free{m_mask + 1 - (tail - m_headCache)};
+    if (free < values.size()) {
+      m_headCache = m_head.value.load(std::memory_order_acquire);
+      free = m_mask + 1 - (tail - m_headCache);
+    }
+    const size_t count{values.size() < free ? values.size() : free};
+    for (size_t i = 0; i < count; i++) {
+      m_slots[(tail + i) & m_mask] = values[i];
+    }
+    m_tail.value.store(tail + count, std::memory_order_release);
+    return count;
+  }
+
+  // TryPopMany fills the front of out with as many values as are ready and
+  // returns how many it popped.
+  size_t TryPopMany(const std::span<T> out) {
+    const size_t head{m_head.value.load(std::memory_order_relaxed)};
+    size_t ready{m_tailCache - head};
+    if (ready < out.size()) {
+      m_tailCache = m_tail.value.load(std::memory_order_acquire);
+      ready = m_tailCache - head;
+    }
+    const size_t count{out.size() < ready ? out.size() : ready};
+    for (size_t i = 0; i < count; i++) {
+      out[i] = m_slots[(head + i) & m_mask];
+    }
+    m_head.value.store(head + count, std::memory_order_release);
+    return count;
+  }
+
+  // Size is exact when called from either end with the other one idle, and
+  // a snapshot otherwise.
+  size_t Size() const {
+    return m_tail.value.load(std::memory_order_acquire) -
+           m_head.value.load(std::memory_order_acquire);
+  }
+
+  size_t Capacity() const {
+    return m_mask + 1;
+  }
+
+private:
+  static constexpr size_t m_lineSize{64};
+  struct alignas(m_lineSize) Index {
+    std::atomic<size_t> value{};
+  };
+
+  const size_t m_mask;
+  const std::unique_ptr<T[]> m_slots;
+
+  Index m_head{}; // Next slot to pop, written by the consumer.
+  alignas(m_lineSize) size_t m_tailCache{};
+  Index m_tail{}; // Next slot to push, written by the producer.
+  alignas(m_lineSize) size_t m_headCache{};
+};
+
+} // namespace cpu
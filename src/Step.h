@@ -0,0 +1,146 @@
+#pragma once
+
+#include "ALUTables.h"
+#include "CPUDefs.h"
+#include "CPUState.h"
+#include "Nibble.h"
+#include "RunResult.h"
+
+#include <cstdint>
+#include <utility>
+
+// CPU4_REGISTER_TABLE makes Step execute Mov, Add and Sub between A and B
+// with a single lookup in alu::RegisterTransitions.
+#ifndef CPU4_REGISTER_TABLE
+#define CPU4_REGISTER_TABLE 0
+#endif
+
+namespace cpu {
+
+// Step executes one instruction on a packed CPUState with the same semantics
+// as CPU::Cycle. Tools that evaluate huge numbers of short programs use it
+// instead of a CPU, so unknown opcodes are skipped without a diagnostic.
+constexpr void Step(CPUState& s) noexcept {
+  uint8_t& pc = s.Registers[regID::PC];
+  const auto fetch = [&s, &pc]() {
+    const uint8_t word = s.Load(uint4(pc)).Raw();
+    pc = (pc + 1) & 0xF;
+    return word;
+  };
+
+  const uint8_t op = fetch();
+  s.Registers[regID::IS] = op;
+
+  switch (static_cast<OpCode>(op)) {
+  case OpCode::LoadA:
+    s.Registers[regID::A] = s.Load(uint4(fetch())).Raw();
+    break;
+  case OpCode::LoadAI:
+    s.Registers[regID::A] = fetch();
+    break;
+  case OpCode::LoadB:
+    s.Registers[regID::B] = s.Load(uint4(fetch())).Raw();
+    break;
+  case OpCode::StoreA:
+    s.Store(uint4(s.Registers[regID::A]), uint4(fetch()));
+    break;
+  case OpCode::Mov:
+  case OpCode::Add:
+  case OpCode::Sub: {
+    const uint8_t args = fetch();
+    if constexpr (CPU4_REGISTER_TABLE) {
+      const uint16_t entry{alu::RegisterTransitions[alu::RegisterTableIndex(
+          static_cast<OpCode>(op), args, s.Registers[regID::A],
+          s.Registers[regID::B])]};
+      if (!(entry & alu::transition::Fallback)) {
+        s.Registers[regID::A] = alu::transition::NewA(entry);
+        s.Registers[regID::B] = alu::transition::NewB(entry);
+        if (entry & alu::transition::WritesALU) {
+          s.ALUResult = alu::transition::NewA(entry);
+          s.Flags = alu::transition::NewFlags(entry);
+        }
+        break;
+      }
+    }
+
+    if (op == std::to_underlying(OpCode::Mov)) {
+      s.Registers[args & 0x3] = s.Registers[args >> 2];
+      break;
+    }
+    const uint8_t entry{alu::Lookup(uint4(s.Registers[args >> 2]),
+                                    uint4(s.Registers[args & 0x3]),
+                                    static_cast<OpCode>(op))};
+    s.Registers[regID::A] = entry & 0xF;
+    s.ALUResult = entry & 0xF;
+    s.Flags = entry >> 4;
+    break;
+  }
+  case OpCode::Jump:
+    pc = s.Load(uint4(pc)).Raw();
+    break;
+  case OpCode::JumpZ: {
+    const uint8_t target = fetch();
+    if (s.Flags & flagBit::Zero) {
+      pc = target;
+    }
+    break;
+  }
+  case OpCode::JumpNZ: {
+    const uint8_t target = fetch();
+    if (!(s.Flags & flagBit::Zero)) {
+      pc = target;
+    }
+    break;
+  }
+  case OpCode::Halt:
+    s.Halted = 1;
+    break;
+  default:
+    break;
+  }
+}
+
+// RunFor steps until the machine halts or maxCycles instructions have run.
+// It returns the number of instructions executed.
+constexpr uint64_t RunFor(CPUState& s, const uint64_t maxCycles) noexcept {
+  uint64_t cycles{0};
+  while (!s.Halted && cycles < maxCycles) {
+    Step(s);
+    cycles++;
+  }
+  return cycles;
+}
+
+// RunBounded runs like CPU::Run(budget, loops): it stops at Halt, after an
+// unknown opcode, on a repeated state or when the budget is used up.
+constexpr RunResult RunBounded(CPUState& s, const uint64_t budget,
+                               const LoopCheck loops = LoopCheck::Off) {
+  LoopDetector detector{s};
+  RunResult result{.Status = RunStatus::BudgetExhausted};
+
+  while (result.Cycles < budget) {
+    if (s.Halted) {
+      result.Status = RunStatus::Halted;
+      return result;
+    }
+    const uint8_t op{s.Load(uint4(s.Registers[regID::PC])).Raw()};
+    Step(s);
+    result.Cycles++;
+
+    if (op > std::to_underlying(OpCode::JumpNZ)) {
+      result.Status = RunStatus::Fault;
+      return result;
+    }
+    if (loops == LoopCheck::Brent && detector.Observe(s)) {
+      result.Status = RunStatus::Looping;
+      result.Period = detector.Period();
+      return result;
+    }
+  }
+  if (s.Halted) {
+    result.Status = RunStatus::Halted;
+  }
+  return result;
+}
+
+} // namespace cpu
@@ -0,0 +1,370 @@
+#include "Superopt.h"
+
+#include "CPUDefs.h"
+#include "CPUState.h"
+#include "Nibble.h"
+#include "Step.h"
+#include "WorkStealingPool.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <limits>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <tuple>
+#include <utility>
+
+namespace cpu::superopt {
+
+namespace {
+
+constexpr uint64_t noCycles{std::numeric_limits<uint64_t>::max()};
+
+// Prepared holds a Spec in the form the evaluation loop wants: one base image
+// per example with the inputs already written, and a flat array of expected
+// outputs.
+struct Prepared {
+  const Spec& spec;
+  std::vector<uint64_t> bases{};
+  std::vector<uint8_t> expected{};
+
+  explicit Prepared(const Spec& s) : spec{s} {
+    for (const Example& example : spec.Examples) {
+      CPUState base{};
+      for (size_t i = 0; i < spec.InputAddrs.size(); i++) {
+        base.Store(example.Inputs[i], spec.InputAddrs[i]);
+      }
+      bases.push_back(base.Image);
+      for (const uint4 out : example.Outputs) {
+        expected.push_back(out.Raw());
+      }
+    }
+  }
+};
+
+// Best orders matches so the merged result does not depend on which worker
+// found what first.
+struct Best {
+  uint64_t cycles{noCycles};
+  size_t length{};
+  uint64_t index{};
+
+  auto key(const Metric goal) const {
+    return goal == Metric::Size ? std::tuple{length, cycles, index}
+                                : std::tuple{cycles, length, index};
+  }
+};
+
+uint8_t wordAt(const CPUState& state, const size_t addr) {
+  return state.Load(uint4(static_cast<uint8_t>(addr))).Raw();
+}
+
+CPUState codeImage(const uint64_t index, const size_t length) {
+  CPUState code{};
+  for (size_t i = 0; i < length; i++) {
+    const auto word{static_cast<uint8_t>(index >> (4 * (length - 1 - i)))};
+    code.Store(uint4(word), uint4(static_cast<uint8_t>(i)));
+  }
+  return code;
+}
+
+// evaluate runs a candidate on every example and returns its total cycle
+// count, or noCycles if it misses an example or cannot beat cycleLimit.
+uint64_t evaluate(const Prepared& prepared, const uint64_t code,
+                  const uint64_t maxCycles, const uint64_t cycleLimit) {
+  const Spec& spec{prepared.spec};
+  const uint8_t* expected{prepared.expected.data()};
+  uint64_t total{0};
+
+  for (const uint64_t base : prepared.bases) {
+    CPUState s{};
+    s.Image = base | code;
+    total += RunFor(s, maxCycles);
+    if (!s.Halted || total > cycleLimit) {
+      return noCycles;
+    }
+    for (const uint4 addr : spec.OutputAddrs) {
+      if (s.Load(addr).Raw() != *expected++) {
+        return noCycles;
+      }
+    }
+    if (spec.CheckA && s.Registers[regID::A] != *expected++) {
+      return noCycles;
+    }
+  }
+  return total;
+}
+
+// isCanonical rejects candidates that provably behave like another candidate
+// that is searched anyway. Programs ending in a zero word equal the shorter
+// program without it. The remaining rules only hold for straight-line code
+// that never reads or writes its own words, so that its linear decode is
+// exactly what runs:
+//  - Add with swapped register arguments gives identical results and flags.
+//  - Words after an early Halt are never used, so a shorter program matches.
+//  - A no-op (unknown opcode or Mov onto itself) can be cut out without
+//    moving anything the program depends on.
+bool isCanonical(const CPUState& code, const size_t length, const Spec& spec) {
+  if (wordAt(code, length - 1) == 0) {
+    return false;
+  }
+  for (const uint4 addr : spec.OutputAddrs) {
+    if (addr.Raw() < length) {
+      return true;
+    }
+  }
+
+  bool hasNoOp{false};
+  bool storesAtEnd{false};
+  size_t pos{0};
+  while (pos < length) {
+    const auto op{static_cast<OpCode>(wordAt(code, pos))};
+    if (op == OpCode::Halt) {
+      return pos + 1 == length;
+    }
+    if (std::to_underlying(op) > std::to_underlying(OpCode::JumpNZ)) {
+      hasNoOp = true;
+      pos++;
+      continue;
+    }
+    if (pos + 1 >= length) {
+      return true; // The argument comes from outside the program.
+    }
+
+    const uint8_t arg{wordAt(code, pos + 1)};
+    const uint8_t src = arg >> 2;
+    const uint8_t dest = arg & 0x3;
+    switch (op) {
+    case OpCode::Jump:
+    case OpCode::JumpZ:
+    case OpCode::JumpNZ:
+      return true;
+    case OpCode::LoadA:
+    case OpCode::LoadB:
+    case OpCode::StoreA:
+      if (arg < length) {
+        return true;
+      }
+      storesAtEnd = storesAtEnd || (op == OpCode::StoreA && arg == length);
+      break;
+    case OpCode::Mov:
+    case OpCode::Add:
+    case OpCode::Sub:
+      if (src > regID::B || dest > regID::B) {
+        return true; // Reads IS or PC, or writes PC.
+      }
+      if (op == OpCode::Add && src > dest) {
+        return false;
+      }
+      if (op == OpCode::Mov && src == dest) {
+        hasNoOp = true;
+      }
+      break;
+    default:
+      break;
+    }
+    pos += 2;
+  }
+
+  // With a no-op removed the program would run into the word at length,
+  // which only stays equivalent if that word is neither an input nor
+  // stored to before the program runs into it.
+  if (hasNoOp) {
+    if (storesAtEnd) {
+      return true;
+    }
+    for (const uint4 addr : spec.InputAddrs) {
+      if (addr.Raw() == length) {
+        return true;
+      }
+    }
+    return false;
+  }
+  return true;
+}
+
+size_t maxSearchLength(const Spec& spec, const Options& options) {
+  size_t maxLength{std::min<size_t>(options.MaxLength, MemSizeWords - 1)};
+  for (const uint4 addr : spec.InputAddrs) {
+    maxLength = std::min<size_t>(maxLength, addr.Raw());
+  }
+  return maxLength;
+}
+
+} // namespace
+
+Spec SpecFromImage(const CPUState& image, const std::vector<uint4>& inputAddrs,
+                   const std::vector<uint4>& outputAddrs, const bool checkA,
+                   const uint64_t maxCycles) {
+  Spec spec{.InputAddrs = inputAddrs,
+            .OutputAddrs = outputAddrs,
+            .CheckA = checkA,
+            .Examples = {}};
+
+  const uint64_t combinations{uint64_t{1} << (4 * inputAddrs.size())};
+  for (uint64_t combo = 0; combo < combinations; combo++) {
+    Example example{};
+    CPUState s{image};
+    for (size_t i = 0; i < inputAddrs.size(); i++) {
+      const uint4 value{static_cast<uint8_t>(combo >> (4 * i))};
+      example.Inputs.push_back(value);
+      s.Store(value, inputAddrs[i]);
+    }
+
+    RunFor(s, maxCycles);
+    if (!s.Halted) {
+      continue;
+    }
+    for (const uint4 addr : outputAddrs) {
+      example.Outputs.push_back(s.Load(addr));
+    }
+    if (checkA) {
+      example.Outputs.push_back(s.GetRegister(regID::A));
+    }
+    spec.Examples.push_back(std::move(example));
+  }
+
+  // Neighbouring inputs tend to be rejected by the same candidates. Mixing
+  // the order lets a wrong candidate fail on the first few examples.
+  std::mt19937 rng{0x4b17};
+  std::shuffle(spec.Examples.begin(), spec.Examples.end(), rng);
+  return spec;
+}
+
+Result Search(const Spec& spec, const Options& options) {
+  const Prepared prepared{spec};
+  WorkStealingPool pool{options.Threads};
+
+  Result result{};
+  Best best{};
+  std::mutex bestMutex{};
+  std::atomic<uint64_t> bestCycles{noCycles};
+  std::atomic<uint64_t> evaluated{0};
+  std::atomic<uint64_t> pruned{0};
+
+  const size_t maxLength{maxSearchLength(spec, options)};
+  for (size_t length = 1; length <= maxLength; length++) {
+    // Split the space on its leading words so there are enough tasks to
+    // steal without paying for thousands of tiny ones.
+    const size_t prefixWords{std::min<size_t>(length, 3)};
+    const uint64_t tasks{uint64_t{1} << (4 * prefixWords)};
+    const uint64_t perTask{uint64_t{1} << (4 * (length - prefixWords))};
+
+    std::vector<WorkStealingPool::Task> work{};
+    work.reserve(tasks);
+    for (uint64_t task = 0; task < tasks; task++) {
+      work.emplace_back([&, task, length](size_t) {
+        Best local{};
+        uint64_t localEvaluated{0};
+        uint64_t localPruned{0};
+
+        for (uint64_t i = 0; i < perTask; i++) {
+          const uint64_t index{task * perTask + i};
+          const CPUState code{codeImage(index, length)};
+          if (!isCanonical(code, length, spec)) {
+            localPruned++;
+            continue;
+          }
+          localEvaluated++;
+
+          // Only the cycles metric can discard a match on cost alone.
+          const uint64_t limit{options.Goal == Metric::Cycles
+                                   ? bestCycles.load(std::memory_order_relaxed)
+                                   : noCycles};
+          const uint64_t cycles{
+              evaluate(prepared, code.Image, options.MaxCycles, limit)};
+          if (cycles == noCycles) {
+            continue;
+          }
+          const Best found{cycles, length, index};
+          if (local.cycles == noCycles ||
+              found.key(options.Goal) < local.key(options.Goal)) {
+            local = found;
+          }
+        }
+
+        evaluated += localEvaluated;
+        pruned += localPruned;
+        if (local.cycles == noCycles) {
+          return;
+        }
+        const std::scoped_lock lock{bestMutex};
+        if (best.cycles == noCycles ||
+            local.key(options.Goal) < best.key(options.Goal)) {
+          best = local;
+          bestCycles = best.cycles;
+        }
+      });
+    }
+    pool.Run(std::move(work));
+
+    if (options.Goal == Metric::Size && best.cycles != noCycles) {
+      break;
+    }
+  }
+
+  result.Evaluated = evaluated;
+  result.Pruned = pruned;
+  if (best.cycles != noCycles) {
+    result.Found = true;
+    result.Program = codeImage(best.index, best.length);
+    result.Length = best.length;
+    result.Cycles = best.cycles;
+  }
+  return result;
+}
+
+std::optional<CPUState> ParseImage(const std::string_view hex) {
+  return cpu::ParseImage(hex);
+}
+
+std::string FormatImage(const CPUState& state) {
+  constexpr std::string_view digits{"0123456789ABCDEF"};
+  std::string hex{};
+  for (uint8_t addr = 0; addr < MemSizeWords; addr++) {
+    hex += digits[state.Load(uint4(addr)).Raw()];
+  }
+  return hex;
+}
+
+std::string Disassemble(const CPUState& state, const size_t length) {
+  constexpr std::array<std::string_view, 4> regNames{"A", "B", "IS", "PC"};
+  std::ostringstream out{};
+
+  size_t pos{0};
+  while (pos < length) {
+    const uint8_t word{wordAt(state, pos)};
+    const auto op{static_cast<OpCode>(word)};
+    const uint8_t arg{wordAt(state, pos + 1)};
+    out << "0x" << std::hex << std::uppercase << pos << std::dec << "  ";
+
+    switch (op) {
+    case OpCode::Halt:
+      out << "Halt";
+      pos++;
+      break;
+    case OpCode::Mov:
+    case OpCode::Add:
+    case OpCode::Sub:
+      out << OpCodeName(op) << ' ' << regNames[arg >> 2] << ", "
+          << regNames[arg & 0x3];
+      pos += 2;
+      break;
+    default:
+      if (word > std::to_underlying(OpCode::JumpNZ)) {
+        out << "Unknown " << static_cast<int>(word);
+        pos++;
+      } else {
+        out << OpCodeName(op) << ' ' << static_cast<int>(arg);
+        pos += 2;
+      }
+    }
+    out << '\n';
+  }
+  return out.str();
+}
+
+} // namespace cpu::superopt
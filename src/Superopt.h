@@ -0,0 +1,72 @@
+#pragma once
+
+#include "CPUState.h"
+#include "Nibble.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace cpu::superopt {
+
+// Example is one input -> output pair of the behaviour being searched for.
+// Inputs line up with Spec::InputAddrs. Outputs line up with
+// Spec::OutputAddrs, followed by register A when Spec::CheckA is set.
+struct Example {
+  std::vector<uint4> Inputs{};
+  std::vector<uint4> Outputs{};
+};
+
+// Spec describes the target behaviour. A candidate program occupies words
+// [0, length); input words are written above it and every other word starts
+// at zero, which also acts as a Halt after the program.
+struct Spec {
+  std::vector<uint4> InputAddrs{};
+  std::vector<uint4> OutputAddrs{};
+  bool CheckA{};
+  std::vector<Example> Examples{};
+};
+
+enum class Metric {
+  Size,  // Shortest program, ties broken by total cycles.
+  Cycles // Fewest total cycles over all examples, ties broken by length.
+};
+
+struct Options {
+  size_t MaxLength{6};
+  uint64_t MaxCycles{64};
+  Metric Goal{Metric::Size};
+  size_t Threads{0}; // Zero uses every hardware thread.
+};
+
+struct Result {
+  bool Found{};
+  CPUState Program{};
+  size_t Length{};
+  uint64_t Cycles{};     // Total over every example.
+  uint64_t Evaluated{};  // Candidates that were run.
+  uint64_t Pruned{};     // Candidates skipped as equivalent to another.
+};
+
+// SpecFromImage derives the behaviour of an existing image by running it on
+// every combination of input values. Inputs the image does not halt on
+// within maxCycles are left out.
+Spec SpecFromImage(const CPUState& image, const std::vector<uint4>& inputAddrs,
+                   const std::vector<uint4>& outputAddrs, bool checkA,
+                   uint64_t maxCycles);
+
+// Search enumerates programs by length and returns the best one that matches
+// every example.
+Result Search(const Spec& spec, const Options& options);
+
+// Images are written as 16 hex digits, word 0 first.
+std::optional<CPUState> ParseImage(std::string_view hex);
+std::string FormatImage(const CPUState& state);
+
+// Disassemble lists the instructions in words [0, length) in program order.
+std::string Disassemble(const CPUState& state, size_t length);
+
+} // namespace cpu::superopt
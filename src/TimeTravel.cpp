@@ -0,0 +1,142 @@
+#include "TimeTravel.h"
+
+#include <algorithm>
+
+namespace cpu {
+
+TimeTravelCPU::TimeTravelCPU(const CPUState& initial, const Options& options)
+    : m_cpu{initial}, m_options{options},
+      m_interval{std::max<uint64_t>(options.Interval, 1)} {
+  m_options.MaxCheckpoints = std::max<size_t>(m_options.MaxCheckpoints, 2);
+  m_checkpoints.push_back({0, initial});
+}
+
+void TimeTravelCPU::Cycle() {
+  if (!m_cpu.IsHalted()) {
+    m_step();
+  }
+}
+
+RunResult TimeTravelCPU::Run(const uint64_t budget) {
+  RunResult result{.Status = RunStatus::BudgetExhausted};
+  while (result.Cycles < budget) {
+    if (m_cpu.IsHalted()) {
+      result.Status = RunStatus::Halted;
+      return result;
+    }
+    m_step();
+    result.Cycles++;
+    if (m_cpu.IsFaulted()) {
+      result.Status = RunStatus::Fault;
+      return result;
+    }
+  }
+  if (m_cpu.IsHalted()) {
+    result.Status = RunStatus::Halted;
+  }
+  return result;
+}
+
+bool TimeTravelCPU::StepBack() {
+  return m_cycle > 0 && RunBackTo(m_cycle - 1);
+}
+
+bool TimeTravelCPU::RunBackTo(const uint64_t cycle) {
+  return cycle <= m_cycle && SeekTo(cycle);
+}
+
+bool TimeTravelCPU::SeekTo(const uint64_t cycle) {
+  if (cycle < m_cycle) {
+    // The first checkpoint is cycle 0, so one always qualifies.
+    const auto after{std::upper_bound(
+        m_checkpoints.begin(), m_checkpoints.end(), cycle,
+        [](const uint64_t c, const Checkpoint& cp) { return c < cp.cycle; })};
+    m_restore(*std::prev(after));
+  }
+  while (m_cycle < cycle) {
+    if (m_cpu.IsHalted()) {
+      return false;
+    }
+    m_step();
+  }
+  return true;
+}
+
+uint64_t TimeTravelCPU::GetCycle() const {
+  return m_cycle;
+}
+
+CPUState TimeTravelCPU::GetState() const {
+  return m_cpu.GetState();
+}
+
+bool TimeTravelCPU::IsHalted() const {
+  return m_cpu.IsHalted();
+}
+
+const std::deque<StoreLog::Entry>& TimeTravelCPU::Writes() const {
+  return m_writes;
+}
+
+std::optional<uint64_t> TimeTravelCPU::LastWriteTo(const uint4 addr,
+                                                   const uint64_t cycle) const {
+  for (auto it = m_writes.rbegin(); it != m_writes.rend(); ++it) {
+    if (it->Cycle <= cycle && it->Addr == addr) {
+      return it->Cycle;
+    }
+  }
+  return std::nullopt;
+}
+
+size_t TimeTravelCPU::Checkpoints() const {
+  return m_checkpoints.size();
+}
+
+uint64_t TimeTravelCPU::Interval() const {
+  return m_interval;
+}
+
+void TimeTravelCPU::m_step() {
+  StoreLog& log{m_cpu.GetProbe()};
+  m_cpu.Cycle();
+  m_cycle++;
+
+  if (!log.Entries.empty()) {
+    if (m_cycle > m_furthest) {
+      m_writes.insert(m_writes.end(), log.Entries.begin(), log.Entries.end());
+      while (m_writes.size() > m_options.MaxLoggedWrites) {
+        m_writes.pop_front();
+      }
+    }
+    log.Entries.clear();
+  }
+  m_furthest = std::max(m_furthest, m_cycle);
+
+  if (m_cycle % m_interval == 0 && m_cycle > m_checkpoints.back().cycle) {
+    m_checkpoint();
+  }
+}
+
+void TimeTravelCPU::m_checkpoint() {
+  m_checkpoints.push_back({m_cycle, m_cpu.GetState()});
+  if (m_checkpoints.size() <= m_options.MaxCheckpoints) {
+    return;
+  }
+
+  // Keep the even ones. They sit on multiples of twice the interval, which
+  // is where the next checkpoints will land too.
+  size_t kept{0};
+  for (size_t i = 0; i < m_checkpoints.size(); i += 2) {
+    m_checkpoints[kept++] = m_checkpoints[i];
+  }
+  m_checkpoints.resize(kept);
+  m_interval *= 2;
+}
+
+void TimeTravelCPU::m_restore(const Checkpoint& checkpoint) {
+  m_cpu.SetState(checkpoint.state);
+  m_cycle = checkpoint.cycle;
+  m_cpu.GetProbe().Cycle = m_cycle;
+}
+
+} // namespace cpu
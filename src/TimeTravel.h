@@ -0,0 +1,85 @@
+#pragma once
+
+#include "CPU.h"
+#include "CPUState.h"
+#include "Instrumentation.h"
+#include "Nibble.h"
+#include "RunResult.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <optional>
+#include <vector>
+
+namespace cpu {
+
+// TimeTravelCPU is a CPU that can run backwards. It checkpoints its full
+// state every Interval cycles and logs every StoreA. Moving to an earlier
+// cycle restores the nearest checkpoint at or before it and replays forward,
+// which is exact because execution is deterministic.
+//
+// When the number of checkpoints exceeds MaxCheckpoints every other one is
+// dropped and the interval doubles. Memory stays bounded for any run length
+// and a seek replays at most twice the current interval.
+class TimeTravelCPU {
+public:
+  struct Options {
+    uint64_t Interval{1024};
+    size_t MaxCheckpoints{4096};
+    size_t MaxLoggedWrites{1 << 16}; // The oldest writes are forgotten first.
+  };
+
+  explicit TimeTravelCPU(const CPUState& initial, const Options& options);
+  explicit TimeTravelCPU(const CPUState& initial)
+      : TimeTravelCPU(initial, Options{}) {}
+
+  // Cycle executes one instruction unless the machine has halted.
+  void Cycle();
+  // Run steps forward like CPU::Run(budget).
+  RunResult Run(uint64_t budget);
+
+  // StepBack undoes one cycle. It returns false at cycle 0.
+  bool StepBack();
+  // RunBackTo rewinds to an earlier cycle. It returns false, and stays put,
+  // if cycle is in the future.
+  bool RunBackTo(uint64_t cycle);
+  // SeekTo moves to any cycle, running forward when needed. It returns false
+  // if the machine halts first, and then stops at the halt.
+  bool SeekTo(uint64_t cycle);
+
+  uint64_t GetCycle() const;
+  CPUState GetState() const;
+  bool IsHalted() const;
+
+  // Writes lists the logged stores, oldest first, each tagged with the cycle
+  // whose state first shows it. Every cycle is logged once, however often
+  // it is replayed.
+  const std::deque<StoreLog::Entry>& Writes() const;
+  // LastWriteTo finds the most recent logged store to addr that is visible
+  // at cycle.
+  std::optional<uint64_t> LastWriteTo(uint4 addr, uint64_t cycle) const;
+
+  size_t Checkpoints() const;
+  uint64_t Interval() const;
+
+private:
+  struct Checkpoint {
+    uint64_t cycle{};
+    CPUState state{};
+  };
+
+  BasicCPU<StoreLog> m_cpu;
+  Options m_options{};
+  uint64_t m_interval{};
+  uint64_t m_cycle{};
+  uint64_t m_furthest{}; // Highest cycle whose stores are in m_writes.
+  std::vector<Checkpoint> m_checkpoints{};
+  std::deque<StoreLog::Entry> m_writes{};
+
+  void m_step();
+  void m_checkpoint();
+  void m_restore(const Checkpoint& checkpoint);
+};
+
+} // namespace cpu
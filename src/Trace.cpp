@@ -0,0 +1,471 @@
+#include "Trace.h"
+
+#include "Step.h"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstring>
+#include <iterator>
+#include <string_view>
+#include <tuple>
+
+namespace cpu {
+
+namespace {
+
+constexpr std::string_view magic{"CPU4TRC\x01", 8};
+
+// Record mask bits, see Trace.h. Bits 0 to 3 are the register ids.
+namespace field {
+constexpr uint8_t ALUResult{1 << 4};
+constexpr uint8_t Flags{1 << 5};
+constexpr uint8_t Halted{1 << 6};
+constexpr uint8_t Memory{1 << 7};
+} // namespace field
+
+constexpr size_t maxRecordBytes{5}; // Mask plus 8 nibbles.
+constexpr size_t keyframeBytes{16};
+
+size_t nibbleCount(const uint8_t mask) {
+  return std::popcount(static_cast<uint8_t>(mask & 0x3F)) +
+         (mask & field::Memory ? 2 : 0);
+}
+
+size_t recordSize(const uint8_t mask) {
+  return 1 + (nibbleCount(mask) + 1) / 2;
+}
+
+// encode writes the record taking prev to next and returns its size, or zero
+// if a record cannot express the change.
+size_t encode(const CPUState& prev, const CPUState& next, uint8_t* out) {
+  if (prev.Reserved != next.Reserved || prev.Halted > 1 || next.Halted > 1) {
+    return 0;
+  }
+
+  uint8_t mask{0};
+  std::array<uint8_t, 8> nibbles{};
+  size_t count{0};
+  bool fits{true};
+  const auto changed = [&](const uint8_t bit, const uint8_t before,
+                           const uint8_t after) {
+    if (before != after) {
+      mask |= bit;
+      nibbles[count++] = after;
+      fits = fits && after <= 0xF;
+    }
+  };
+
+  for (size_t id = 0; id < NumRegisters + 2; id++) {
+    changed(static_cast<uint8_t>(1 << id), prev.Registers[id],
+            next.Registers[id]);
+  }
+  changed(field::ALUResult, prev.ALUResult, next.ALUResult);
+  changed(field::Flags, prev.Flags, next.Flags);
+  if (prev.Halted != next.Halted) {
+    mask |= field::Halted;
+  }
+  if (const uint64_t diff{prev.Image ^ next.Image}) {
+    const int shift{std::countr_zero(diff) & ~3};
+    if ((diff >> shift) > 0xF) {
+      return 0; // More than one word changed.
+    }
+    mask |= field::Memory;
+    nibbles[count++] = static_cast<uint8_t>((shift >> 2) ^ 1);
+    nibbles[count++] = static_cast<uint8_t>((next.Image >> shift) & 0xF);
+  }
+  if (!fits) {
+    return 0;
+  }
+
+  out[0] = mask;
+  for (size_t i = 0; i < count; i += 2) {
+    out[1 + i / 2] = static_cast<uint8_t>(nibbles[i] << 4 | nibbles[i + 1]);
+  }
+  return 1 + (count + 1) / 2;
+}
+
+// apply advances state by one record and returns the record's size.
+size_t apply(CPUState& state, const uint8_t* record) {
+  const uint8_t mask{record[0]};
+  size_t index{0};
+  const auto next = [record, &index]() {
+    const uint8_t byte{record[1 + index / 2]};
+    return static_cast<uint8_t>(index++ % 2 ? byte & 0xF : byte >> 4);
+  };
+
+  for (size_t id = 0; id < NumRegisters + 2; id++) {
+    if (mask & (1 << id)) {
+      state.Registers[id] = next();
+    }
+  }
+  if (mask & field::ALUResult) {
+    state.ALUResult = next();
+  }
+  if (mask & field::Flags) {
+    state.Flags = next();
+  }
+  if (mask & field::Halted) {
+    state.Halted ^= 1;
+  }
+  if (mask & field::Memory) {
+    const uint8_t addr{next()};
+    state.Store(uint4(next()), uint4(addr));
+  }
+  return recordSize(mask);
+}
+
+void putVarint(std::string& out, uint64_t value) {
+  while (value >= 0x80) {
+    out += static_cast<char>((value & 0x7F) | 0x80);
+    value >>= 7;
+  }
+  out += static_cast<char>(value);
+}
+
+std::optional<uint64_t> getVarint(const std::vector<uint8_t>& data,
+                                  size_t& pos) {
+  uint64_t value{0};
+  for (int shift = 0; shift < 64 && pos < data.size(); shift += 7) {
+    const uint8_t byte{data[pos++]};
+    value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+    if (!(byte & 0x80)) {
+      return value;
+    }
+  }
+  return std::nullopt;
+}
+
+void putKeyframe(std::string& out, const CPUState& state) {
+  for (int i = 0; i < 8; i++) {
+    out += static_cast<char>(state.Image >> (8 * i));
+  }
+  for (const uint8_t reg : state.Registers) {
+    out += static_cast<char>(reg);
+  }
+  out += static_cast<char>(state.ALUResult);
+  out += static_cast<char>(state.Flags);
+  out += static_cast<char>(state.Halted);
+  out += static_cast<char>(state.Reserved);
+}
+
+CPUState getKeyframe(const uint8_t* bytes) {
+  CPUState state{};
+  for (int i = 0; i < 8; i++) {
+    state.Image |= static_cast<uint64_t>(bytes[i]) << (8 * i);
+  }
+  std::memcpy(state.Registers.data(), bytes + 8, state.Registers.size());
+  state.ALUResult = bytes[12];
+  state.Flags = bytes[13];
+  state.Halted = bytes[14];
+  state.Reserved = bytes[15];
+  return state;
+}
+
+} // namespace
+
+// TraceWriter.
+
+TraceWriter::TraceWriter(std::ostream& out) : m_out{out} {
+  m_out.write(magic.data(), magic.size());
+  m_bytes = magic.size();
+  m_thread = std::jthread{[this] { m_run(); }};
+}
+
+TraceWriter::TraceWriter(const std::string& path)
+    : m_file{std::make_unique<std::ofstream>(path, std::ios::binary)},
+      m_out{*m_file} {
+  m_out.write(magic.data(), magic.size());
+  m_bytes = magic.size();
+  m_thread = std::jthread{[this] { m_run(); }};
+}
+
+// Recorders hold a reference to their writer, so they are all gone by now
+// and their chunks written.
+TraceWriter::~TraceWriter() {
+  m_stop = true;
+  m_notify();
+  m_thread.join();
+}
+
+bool TraceWriter::Good() const {
+  return m_good;
+}
+
+uint64_t TraceWriter::BytesWritten() const {
+  return m_bytes;
+}
+
+void TraceWriter::m_attach(TraceRecorder* recorder) {
+  const std::scoped_lock lock{m_mutex};
+  m_recorders.push_back(recorder);
+}
+
+void TraceWriter::m_detach(TraceRecorder* recorder) {
+  const std::scoped_lock lock{m_mutex};
+  std::erase(m_recorders, recorder);
+}
+
+void TraceWriter::m_notify() {
+  m_signal.fetch_add(1, std::memory_order_release);
+  m_signal.notify_one();
+}
+
+void TraceWriter::m_run() {
+  std::string header{};
+  while (true) {
+    const uint64_t seen{m_signal.load(std::memory_order_acquire)};
+    const bool stopping{m_stop};
+    bool wrote{false};
+
+    {
+      const std::scoped_lock lock{m_mutex};
+      for (TraceRecorder* recorder : m_recorders) {
+        while (const auto slot{recorder->m_filled.TryPop()}) {
+          const TraceRecorder::Slot& chunk{recorder->m_slots[*slot]};
+          header.clear();
+          putVarint(header, recorder->m_options.Stream);
+          putVarint(header, chunk.firstCycle);
+          putVarint(header, chunk.steps);
+          putVarint(header, chunk.bytes);
+          putKeyframe(header, chunk.keyframe);
+          m_out.write(header.data(),
+                      static_cast<std::streamsize>(header.size()));
+          m_out.write(reinterpret_cast<const char*>(recorder->m_data(*slot)),
+                      static_cast<std::streamsize>(chunk.bytes));
+          m_bytes += header.size() + chunk.bytes;
+
+          recorder->m_free.TryPush(*slot);
+          recorder->m_inFlight.fetch_sub(1, std::memory_order_release);
+          recorder->m_inFlight.notify_all();
+          wrote = true;
+        }
+      }
+    }
+
+    if (wrote) {
+      continue;
+    }
+    m_out.flush();
+    m_good = m_out.good();
+    if (stopping) {
+      return;
+    }
+    m_signal.wait(seen, std::memory_order_acquire);
+  }
+}
+
+// TraceRecorder.
+
+TraceRecorder::TraceRecorder(TraceWriter& writer, const CPUState& initial,
+                             const Options& options)
+    : m_writer{writer}, m_options{options},
+      m_filled{std::max<size_t>(options.Chunks, 2)},
+      m_free{std::max<size_t>(options.Chunks, 2)} {
+  m_options.Chunks = std::max<size_t>(m_options.Chunks, 2);
+  m_options.ChunkBytes = std::max(m_options.ChunkBytes, maxRecordBytes);
+  m_slots.resize(m_options.Chunks);
+  m_payload = std::make_unique<uint8_t[]>(m_options.Chunks *
+                                          m_options.ChunkBytes);
+  for (uint32_t slot = 1; slot < m_options.Chunks; slot++) {
+    m_free.TryPush(slot);
+  }
+
+  m_previous = initial;
+  m_open(initial);
+  m_writer.m_attach(this);
+}
+
+TraceRecorder::~TraceRecorder() {
+  Flush();
+  m_writer.m_detach(this);
+}
+
+void TraceRecorder::Record(const CPUState& state) {
+  std::array<uint8_t, maxRecordBytes> record{};
+  const size_t size{encode(m_previous, state, record.data())};
+  if (size == 0) {
+    m_cycle++;
+    m_previous = state;
+    m_submit(); // The next chunk's keyframe is this step.
+    return;
+  }
+
+  Slot& slot{m_slots[m_current]};
+  if (slot.bytes + size > m_options.ChunkBytes) {
+    m_submit();
+  }
+  Slot& open{m_slots[m_current]};
+  std::memcpy(m_data(m_current) + open.bytes, record.data(), size);
+  open.bytes += size;
+  open.steps++;
+  m_cycle++;
+  m_previous = state;
+}
+
+void TraceRecorder::Flush() {
+  if (m_slots[m_current].steps > 0) {
+    const bool drop{m_options.DropWhenFull};
+    m_options.DropWhenFull = false;
+    m_submit();
+    m_options.DropWhenFull = drop;
+  }
+  uint64_t inFlight{};
+  while ((inFlight = m_inFlight.load(std::memory_order_acquire)) != 0) {
+    m_inFlight.wait(inFlight, std::memory_order_acquire);
+  }
+}
+
+uint64_t TraceRecorder::Cycle() const {
+  return m_cycle;
+}
+
+uint64_t TraceRecorder::Dropped() const {
+  return m_dropped;
+}
+
+uint8_t* TraceRecorder::m_data(const uint32_t slot) {
+  return m_payload.get() + slot * m_options.ChunkBytes;
+}
+
+void TraceRecorder::m_open(const CPUState& keyframe) {
+  m_slots[m_current] = {.firstCycle = m_cycle, .keyframe = keyframe};
+}
+
+// m_submit hands the open chunk to the writer and opens the next one at the
+// current cycle.
+void TraceRecorder::m_submit() {
+  Slot& slot{m_slots[m_current]};
+  if (slot.steps == 0) {
+    m_open(m_previous);
+    return;
+  }
+
+  auto next{m_free.TryPop()};
+  while (!next) {
+    if (m_options.DropWhenFull) {
+      m_dropped += slot.steps;
+      m_open(m_previous);
+      return;
+    }
+    std::this_thread::yield();
+    next = m_free.TryPop();
+  }
+
+  m_inFlight.fetch_add(1, std::memory_order_relaxed);
+  m_filled.TryPush(m_current); // Never full: it has room for every slot.
+  m_writer.m_notify();
+  m_current = *next;
+  m_open(m_previous);
+}
+
+uint64_t RunTraced(CPUState& state, const uint64_t maxCycles,
+                   TraceRecorder& recorder) {
+  uint64_t cycles{0};
+  while (!state.Halted && cycles < maxCycles) {
+    Step(state);
+    recorder.Record(state);
+    cycles++;
+  }
+  return cycles;
+}
+
+// TraceReplayer.
+
+std::optional<TraceReplayer> TraceReplayer::Load(std::istream& in) {
+  TraceReplayer replayer{};
+  std::vector<uint8_t>& data{replayer.m_data};
+  data.assign(std::istreambuf_iterator<char>{in},
+              std::istreambuf_iterator<char>{});
+  if (data.size() < magic.size() ||
+      std::memcmp(data.data(), magic.data(), magic.size()) != 0) {
+    return std::nullopt;
+  }
+
+  size_t pos{magic.size()};
+  while (pos < data.size()) {
+    const auto stream{getVarint(data, pos)};
+    const auto firstCycle{getVarint(data, pos)};
+    const auto steps{getVarint(data, pos)};
+    const auto bytes{getVarint(data, pos)};
+    if (!stream || !firstCycle || !steps || !bytes || *stream > UINT32_MAX ||
+        data.size() - pos < keyframeBytes ||
+        data.size() - pos - keyframeBytes < *bytes) {
+      return std::nullopt;
+    }
+
+    Chunk chunk{.stream = static_cast<uint32_t>(*stream),
+                .firstCycle = *firstCycle,
+                .steps = *steps,
+                .keyframe = getKeyframe(data.data() + pos),
+                .offset = pos + keyframeBytes,
+                .bytes = *bytes};
+    pos = chunk.offset + chunk.bytes;
+
+    // The payload must hold exactly the advertised records.
+    size_t offset{0};
+    for (uint64_t step = 0; step < chunk.steps; step++) {
+      if (offset >= chunk.bytes) {
+        return std::nullopt;
+      }
+      offset += recordSize(data[chunk.offset + offset]);
+    }
+    if (offset != chunk.bytes) {
+      return std::nullopt;
+    }
+    replayer.m_chunks.push_back(chunk);
+  }
+
+  std::sort(replayer.m_chunks.begin(), replayer.m_chunks.end(),
+            [](const Chunk& a, const Chunk& b) {
+              return std::tie(a.stream, a.firstCycle) <
+                     std::tie(b.stream, b.firstCycle);
+            });
+  return replayer;
+}
+
+std::vector<uint32_t> TraceReplayer::Streams() const {
+  std::vector<uint32_t> streams{};
+  for (const Chunk& chunk : m_chunks) {
+    if (streams.empty() || streams.back() != chunk.stream) {
+      streams.push_back(chunk.stream);
+    }
+  }
+  return streams;
+}
+
+uint64_t TraceReplayer::End(const uint32_t stream) const {
+  uint64_t end{0};
+  for (const Chunk& chunk : m_chunks) {
+    if (chunk.stream == stream) {
+      end = std::max(end, chunk.firstCycle + chunk.steps);
+    }
+  }
+  return end;
+}
+
+std::optional<CPUState> TraceReplayer::StateAt(const uint64_t cycle,
+                                               const uint32_t stream) const {
+  // Find the last chunk of the stream starting at or before cycle.
+  const auto after{std::upper_bound(
+      m_chunks.begin(), m_chunks.end(), std::tuple{stream, cycle},
+      [](const std::tuple<uint32_t, uint64_t>& key, const Chunk& chunk) {
+        return key < std::tie(chunk.stream, chunk.firstCycle);
+      })};
+  if (after == m_chunks.begin()) {
+    return std::nullopt;
+  }
+  const Chunk& chunk{*std::prev(after)};
+  if (chunk.stream != stream || cycle > chunk.firstCycle + chunk.steps) {
+    return std::nullopt;
+  }
+
+  CPUState state{chunk.keyframe};
+  const uint8_t* record{m_data.data() + chunk.offset};
+  for (uint64_t step = chunk.firstCycle; step < cycle; step++) {
+    record += apply(state, record);
+  }
+  return state;
+}
+
+} // namespace cpu
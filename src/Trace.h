@@ -0,0 +1,176 @@
+#pragma once
+
+#include "CPUState.h"
+#include "SPSCQueue.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <istream>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace cpu {
+
+// Execution traces record a machine's state after every step.
+//
+// A trace file starts with the 8 byte magic "CPU4TRC" plus a version byte,
+// followed by chunks. Every chunk holds consecutive steps of one stream:
+//
+//   varint stream, varint first cycle, varint step count, varint payload size
+//   keyframe: the state at the first cycle, 16 bytes: the image as a
+//             little-endian uint64, then the register, ALUResult, Flags,
+//             Halted and Reserved bytes
+//   payload: one record per step
+//
+// A record is a byte saying which fields changed since the previous step:
+// A, B, IS, PC, ALUResult, Flags, Halted (toggled) and one memory word, from
+// bit 0 up. The new values follow as nibbles, two per byte, in that order,
+// with the memory word as address then value. Operands are not stored; they
+// are in memory, which the keyframe and writes reconstruct. A step that the
+// record cannot express, such as a host write to several words, starts a new
+// chunk whose keyframe is the state after it.
+
+class TraceRecorder;
+
+// TraceWriter owns the background thread that streams the chunks of any
+// number of recorders to one output.
+class TraceWriter {
+public:
+  explicit TraceWriter(std::ostream& out);
+  explicit TraceWriter(const std::string& path);
+  ~TraceWriter();
+
+  TraceWriter(const TraceWriter&) = delete;
+  TraceWriter& operator=(const TraceWriter&) = delete;
+
+  // Good is false once the output could not be written.
+  bool Good() const;
+  uint64_t BytesWritten() const;
+
+private:
+  friend class TraceRecorder;
+
+  std::unique_ptr<std::ofstream> m_file{};
+  std::ostream& m_out;
+
+  std::mutex m_mutex{}; // Guards m_recorders.
+  std::vector<TraceRecorder*> m_recorders{};
+  std::atomic<uint64_t> m_signal{}; // Bumped whenever a chunk is submitted.
+  std::atomic<bool> m_stop{};
+  std::atomic<uint64_t> m_bytes{};
+  std::atomic<bool> m_good{true};
+  std::jthread m_thread{};
+
+  void m_attach(TraceRecorder* recorder);
+  void m_detach(TraceRecorder* recorder);
+  void m_notify();
+  void m_run();
+};
+
+// TraceRecorder encodes the steps of one machine. It is used from a single
+// thread; the writer drains its chunks through lock-free rings, so memory is
+// bounded by Options::Chunks * Options::ChunkBytes.
+class TraceRecorder {
+public:
+  struct Options {
+    uint32_t Stream{};       // Distinguishes machines sharing a writer.
+    size_t ChunkBytes{4096}; // Payload bytes per chunk.
+    size_t Chunks{16};
+    // When every chunk is waiting for the writer, discard the chunk being
+    // filled instead of waiting. Dropped steps leave a gap in the trace.
+    bool DropWhenFull{};
+  };
+
+  TraceRecorder(TraceWriter& writer, const CPUState& initial,
+                const Options& options);
+  TraceRecorder(TraceWriter& writer, const CPUState& initial)
+      : TraceRecorder(writer, initial, Options{}) {}
+  ~TraceRecorder();
+
+  TraceRecorder(const TraceRecorder&) = delete;
+  TraceRecorder& operator=(const TraceRecorder&) = delete;
+
+  // Record appends the state after one more step.
+  void Record(const CPUState& state);
+
+  // Flush hands the open chunk to the writer and waits until everything
+  // recorded so far has been written.
+  void Flush();
+
+  uint64_t Cycle() const;
+  uint64_t Dropped() const;
+
+private:
+  friend class TraceWriter;
+
+  struct Slot {
+    uint64_t firstCycle{};
+    uint64_t steps{};
+    size_t bytes{};
+    CPUState keyframe{};
+  };
+
+  TraceWriter& m_writer;
+  Options m_options{};
+  std::vector<Slot> m_slots{};
+  std::unique_ptr<uint8_t[]> m_payload{};
+  SPSCQueue<uint32_t> m_filled; // Recorder to writer.
+  SPSCQueue<uint32_t> m_free;   // Writer to recorder.
+  std::atomic<uint64_t> m_inFlight{};
+
+  uint32_t m_current{};
+  CPUState m_previous{};
+  uint64_t m_cycle{};
+  uint64_t m_dropped{};
+
+  uint8_t* m_data(uint32_t slot);
+  void m_open(const CPUState& keyframe);
+  void m_submit();
+};
+
+// RunTraced steps a packed state like RunFor and records every step.
+uint64_t RunTraced(CPUState& state, uint64_t maxCycles,
+                   TraceRecorder& recorder);
+
+// TraceReplayer indexes a trace and rebuilds the state of any stream at any
+// recorded cycle by applying records forward from the nearest keyframe.
+class TraceReplayer {
+public:
+  // Load reads a whole trace. It returns nothing if the input is not a
+  // well formed trace.
+  static std::optional<TraceReplayer> Load(std::istream& in);
+
+  std::vector<uint32_t> Streams() const;
+
+  // End is the last cycle recorded for stream.
+  uint64_t End(uint32_t stream = 0) const;
+
+  // StateAt returns the state after cycle steps, where cycle 0 is the state
+  // the recorder started from. It returns nothing for cycles that were never
+  // recorded or were dropped.
+  std::optional<CPUState> StateAt(uint64_t cycle, uint32_t stream = 0) const;
+
+private:
+  struct Chunk {
+    uint32_t stream{};
+    uint64_t firstCycle{};
+    uint64_t steps{};
+    CPUState keyframe{};
+    size_t offset{}; // Payload position in m_data.
+    size_t bytes{};
+  };
+
+  std::vector<uint8_t> m_data{};
+  std::vector<Chunk> m_chunks{}; // Sorted by stream, then first cycle.
+
+  TraceReplayer() = default;
+};
+
+} // namespace cpu
@@ -0,0 +1,163 @@
+#include "TranslationCache.h"
+
+#include "CPUDefs.h"
+#include "CPUState.h"
+#include "Nibble.h"
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace cpu {
+
+namespace {
+constexpr size_t defaultCapacity{4096};
+
+uint64_t nibbleMask(const uint8_t addr) {
+  return uint64_t{0xF} << CPUState::ShiftOf(uint4(addr));
+}
+} // namespace
+
+// The blocks are found by following fall-through, jump and branch targets
+// from the entry. Jump targets are arguments in the image, so they are known
+// statically; only Mov into PC leaves the translation.
+Translation::Translation(const uint64_t image, const uint8_t entry) {
+  CPUState state{};
+  state.Image = image;
+  const auto word = [&state](const uint8_t addr) {
+    return state.Load(uint4(static_cast<uint8_t>(addr & 0xF))).Raw();
+  };
+
+  m_blockAt.fill(m_none);
+  uint8_t count{0};
+  std::vector<uint8_t> pending{entry};
+
+  while (!pending.empty()) {
+    const uint8_t start{pending.back()};
+    pending.pop_back();
+    if (m_blockAt[start] != m_none) {
+      continue;
+    }
+
+    Block& block{m_blocks[count]};
+    m_blockAt[start] = count++;
+    block.start = start;
+
+    uint8_t pc{start};
+    bool ended{false};
+    while (!ended && block.length < MemSizeWords) {
+      const uint8_t raw{word(pc)};
+      const auto opcode{static_cast<OpCode>(raw)};
+      const bool hasArg{raw != std::to_underlying(OpCode::Halt) &&
+                        raw <= std::to_underlying(OpCode::JumpNZ)};
+
+      Block::Op& op{block.ops[block.length++]};
+      op.opcode = opcode;
+      op.raw = raw;
+      op.arg = word(pc + 1);
+      op.src = op.arg >> 2;
+      op.dest = op.arg & 0x3;
+      op.next = (pc + (hasArg ? 2 : 1)) & 0xF;
+
+      m_codeMask |= nibbleMask(pc);
+      if (hasArg) {
+        m_codeMask |= nibbleMask((pc + 1) & 0xF);
+      }
+
+      switch (opcode) {
+      case OpCode::Jump:
+        pending.push_back(op.arg);
+        ended = true;
+        break;
+      case OpCode::JumpZ:
+      case OpCode::JumpNZ:
+        pending.push_back(op.arg);
+        pending.push_back(op.next);
+        ended = true;
+        break;
+      case OpCode::Halt:
+        ended = true;
+        break;
+      case OpCode::Mov:
+        ended = op.dest == regID::PC;
+        break;
+      default:
+        break;
+      }
+      pc = op.next;
+    }
+
+    block.fallthrough = pc;
+    if (!ended) {
+      pending.push_back(pc);
+    }
+  }
+}
+
+const Block* Translation::BlockAt(const uint8_t pc) const {
+  const uint8_t index{m_blockAt[pc]};
+  return index == m_none ? nullptr : &m_blocks[index];
+}
+
+uint64_t Translation::CodeMask() const {
+  return m_codeMask;
+}
+
+TranslationCache::TranslationCache(const size_t capacity) : m_lru{capacity} {}
+
+TranslationCache& TranslationCache::Global() {
+  static TranslationCache cache{defaultCapacity};
+  return cache;
+}
+
+std::shared_ptr<const Translation>
+TranslationCache::Get(const uint64_t image, const uint8_t entry) {
+  const Key key{image, entry};
+  {
+    const std::scoped_lock lock{m_mutex};
+    if (auto found{m_lru.Find(key)}) {
+      m_stats.Hits++;
+      return std::move(*found);
+    }
+    m_stats.Misses++;
+  }
+
+  // Translate outside the lock; if another thread raced us the first
+  // translation to be inserted wins.
+  auto translation{std::make_shared<const Translation>(image, entry)};
+
+  const std::scoped_lock lock{m_mutex};
+  return m_lru.Insert(key, std::move(translation));
+}
+
+void TranslationCache::SetCapacity(const size_t capacity) {
+  const std::scoped_lock lock{m_mutex};
+  m_lru.SetCapacity(capacity);
+}
+
+size_t TranslationCache::Size() const {
+  const std::scoped_lock lock{m_mutex};
+  return m_lru.Size();
+}
+
+TranslationCache::Stats TranslationCache::GetStats() const {
+  const std::scoped_lock lock{m_mutex};
+  Stats stats{m_stats};
+  stats.Evictions = m_lru.Evictions();
+  return stats;
+}
+
+void TranslationCache::Clear() {
+  const std::scoped_lock lock{m_mutex};
+  m_lru.Clear();
+  m_stats = {};
+}
+
+size_t TranslationCache::KeyHash::operator()(const Key& key) const {
+  CPUState state{};
+  state.Image = key.image;
+  state.Registers[regID::PC] = key.entry;
+  return static_cast<size_t>(Hash(state));
+}
+
+} // namespace cpu
@@ -0,0 +1,96 @@
+#pragma once
+
+#include "CPUDefs.h"
+#include "CPUState.h"
+#include "LRUCache.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+
+namespace cpu {
+
+// Block is a translated basic block: the instructions from its start address
+// up to and including the first Jump, JumpZ, JumpNZ, Halt or Mov into PC.
+// Operands are parsed once at translation time so running a block is a
+// single pass over its ops.
+struct Block {
+  struct Op {
+    OpCode opcode{};
+    uint8_t raw{}; // Opcode word as loaded into IS.
+    uint8_t arg{};
+    uint8_t src{};
+    uint8_t dest{};
+    uint8_t next{}; // PC once this op has fetched its words.
+  };
+
+  std::array<Op, MemSizeWords> ops{};
+  uint8_t length{};
+  uint8_t start{};
+  uint8_t fallthrough{}; // PC after the block when it ends without a jump.
+};
+
+// Translation holds the blocks reachable from an entry address of one memory
+// image. It is immutable once built so running CPUs can share it.
+class Translation {
+public:
+  Translation(uint64_t image, uint8_t entry);
+
+  // BlockAt returns the block starting at pc, or nullptr if none was
+  // statically reachable from the entry.
+  const Block* BlockAt(uint8_t pc) const;
+
+  // CodeMask has every nibble set that some block decoded, in the layout of
+  // CPUState::Image. Writes outside it cannot change any block.
+  uint64_t CodeMask() const;
+
+private:
+  std::array<uint8_t, MemSizeWords> m_blockAt{};
+  std::array<Block, MemSizeWords> m_blocks{};
+  uint64_t m_codeMask{};
+
+  static constexpr uint8_t m_none{0xFF};
+};
+
+// TranslationCache maps a memory image and entry address to its Translation.
+// It is bounded and evicts the least recently used image once full. All
+// members are safe to call from multiple threads.
+class TranslationCache {
+public:
+  struct Stats {
+    uint64_t Hits{};
+    uint64_t Misses{};
+    uint64_t Evictions{};
+  };
+
+  explicit TranslationCache(size_t capacity);
+
+  // Global is the process-wide cache BlockCPU uses by default.
+  static TranslationCache& Global();
+
+  std::shared_ptr<const Translation> Get(uint64_t image, uint8_t entry);
+
+  void SetCapacity(size_t capacity);
+  size_t Size() const;
+  Stats GetStats() const;
+  void Clear();
+
+private:
+  struct Key {
+    uint64_t image{};
+    uint8_t entry{};
+
+    bool operator==(const Key&) const = default;
+  };
+  struct KeyHash {
+    size_t operator()(const Key& key) const;
+  };
+
+  mutable std::mutex m_mutex{};
+  LRUCache<Key, std::shared_ptr<const Translation>, KeyHash> m_lru;
+  Stats m_stats{};
+};
+
+} // namespace cpu
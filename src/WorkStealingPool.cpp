@@ -0,0 +1,86 @@
+#include "WorkStealingPool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <utility>
+
+namespace cpu {
+
+WorkStealingPool::WorkStealingPool(const size_t threads)
+    : m_threads{threads} {
+  if (m_threads == 0) {
+    m_threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+}
+
+void WorkStealingPool::Run(std::vector<Task> tasks) {
+  std::vector<Worker> workers(m_threads);
+  for (size_t i = 0; i < tasks.size(); i++) {
+    workers[i % m_threads].tasks.push_back(std::move(tasks[i]));
+  }
+
+  m_stats.assign(m_threads, {});
+  if (m_threads == 1) {
+    m_work(workers, 0);
+    return;
+  }
+
+  std::vector<std::jthread> threads{};
+  threads.reserve(m_threads);
+  for (size_t id = 0; id < m_threads; id++) {
+    threads.emplace_back([this, &workers, id] { m_work(workers, id); });
+  }
+}
+
+size_t WorkStealingPool::Threads() const {
+  return m_threads;
+}
+
+const std::vector<WorkStealingPool::WorkerStats>&
+WorkStealingPool::GetStats() const {
+  return m_stats;
+}
+
+bool WorkStealingPool::m_pop(Worker& worker, Task& task, const bool fromBack) {
+  const std::scoped_lock lock{worker.mutex};
+  if (worker.tasks.empty()) {
+    return false;
+  }
+  if (fromBack) {
+    task = std::move(worker.tasks.back());
+    worker.tasks.pop_back();
+  } else {
+    task = std::move(worker.tasks.front());
+    worker.tasks.pop_front();
+  }
+  return true;
+}
+
+// m_work drains the worker's own deque and then steals. Tasks never spawn new
+// tasks, so once every deque is empty the worker is done.
+void WorkStealingPool::m_work(std::vector<Worker>& workers, const size_t id) {
+  WorkerStats& stats{m_stats[id]};
+  Task task{};
+
+  while (true) {
+    bool found{m_pop(workers[id], task, false)};
+    for (size_t i = 1; !found && i < workers.size(); i++) {
+      found = m_pop(workers[(id + i) % workers.size()], task, true);
+      stats.Stolen += found;
+    }
+    if (!found) {
+      return;
+    }
+
+    const auto start{std::chrono::steady_clock::now()};
+    task(id);
+    const auto end{std::chrono::steady_clock::now()};
+    stats.BusyNanos += static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(end - start)
+            .count());
+    stats.Executed++;
+  }
+}
+
+} // namespace cpu
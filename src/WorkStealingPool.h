@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+namespace cpu {
+
+// WorkStealingPool runs a batch of independent tasks across a fixed number of
+// threads. Each worker owns a deque, takes work from its front and, once it
+// runs dry, steals from the back of the other workers' deques. Job lengths
+// vary a lot between programs, so stealing keeps every thread busy until the
+// whole batch is done.
+class WorkStealingPool {
+public:
+  // A task receives the index of the worker running it.
+  using Task = std::function<void(size_t worker)>;
+
+  struct WorkerStats {
+    uint64_t Executed{};
+    uint64_t Stolen{};
+    uint64_t BusyNanos{};
+  };
+
+  // Zero threads picks one per hardware thread.
+  explicit WorkStealingPool(size_t threads = 0);
+
+  // Run executes every task and returns once all of them have finished.
+  // Tasks are dealt round robin, so worker i starts with tasks i, i+n, ...
+  void Run(std::vector<Task> tasks);
+
+  size_t Threads() const;
+
+  // Stats for the most recent Run, one entry per worker.
+  const std::vector<WorkerStats>& GetStats() const;
+
+private:
+  struct Worker {
+    std::mutex mutex{};
+    std::deque<Task> tasks{};
+  };
+
+  size_t m_threads{};
+  std::vector<WorkerStats> m_stats{};
+
+  static bool m_pop(Worker& worker, Task& task, bool fromBack);
+  void m_work(std::vector<Worker>& workers, size_t id);
+};
+
+} // namespace cpu
@@ -1,4 +1,5 @@
 #include "ALU.h"
+#include "ALUTables.h"
 #include "CPUDefs.h"
 
 #include <cassert>
@@ -90,6 +91,60 @@ void TestFlags() {
   assert(alu.GetFlags().Zero == true);
 }
 
+void TestTablesMatchReference() {
+  for (uint8_t a = 0; a < 16; a++) {
+    for (uint8_t b = 0; b < 16; b++) {
+      const uint4 inA{a};
+      const uint4 inB{b};
+      for (const OpCode op : {OpCode::Add, OpCode::Sub}) {
+        Register ripple{};
+        Register table{};
+        alu::ALU reference{ripple, alu::Backend::RippleCarry};
+        alu::ALU lookup{table, alu::Backend::Table};
+        reference.DoOperation(inA, inB, op);
+        lookup.DoOperation(inA, inB, op);
+
+        assert(ripple == table);
+        assert(alu::PackFlags(reference.GetFlags()) ==
+               alu::PackFlags(lookup.GetFlags()));
+      }
+    }
+  }
+
+  // Sub sees the sign of the negated input: 0 - (-8) wraps without overflow.
+  static_assert(alu::Lookup(uint4(0), uint4(8), OpCode::Sub) ==
+                (0x8 | (flagBit::Negative << 4)));
+  static_assert(alu::Lookup(uint4(7), uint4(1), OpCode::Add) ==
+                (0x8 | ((flagBit::Overflow | flagBit::Negative) << 4)));
+}
+
+void TestRegisterTransitions() {
+  using namespace alu::transition;
+
+  for (uint8_t a = 0; a < 16; a++) {
+    for (uint8_t b = 0; b < 16; b++) {
+      // Mov B -> A.
+      [[maybe_unused]] uint16_t entry{
+          alu::RegisterTransitions[alu::RegisterTableIndex(OpCode::Mov, 0b0100,
+                                                           a, b)]};
+      assert(NewA(entry) == b && NewB(entry) == b && !(entry & WritesALU));
+
+      // Sub B, A.
+      entry = alu::RegisterTransitions[alu::RegisterTableIndex(
+          OpCode::Sub, 0b0100, a, b)];
+      [[maybe_unused]] const uint8_t sub{
+          alu::Lookup(uint4(b), uint4(a), OpCode::Sub)};
+      assert(NewA(entry) == (sub & 0xF) && NewB(entry) == b);
+      assert(NewFlags(entry) == sub >> 4 && (entry & WritesALU));
+
+      // Anything naming IS or PC is left to the interpreter.
+      entry = alu::RegisterTransitions[alu::RegisterTableIndex(
+          OpCode::Add, 0b0011, a, b)];
+      assert(entry & Fallback);
+    }
+  }
+}
+
 } // namespace
 
 } // namespace cpu
@@ -99,4 +154,6 @@ void RunAllALUTests() {
   cpu::TestAddAll();
   cpu::TestSubAll();
   cpu::TestFlags();
+  cpu::TestTablesMatchReference();
+  cpu::TestRegisterTransitions();
 }
@@ -0,0 +1,150 @@
+#include "Async.h"
+#include "CPU.h"
+#include "CPUState.h"
+#include "DeviceBus.h"
+#include "RunResult.h"
+
+#include "TestUtils.h"
+
+#include <array>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace cpu::test {
+
+namespace {
+// finish resumes a task until it is done and returns how many resumes that
+// took.
+size_t finish(Task& task) {
+  size_t resumes{0};
+  while (!task.Done()) {
+    task.Resume();
+    resumes++;
+  }
+  return resumes;
+}
+} // namespace
+
+void testAsyncMatchesRun() {
+  QuietStderr quiet{};
+  TestRandom random{.seed = 7};
+  for (int i = 0; i < 2000; i++) {
+    CPUState state{};
+    state.Image = random.Next();
+
+    CPU blocking{state};
+    [[maybe_unused]] const RunResult expected{blocking.Run(500)};
+
+    CPU cooperative{state};
+    Task task{cooperative.RunAsync(500, 37)};
+    finish(task);
+    assert(task.Result() == expected);
+    assert(cooperative.GetState() == blocking.GetState());
+  }
+}
+
+void testAsyncSlices() {
+  // The tight loop never halts, so it yields every slice until the budget
+  // is gone.
+  CPU cpu{TestImage("2161820000000000")};
+  Task task{cpu.RunAsync(1000, 100)};
+  assert(!task.Done());
+  assert(finish(task) == 10);
+  assert(task.Result() ==
+         (RunResult{.Status = RunStatus::BudgetExhausted, .Cycles = 1000}));
+
+  // A halting program returns at once.
+  CPU countdown{TestImage("21512371A6000000")};
+  Task halts{countdown.RunAsync(1000, 4)};
+  finish(halts);
+  assert(halts.Result() ==
+         (RunResult{.Status = RunStatus::Halted, .Cycles = 10}));
+}
+
+void testAsyncBlocked() {
+  // The echo program yields on an empty port and resumes once fed: In 0;
+  // Out 1; Jump 0.
+  DeviceBus bus{};
+  CPU cpu{TestImage("B0C1800000000000")};
+  cpu.AttachBus(&bus);
+  Task task{cpu.RunAsync(30, 1000)};
+
+  task.Resume();
+  task.Resume();
+  assert(!task.Done());
+  const std::array<uint8_t, 5> samples{1, 2, 3, 4, 5};
+  bus.Send(0, samples);
+  task.Resume();
+  assert(!task.Done() && bus.Available(1) == 5);
+  bus.Send(0, samples);
+  task.Resume();
+  assert(task.Done());
+  assert(task.Result() ==
+         (RunResult{.Status = RunStatus::BudgetExhausted, .Cycles = 30}));
+}
+
+void testExecutor() {
+  // Every machine gets one slice per round.
+  constexpr size_t machines{10000};
+  std::vector<CPU> cpus(machines, CPU{TestImage("2161820000000000")});
+  Executor executor{};
+  for (CPU& cpu : cpus) {
+    executor.Spawn(cpu.RunAsync(640, 64));
+  }
+  assert(executor.RunRound() == machines);
+  executor.Run();
+  assert(executor.Switches() == machines * 10);
+  for (size_t id = 0; id < executor.Size(); id++) {
+    assert(executor.Get(id).Done());
+    assert(executor.Get(id).Result().Cycles == 640);
+  }
+
+  // Finished and unfinished machines mix freely.
+  CPU halts{TestImage("21512371A6000000")};
+  CPU spins{TestImage("2161820000000000")};
+  Executor mixed{};
+  [[maybe_unused]] const size_t first{mixed.Spawn(halts.RunAsync(100, 4))};
+  [[maybe_unused]] const size_t second{mixed.Spawn(spins.RunAsync(100, 4))};
+  mixed.Run();
+  assert(mixed.Get(first).Result().Status == RunStatus::Halted);
+  assert(mixed.Get(second).Result().Cycles == 100);
+}
+
+void testFramePool() {
+  // Once warm, tasks reuse pooled frames instead of the heap.
+  CPU cpu{TestImage("21512371A6000000")};
+  {
+    Task warm{cpu.RunAsync(100)};
+  }
+  [[maybe_unused]] const FramePool::Stats before{FramePool::Local().GetStats()};
+  for (int i = 0; i < 1000; i++) {
+    cpu.SetState(TestImage("21512371A6000000"));
+    Task task{cpu.RunAsync(100)};
+    finish(task);
+  }
+  [[maybe_unused]] const FramePool::Stats& after{FramePool::Local().GetStats()};
+  assert(after.Allocations == before.Allocations + 1000);
+  assert(after.Chunks == before.Chunks);
+  assert(after.Oversized == before.Oversized);
+
+  // Oversized requests still work.
+  FramePool pool{};
+  void* const big{pool.Allocate(4096)};
+  void* const small{pool.Allocate(100)};
+  pool.Deallocate(big, 4096);
+  pool.Deallocate(small, 100);
+  assert(pool.Allocate(100) == small);
+  assert(pool.GetStats().Oversized == 1 && pool.GetStats().Chunks == 1);
+}
+
+} // namespace cpu::test
+
+void RunAllAsyncTests() {
+  cpu::test::testAsyncMatchesRun();
+  cpu::test::testAsyncSlices();
+  cpu::test::testAsyncBlocked();
+  cpu::test::testExecutor();
+  cpu::test::testFramePool();
+}
@@ -0,0 +1,92 @@
+#include "BatchCPU.h"
+#include "CPU.h"
+#include "CPUState.h"
+
+#include "TestUtils.h"
+
+#include <cassert>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace cpu::test {
+
+namespace {
+constexpr uint64_t maxCycles{48};
+
+// Runs every lane against a scalar CPU started from the same random image.
+template <size_t N, typename Ops> void testMatchesCPU(const uint64_t seed) {
+  QuietStderr quiet{};
+  TestRandom rng{seed};
+  auto batch = std::make_unique<BatchCPU<N, Ops>>();
+  std::vector<CPU> cpus{};
+
+  for (size_t lane = 0; lane < N; lane++) {
+    CPUState state{};
+    state.Image = rng.Next();
+    // A few lanes start with registers and flags set.
+    if (lane % 3 == 0) {
+      const uint64_t bits{rng.Next()};
+      state.Registers[regID::A] = bits & 0xF;
+      state.Registers[regID::B] = (bits >> 4) & 0xF;
+      state.Registers[regID::PC] = (bits >> 8) & 0xF;
+      state.Flags = (bits >> 12) & 0x7;
+    }
+    batch->Load(lane, state);
+    cpus.emplace_back(state);
+  }
+
+  const uint64_t steps{batch->Run(maxCycles)};
+  assert(steps <= maxCycles);
+
+  for (size_t lane = 0; lane < N; lane++) {
+    CPU& cpu{cpus[lane]};
+    uint64_t cycles{0};
+    while (!cpu.IsHalted() && cycles < steps) {
+      cpu.Cycle();
+      cycles++;
+    }
+    assert(batch->Get(lane) == cpu.GetState());
+    assert(batch->Cycles(lane) == cycles);
+    assert(batch->IsHalted(lane) == cpu.IsHalted());
+  }
+}
+} // namespace
+
+void testBatchScalar() {
+  testMatchesCPU<67, batch::ScalarOps>(1);
+}
+
+void testBatchVector() {
+  // 70 lanes leaves a scalar tail after the vector chunks.
+  testMatchesCPU<70, batch::VectorOps>(2);
+  testMatchesCPU<256, batch::VectorOps>(3);
+#if defined(__SSE2__)
+  testMatchesCPU<64, batch::SSEOps>(4);
+#endif
+}
+
+void testBatchEmptyLanes() {
+  BatchCPU<8> batch{};
+  assert(batch.Run(10) == 0);
+
+  // LoadAI 5, Halt.
+  CPUState state{};
+  state.Store(uint4(std::to_underlying(OpCode::LoadAI)), uint4(0));
+  state.Store(uint4(5), uint4(1));
+  batch.Load(3, state);
+
+  assert(batch.Run(10) == 2);
+  assert(batch.IsHalted(3));
+  assert(batch.Cycles(3) == 2);
+  assert(batch.Get(3).GetRegister(regID::A) == 5);
+  assert(batch.Get(3).GetRegister(regID::PC) == 3);
+}
+
+} // namespace cpu::test
+
+void RunAllBatchCPUTests() {
+  cpu::test::testBatchScalar();
+  cpu::test::testBatchVector();
+  cpu::test::testBatchEmptyLanes();
+}
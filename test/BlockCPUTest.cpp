@@ -0,0 +1,109 @@
+#include "BlockCPU.h"
+#include "CPU.h"
+#include "CPUState.h"
+#include "Superopt.h"
+#include "TranslationCache.h"
+
+#include "TestUtils.h"
+
+#include <cassert>
+#include <cstdint>
+
+namespace cpu::test {
+
+void testBlockMatchesCPU() {
+  QuietStderr quiet{};
+  TestRandom rng{31};
+  TranslationCache cache{64};
+
+  for (int run = 0; run < 2000; run++) {
+    CPUState state{};
+    state.Image = rng.Next();
+    state.Flags = rng.Next() & 0x7;
+    state.Registers[regID::PC] = run % 5 == 0 ? rng.Next() & 0xF : 0;
+    const uint64_t budget{rng.Next() % 64};
+
+    CPU cpu{state};
+    uint64_t cycles{0};
+    while (!cpu.IsHalted() && cycles < budget) {
+      cpu.Cycle();
+      cycles++;
+    }
+
+    BlockCPU block{state, cache};
+    assert(block.Run(budget) == cycles);
+    assert(block.GetState() == cpu.GetState());
+  }
+}
+
+void testTranslationReuse() {
+  // Count B down from 3 in a loop.
+  const auto image{superopt::ParseImage("21512371A6000000")};
+  assert(image.has_value());
+  TranslationCache cache{8};
+
+  BlockCPU first{*image, cache};
+  assert(first.Run(1000) == 10);
+  assert(cache.GetStats().Misses == 1);
+  assert(cache.GetStats().Hits == 0);
+
+  BlockCPU second{*image, cache};
+  assert(second.Run(1000) == 10);
+  assert(second.GetState() == first.GetState());
+  assert(cache.GetStats().Misses == 1);
+  assert(cache.GetStats().Hits == 1);
+
+  // Loop body, loop exit and Halt are blocks; the data words are not code.
+  const auto translation{cache.Get(image->Image, 0)};
+  assert(translation->BlockAt(0) != nullptr);
+  assert(translation->BlockAt(6) != nullptr);
+  assert(translation->BlockAt(0xA) != nullptr);
+  assert(translation->BlockAt(2) == nullptr);
+  [[maybe_unused]] CPUState code{};
+  code.Image = translation->CodeMask();
+  assert(code.Load(uint4(0xA)) == 0xF && code.Load(uint4(0xB)) == 0);
+}
+
+void testTranslationEviction() {
+  TranslationCache cache{2};
+  cache.Get(1, 0);
+  cache.Get(2, 0);
+  cache.Get(1, 0); // 2 is now least recently used.
+  cache.Get(3, 0);
+  assert(cache.Size() == 2);
+  assert(cache.GetStats().Evictions == 1);
+
+  cache.Get(1, 0);
+  assert(cache.GetStats().Hits == 2);
+  cache.Get(2, 0);
+  assert(cache.GetStats().Misses == 4);
+
+  cache.SetCapacity(0);
+  assert(cache.Size() == 0);
+}
+
+void testBlockSelfModifyingCode() {
+  // Patches the argument of the LoadAI at 8 on the first pass.
+  const auto image{superopt::ParseImage("882049882561A200")};
+  assert(image.has_value());
+  TranslationCache cache{8};
+
+  CPU reference{*image};
+  reference.Run();
+
+  BlockCPU cpu{*image, cache};
+  assert(cpu.Run(100) == 11);
+  assert(cpu.GetState() == reference.GetState());
+
+  // The patched image got its own translation.
+  assert(cache.GetStats().Misses == 2);
+}
+
+} // namespace cpu::test
+
+void RunAllBlockCPUTests() {
+  cpu::test::testBlockMatchesCPU();
+  cpu::test::testTranslationReuse();
+  cpu::test::testTranslationEviction();
+  cpu::test::testBlockSelfModifyingCode();
+}
@@ -0,0 +1,176 @@
+#include "CPU.h"
+#include "CPUDefs.h"
+#include "CPUState.h"
+#include "Step.h"
+
+#include "TestUtils.h"
+
+#include <cassert>
+#include <utility>
+
+namespace cpu::test {
+
+namespace {
+// Counts A down from 3 to 0 then stores it, leaving a few cycles to fork in.
+void storeCountdown(Memory& mem) {
+  StoreVal(mem, 3, 14);
+  StoreVal(mem, 1, 15);
+
+  // A = 3
+  StoreOp(mem, OpCode::LoadA, 0);
+  StoreArg(mem, 14, 1);
+  // B = 1
+  StoreOp(mem, OpCode::LoadB, 2);
+  StoreArg(mem, 15, 3);
+  // A = A - B
+  StoreOp(mem, OpCode::Sub, 4);
+  Store2Args(mem, 0, 1, 5);
+  // Loop while A != 0
+  StoreOp(mem, OpCode::JumpNZ, 6);
+  StoreArg(mem, 4, 7);
+  // mem[13] = A
+  StoreOp(mem, OpCode::StoreA, 8);
+  StoreArg(mem, 13, 9);
+}
+} // namespace
+
+void testStateLayout() {
+  CPUState state{};
+
+  // Word 0 is the high nibble of byte 0, word 1 the low nibble.
+  state.Store(uint4(0xA), uint4(0));
+  state.Store(uint4(0x5), uint4(1));
+  state.Store(uint4(0xF), uint4(15));
+  assert(state.Image == 0x0F000000000000A5);
+  assert(state.Load(uint4(0)) == 0xA);
+  assert(state.Load(uint4(1)) == 0x5);
+  assert(state.Load(uint4(15)) == 0xF);
+
+  state.Store(uint4(0x3), uint4(0));
+  assert(state.Load(uint4(0)) == 0x3);
+  assert(state.Load(uint4(1)) == 0x5);
+
+  state.SetFlags({.Overflow = true, .Zero = false, .Negative = true});
+  assert(state.Flags == (flagBit::Overflow | flagBit::Negative));
+  assert(state.GetFlags().Overflow && !state.GetFlags().Zero);
+}
+
+void testStateRoundTrip() {
+  WithCPU cpu{};
+  storeCountdown(cpu.mem);
+
+  cpu->Cycle();
+  cpu->Cycle();
+  cpu->Cycle();
+
+  const CPUState state{cpu->GetState()};
+  assert(state.GetRegister(regID::A) == 2);
+  assert(state.GetRegister(regID::B) == 1);
+  assert(state.GetRegister(regID::PC) == 6);
+  assert(state.GetRegister(regID::IS) == std::to_underlying(OpCode::Sub));
+  assert(state.ALUResult == 2);
+  assert(state.Halted == 0);
+
+  const CPU restored{state};
+  assert(restored.GetState() == state);
+}
+
+void testFork() {
+  WithCPU cpu{};
+  storeCountdown(cpu.mem);
+
+  cpu->Cycle();
+  cpu->Cycle();
+
+  // The fork owns its own memory and ALU result buffer.
+  CPU fork{*cpu.cpu};
+  fork.GetMemory().Store(uint4(7), uint4(12));
+  fork.Run();
+  assert(fork.IsHalted());
+  assert(fork.GetRegisterA() == 0);
+  assert(fork.GetFlags().Zero);
+
+  assert(!cpu->IsHalted());
+  assert(ReadVal(cpu.mem, 12) == 0);
+  cpu->Run();
+  StoreVal(cpu.mem, 7, 12);
+  assert(cpu->GetState() == fork.GetState());
+
+  // Assignment and moves go through the same snapshot.
+  CPU moved{std::move(fork)};
+  CPU assigned{};
+  assigned = moved;
+  assert(assigned.GetState() == cpu->GetState());
+}
+
+void testRegisterAliases() {
+  WithCPU cpu{};
+
+  // Mov A -> PC is an indirect jump to the value in A.
+  StoreOp(cpu.mem, OpCode::LoadAI, 0);
+  StoreArg(cpu.mem, 9, 1);
+  StoreOp(cpu.mem, OpCode::Mov, 2);
+  Store2Args(cpu.mem, regID::A, regID::PC, 3);
+  StoreOp(cpu.mem, OpCode::LoadAI, 4);
+  StoreArg(cpu.mem, 1, 5);
+
+  cpu->Run();
+  assert(cpu->GetRegisterA() == 9);
+  assert(cpu->GetState().GetRegister(regID::PC) == 10);
+}
+
+void testStepMatchesCPU() {
+  QuietStderr quiet{};
+  TestRandom rng{11};
+
+  for (int run = 0; run < 2000; run++) {
+    CPUState state{};
+    state.Image = rng.Next();
+    state.Flags = rng.Next() & 0x7;
+
+    CPU cpu{state};
+    for (int cycle = 0; cycle < 32 && !cpu.IsHalted(); cycle++) {
+      cpu.Cycle();
+      Step(state);
+      assert(state == cpu.GetState());
+    }
+  }
+
+  // RunFor stops at Halt and counts it.
+  CPUState state{};
+  state.Store(uint4(std::to_underlying(OpCode::LoadAI)), uint4(0));
+  state.Store(uint4(3), uint4(1));
+  assert(RunFor(state, 100) == 2);
+  assert(state.Halted && state.GetRegister(regID::A) == 3);
+}
+
+void testRunBoundedMatchesCPU() {
+  QuietStderr quiet{};
+  TestRandom rng{12};
+
+  for (int run = 0; run < 1000; run++) {
+    CPUState state{};
+    state.Image = rng.Next();
+    const uint64_t budget{rng.Next() % 200};
+    const LoopCheck loops{run % 2 == 0 ? LoopCheck::Off : LoopCheck::Brent};
+
+    CPU cpu{state};
+    [[maybe_unused]] const RunResult expected{cpu.Run(budget, loops)};
+    [[maybe_unused]] const RunResult result{RunBounded(state, budget, loops)};
+    assert(result.Status == expected.Status);
+    assert(result.Cycles == expected.Cycles);
+    assert(result.Period == expected.Period);
+    assert(state == cpu.GetState());
+  }
+}
+
+} // namespace cpu::test
+
+void RunAllCPUStateTests() {
+  cpu::test::testStateLayout();
+  cpu::test::testStateRoundTrip();
+  cpu::test::testFork();
+  cpu::test::testRegisterAliases();
+  cpu::test::testStepMatchesCPU();
+  cpu::test::testRunBoundedMatchesCPU();
+}
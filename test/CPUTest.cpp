@@ -267,6 +267,63 @@ void testJumpNotZero() {
   delete cpu;
 }
 
+void testRunBudget() {
+  WithCPU cpu{};
+
+  // Jump 0 forever.
+  StoreOp(cpu.mem, OpCode::Jump, 0);
+  StoreArg(cpu.mem, 0, 1);
+
+  [[maybe_unused]] const RunResult result{cpu->Run(100)};
+  assert(result.Status == RunStatus::BudgetExhausted);
+  assert(result.Cycles == 100);
+  assert(!cpu->IsHalted());
+}
+
+void testRunLoopDetection() {
+  WithCPU cpu{};
+
+  // B = 1; A = A + B forever. A wraps every 16 passes of a 2 cycle loop.
+  StoreOp(cpu.mem, OpCode::LoadB, 0);
+  StoreArg(cpu.mem, 15, 1);
+  StoreOp(cpu.mem, OpCode::Add, 2);
+  Store2Args(cpu.mem, 0, 1, 3);
+  StoreOp(cpu.mem, OpCode::Jump, 4);
+  StoreArg(cpu.mem, 2, 5);
+  StoreVal(cpu.mem, 1, 15);
+
+  [[maybe_unused]] const RunResult result{
+      cpu->Run(1'000'000, LoopCheck::Brent)};
+  assert(result.Status == RunStatus::Looping);
+  assert(result.Period == 32);
+  assert(result.Cycles < 4 * 32);
+}
+
+void testRunHaltAndFault() {
+  WithCPU cpu{};
+
+  StoreOp(cpu.mem, OpCode::LoadAI, 0);
+  StoreArg(cpu.mem, 3, 1);
+  StoreOp(cpu.mem, OpCode::Halt, 2);
+
+  RunResult result{cpu->Run(100, LoopCheck::Brent)};
+  assert(result.Status == RunStatus::Halted);
+  assert(result.Cycles == 2);
+
+  // Already halted, nothing more runs.
+  result = cpu->Run(100);
+  assert(result.Status == RunStatus::Halted);
+  assert(result.Cycles == 0);
+
+  // 0xB is not an instruction.
+  QuietStderr quiet{};
+  WithCPU faulting{};
+  StoreArg(faulting.mem, 0xB, 0);
+  result = faulting->Run(100);
+  assert(result.Status == RunStatus::Fault);
+  assert(result.Cycles == 1);
+}
+
 } // namespace cpu::test
 
 void RunAllCPUTests() {
@@ -284,4 +341,8 @@ void RunAllCPUTests() {
   cpu::test::testJump();
   cpu::test::testJumpZero();
   cpu::test::testJumpNotZero();
+
+  cpu::test::testRunBudget();
+  cpu::test::testRunLoopDetection();
+  cpu::test::testRunHaltAndFault();
 }
@@ -0,0 +1,79 @@
+#include "ALU.h"
+#include "CPU.h"
+#include "CPUDefs.h"
+#include "CPUState.h"
+#include "Memory.h"
+#include "Nibble.h"
+#include "RunResult.h"
+
+#include "TestUtils.h"
+
+#include <cassert>
+#include <cstdint>
+
+namespace cpu::test {
+
+namespace {
+
+// The addNumbers sample: 2 + 5 into 0xD, then 2 + 5 + ... into 0xE.
+constexpr auto addNumbers{ParseImage("2251254D614E0000")};
+// LoadAI 1; Mov A, B; LoadAI 3; Sub A, B; JumpNZ 6; Halt.
+constexpr auto countdown{ParseImage("21512371A6000000")};
+// LoadAI 1; Mov A, B; Jump 2; spins on the jump forever.
+constexpr auto tightLoop{ParseImage("2161820000000000")};
+
+static_assert(addNumbers.has_value() && countdown.has_value() &&
+              tightLoop.has_value());
+static_assert(!ParseImage("2251254D614E000").has_value());
+static_assert(!ParseImage("2251254D614E000G").has_value());
+
+constexpr Execution added{Execute(*addNumbers)};
+static_assert(added.Result.Status == RunStatus::Halted);
+static_assert(added.Result.Cycles == 7);
+static_assert(added.Final.Load(uint4(0xD)) == 5);
+static_assert(added.Final.Load(uint4(0xE)) == 7);
+
+static_assert(Execute(*countdown).Result ==
+              RunResult{.Status = RunStatus::Halted, .Cycles = 10});
+static_assert(Execute(*tightLoop).Result.Status == RunStatus::Looping);
+static_assert(Execute(*tightLoop, 64, LoopCheck::Off).Result.Status ==
+              RunStatus::BudgetExhausted);
+
+constexpr uint4 sum(const uint4 a, const uint4 b, const alu::Backend backend) {
+  Register result{};
+  alu::ALU unit{result, backend};
+  unit.DoOperation(a, b, OpCode::Add);
+  return result;
+}
+static_assert(sum(uint4(9), uint4(8), alu::Backend::RippleCarry) == 1);
+static_assert(sum(uint4(9), uint4(8), alu::Backend::Table) == 1);
+
+constexpr uint4 roundTrip(const uint4 value, const uint4 addr) {
+  Memory memory{MemSizeWords};
+  memory.Store(value, addr);
+  return memory.Load(addr);
+}
+static_assert(roundTrip(uint4(0xA), uint4(7)) == 0xA);
+
+} // namespace
+
+void testExecuteMatchesRuntimeCPU() {
+  // The same call at run time must agree with the constant evaluation.
+  assert(Execute(*addNumbers) == added);
+
+  TestRandom rng{113};
+  QuietStderr quiet{};
+  for (int run = 0; run < 200; run++) {
+    CPUState state{};
+    state.Image = rng.Next();
+    CPU cpu{state};
+    [[maybe_unused]] const RunResult result{cpu.Run(256, LoopCheck::Brent)};
+    assert(Execute(state, 256) == (Execution{cpu.GetState(), result}));
+  }
+}
+
+} // namespace cpu::test
+
+void RunAllConstexprTests() {
+  cpu::test::testExecuteMatchesRuntimeCPU();
+}
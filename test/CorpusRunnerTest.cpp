@@ -0,0 +1,111 @@
+#include "CPU.h"
+#include "CPUState.h"
+#include "Corpus.h"
+#include "CorpusRunner.h"
+#include "RunResult.h"
+
+#include "TestUtils.h"
+
+#include <cassert>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+namespace cpu::test {
+
+namespace {
+struct tempPath {
+  std::string path;
+  explicit tempPath(const std::string& name)
+      : path{(std::filesystem::temp_directory_path() / name).string()} {}
+  ~tempPath() {
+    std::filesystem::remove(path);
+  }
+};
+} // namespace
+
+void testLatencyHistogram() {
+  LatencyHistogram histogram{};
+  assert(histogram.Percentile(0.5) == 0);
+  for (uint64_t nanos = 1; nanos <= 1000; nanos++) {
+    histogram.Record(nanos);
+  }
+  assert(histogram.Count() == 1000);
+  assert(histogram.Max() == 1000);
+  assert(histogram.Percentile(1) == 1000);
+  // Bounds are within one bucket (12.5%) above the exact quantile.
+  [[maybe_unused]] const uint64_t p50{histogram.Percentile(0.5)};
+  assert(p50 >= 500 && p50 <= 500 * 9 / 8);
+  [[maybe_unused]] const uint64_t p99{histogram.Percentile(0.99)};
+  assert(p99 >= 990 && p99 <= 1000);
+
+  LatencyHistogram other{};
+  other.Record(5000);
+  histogram.Merge(other);
+  assert(histogram.Count() == 1001 && histogram.Max() == 5000);
+}
+
+void testRunCorpusMatchesCPU() {
+  // Mix instant halts with long budget-limited loops so batches differ a lot
+  // in cost and workers have to steal.
+  TestRandom rng{79};
+  std::vector<CPUState> states(5000);
+  for (size_t i = 0; i < states.size(); i++) {
+    states[i].Image = i % 7 == 0 ? 0x2161820000000000 : rng.Next();
+    states[i].Flags = rng.Next() & 0x7;
+  }
+
+  const tempPath in{"cpu4-runner-in.bin"};
+  const tempPath out{"cpu4-runner-out.bin"};
+  [[maybe_unused]] const bool written{
+      WriteCorpus(in.path, states, CorpusHeader::Registers)};
+  assert(written);
+  const auto input{CorpusReader::Open(in.path)};
+  assert(input.has_value());
+
+  const CorpusRunOptions options{
+      .Threads = 4, .Budget = 2000, .Loops = LoopCheck::Off, .Batch = 16};
+  CorpusReport report{};
+  {
+    CorpusWriter output{
+        out.path, input->Size(),
+        CorpusHeader::Registers | CorpusHeader::Results};
+    report = RunCorpus(*input, output, options);
+    [[maybe_unused]] const bool closed{output.Close()};
+    assert(closed);
+  }
+
+  assert(report.Programs == states.size());
+  assert(report.Workers.size() == 4);
+  assert(report.Latency.Count() == states.size());
+  uint64_t programs{0};
+  uint64_t batches{0};
+  for (const auto& worker : report.Workers) {
+    programs += worker.Programs;
+    batches += worker.Batches;
+  }
+  assert(programs == states.size());
+  assert(batches == (states.size() + 15) / 16);
+
+  const auto results{CorpusReader::Open(out.path)};
+  assert(results.has_value() && results->HasResults());
+  QuietStderr quiet{};
+  uint64_t cycles{0};
+  for (size_t i = 0; i < states.size(); i++) {
+    CPU cpu{states[i]};
+    const RunResult expected{cpu.Run(options.Budget, options.Loops)};
+    assert(results->State(i) == states[i]);
+    assert(results->Results()[i].ToRunResult() == expected);
+    assert(results->Results()[i].Final == cpu.GetState());
+    cycles += expected.Cycles;
+  }
+  assert(report.Cycles == cycles);
+}
+
+} // namespace cpu::test
+
+void RunAllCorpusRunnerTests() {
+  cpu::test::testLatencyHistogram();
+  cpu::test::testRunCorpusMatchesCPU();
+}
@@ -0,0 +1,141 @@
+#include "CPU.h"
+#include "CPUState.h"
+#include "Corpus.h"
+#include "Memory.h"
+#include "RunResult.h"
+
+#include "TestUtils.h"
+
+#include <cassert>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace cpu::test {
+
+namespace {
+// tempPath names a scratch file that is removed when it goes out of scope.
+struct tempPath {
+  std::string path;
+  explicit tempPath(const std::string& name)
+      : path{(std::filesystem::temp_directory_path() / name).string()} {}
+  ~tempPath() {
+    std::filesystem::remove(path);
+  }
+};
+
+std::vector<CPUState> randomStates(const uint64_t seed, const size_t count) {
+  TestRandom rng{seed};
+  std::vector<CPUState> states(count);
+  for (CPUState& state : states) {
+    state.Image = rng.Next();
+    state.Registers[regID::A] = rng.Next() & 0xF;
+    state.Registers[regID::PC] = rng.Next() & 0xF;
+    state.Flags = rng.Next() & 0x7;
+  }
+  return states;
+}
+} // namespace
+
+void testCorpusImagesMatchMemory() {
+  // Image bytes use Memory's packing: word 0 in the high nibble of byte 0.
+  CPUState state{};
+  for (uint8_t addr = 0; addr < MemSizeWords; addr++) {
+    state.Store(uint4(addr), uint4(addr));
+  }
+  const tempPath file{"cpu4-corpus-images.bin"};
+  [[maybe_unused]] const bool written{WriteCorpus(file.path, {&state, 1})};
+  assert(written);
+
+  const auto reader{CorpusReader::Open(file.path)};
+  assert(reader.has_value());
+  assert(reader->Size() == 1);
+  assert(!reader->HasRegisters() && !reader->HasResults());
+  assert(reader->Results().empty());
+
+  [[maybe_unused]] const auto* bytes{
+      reinterpret_cast<const uint8_t*>(reader->Images().data())};
+  assert(bytes[0] == 0x01 && bytes[1] == 0x23 && bytes[7] == 0xEF);
+
+  CPU cpu{reader->State(0)};
+  for (uint8_t addr = 0; addr < MemSizeWords; addr++) {
+    assert(cpu.GetMemory().Load(uint4(addr)) == addr);
+  }
+}
+
+void testCorpusRoundTrip() {
+  const std::vector<CPUState> states{randomStates(71, 1000)};
+  const tempPath file{"cpu4-corpus-roundtrip.bin"};
+
+  {
+    CorpusWriter writer{file.path, states.size(),
+                        CorpusHeader::Registers | CorpusHeader::Results};
+    assert(writer.Good());
+    QuietStderr quiet{};
+    // Fill back to front; results land by index, not by arrival.
+    for (size_t i = states.size(); i-- > 0;) {
+      CPU cpu{states[i]};
+      const RunResult result{cpu.Run(128, LoopCheck::Brent)};
+      writer.SetState(i, states[i]);
+      writer.SetResult(i, CorpusResult::From(cpu.GetState(), result));
+    }
+    [[maybe_unused]] const bool closed{writer.Close()};
+    assert(closed);
+  }
+
+  const auto reader{CorpusReader::Open(file.path)};
+  assert(reader.has_value());
+  assert(reader->Size() == states.size());
+  assert(reader->HasRegisters() && reader->HasResults());
+
+  QuietStderr quiet{};
+  for (size_t i = 0; i < states.size(); i++) {
+    assert(reader->Images()[i] == states[i].Image);
+    assert(reader->State(i) == states[i]);
+
+    CPU cpu{states[i]};
+    [[maybe_unused]] const RunResult result{cpu.Run(128, LoopCheck::Brent)};
+    [[maybe_unused]] const CorpusResult& stored{reader->Results()[i]};
+    assert(stored.ToRunResult() == result);
+    assert(stored.Final == cpu.GetState());
+  }
+}
+
+void testCorpusRejectsBadFiles() {
+  assert(!CorpusReader::Open("/nonexistent/cpu4-corpus.bin").has_value());
+
+  const tempPath file{"cpu4-corpus-bad.bin"};
+  const std::vector<CPUState> states{randomStates(73, 10)};
+  [[maybe_unused]] bool written{WriteCorpus(file.path, states)};
+  assert(written);
+
+  // Truncated column.
+  std::filesystem::resize_file(file.path, 64 + 8 * 9);
+  assert(!CorpusReader::Open(file.path).has_value());
+
+  // Wrong magic.
+  written = WriteCorpus(file.path, states);
+  assert(written);
+  {
+    std::fstream out{file.path, std::ios::in | std::ios::out |
+                                    std::ios::binary};
+    out.put('X');
+  }
+  assert(!CorpusReader::Open(file.path).has_value());
+
+  // Empty corpora are valid.
+  written = WriteCorpus(file.path, {});
+  assert(written);
+  const auto empty{CorpusReader::Open(file.path)};
+  assert(empty.has_value() && empty->Size() == 0);
+}
+
+} // namespace cpu::test
+
+void RunAllCorpusTests() {
+  cpu::test::testCorpusImagesMatchMemory();
+  cpu::test::testCorpusRoundTrip();
+  cpu::test::testCorpusRejectsBadFiles();
+}
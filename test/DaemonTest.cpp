@@ -0,0 +1,204 @@
+#include "CPUState.h"
+#include "Corpus.h"
+#include "Daemon.h"
+#include "RunResult.h"
+#include "Step.h"
+
+#include "TestUtils.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <unistd.h>
+
+namespace cpu::test {
+
+namespace {
+// runningServer serves on a fresh socket for the lifetime of the object.
+struct runningServer {
+  daemon::Server server;
+  std::jthread thread{};
+
+  explicit runningServer(daemon::ServerOptions options)
+      : server{withPath(std::move(options))} {
+    [[maybe_unused]] const bool listening{server.Listen()};
+    assert(listening);
+    thread = std::jthread{[this] { server.Serve(); }};
+  }
+  ~runningServer() {
+    server.Stop();
+    thread.join();
+  }
+
+  std::optional<daemon::Client> Connect() const {
+    return daemon::Client::Connect(path());
+  }
+
+  static std::string path() {
+    return (std::filesystem::temp_directory_path() /
+            ("cpu4d-test-" + std::to_string(getpid()) + ".sock"))
+        .string();
+  }
+  static daemon::ServerOptions withPath(daemon::ServerOptions options) {
+    options.Path = path();
+    return options;
+  }
+};
+
+std::vector<daemon::Request> randomRequests(const uint64_t seed,
+                                            const size_t count) {
+  TestRandom random{seed};
+  std::vector<daemon::Request> requests(count);
+  for (size_t i = 0; i < count; i++) {
+    requests[i].Id = i;
+    requests[i].Budget = 256;
+    requests[i].Initial.Image = random.Next();
+  }
+  return requests;
+}
+
+// checkResponses matches responses to requests by id and compares them with
+// a local run.
+void checkResponses(const std::vector<daemon::Request>& requests,
+                    std::vector<daemon::Response> responses) {
+  assert(responses.size() == requests.size());
+  std::sort(responses.begin(), responses.end(),
+            [](const auto& a, const auto& b) { return a.Id < b.Id; });
+  for (size_t i = 0; i < requests.size(); i++) {
+    CPUState state{requests[i].Initial};
+    [[maybe_unused]] const RunResult expected{RunBounded(
+        state, requests[i].Budget,
+        requests[i].Loops == 1 ? LoopCheck::Brent : LoopCheck::Off)};
+    assert(responses[i].Id == requests[i].Id);
+    assert(responses[i].Error == 0);
+    assert(responses[i].Result.Final == state);
+    assert(responses[i].Result.ToRunResult() == expected);
+  }
+}
+} // namespace
+
+void testDaemonPipelined() {
+  runningServer running{{.Threads = 2, .MaxBatch = 16}};
+  auto client{running.Connect()};
+  assert(client.has_value());
+
+  const auto requests{randomRequests(1, 2000)};
+  checkResponses(requests, client->Call(requests));
+
+  // Single requests, and the loop check and default budget.
+  daemon::Request loop{.Id = 99, .Loops = 1};
+  loop.Initial = *ParseImage("2161820000000000");
+  [[maybe_unused]] const bool sent{client->Send(loop)};
+  assert(sent);
+  const auto response{client->Receive()};
+  assert(response && response->Id == 99);
+  assert(response->Result.ToRunResult().Status == RunStatus::Looping);
+
+  [[maybe_unused]] const daemon::ServerStats stats{running.server.GetStats()};
+  assert(stats.Requests == requests.size() + 1);
+  assert(stats.Connections == 1);
+  assert(stats.Batches < stats.Requests);
+}
+
+void testDaemonClients() {
+  runningServer running{{.Threads = 3, .MaxBatch = 8, .MaxDelayMicros = 50}};
+  std::vector<std::jthread> clients{};
+  for (uint64_t c = 0; c < 4; c++) {
+    clients.emplace_back([&running, c] {
+      auto client{running.Connect()};
+      assert(client.has_value());
+      const auto requests{randomRequests(100 + c, 500)};
+      checkResponses(requests, client->Call(requests, 64));
+    });
+  }
+  clients.clear();
+  assert(running.server.GetStats().Connections == 4);
+}
+
+void testDaemonBackpressure() {
+  // Four requests in flight at most, against a client that would send
+  // everything at once. The server stops reading until it has answered.
+  runningServer running{{.Threads = 1, .MaxBatch = 4, .MaxInFlight = 4}};
+  auto client{running.Connect()};
+  const auto requests{randomRequests(7, 3000)};
+  checkResponses(requests, client->Call(requests, requests.size()));
+}
+
+void testDaemonBatchSize() {
+  // Batches of one answer each request on its own.
+  runningServer running{{.Threads = 1, .MaxBatch = 1}};
+  auto client{running.Connect()};
+  const auto requests{randomRequests(9, 300)};
+  checkResponses(requests, client->Call(requests));
+  [[maybe_unused]] const daemon::ServerStats stats{running.server.GetStats()};
+  assert(stats.Batches == stats.Requests);
+}
+
+void testDaemonInvalidState() {
+  runningServer running{{.Threads = 1}};
+  auto client{running.Connect()};
+  assert(client.has_value());
+
+  // Out of range fields are refused rather than run, and valid requests
+  // around them are answered as usual.
+  std::vector<daemon::Request> requests{randomRequests(11, 8)};
+  requests[1].Initial.Registers[regID::A] = 0x10;
+  requests[3].Initial.Registers[regID::PC] = 0xFF;
+  requests[4].Initial.Flags = 0x8;
+  requests[6].Initial.Halted = 2;
+  std::vector<daemon::Response> responses{client->Call(requests)};
+  assert(responses.size() == requests.size());
+  std::sort(responses.begin(), responses.end(),
+            [](const auto& a, const auto& b) { return a.Id < b.Id; });
+  for (size_t i = 0; i < requests.size(); i++) {
+    assert(responses[i].Id == requests[i].Id);
+    if (requests[i].Initial.IsValid()) {
+      assert(responses[i].Error == 0);
+    } else {
+      assert(responses[i].Error ==
+             std::to_underlying(daemon::ResponseError::InvalidState));
+      assert(responses[i].Result.Final == CPUState{});
+      assert(responses[i].Result.Cycles == 0);
+    }
+  }
+}
+
+void testDaemonHalfClose() {
+  // A client that shuts down its side after sending still gets every
+  // response, even with requests waiting behind the in-flight limit.
+  runningServer running{{.Threads = 1, .MaxBatch = 4, .MaxInFlight = 4}};
+  auto client{running.Connect()};
+  assert(client.has_value());
+  const auto requests{randomRequests(13, 100)};
+  for (const daemon::Request& request : requests) {
+    [[maybe_unused]] const bool sent{client->Send(request)};
+    assert(sent);
+  }
+  [[maybe_unused]] const bool finished{client->Finish()};
+  assert(finished);
+
+  std::vector<daemon::Response> responses{};
+  while (const auto response{client->Receive()}) {
+    responses.push_back(*response);
+  }
+  checkResponses(requests, responses);
+}
+
+} // namespace cpu::test
+
+void RunAllDaemonTests() {
+  cpu::test::testDaemonPipelined();
+  cpu::test::testDaemonClients();
+  cpu::test::testDaemonBackpressure();
+  cpu::test::testDaemonBatchSize();
+  cpu::test::testDaemonInvalidState();
+  cpu::test::testDaemonHalfClose();
+}
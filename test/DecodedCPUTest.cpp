@@ -0,0 +1,229 @@
+#include "CPU.h"
+#include "CPUDefs.h"
+#include "CPUState.h"
+#include "DecodedCPU.h"
+#include "Instrumentation.h"
+#include "Superopt.h"
+
+#include "TestUtils.h"
+
+#include <array>
+#include <cassert>
+#include <cstdint>
+#include <utility>
+
+namespace cpu::test {
+
+namespace {
+// fusablePrograms fills images mostly with the first and second halves of
+// fusion rules, with arguments that often name IS or PC or land on code.
+CPUState fusableProgram(TestRandom& rng) {
+  constexpr std::array<OpCode, 6> ops{OpCode::LoadAI, OpCode::Mov,
+                                      OpCode::Add,    OpCode::Sub,
+                                      OpCode::StoreA, OpCode::JumpNZ};
+  CPUState state{};
+  state.Image = rng.Next();
+  for (uint8_t addr = 0; addr < MemSizeWords; addr += 2) {
+    if (rng.Next() % 4 != 0) {
+      state.Store(uint4(std::to_underlying(ops[rng.Next() % ops.size()])),
+                  uint4(addr));
+    }
+  }
+  state.Registers[regID::A] = rng.Next() & 0xF;
+  state.Registers[regID::B] = rng.Next() & 0xF;
+  state.Flags = rng.Next() & 0x7;
+  return state;
+}
+} // namespace
+
+void testDecodedMatchesCPU() {
+  QuietStderr quiet{};
+  TestRandom rng{21};
+
+  for (int run = 0; run < 2000; run++) {
+    CPUState state{};
+    state.Image = rng.Next();
+    state.Flags = rng.Next() & 0x7;
+
+    CPU cpu{state};
+    DecodedCPU decoded{state};
+    for (int cycle = 0; cycle < 40 && !cpu.IsHalted(); cycle++) {
+      cpu.Cycle();
+      decoded.Cycle();
+      assert(decoded.GetState() == cpu.GetState());
+    }
+
+    // A single long run ends in the same place as stepping.
+    DecodedCPU whole{state};
+    CPU stepped{state};
+    uint64_t cycles{0};
+    while (!stepped.IsHalted() && cycles < 40) {
+      stepped.Cycle();
+      cycles++;
+    }
+    assert(whole.Run(40) == cycles);
+    assert(whole.GetState() == stepped.GetState());
+  }
+}
+
+void testDecodeOnce() {
+  // Count B down from 3 in a loop; nothing writes to code.
+  //   0 LoadAI 1; 2 Mov A, B; 4 LoadAI 3; 6 Sub A, B; 8 JumpNZ 6; A Halt
+  const auto image{superopt::ParseImage("21512371A6000000")};
+  assert(image.has_value());
+
+  DecodedCPU cpu{*image};
+  [[maybe_unused]] const uint64_t cycles{cpu.Run(1000)};
+  assert(cpu.GetState().Halted);
+  assert(cpu.GetState().GetRegister(regID::A) == 0);
+  assert(cycles == 10);
+  assert(cpu.GetDecodeCount() == 6);
+}
+
+void testSelfModifyingCode() {
+  //   0 Jump 8
+  //   2 LoadAI 0; 4 StoreA 9; 6 Jump 8   Patch the LoadAI at 8 to load 0.
+  //   8 LoadAI 5; A Add A, B; C JumpNZ 2; E Halt
+  const auto image{superopt::ParseImage("882049882561A200")};
+  assert(image.has_value());
+
+  CPU reference{*image};
+  reference.Run();
+
+  DecodedCPU cpu{*image};
+  assert(cpu.Run(100) == 11);
+  assert(cpu.GetState() == reference.GetState());
+  assert(cpu.GetState().Load(uint4(9)) == 0);
+
+  // Only the patched LoadAI is decoded again.
+  assert(cpu.GetDecodeCount() == 9);
+}
+
+void testHostStore() {
+  const auto image{superopt::ParseImage("21512371A6000000")};
+  assert(image.has_value());
+
+  // Stop after the first Sub, then turn it into Sub A, A from the host.
+  // With one cycle left the Sub runs on its own rather than fused with the
+  // JumpNZ after it.
+  DecodedCPU cpu{*image};
+  assert(cpu.Run(4) == 4);
+  assert(cpu.GetState().GetRegister(regID::A) == 2);
+  cpu.Store(uint4(0b0000), uint4(7));
+
+  // The JumpNZ is decoded alone, then again in the new Sub A, A pair.
+  assert(cpu.Run(100) == 4);
+  assert(cpu.GetState().Halted);
+  assert(cpu.GetDecodeCount() == 9);
+}
+
+void testFusionMatchesCPU() {
+  QuietStderr quiet{};
+  TestRandom rng{24};
+
+  for (int run = 0; run < 3000; run++) {
+    const CPUState state{fusableProgram(rng)};
+    const FusionSet fusions{rng.Next() % 2 ? AllFusions
+                                           : FusionSet{rng.Next() & 0xF}};
+
+    // Single cycles always split pairs; runs of every length end inside
+    // some of them.
+    CPU cpu{state};
+    DecodedCPU stepped{state, fusions};
+    for (int cycle = 0; cycle < 40 && !cpu.IsHalted(); cycle++) {
+      cpu.Cycle();
+      stepped.Cycle();
+      assert(stepped.GetState() == cpu.GetState());
+    }
+
+    const uint64_t budget{rng.Next() % 48};
+    CPU reference{state};
+    uint64_t expected{0};
+    while (expected < budget && !reference.IsHalted()) {
+      reference.Cycle();
+      expected++;
+    }
+    DecodedCPU decoded{state, fusions};
+    uint64_t cycles{0};
+    while (cycles < budget && !decoded.GetState().Halted) {
+      cycles += decoded.Run(1 + rng.Next() % (budget - cycles));
+    }
+    assert(cycles == expected);
+    assert(decoded.GetState() == reference.GetState());
+  }
+}
+
+void testFusionCounts() {
+  const auto image{superopt::ParseImage("21512371A6000000")};
+  assert(image.has_value());
+
+  // The countdown fuses its LoadAI 1; Mov A, B and runs Sub A, B; JumpNZ 6
+  // three times, in the same number of cycles.
+  DecodedCPU fused{*image};
+  assert(fused.Run(1000) == 10);
+  [[maybe_unused]] const std::array<uint64_t, FusionCount>& counts{
+      fused.GetFusionCounts()};
+  assert(counts[std::to_underlying(Fusion::LoadAIMov)] == 1);
+  assert(counts[std::to_underlying(Fusion::SubJumpNZ)] == 3);
+  assert(counts[std::to_underlying(Fusion::AddStoreA)] == 0);
+
+  DecodedCPU plain{*image, FusionSet{}};
+  assert(plain.Run(1000) == 10);
+  assert(plain.GetState() == fused.GetState());
+  assert(plain.GetFusionCounts() == (std::array<uint64_t, FusionCount>{}));
+
+  // StoreA 3 stores over its own Add's argument, so every pass decodes the
+  // pair again.
+  //   0 LoadAI 1; 2 Add A, B; 4 StoreA 3; 6 Jump 2
+  const auto accumulate{superopt::ParseImage("2161438200000000")};
+  assert(accumulate.has_value());
+  CPU reference{*accumulate};
+  for (int cycle = 0; cycle < 9; cycle++) {
+    reference.Cycle();
+  }
+  DecodedCPU cpu{*accumulate};
+  assert(cpu.Run(9) == 9);
+  assert(cpu.GetState() == reference.GetState());
+  assert(cpu.GetFusionCounts()[std::to_underlying(Fusion::AddStoreA)] == 3);
+}
+
+void testChooseFusions() {
+  const auto image{superopt::ParseImage("21512371A6000000")};
+  assert(image.has_value());
+
+  BasicCPU<PairCounts> cpu{*image};
+  cpu.Run();
+  const PairCounts& profile{cpu.GetProbe()};
+  assert(profile.Count(OpCode::LoadAI, OpCode::Mov) == 1);
+  assert(profile.Count(OpCode::Sub, OpCode::JumpNZ) == 3);
+  // Taken branches split pairs: JumpNZ 6 never falls through to a Sub.
+  assert(profile.Count(OpCode::JumpNZ, OpCode::Sub) == 0);
+  assert(profile.Count(OpCode::JumpNZ, OpCode::Halt) == 1);
+
+  // Of its seven pairs, three are Sub; JumpNZ and one LoadAI; Mov.
+  FusionSet loop{};
+  loop.set(std::to_underlying(Fusion::SubJumpNZ));
+  FusionSet both{loop};
+  both.set(std::to_underlying(Fusion::LoadAIMov));
+  assert(ChooseFusions(profile, 0.2) == loop);
+  assert(ChooseFusions(profile, 0.1) == both);
+  assert(ChooseFusions(PairCounts{}) == FusionSet{});
+
+  DecodedCPU decoded{*image, ChooseFusions(profile, 0.2)};
+  decoded.Run(1000);
+  assert(decoded.GetFusions() == loop);
+  assert(decoded.GetFusionCounts()[std::to_underlying(Fusion::LoadAIMov)] ==
+         0);
+}
+
+} // namespace cpu::test
+
+void RunAllDecodedCPUTests() {
+  cpu::test::testDecodedMatchesCPU();
+  cpu::test::testDecodeOnce();
+  cpu::test::testSelfModifyingCode();
+  cpu::test::testHostStore();
+  cpu::test::testFusionMatchesCPU();
+  cpu::test::testFusionCounts();
+  cpu::test::testChooseFusions();
+}
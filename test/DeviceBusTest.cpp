@@ -0,0 +1,188 @@
+#include "CPU.h"
+#include "CPUState.h"
+#include "DeviceBus.h"
+#include "Nibble.h"
+#include "RunResult.h"
+#include "SPSCQueue.h"
+
+#include "TestUtils.h"
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace cpu::test {
+
+namespace {
+// echo is In 0; Out 1; Jump 0.
+constexpr std::string_view echo{"B0C1800000000000"};
+} // namespace
+
+void testQueueBulk() {
+  SPSCQueue<uint8_t> queue{8};
+  [[maybe_unused]] std::array<uint8_t, 6> in{1, 2, 3, 4, 5, 6};
+  [[maybe_unused]] std::array<uint8_t, 6> out{};
+
+  // Repeated batches wrap around the ring.
+  for (int round = 0; round < 4; round++) {
+    assert(queue.TryPushMany(in) == 6);
+    assert(queue.TryPopMany(out) == 6);
+    assert(out == in);
+  }
+
+  // Pushes stop at the capacity and pops at what is queued.
+  assert(queue.TryPushMany(in) == 6);
+  assert(queue.TryPushMany(in) == 2);
+  assert(!queue.TryPush(9));
+  assert(queue.TryPopMany(out) == 6);
+  assert(queue.TryPopMany(out) == 2);
+  assert(out[0] == 1 && out[1] == 2);
+  assert(queue.TryPopMany(out) == 0);
+}
+
+void testEcho() {
+  DeviceBus bus{};
+  CPU cpu{TestImage(echo)};
+  cpu.AttachBus(&bus);
+
+  // With no input In waits on its own address.
+  assert(cpu.Run(100) == (RunResult{.Status = RunStatus::Blocked}));
+  assert(cpu.IsBlocked());
+  assert(cpu.GetState().GetRegister(regID::PC) == 0);
+
+  const std::array<uint8_t, 5> samples{3, 1, 4, 1, 5};
+  assert(bus.Send(0, samples) == samples.size());
+  assert(bus.Pending(0) == 5);
+  [[maybe_unused]] const RunResult result{cpu.Run(100)};
+  assert(result.Status == RunStatus::Blocked && result.Cycles == 3 * 5);
+  assert(bus.Available(1) == 5);
+
+  [[maybe_unused]] std::array<uint8_t, 8> out{};
+  assert(bus.Receive(1, out) == 5);
+  for (size_t i = 0; i < samples.size(); i++) {
+    assert(out[i] == samples[i]);
+  }
+  assert(!bus.Receive(1).has_value());
+}
+
+void testOutputBackpressure() {
+  // LoadAI 7; Out 3; Jump 2.
+  DeviceBus bus{2};
+  CPU cpu{TestImage("27C3820000000000")};
+  cpu.AttachBus(&bus);
+  assert(cpu.Run(100).Status == RunStatus::Blocked);
+  assert(bus.Available(3) == 2);
+  assert(cpu.GetState().GetRegister(regID::PC) == 2);
+
+  // Draining one sample lets exactly one more Out retire.
+  assert(bus.Receive(3) == 7);
+  assert(cpu.Run(100) == (RunResult{.Status = RunStatus::Blocked,
+                                    .Cycles = 2}));
+}
+
+void testPoll() {
+  // Poll 5; JumpZ 0; In 5; Halt.
+  DeviceBus bus{};
+  CPU cpu{TestImage("D590B50000000000")};
+  cpu.AttachBus(&bus);
+
+  // An idle poll loop repeats its state but is not reported as looping.
+  assert(cpu.Run(100, LoopCheck::Brent).Status == RunStatus::BudgetExhausted);
+  assert(cpu.GetFlags().Zero);
+
+  assert(bus.Send(5, uint8_t{0x1C}));
+  [[maybe_unused]] const RunResult result{cpu.Run(100, LoopCheck::Brent)};
+  assert(result.Status == RunStatus::Halted);
+  // Samples are masked to the word width.
+  assert(cpu.GetRegisterA() == 0xC);
+}
+
+void testWithoutBus() {
+  // The port opcodes fault when nothing is attached, as in the other
+  // engines.
+  QuietStderr quiet{};
+  CPU cpu{TestImage(echo)};
+  assert(cpu.Run(10).Status == RunStatus::Fault);
+
+  DeviceBus bus{};
+  cpu.AttachBus(&bus);
+  cpu.AttachBus(nullptr);
+  cpu.SetState(TestImage(echo));
+  assert(cpu.Run(10).Status == RunStatus::Fault);
+}
+
+void testWideBus() {
+  // An 8 bit machine moves whole bytes: In 0; Out 1; Jump 0.
+  CPUN<8, 256> cpu{};
+  constexpr std::array<uint8_t, 6> program{0xB, 0, 0xC, 1, 8, 0};
+  for (size_t addr = 0; addr < program.size(); addr++) {
+    cpu.GetMemory().Store(uintN<8>(program[addr]), uintN<8>(int(addr)));
+  }
+  CPUN<8, 256>::BusType bus{};
+  cpu.AttachBus(&bus);
+  assert(bus.Send(0, uint8_t{0xA5}));
+  assert(cpu.Run(100).Status == RunStatus::Blocked);
+  assert(bus.Receive(1) == 0xA5);
+}
+
+void testStreaming() {
+  // A feeder and a drainer thread stream through a CPU on this thread.
+  constexpr size_t total{200000};
+  DeviceBus bus{64};
+  CPU cpu{TestImage(echo)};
+  cpu.AttachBus(&bus);
+
+  std::thread feeder{[&bus] {
+    std::array<uint8_t, 16> block{};
+    size_t sent{0};
+    while (sent < total) {
+      for (size_t i = 0; i < block.size(); i++) {
+        block[i] = static_cast<uint8_t>((sent + i) & 0xF);
+      }
+      const size_t count{std::min(block.size(), total - sent)};
+      sent += bus.Send(0, std::span<const uint8_t>{block}.first(count));
+      std::this_thread::yield();
+    }
+  }};
+
+  std::vector<uint8_t> received{};
+  received.reserve(total);
+  std::thread drainer{[&bus, &received] {
+    std::array<uint8_t, 16> block{};
+    while (received.size() < total) {
+      const size_t count{bus.Receive(1, block)};
+      received.insert(received.end(), block.begin(), block.begin() + count);
+      std::this_thread::yield();
+    }
+  }};
+
+  uint64_t cycles{0};
+  while (cycles < 3 * total) {
+    cycles += cpu.Run(3 * total - cycles).Cycles;
+    std::this_thread::yield();
+  }
+  feeder.join();
+  drainer.join();
+
+  for (size_t i = 0; i < total; i++) {
+    assert(received[i] == (i & 0xF));
+  }
+}
+
+} // namespace cpu::test
+
+void RunAllDeviceBusTests() {
+  cpu::test::testQueueBulk();
+  cpu::test::testEcho();
+  cpu::test::testOutputBackpressure();
+  cpu::test::testPoll();
+  cpu::test::testWithoutBus();
+  cpu::test::testWideBus();
+  cpu::test::testStreaming();
+}
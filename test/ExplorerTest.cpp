@@ -0,0 +1,201 @@
+#include "CPUState.h"
+#include "Explorer.h"
+#include "RunResult.h"
+#include "Step.h"
+
+#include "TestUtils.h"
+
+#include <array>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+namespace cpu::test {
+
+namespace {
+// expected explores initial the slow way: a sequential breadth-first search
+// for the states and depth, and a Brent run of every initial state for how
+// it ends.
+ExploreReport expected(const std::vector<CPUState>& initial) {
+  ExploreReport report{};
+  std::unordered_set<CPUState, CPUStateHash> seen{};
+  std::vector<CPUState> frontier{initial};
+  for (uint64_t level = 0; !frontier.empty(); level++) {
+    std::vector<CPUState> next{};
+    for (const CPUState& state : frontier) {
+      if (!seen.insert(state).second) {
+        continue;
+      }
+      report.Depth = level;
+      CPUState after{state};
+      const uint8_t op{after.Load(uint4(after.Registers[regID::PC])).Raw()};
+      if (!state.Halted && op <= std::to_underlying(OpCode::JumpNZ)) {
+        Step(after);
+        next.push_back(after);
+      }
+    }
+    frontier = std::move(next);
+  }
+  report.States = seen.size();
+
+  std::unordered_map<CPUState, uint64_t, CPUStateHash> finals{};
+  for (CPUState state : initial) {
+    const RunResult result{RunBounded(state, 1 << 20, LoopCheck::Brent)};
+    switch (result.Status) {
+    case RunStatus::Halted:
+      report.Halting++;
+      finals[state]++;
+      break;
+    case RunStatus::Fault:
+      report.Faulting++;
+      finals[state]++;
+      break;
+    default:
+      report.Looping++;
+    }
+  }
+  for (const auto& [state, count] : finals) {
+    report.Finals.push_back({.State = state, .Count = count});
+  }
+  return report;
+}
+
+void checkReport(const ExploreReport& actual, const ExploreReport& want) {
+  assert(actual.States == want.States);
+  assert(actual.Depth == want.Depth);
+  assert(actual.Halting == want.Halting);
+  assert(actual.Faulting == want.Faulting);
+  assert(actual.Looping == want.Looping);
+  assert(actual.Unresolved == 0 && !actual.Truncated);
+  assert(actual.Finals.size() == want.Finals.size());
+  for (size_t i = 0; i < actual.Finals.size(); i++) {
+    assert(i == 0 || actual.Finals[i - 1].Count >= actual.Finals[i].Count);
+    bool found{false};
+    for (const FinalState& final : want.Finals) {
+      found = found || (final.State == actual.Finals[i].State &&
+                        final.Count == actual.Finals[i].Count);
+    }
+    assert(found);
+  }
+}
+} // namespace
+
+void testStateSet() {
+  StateSet set{100};
+  assert(set.Capacity() >= 133 && set.Size() == 0);
+
+  CPUState state{*ParseImage("21512371A6000000")};
+  state.Registers = {1, 2, 3, 4};
+  state.ALUResult = 5;
+  state.Flags = 6;
+  state.Halted = 1;
+  assert(StateSet::Unpack(state.Image, StateSet::Pack(state)) == state);
+
+  [[maybe_unused]] const auto first{set.Insert(state, 7)};
+  [[maybe_unused]] const auto again{set.Insert(state, 8)};
+  assert(first.Kind == StateSet::Insertion::Inserted && first.Tag == 7);
+  assert(again.Kind == StateSet::Insertion::Present && again.Tag == 7);
+  [[maybe_unused]] CPUState other{state};
+  other.Halted = 0;
+  assert(set.Contains(state) && !set.Contains(other));
+  assert(set.Size() == 1);
+
+  // A full set still finds what it holds.
+  StateSet small{2};
+  for (uint64_t image = 0; image < 2; image++) {
+    [[maybe_unused]] const auto added{small.Insert({.Image = image}, 0)};
+    assert(added.Kind == StateSet::Insertion::Inserted);
+  }
+  [[maybe_unused]] const auto full{small.Insert({.Image = 9}, 0)};
+  [[maybe_unused]] const auto present{small.Insert({.Image = 1}, 0)};
+  assert(full.Kind == StateSet::Insertion::Full);
+  assert(present.Kind == StateSet::Insertion::Present);
+  assert(small.Size() == 2);
+}
+
+void testStateSetConcurrent() {
+  // Threads insert overlapping ranges; each state is inserted exactly once.
+  constexpr uint64_t states{20000};
+  StateSet set{states};
+  std::array<uint64_t, 4> inserted{};
+  {
+    std::vector<std::jthread> threads{};
+    for (uint32_t t = 0; t < inserted.size(); t++) {
+      threads.emplace_back([&set, &inserted, t] {
+        for (uint64_t i = 0; i < states; i++) {
+          // Same images with different registers keep the meta words apart.
+          CPUState state{.Image = (i * 7 + t * 1000) % states};
+          state.Registers[regID::A] = state.Image & 0xF;
+          if (set.Insert(state, t).Kind == StateSet::Insertion::Inserted) {
+            inserted[t]++;
+          }
+        }
+      });
+    }
+  }
+  assert(inserted[0] + inserted[1] + inserted[2] + inserted[3] == states);
+  assert(set.Size() == states);
+}
+
+void testExploreMatchesRuns() {
+  QuietStderr quiet{};
+  TestRandom random{.seed = 23};
+  constexpr std::array<uint4, 2> words{uint4(0xE), uint4(0xF)};
+  for (int program = 0; program < 40; program++) {
+    CPUState state{};
+    state.Image = random.Next();
+    const std::vector<CPUState> initial{EveryValue(state, words)};
+    const ExploreReport want{expected(initial)};
+    checkReport(Explore(initial, {.Threads = 1}), want);
+    checkReport(Explore(initial, {.Threads = 3}), want);
+  }
+
+  // Count B down from the data word at E; every start value halts.
+  //   0 LoadB E; 2 LoadAI 1; 4 Sub B, A; 6 Mov A, B; 8 JumpNZ 2; A Halt
+  const std::vector<CPUState> countdown{
+      EveryValue(*ParseImage("3E217451A2000000"), std::array{uint4(0xE)})};
+  const ExploreReport report{Explore(countdown, {.Threads = 2})};
+  checkReport(report, expected(countdown));
+  assert(report.Halting == 16 && report.Finals.size() == 16);
+  assert(report.Depth == 2 + 4 * 16); // LoadB, 16 rounds, Halt.
+}
+
+void testExploreTruncated() {
+  // A tight loop from every value of three words needs many more states
+  // than the set has room for.
+  const std::vector<CPUState> initial{EveryValue(
+      *ParseImage("2161820000000000"),
+      std::array{uint4(0xD), uint4(0xE), uint4(0xF)})};
+  const ExploreReport report{
+      Explore(initial, {.Threads = 2, .MaxStates = 1000})};
+  assert(report.Truncated);
+  assert(report.States == 1000);
+  assert(report.Unresolved > 0);
+  assert(report.Unresolved + report.Looping == initial.size());
+}
+
+void testEveryValue() {
+  const CPUState program{*ParseImage("1234000000000000")};
+  const std::vector<CPUState> states{
+      EveryValue(program, std::array{uint4(1), uint4(0xF)})};
+  assert(states.size() == 256);
+  assert(states[0].Load(uint4(1)) == 0 && states[0].Load(uint4(0)) == 1);
+  assert(states[0x21].Load(uint4(1)) == 1 &&
+         states[0x21].Load(uint4(0xF)) == 2);
+  assert(EveryValue(program, {}).size() == 1);
+}
+
+} // namespace cpu::test
+
+void RunAllExplorerTests() {
+  cpu::test::testStateSet();
+  cpu::test::testStateSetConcurrent();
+  cpu::test::testExploreMatchesRuns();
+  cpu::test::testExploreTruncated();
+  cpu::test::testEveryValue();
+}
@@ -0,0 +1,136 @@
+#include "CPUDefs.h"
+#include "CPUState.h"
+#include "Fuzzer.h"
+#include "RunResult.h"
+#include "Step.h"
+
+#include "TestUtils.h"
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+namespace cpu::test {
+
+namespace {
+constexpr uint64_t budget{64};
+
+// brokenJump runs like RunFor, except that Jump takes its target from the
+// word after its operand.
+CPUState brokenJump(CPUState state) {
+  for (uint64_t cycle = 0; cycle < budget && !state.Halted; cycle++) {
+    const uint4 pc{state.Registers[regID::PC]};
+    if (state.Load(pc) == std::to_underlying(OpCode::Jump)) {
+      state.Registers[regID::IS] = std::to_underlying(OpCode::Jump);
+      state.Registers[regID::PC] = state.Load(pc + uint4(2)).Raw();
+      continue;
+    }
+    Step(state);
+  }
+  return state;
+}
+
+bool jumpDiverges(const CPUState& state) {
+  CPUState expected{state};
+  RunFor(expected, budget);
+  return expected != brokenJump(state);
+}
+
+size_t nonZeroWords(const CPUState& state) {
+  size_t count{0};
+  for (uint8_t addr = 0; addr < MemSizeWords; addr++) {
+    count += state.Load(uint4(addr)) == 0 ? 0 : 1;
+  }
+  return count;
+}
+} // namespace
+
+void testFuzzerEdgeCases() {
+  QuietStderr quiet{};
+
+  // Jump does not advance past its operand: Jump 2 lands on the unknown
+  // opcode F, which faults and leaves PC after it.
+  const CPUState jump{*ParseImage("82F0000000000000")};
+  [[maybe_unused]] const fuzz::Outcome jumped{fuzz::Reference(jump, budget)};
+  assert(jumped.Result ==
+         (RunResult{.Status = RunStatus::Fault, .Cycles = 2}));
+  assert(jumped.Final.Registers[regID::PC] == 3);
+  assert(!fuzz::Check(jump, budget));
+
+  // Every unknown opcode, and the port instructions with no bus.
+  for (uint8_t op = 0xB; op <= 0xF; op++) {
+    CPUState state{};
+    state.Store(uint4(op), uint4(0));
+    [[maybe_unused]] const fuzz::Outcome outcome{
+        fuzz::Reference(state, budget)};
+    assert(outcome.Result.Status == RunStatus::Fault);
+    assert(outcome.Final.Registers[regID::IS] == op);
+    assert(!fuzz::Check(state, budget));
+  }
+
+  // LoadAI 8; StoreA 4 turns the unknown opcode at 4 into Jump 0, so the
+  // program loops until the budget runs out.
+  [[maybe_unused]] const CPUState patched{*ParseImage("2844E00000000000")};
+  assert(fuzz::Reference(patched, budget).Result.Status ==
+         RunStatus::BudgetExhausted);
+  assert(!fuzz::Check(patched, budget));
+}
+
+void testFuzzerCampaign() {
+  QuietStderr quiet{};
+  fuzz::Fuzzer fuzzer{{.Seed = 5}};
+  [[maybe_unused]] const auto found{fuzzer.Run(20000)};
+  assert(found.empty());
+
+  [[maybe_unused]] const fuzz::FuzzStats stats{fuzzer.GetStats()};
+  assert(stats.Programs == 20000);
+  assert(stats.Divergences == 0);
+  assert(stats.Cycles > stats.Programs);
+  assert(stats.Corpus == fuzzer.GetCorpus().size() && stats.Corpus > 0);
+
+  // The campaign reaches every opcode, branch direction and status of a
+  // busless run, and stores over its own code.
+  const fuzz::Coverage& coverage{fuzzer.GetCoverage()};
+  assert(coverage.OpCodes == 0xFFFF);
+  assert(coverage.Branches == 0xF);
+  assert(coverage.Writes == 0xFFFF);
+  assert(coverage.Statuses == 0xB); // All but Looping.
+  assert(stats.Coverage == coverage.Count());
+
+  // More programs only add coverage.
+  fuzzer.Run(10000);
+  assert(fuzzer.GetStats().Coverage >= stats.Coverage);
+  fuzz::Coverage merged{};
+  [[maybe_unused]] const bool added{merged.Merge(coverage)};
+  [[maybe_unused]] const bool again{merged.Merge(coverage)};
+  assert(added && !again);
+  assert(merged.Count() == coverage.Count());
+}
+
+void testFuzzerMinimise() {
+  QuietStderr quiet{};
+  TestRandom random{.seed = 11};
+  CPUState original{};
+  do {
+    original.Image = random.Next();
+    original.Registers[regID::A] = random.Next() & 0xF;
+    original.Flags = random.Next() & 0x7;
+  } while (!jumpDiverges(original) || nonZeroWords(original) < 12);
+
+  [[maybe_unused]] const CPUState minimised{
+      fuzz::Minimise(original, jumpDiverges)};
+  assert(jumpDiverges(minimised));
+  // What is left is a Jump at 0 and one non-zero target next to it.
+  assert(minimised.Load(uint4(0)) == std::to_underlying(OpCode::Jump));
+  assert(nonZeroWords(minimised) == 2);
+  assert(minimised.Registers[regID::A] == 0 && minimised.Flags == 0);
+}
+
+} // namespace cpu::test
+
+void RunAllFuzzerTests() {
+  cpu::test::testFuzzerEdgeCases();
+  cpu::test::testFuzzerCampaign();
+  cpu::test::testFuzzerMinimise();
+}
@@ -0,0 +1,95 @@
+#include "CPU.h"
+#include "CPUState.h"
+#include "Instrumentation.h"
+#include "Superopt.h"
+
+#include "TestUtils.h"
+
+#include <cassert>
+#include <cstdint>
+#include <sstream>
+#include <string>
+#include <utility>
+
+namespace cpu::test {
+
+void testNullProbeIsFree() {
+  static_assert(sizeof(CPU) < sizeof(ProfilingCPU));
+
+  TestRandom rng{61};
+  QuietStderr quiet{};
+  for (int run = 0; run < 200; run++) {
+    CPUState state{};
+    state.Image = rng.Next();
+    CPU plain{state};
+    ProfilingCPU profiled{state};
+    assert(plain.Run(64) == profiled.Run(64));
+    assert(plain.GetState() == profiled.GetState());
+  }
+}
+
+void testExecutionStatsCountdown() {
+  // LoadAI 1; Mov A, B; LoadAI 3; Sub A, B; JumpNZ 6; Halt.
+  const auto image{superopt::ParseImage("21512371A6000000")};
+  assert(image.has_value());
+  ProfilingCPU cpu{*image};
+  cpu.Run();
+
+  [[maybe_unused]] const ExecutionStats& stats{cpu.GetProbe()};
+  assert(stats.OpCodes[std::to_underlying(OpCode::LoadAI)] == 2);
+  assert(stats.OpCodes[std::to_underlying(OpCode::Mov)] == 1);
+  assert(stats.OpCodes[std::to_underlying(OpCode::Sub)] == 3);
+  assert(stats.OpCodes[std::to_underlying(OpCode::JumpNZ)] == 3);
+  assert(stats.OpCodes[std::to_underlying(OpCode::Halt)] == 1);
+  assert(stats.PC[6] == 3);
+  assert(stats.PC[8] == 3);
+  assert(stats.PC[0xA] == 1);
+  assert(stats.JumpNZ.Taken == 2);
+  assert(stats.JumpNZ.NotTaken == 1);
+  assert(stats.JumpZ.Taken + stats.JumpZ.NotTaken == 0);
+
+  // 3 - 1 and 2 - 1 set no flags, 1 - 1 sets Zero.
+  assert(stats.SubFlags[0] == 2);
+  assert(stats.SubFlags[flagBit::Zero] == 1);
+}
+
+void testExecutionStatsMemory() {
+  // The addNumbers sample: loads immediates, stores to 0xD and 0xE.
+  const auto image{superopt::ParseImage("2251254D614E0000")};
+  assert(image.has_value());
+  ProfilingCPU cpu{*image};
+  cpu.Run();
+
+  const ExecutionStats& stats{cpu.GetProbe()};
+  assert(stats.Writes[0xD] == 1);
+  assert(stats.Writes[0xE] == 1);
+  for ([[maybe_unused]] const uint64_t reads : stats.Reads) {
+    assert(reads == 0);
+  }
+  assert(stats.AddFlags[0] == 1);
+
+  std::ostringstream json{};
+  WriteJSON(json, stats);
+  assert(json.str().find("\"StoreA\": 2") != std::string::npos);
+  assert(json.str().find("\"writes\": [0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, "
+                         "0, 1, 1, 0]") != std::string::npos);
+
+  std::ostringstream csv{};
+  WriteCSV(csv, stats);
+  assert(csv.str().starts_with("kind,key,count\n"));
+  assert(csv.str().find("\nopcode,Add,1\n") != std::string::npos);
+  assert(csv.str().find("\nwrite,13,1\n") != std::string::npos);
+  assert(csv.str().find("\nalu,Add.-,1\n") != std::string::npos);
+
+  ExecutionStats cleared{stats};
+  cleared.Clear();
+  assert(cleared.OpCodes[std::to_underlying(OpCode::StoreA)] == 0);
+}
+
+} // namespace cpu::test
+
+void RunAllInstrumentationTests() {
+  cpu::test::testNullProbeIsFree();
+  cpu::test::testExecutionStatsCountdown();
+  cpu::test::testExecutionStatsMemory();
+}
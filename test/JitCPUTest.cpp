@@ -0,0 +1,194 @@
+#include "CPU.h"
+#include "CPUState.h"
+#include "JitCPU.h"
+#include "RunResult.h"
+
+#include "TestUtils.h"
+
+#include <cassert>
+#include <cstdint>
+
+namespace cpu::test {
+
+void testJitMatchesCPU() {
+  QuietStderr quiet{};
+  TestRandom rng{25};
+
+  for (int run = 0; run < 5000; run++) {
+    CPUState state{};
+    state.Image = rng.Next();
+    state.Registers[regID::A] = rng.Next() & 0xF;
+    state.Registers[regID::B] = rng.Next() & 0xF;
+    state.Registers[regID::PC] = run % 5 == 0 ? rng.Next() & 0xF : 0;
+    state.Flags = rng.Next() & 0x7;
+    const uint64_t budget{rng.Next() % 200};
+
+    CPU cpu{state};
+    [[maybe_unused]] const RunResult expected{cpu.Run(budget)};
+    JitCPU jit{state};
+    assert(jit.Run(budget) == expected);
+    assert(jit.GetState() == cpu.GetState());
+
+    // The same run in pieces ends in the same place.
+    JitCPU pieces{state};
+    RunResult total{.Status = RunStatus::BudgetExhausted};
+    while (total.Cycles < budget &&
+           total.Status == RunStatus::BudgetExhausted) {
+      const uint64_t left{budget - total.Cycles};
+      const RunResult part{pieces.Run(1 + rng.Next() % left)};
+      total.Cycles += part.Cycles;
+      total.Status = part.Status;
+    }
+    assert(total.Cycles == expected.Cycles);
+    assert(pieces.GetState() == cpu.GetState());
+  }
+}
+
+void testJitLoop() {
+  // LoadAI 1; Add A, B; Jump 2 loops forever without touching its code.
+  const auto image{ParseImage("2161820000000000")};
+  assert(image.has_value());
+
+  CPU cpu{*image};
+  JitCPU jit{*image};
+  [[maybe_unused]] constexpr uint64_t budget{1000003};
+  assert(jit.Run(budget) == cpu.Run(budget));
+  assert(jit.GetState() == cpu.GetState());
+
+  if constexpr (JitCPU::Available()) {
+    // Only the last, partial pass through the loop is interpreted.
+    [[maybe_unused]] const JitCPU::Stats& stats{jit.GetStats()};
+    assert(stats.Compiles == 1);
+    assert(stats.CodeBytes > 0);
+    assert(stats.InterpretedCycles < 2);
+    assert(stats.NativeCycles + stats.InterpretedCycles == budget);
+    assert(stats.GuardExits == 0);
+  }
+
+  // SetState keeps the compiled code.
+  jit.SetState(*image);
+  assert(jit.Run(100).Cycles == 100);
+  assert(jit.GetStats().Compiles == (JitCPU::Available() ? 1 : 0));
+}
+
+void testJitSelfModifyingCode() {
+  QuietStderr quiet{};
+  //   0 Jump 8
+  //   2 LoadAI 0; 4 StoreA 9; 6 Jump 8   Patch the LoadAI at 8 to load 0.
+  //   8 LoadAI 5; A Add A, B; C JumpNZ 2; E Halt
+  const auto patched{ParseImage("882049882561A200")};
+  assert(patched.has_value());
+  CPU reference{*patched};
+  [[maybe_unused]] const RunResult expected{reference.Run(100)};
+  assert(expected.Status == RunStatus::Halted);
+
+  JitCPU jit{*patched};
+  assert(jit.Run(100) == expected);
+  assert(jit.GetState() == reference.GetState());
+  if constexpr (JitCPU::Available()) {
+    assert(jit.GetStats().GuardExits == 1);
+  }
+
+  // LoadAI 2; StoreA 5; Jump 5 stores over the Jump's own operand, a no-op
+  // from the second pass on, so the guard fires once.
+  const auto storeLoop{ParseImage("2245800000000000")};
+  assert(storeLoop.has_value());
+  CPU cpu{*storeLoop};
+  JitCPU loop{*storeLoop};
+  assert(loop.Run(10000) == cpu.Run(10000));
+  assert(loop.GetState() == cpu.GetState());
+  if constexpr (JitCPU::Available()) {
+    assert(loop.GetStats().GuardExits <= 1);
+  }
+
+  // With B = 1 this counts in the operand of its own LoadAI, so every pass
+  // rewrites its code. The guard sends it back to the interpreter for longer
+  // and longer stretches.
+  //   0 LoadAI 0; 2 Add A, B; 4 StoreA 1; 6 Jump 0
+  auto rewriting{ParseImage("2061418000000000")};
+  assert(rewriting.has_value());
+  rewriting->Registers[regID::B] = 1;
+  CPU rewriter{*rewriting};
+  JitCPU jitted{*rewriting};
+  assert(jitted.Run(100000) == rewriter.Run(100000));
+  assert(jitted.GetState() == rewriter.GetState());
+  if constexpr (JitCPU::Available()) {
+    [[maybe_unused]] const JitCPU::Stats& stats{jitted.GetStats()};
+    assert(stats.GuardExits > 0 && stats.GuardExits < 100);
+    assert(stats.InterpretedCycles > stats.NativeCycles);
+  }
+}
+
+void testJitFaultAndHalt() {
+  QuietStderr quiet{};
+  // Mov A, PC jumps through A: LoadAI 4; Mov A, PC lands on the unknown
+  // opcode F at 4, which faults with PC after it.
+  const auto dispatch{ParseImage("2453F00000000000")};
+  assert(dispatch.has_value());
+  CPU cpu{*dispatch};
+  JitCPU jit{*dispatch};
+  [[maybe_unused]] const RunResult result{jit.Run(100)};
+  assert(result == cpu.Run(100));
+  assert(result.Status == RunStatus::Fault && result.Cycles == 3);
+  assert(jit.GetState() == cpu.GetState());
+  assert(jit.GetState().Registers[regID::PC] == 5);
+
+  // A halted machine stays halted.
+  const auto halt{ParseImage("0000000000000000")};
+  assert(halt.has_value());
+  JitCPU halting{*halt};
+  halting.Run();
+  assert(halting.IsHalted());
+  assert(halting.Run(10) == (RunResult{.Status = RunStatus::Halted}));
+}
+
+void testJitLargeTranslation() {
+  QuietStderr quiet{};
+  // Both images reach every address from 0 through blocks full of guarded
+  // stores, so their code is several KiB.
+  for (const uint64_t image : {0xc44444979593e494, 0xe44444939597e494}) {
+    const CPUState state{.Image = image};
+    CPU cpu{state};
+    JitCPU jit{state};
+    assert(jit.Run(1000) == cpu.Run(1000));
+    assert(jit.GetState() == cpu.GetState());
+    if constexpr (JitCPU::Available()) {
+      assert(jit.GetStats().CodeBytes > 4096);
+    }
+  }
+}
+
+void testJitMasksState() {
+  // Out of range registers are taken modulo 16, so they neither index past
+  // the compiled blocks nor past the ALU tables.
+  const auto image{ParseImage("2161820000000000")};
+  assert(image.has_value());
+  CPUState state{*image};
+  state.Registers[regID::A] = 0x31;
+  state.Registers[regID::B] = 0xF2;
+  state.Registers[regID::PC] = 0x12;
+  state.ALUResult = 0x40;
+  CPUState nibbles{state};
+  nibbles.Registers = {0x1, 0x2, 0x0, 0x2};
+  nibbles.ALUResult = 0;
+
+  JitCPU jit{state};
+  assert(jit.GetState() == nibbles);
+  CPU cpu{nibbles};
+  assert(jit.Run(1000) == cpu.Run(1000));
+  assert(jit.GetState() == cpu.GetState());
+
+  jit.SetState(state);
+  assert(jit.GetState() == nibbles);
+}
+
+} // namespace cpu::test
+
+void RunAllJitCPUTests() {
+  cpu::test::testJitMatchesCPU();
+  cpu::test::testJitLoop();
+  cpu::test::testJitSelfModifyingCode();
+  cpu::test::testJitFaultAndHalt();
+  cpu::test::testJitLargeTranslation();
+  cpu::test::testJitMasksState();
+}
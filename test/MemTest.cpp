@@ -65,9 +65,44 @@ void testSize() {
   assert(memory.Size() == 2);
 }
 
+void testImage() {
+  Memory memory{cpu::MemSizeWords};
+  for (int i = 0; i < cpu::MemSizeWords; i++) {
+    memory.Store(cpu::uint4(i), cpu::uint4(i));
+  }
+  // Word 0 sits in the high nibble of the lowest byte.
+  assert(memory.DumpImage() == 0xEFCDAB8967452301);
+
+  Memory copy{cpu::MemSizeWords};
+  assert(!(copy == memory));
+  copy.LoadImage(memory.DumpImage());
+  assert(copy == memory);
+  assert(copy.Hash() == memory.Hash());
+  for (int i = 0; i < cpu::MemSizeWords; i++) {
+    assert(copy.Load(cpu::uint4(i)) == i);
+  }
+
+  copy.Store(cpu::uint4(0), cpu::uint4(3));
+  assert(!(copy == memory));
+  assert(copy.Hash() != memory.Hash());
+}
+
+void testFillClear() {
+  Memory memory{cpu::MemSizeWords};
+  memory.Fill(cpu::uint4(0xA));
+  for (int i = 0; i < cpu::MemSizeWords; i++) {
+    assert(memory.Load(cpu::uint4(i)) == 0xA);
+  }
+  memory.Clear();
+  assert(memory.DumpImage() == 0);
+  assert(memory == Memory{cpu::MemSizeWords});
+}
+
 void RunAllMemTests() {
   testSimple();
   testMultiple();
   testFull();
   testSize();
+  testImage();
+  testFillClear();
 }
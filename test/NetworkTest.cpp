@@ -0,0 +1,132 @@
+#include "CPUDefs.h"
+#include "CPUState.h"
+#include "Network.h"
+
+#include "TestUtils.h"
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+namespace cpu::test {
+
+namespace {
+[[maybe_unused]] uint64_t countOf(const NetworkStats& stats,
+                                  const NodeStatus status) {
+  return stats.Statuses[std::to_underlying(status)];
+}
+} // namespace
+
+void testTopology() {
+  Topology topology{3};
+  assert(topology.Connect(0, 1, 1, 0));
+  // Each port takes part in one link.
+  assert(!topology.Connect(0, 1, 2, 0));
+  assert(!topology.Connect(2, 1, 1, 0));
+  // Nodes and ports must exist.
+  assert(!topology.Connect(0, 2, 3, 0));
+  assert(!topology.Connect(0, 16, 1, 1));
+  assert(topology.Links().size() == 1);
+
+  assert(Topology::Ring(5).Links().size() == 5);
+  const Topology torus{Topology::Torus(4, 3)};
+  assert(torus.Nodes() == 12 && torus.Links().size() == 48);
+  // Node 0's west port reaches node 3 at the other end of its row, which
+  // reads it on its east port.
+  for (const Topology::Link& link : torus.Links()) {
+    if (link.From == 0 && link.OutPort == 3) {
+      assert(link.To == 3 && link.InPort == 1);
+    }
+  }
+}
+
+void testPipeline() {
+  // Node 0: LoadAI 5; Out 1; Halt. Node 1: In 0; StoreA F; Halt.
+  Topology topology{2};
+  topology.Connect(0, 1, 1, 0);
+  Network network{topology, TestImage("25C1000000000000")};
+  network.SetState(1, TestImage("B04F000000000000"));
+
+  // A sample sent in one epoch arrives in the next.
+  NetworkStats stats{network.Run(1)};
+  assert(network.Status(0) == NodeStatus::Halted);
+  assert(network.Status(1) == NodeStatus::Blocked);
+  assert(stats.Messages == 0 && stats.Cycles == 3);
+
+  stats = network.Run(1);
+  assert(stats.Messages == 1 && stats.Cycles == 3);
+  assert(countOf(stats, NodeStatus::Halted) == 2);
+  assert(network.State(1).Load(uint4(0xF)) == 5);
+  assert(network.Epoch() == 2);
+}
+
+void testTokenRing() {
+  // Node 0 sends 0, then every node adds 1 to what it reads and passes it
+  // on: In 0; Mov A, B; LoadAI 1; Add A, B; Out 1; Jump back.
+  Network network{Topology::Ring(5), TestImage("B0512161C1800000")};
+  network.SetState(0, TestImage("20C1B0512161C184"));
+
+  // One hop per epoch: in epoch e node (e - 1) % 5 sends e - 1.
+  [[maybe_unused]] const NetworkStats stats{network.Run(10)};
+  assert(stats.Messages == 9);
+  assert(network.State(4).Registers[regID::A] == 9);
+  assert(network.Pending(0, 0) == 0);
+  assert(countOf(stats, NodeStatus::Blocked) == 5);
+}
+
+void testBackpressure() {
+  // LoadAI 7; Out 1; Jump 2 into a node that never reads.
+  Topology topology{2};
+  topology.Connect(0, 1, 1, 0);
+  Network network{topology, TestImage("27C1820000000000")};
+  network.SetState(1, CPUState{});
+
+  NetworkStats stats{network.Run(1)};
+  assert(network.Status(0) == NodeStatus::Blocked);
+  // LoadAI, then Out and Jump until the link is full, and node 1's Halt.
+  assert(stats.Cycles == 1 + 2 * Network::ChannelCapacity + 1);
+
+  // The full queue keeps the sender blocked.
+  stats = network.Run(2);
+  assert(network.Pending(1, 0) == Network::ChannelCapacity);
+  assert(network.Status(0) == NodeStatus::Blocked);
+  assert(stats.Messages == Network::ChannelCapacity);
+}
+
+void testDeterministic() {
+  // Random programs on a torus reach the same state on any number of
+  // threads.
+  const Topology torus{Topology::Torus(32, 24)};
+  [[maybe_unused]] uint64_t expected{};
+  NetworkStats expectedStats{};
+  for (const size_t threads : {1, 2, 3, 8}) {
+    Network network{torus, CPUState{}, {.Threads = threads, .EpochCycles = 8}};
+    TestRandom random{.seed = 42};
+    for (size_t node = 0; node < network.Nodes(); node++) {
+      CPUState state{};
+      state.Image = random.Next();
+      network.SetState(node, state);
+    }
+    const NetworkStats stats{network.Run(40)};
+    assert(stats.Messages > 0);
+    if (threads == 1) {
+      expected = network.Hash();
+      expectedStats = stats;
+    }
+    assert(network.Hash() == expected);
+    assert(stats.Cycles == expectedStats.Cycles);
+    assert(stats.Messages == expectedStats.Messages);
+    assert(stats.Statuses == expectedStats.Statuses);
+  }
+}
+
+} // namespace cpu::test
+
+void RunAllNetworkTests() {
+  cpu::test::testTopology();
+  cpu::test::testPipeline();
+  cpu::test::testTokenRing();
+  cpu::test::testBackpressure();
+  cpu::test::testDeterministic();
+}
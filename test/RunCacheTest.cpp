@@ -0,0 +1,132 @@
+#include "CPU.h"
+#include "CPUState.h"
+#include "RunCache.h"
+#include "RunResult.h"
+#include "Step.h"
+#include "Superopt.h"
+
+#include "TestUtils.h"
+
+#include <cassert>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+namespace cpu::test {
+
+void testRunCacheMatchesCPU() {
+  QuietStderr quiet{};
+  TestRandom rng{53};
+  RunCache cache{{.Capacity = 256, .Shards = 4, .Budget = 200}};
+
+  for (int run = 0; run < 500; run++) {
+    CPUState state{};
+    state.Image = rng.Next();
+    state.Registers[regID::A] = rng.Next() & 0xF;
+
+    CPU cpu{state};
+    [[maybe_unused]] const RunResult expected{cpu.Run(200, LoopCheck::Brent)};
+
+    [[maybe_unused]] const RunCache::Outcome outcome{cache.Run(state)};
+    assert(outcome.Result == expected);
+    assert(outcome.Final == cpu.GetState());
+  }
+}
+
+void testRunCacheHits() {
+  // Count B down from 3 in a loop.
+  const auto image{superopt::ParseImage("21512371A6000000")};
+  assert(image.has_value());
+  RunCache cache{{.Capacity = 8, .Shards = 2}};
+
+  [[maybe_unused]] const RunCache::Outcome first{cache.Run(*image)};
+  assert(first.Result.Status == RunStatus::Halted);
+  assert(first.Result.Cycles == 10);
+  assert(cache.GetStats().Misses == 1);
+
+  [[maybe_unused]] const RunCache::Outcome second{cache.Run(*image)};
+  assert(second.Final == first.Final);
+  assert(cache.GetStats().Hits == 1);
+
+  // Registers are part of the key.
+  CPUState other{*image};
+  other.Registers[regID::B] = 5;
+  cache.Run(other);
+  assert(cache.GetStats().Misses == 2);
+  assert(cache.GetStats().Size == 2);
+
+  cache.Clear();
+  assert(cache.GetStats().Size == 0);
+  assert(cache.GetStats().Hits == 0);
+}
+
+void testRunCacheEviction() {
+  RunCache cache{{.Capacity = 4, .Shards = 1, .Budget = 16}};
+  for (uint64_t i = 0; i < 10; i++) {
+    CPUState state{};
+    state.Image = i << 60; // LoadA i, then halt on the zero words.
+    cache.Run(state);
+  }
+  [[maybe_unused]] const RunCache::Stats stats{cache.GetStats()};
+  assert(stats.Size == 4);
+  assert(stats.Evictions == 6);
+}
+
+void testRunCacheBypass() {
+  RunCache cache{{.Capacity = 8, .Bypass = true}};
+  const CPUState state{};
+  cache.Run(state);
+  cache.Run(state);
+  assert(cache.GetStats().Bypassed == 2);
+  assert(cache.GetStats().Misses == 0);
+  assert(cache.GetStats().Size == 0);
+
+  cache.SetBypass(false);
+  cache.Run(state);
+  cache.Run(state);
+  assert(cache.GetStats().Misses == 1);
+  assert(cache.GetStats().Hits == 1);
+}
+
+void testRunCacheConcurrent() {
+  QuietStderr quiet{};
+  RunCache cache{{.Capacity = 256, .Shards = 8, .Budget = 100}};
+  std::vector<CPUState> states(32);
+  TestRandom rng{59};
+  for (CPUState& state : states) {
+    state.Image = rng.Next();
+  }
+
+  std::vector<std::thread> threads{};
+  for (int t = 0; t < 4; t++) {
+    threads.emplace_back([&cache, &states] {
+      for (int round = 0; round < 20; round++) {
+        for (const CPUState& state : states) {
+          CPUState expected{state};
+          [[maybe_unused]] const RunResult result{
+              RunBounded(expected, 100, LoopCheck::Brent)};
+          [[maybe_unused]] const RunCache::Outcome outcome{cache.Run(state)};
+          assert(outcome.Final == expected);
+          assert(outcome.Result == result);
+        }
+      }
+    });
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+
+  [[maybe_unused]] const RunCache::Stats stats{cache.GetStats()};
+  assert(stats.Hits + stats.Misses == 4 * 20 * states.size());
+  assert(stats.Size == states.size());
+}
+
+} // namespace cpu::test
+
+void RunAllRunCacheTests() {
+  cpu::test::testRunCacheMatchesCPU();
+  cpu::test::testRunCacheHits();
+  cpu::test::testRunCacheEviction();
+  cpu::test::testRunCacheBypass();
+  cpu::test::testRunCacheConcurrent();
+}
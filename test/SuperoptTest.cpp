@@ -0,0 +1,98 @@
+#include "CPUDefs.h"
+#include "CPUState.h"
+#include "Superopt.h"
+
+#include <cassert>
+#include <string>
+#include <utility>
+
+namespace cpu::test {
+
+void testImageText() {
+  const auto image{superopt::ParseImage("1e3F614d00000000")};
+  assert(image.has_value());
+  assert(image->Load(uint4(0)) == std::to_underlying(OpCode::LoadA));
+  assert(image->Load(uint4(1)) == 0xE);
+  assert(superopt::FormatImage(*image) == "1E3F614D00000000");
+
+  assert(!superopt::ParseImage("1E3F").has_value());
+  assert(!superopt::ParseImage("1E3F614D0000000G").has_value());
+
+  assert(superopt::Disassemble(*image, 9) == "0x0  LoadA 14\n"
+                                             "0x2  LoadB 15\n"
+                                             "0x4  Add A, B\n"
+                                             "0x6  StoreA 13\n"
+                                             "0x8  Halt\n");
+}
+
+void testSearchFromImage() {
+  // A = mem[F]; B = A; A = A + B; Halt. Doubling needs no copy into B, and
+  // the zero word after the program doubles as the A, A argument.
+  const auto image{superopt::ParseImage("1F51600100000000")};
+  assert(image.has_value());
+
+  const superopt::Spec spec{superopt::SpecFromImage(*image, {uint4(0xF)}, {},
+                                                    true, 32)};
+  assert(spec.Examples.size() == 16);
+
+  const superopt::Options options{.MaxLength = 5, .Threads = 2};
+  [[maybe_unused]] const superopt::Result result{
+      superopt::Search(spec, options)};
+  assert(result.Found);
+  assert(result.Length == 3);
+  assert(superopt::FormatImage(result.Program) == "1F60000000000000");
+  assert(result.Cycles == 3 * spec.Examples.size());
+  assert(result.Pruned > 0);
+
+  // The answer does not depend on how the work was split.
+  [[maybe_unused]] const superopt::Result single{
+      superopt::Search(spec, {.MaxLength = 5, .Threads = 1})};
+  assert(single.Program == result.Program);
+  assert(single.Evaluated == result.Evaluated);
+}
+
+void testSearchFromExamples() {
+  // mem[D] = mem[E] for a handful of values.
+  superopt::Spec spec{.InputAddrs = {uint4(0xE)},
+                      .OutputAddrs = {uint4(0xD)},
+                      .CheckA = false,
+                      .Examples = {}};
+  for (uint8_t v : {1, 7, 8, 15}) {
+    spec.Examples.push_back({{uint4(v)}, {uint4(v)}});
+  }
+
+  [[maybe_unused]] const superopt::Result result{
+      superopt::Search(spec, {.MaxLength = 4})};
+  assert(result.Found);
+  assert(result.Length == 4);
+  assert(superopt::FormatImage(result.Program) == "1E4D000000000000");
+  assert(result.Cycles == 3 * spec.Examples.size());
+
+  // Nothing of length 3 or less can do it.
+  assert(!superopt::Search(spec, {.MaxLength = 3}).Found);
+}
+
+void testSearchStoresOverEnd() {
+  // Unknown opcode E; A = mem[F]; mem[5] = A, then the input runs as the
+  // instruction at 5. The no-op cannot be cut out: the shorter program
+  // would halt at 4 instead of running the word it just stored.
+  const auto image{superopt::ParseImage("E1F4500000000000")};
+  assert(image.has_value());
+  const superopt::Spec spec{superopt::SpecFromImage(*image, {uint4(0xF)}, {},
+                                                    true, 32)};
+
+  [[maybe_unused]] const superopt::Result result{
+      superopt::Search(spec, {.MaxLength = 5, .Threads = 2})};
+  assert(result.Found);
+  assert(result.Length == 5);
+  assert(superopt::FormatImage(result.Program) == "E1F4500000000000");
+}
+
+} // namespace cpu::test
+
+void RunAllSuperoptTests() {
+  cpu::test::testImageText();
+  cpu::test::testSearchFromImage();
+  cpu::test::testSearchFromExamples();
+  cpu::test::testSearchStoresOverEnd();
+}
@@ -1,13 +1,53 @@
 #pragma once
 
 void RunAllMemTests();
+void RunAllAsyncTests();
 void RunAllCPUTests();
+void RunAllCPUStateTests();
+void RunAllConstexprTests();
+void RunAllCorpusTests();
+void RunAllCorpusRunnerTests();
+void RunAllDaemonTests();
+void RunAllDecodedCPUTests();
+void RunAllDeviceBusTests();
+void RunAllExplorerTests();
+void RunAllFuzzerTests();
 void RunAllALUTests();
+void RunAllBatchCPUTests();
+void RunAllBlockCPUTests();
+void RunAllInstrumentationTests();
+void RunAllJitCPUTests();
+void RunAllNetworkTests();
+void RunAllRunCacheTests();
 void RunAllSamples();
+void RunAllSuperoptTests();
+void RunAllTimeTravelTests();
+void RunAllTraceTests();
+void RunAllWideCPUTests();
 
 inline void RunAllTests() {
   RunAllALUTests();
   RunAllMemTests();
+  RunAllAsyncTests();
   RunAllCPUTests();
+  RunAllCPUStateTests();
+  RunAllConstexprTests();
+  RunAllCorpusTests();
+  RunAllCorpusRunnerTests();
+  RunAllDaemonTests();
+  RunAllDecodedCPUTests();
+  RunAllDeviceBusTests();
+  RunAllExplorerTests();
+  RunAllFuzzerTests();
+  RunAllBatchCPUTests();
+  RunAllBlockCPUTests();
+  RunAllInstrumentationTests();
+  RunAllJitCPUTests();
+  RunAllNetworkTests();
+  RunAllRunCacheTests();
   RunAllSamples();
+  RunAllSuperoptTests();
+  RunAllTimeTravelTests();
+  RunAllTraceTests();
+  RunAllWideCPUTests();
 }
\ No newline at end of file
@@ -2,8 +2,15 @@
 
 #include "CPU.h"
 #include "CPUDefs.h"
+#include "CPUState.h"
 #include "Memory.h"
 
+#include <cassert>
+#include <cstdint>
+#include <iostream>
+#include <optional>
+#include <streambuf>
+#include <string_view>
 #include <utility>
 
 namespace cpu::test {
@@ -50,4 +57,33 @@ inline int ReadVal(const Memory& m, const int address) {
   const cpu::uint4 a{address};
   return static_cast<int8_t>(cpu::int4(m.Load(a)));
 }
+
+// TestImage parses a test program written as 16 hex digits, which must be
+// well formed.
+inline CPUState TestImage(const std::string_view text) {
+  const std::optional<CPUState> state{ParseImage(text)};
+  assert(state.has_value());
+  return *state;
+}
+
+// Random number source for tests that run generated images (splitmix64).
+struct TestRandom {
+  uint64_t seed{};
+
+  uint64_t Next() {
+    return SplitMix64(seed);
+  }
+};
+
+// QuietStderr silences std::cerr while generated images run into unknown
+// opcodes.
+struct QuietStderr {
+  std::streambuf* buf{std::cerr.rdbuf(nullptr)};
+  QuietStderr() = default;
+  QuietStderr(const QuietStderr&) = delete;
+  QuietStderr& operator=(const QuietStderr&) = delete;
+  ~QuietStderr() {
+    std::cerr.rdbuf(buf);
+  }
+};
 } // namespace cpu::test
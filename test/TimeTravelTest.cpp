@@ -0,0 +1,105 @@
+#include "CPUState.h"
+#include "Step.h"
+#include "Superopt.h"
+#include "TimeTravel.h"
+
+#include "TestUtils.h"
+
+#include <cassert>
+#include <cstdint>
+#include <vector>
+
+namespace cpu::test {
+
+void testSeekMatchesHistory() {
+  QuietStderr quiet{};
+  TestRandom rng{73};
+
+  for (int run = 0; run < 50; run++) {
+    CPUState initial{};
+    initial.Image = rng.Next();
+    std::vector<CPUState> history{initial};
+    CPUState state{initial};
+    for (int i = 0; i < 300 && !state.Halted; i++) {
+      Step(state);
+      history.push_back(state);
+    }
+
+    // Cycle carries on past unknown opcodes where Run would stop.
+    TimeTravelCPU cpu{initial, {.Interval = 16}};
+    for (int i = 0; i < 300; i++) {
+      cpu.Cycle();
+    }
+    assert(cpu.GetCycle() == history.size() - 1);
+    assert(cpu.GetState() == history.back());
+
+    for (int seek = 0; seek < 20; seek++) {
+      [[maybe_unused]] const uint64_t cycle{rng.Next() % history.size()};
+      assert(cpu.SeekTo(cycle));
+      assert(cpu.GetCycle() == cycle);
+      assert(cpu.GetState() == history[cycle]);
+    }
+
+    assert(cpu.SeekTo(history.size() - 1));
+    for (uint64_t cycle = history.size() - 1; cycle > 0; cycle--) {
+      assert(cpu.StepBack());
+      assert(cpu.GetState() == history[cycle - 1]);
+    }
+    assert(!cpu.StepBack());
+    assert(cpu.GetCycle() == 0);
+  }
+}
+
+void testCheckpointsStayBounded() {
+  // LoadAI 1; Add A, B; Jump 2 never halts.
+  const auto image{superopt::ParseImage("2161820000000000")};
+  assert(image.has_value());
+  TimeTravelCPU cpu{*image, {.Interval = 4, .MaxCheckpoints = 8}};
+
+  cpu.Run(10000);
+  assert(cpu.Checkpoints() <= 8);
+  assert(cpu.Interval() > 4);
+
+  [[maybe_unused]] const CPUState end{cpu.GetState()};
+  assert(cpu.RunBackTo(5));
+  CPUState state{*image};
+  RunFor(state, 5);
+  assert(cpu.GetState() == state);
+
+  assert(!cpu.RunBackTo(6));
+  assert(cpu.SeekTo(10000));
+  assert(cpu.GetState() == end);
+}
+
+void testWriteLog() {
+  // The addNumbers sample stores 5 to 0xD in cycle 4 and 7 to 0xE in cycle 6.
+  const auto image{superopt::ParseImage("2251254D614E0000")};
+  assert(image.has_value());
+  TimeTravelCPU cpu{*image, {.Interval = 2}};
+
+  cpu.Run(100);
+  assert(cpu.IsHalted());
+  assert(cpu.GetCycle() == 7);
+  assert(!cpu.SeekTo(20));
+  assert(cpu.GetCycle() == 7);
+
+  assert(cpu.Writes().size() == 2);
+  assert(cpu.Writes()[0].Cycle == 4);
+  assert(cpu.Writes()[0].Addr == 0xD);
+  assert(cpu.Writes()[0].Value == 5);
+  assert(cpu.LastWriteTo(uint4(0xE), 7) == 6);
+  assert(!cpu.LastWriteTo(uint4(0xE), 5).has_value());
+
+  // Replaying the same cycles does not log them twice.
+  assert(cpu.RunBackTo(1));
+  assert(cpu.SeekTo(7));
+  assert(cpu.Writes().size() == 2);
+}
+
+} // namespace cpu::test
+
+void RunAllTimeTravelTests() {
+  cpu::test::testSeekMatchesHistory();
+  cpu::test::testCheckpointsStayBounded();
+  cpu::test::testWriteLog();
+}
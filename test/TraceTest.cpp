@@ -0,0 +1,147 @@
+#include "CPUState.h"
+#include "Step.h"
+#include "Trace.h"
+
+#include "TestUtils.h"
+
+#include <cassert>
+#include <cstdint>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+namespace cpu::test {
+
+namespace {
+// history steps a copy of initial and returns the state after every step.
+std::vector<CPUState> history(const CPUState& initial, const uint64_t steps) {
+  std::vector<CPUState> states{initial};
+  CPUState state{initial};
+  for (uint64_t i = 0; i < steps && !state.Halted; i++) {
+    Step(state);
+    states.push_back(state);
+  }
+  return states;
+}
+} // namespace
+
+void testTraceRoundTrip() {
+  TestRandom rng{67};
+  for (int run = 0; run < 50; run++) {
+    CPUState initial{};
+    initial.Image = rng.Next();
+    initial.Flags = rng.Next() & 0x7;
+    const std::vector<CPUState> expected{history(initial, 500)};
+
+    std::stringstream file{};
+    {
+      TraceWriter writer{file};
+      // Tiny chunks so the rings wrap and most states come from records.
+      TraceRecorder recorder{writer, initial,
+                             {.ChunkBytes = 32, .Chunks = 2}};
+      CPUState state{initial};
+      RunTraced(state, 500, recorder);
+      assert(state == expected.back());
+      assert(recorder.Cycle() == expected.size() - 1);
+    }
+
+    const auto replayer{TraceReplayer::Load(file)};
+    assert(replayer.has_value());
+    assert(replayer->End() == expected.size() - 1);
+    for (uint64_t cycle = 0; cycle < expected.size(); cycle++) {
+      assert(replayer->StateAt(cycle) == expected[cycle]);
+    }
+    assert(!replayer->StateAt(expected.size()).has_value());
+  }
+}
+
+void testTraceKeyframeFallback() {
+  CPUState state{};
+  state.Image = 0x1234;
+
+  std::stringstream file{};
+  {
+    TraceWriter writer{file};
+    TraceRecorder recorder{writer, state};
+    state.Registers[regID::PC] = 1;
+    recorder.Record(state);
+    // A host write to several words cannot be a record.
+    state.Image = 0xFFFF000000000000;
+    recorder.Record(state);
+    state.Registers[regID::A] = 7;
+    recorder.Record(state);
+  }
+
+  const auto replayer{TraceReplayer::Load(file)};
+  assert(replayer.has_value());
+  assert(replayer->End() == 3);
+  assert(replayer->StateAt(1)->Image == 0x1234);
+  assert(replayer->StateAt(2)->Image == 0xFFFF000000000000);
+  assert(replayer->StateAt(3)->Registers[regID::A] == 7);
+}
+
+void testTraceStreams() {
+  TestRandom rng{71};
+  std::vector<CPUState> initial(4);
+  for (CPUState& state : initial) {
+    state.Image = rng.Next();
+  }
+
+  std::stringstream file{};
+  {
+    TraceWriter writer{file};
+    std::vector<std::thread> threads{};
+    for (uint32_t stream = 0; stream < initial.size(); stream++) {
+      threads.emplace_back([&writer, &initial, stream] {
+        TraceRecorder recorder{
+            writer, initial[stream],
+            {.Stream = stream, .ChunkBytes = 64, .Chunks = 4}};
+        CPUState state{initial[stream]};
+        RunTraced(state, 2000, recorder);
+      });
+    }
+    for (std::thread& thread : threads) {
+      thread.join();
+    }
+    assert(writer.Good());
+  }
+
+  const auto replayer{TraceReplayer::Load(file)};
+  assert(replayer.has_value());
+  assert(replayer->Streams().size() == initial.size());
+  for (uint32_t stream = 0; stream < initial.size(); stream++) {
+    const std::vector<CPUState> expected{history(initial[stream], 2000)};
+    assert(replayer->End(stream) == expected.size() - 1);
+    for (uint64_t cycle = 0; cycle < expected.size(); cycle += 7) {
+      assert(replayer->StateAt(cycle, stream) == expected[cycle]);
+    }
+  }
+}
+
+void testTraceRejectsCorruptInput() {
+  std::stringstream empty{};
+  assert(!TraceReplayer::Load(empty).has_value());
+
+  std::stringstream file{};
+  {
+    TraceWriter writer{file};
+    TraceRecorder recorder{writer, CPUState{}};
+    CPUState state{};
+    state.Image = 0x2161820000000000; // Loops forever.
+    recorder.Record(state);
+    RunTraced(state, 100, recorder);
+  }
+  std::string bytes{file.str()};
+  bytes.pop_back();
+  std::stringstream truncated{bytes};
+  assert(!TraceReplayer::Load(truncated).has_value());
+}
+
+} // namespace cpu::test
+
+void RunAllTraceTests() {
+  cpu::test::testTraceRoundTrip();
+  cpu::test::testTraceKeyframeFallback();
+  cpu::test::testTraceStreams();
+  cpu::test::testTraceRejectsCorruptInput();
+}
@@ -0,0 +1,151 @@
+#include "ALU.h"
+#include "CPU.h"
+#include "CPUDefs.h"
+#include "Memory.h"
+#include "Nibble.h"
+#include "RippleCarry.h"
+#include "RunResult.h"
+
+#include "TestUtils.h"
+
+#include <cassert>
+#include <cstdint>
+#include <initializer_list>
+#include <type_traits>
+
+namespace cpu::test {
+
+namespace {
+// load writes words from address 0 up.
+template <typename Machine>
+constexpr void load(Machine& machine, const std::initializer_list<int> words) {
+  using Word = typename Machine::Word;
+  int addr{0};
+  for (const int word : words) {
+    machine.GetMemory().Store(Word(word), Word(addr++));
+  }
+}
+
+// countdown loads n into A and subtracts 1 until it reaches zero.
+template <typename Machine>
+constexpr void loadCountdown(Machine& machine, const int n) {
+  constexpr unsigned argBits{Machine::Word::Width / 2};
+  // Mov A, B and Sub A, B both take A as source and B as destination.
+  const int argsAB{(regID::A << argBits) | regID::B};
+  load(machine, {2, 1, 5, argsAB, 2, n, 7, argsAB, 0xA, 6, 0});
+}
+
+constexpr bool wideCountdown() {
+  CPUN<8, 256> machine{};
+  loadCountdown(machine, 100);
+  const RunResult result{machine.Run(1000)};
+  return result.Status == RunStatus::Halted && result.Cycles == 3 + 200 + 1;
+}
+static_assert(wideCountdown());
+
+// Spelling out the standard shape gives the same machine as CPU.
+static_assert(std::is_same_v<CPUN<4, 16>, CPU>);
+} // namespace
+
+void testWideIntegers() {
+  using u8 [[maybe_unused]] = uintN<8>;
+  using i8 [[maybe_unused]] = intN<8>;
+  assert(u8(250) + u8(10) == 4);
+  assert(u8(3) - u8(5) == 254);
+  assert(static_cast<int8_t>(i8(u8(0xFE))) == -2);
+  assert(static_cast<int8_t>(i8(u8(0x7F))) == 127);
+
+  using u12 [[maybe_unused]] = uintN<12>;
+  using i12 [[maybe_unused]] = intN<12>;
+  assert(u12(0xFFF) + u12(1) == 0);
+  assert(static_cast<int16_t>(i12(u12(0x800))) == -2048);
+  assert((u12(0xABC) >> 4) == 0xAB);
+}
+
+void testWideRippleCarry() {
+  // The gate level adder agrees with native arithmetic at 8 bits.
+  for (int a = 0; a < 256; a++) {
+    for (int b = 0; b < 256; b++) {
+      [[maybe_unused]] const auto sum{
+          alu::RippleCarryAdd(uintN<8>(a), uintN<8>(b))};
+      [[maybe_unused]] const auto diff{
+          alu::RippleCarrySub(uintN<8>(a), uintN<8>(b))};
+      assert(sum.Result == ((a + b) & 0xFF));
+      assert(diff.Result == ((a - b) & 0xFF));
+
+      [[maybe_unused]] const int signedSum{
+          static_cast<int8_t>(a) + static_cast<int8_t>(b)};
+      assert(sum.Flags.Overflow == (signedSum < -128 || signedSum > 127));
+      assert(sum.Flags.Zero == (((a + b) & 0xFF) == 0));
+      assert(sum.Flags.Negative == (((a + b) & 0x80) != 0));
+    }
+  }
+}
+
+void testWideMemory() {
+  BasicMemory<8, 256> memory{};
+  assert(memory.Size() == 256);
+  for (int addr = 0; addr < 256; addr++) {
+    memory.Store(uintN<8>(255 - addr), uintN<8>(addr));
+  }
+  for (int addr = 0; addr < 256; addr++) {
+    assert(memory.Load(uintN<8>(addr)) == 255 - addr);
+  }
+  memory.Fill(uintN<8>(0x5A));
+  assert(memory.Load(uintN<8>(77)) == 0x5A);
+
+  // Addresses wrap at the memory size.
+  BasicMemory<16, 1024> wide{};
+  wide.Store(uintN<16>(0xBEEF), uintN<16>(1024 + 3));
+  assert(wide.Load(uintN<16>(3)) == 0xBEEF);
+}
+
+void testWideCPU() {
+  CPUN<8, 256> cpu8{};
+  loadCountdown(cpu8, 200);
+  assert(cpu8.Run(10000) == (RunResult{RunStatus::Halted, 3 + 400 + 1}));
+  assert(cpu8.GetRegisterA() == 0);
+  assert(cpu8.GetFlags().Zero);
+
+  // Counting down from more than a byte holds.
+  CPUN<16, 1024> cpu16{};
+  loadCountdown(cpu16, 1000);
+  assert(cpu16.Run(10000) == (RunResult{RunStatus::Halted, 3 + 2000 + 1}));
+
+  // Jump 0 spins forever; the loop check sees the repeated state.
+  CPUN<8, 256> spin{};
+  load(spin, {8, 0});
+  assert(spin.Run(1000, LoopCheck::Brent).Status == RunStatus::Looping);
+
+  // Opcodes past JumpNZ fault at any width.
+  CPUN<16, 64> fault{};
+  load(fault, {0x1234});
+  QuietStderr quiet{};
+  assert(fault.Run(10).Status == RunStatus::Fault);
+}
+
+void testExtraRegisters() {
+  // With four general purpose registers at 8 bits, ids 4 and 5 are IS and
+  // PC. LoadAI 9; Mov A, R3; LoadAI 0; Mov R3, B; Add A, B; Halt.
+  CPUN<8, 256, 4> cpu{};
+  load(cpu, {2, 9, 5, 0x03, 2, 0, 5, 0x31, 6, 0x01, 0});
+  cpu.Run();
+  assert(cpu.GetRegisterB() == 9);
+  assert(cpu.GetRegisterA() == 9);
+
+  // Mov PC, A reads the program counter past the operand.
+  CPUN<8, 256, 4> pc{};
+  load(pc, {5, 0x50, 0});
+  pc.Run();
+  assert(pc.GetRegisterA() == 2);
+}
+
+} // namespace cpu::test
+
+void RunAllWideCPUTests() {
+  cpu::test::testWideIntegers();
+  cpu::test::testWideRippleCarry();
+  cpu::test::testWideMemory();
+  cpu::test::testWideCPU();
+  cpu::test::testExtraRegisters();
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <charconv>
+#include <cstdint>
+#include <optional>
+#include <string_view>
+#include <system_error>
+
+namespace cpu::tools {
+// ParseNumber reads a whole command line argument as a decimal number, or a
+// hex one with a 0x prefix.
+inline std::optional<uint64_t> ParseNumber(std::string_view text) {
+  int base{10};
+  if (text.starts_with("0x") || text.starts_with("0X")) {
+    text.remove_prefix(2);
+    base = 16;
+  }
+  uint64_t value{};
+  const auto [end, err] =
+      std::from_chars(text.data(), text.data() + text.size(), value, base);
+  if (err != std::errc{} || end != text.data() + text.size()) {
+    return std::nullopt;
+  }
+  return value;
+}
+} // namespace cpu::tools
@@ -0,0 +1,566 @@
+// cpu4bench measures the simulator's hot paths and a small workload corpus.
+//
+//   cpu4bench [--filter TEXT] [--samples N] [--warmup N] [--min-time-ms N]
+//             [--json FILE|-]
+//
+// Every benchmark is calibrated to a batch that runs for at least
+// --min-time-ms, then timed for --warmup discarded and --samples measured
+// batches. The table reports ns/op and ops/s from the measured batches; for
+// CPU::Cycle, CPU::Run, DecodedCPU, JitCPU, Step, traced and async runs an op
+// is one executed instruction, and for the device bus one sample. --json
+// writes the same numbers, warmup included, for comparing builds.
+
+#include "ALU.h"
+#include "Async.h"
+#include "CPU.h"
+#include "CPUDefs.h"
+#include "CPUState.h"
+#include "DecodedCPU.h"
+#include "DeviceBus.h"
+#include "JitCPU.h"
+#include "Memory.h"
+#include "Nibble.h"
+#include "RunResult.h"
+#include "Step.h"
+#include "Superopt.h"
+#include "Trace.h"
+
+#include "ToolUtils.h"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <optional>
+#include <ostream>
+#include <streambuf>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace {
+
+using cpu::tools::ParseNumber;
+
+using cpu::CPUState;
+using cpu::OpCode;
+using cpu::uint4;
+
+// keep stops the compiler from discarding a result nobody reads.
+template <typename T>
+void keep(const T& value) {
+#if defined(__GNUC__) || defined(__clang__)
+  asm volatile("" : : "r"(&value) : "memory");
+#else
+  static volatile const void* sink{};
+  sink = &value;
+#endif
+}
+
+// nibble makes an operand from the low bits of a loop counter.
+uint4 nibble(const uint64_t value) {
+  return uint4(static_cast<uint8_t>(value & 0xF));
+}
+
+// NullBuffer discards everything written to it.
+struct NullBuffer : std::streambuf {
+  int overflow(const int c) override {
+    return c;
+  }
+  std::streamsize xsputn(const char*, const std::streamsize n) override {
+    return n;
+  }
+};
+
+// Benchmark runs its body for a number of iterations and returns how many
+// ops those performed.
+struct Benchmark {
+  std::string Name{};
+  std::function<uint64_t(uint64_t iterations)> Body{};
+};
+
+struct Summary {
+  double Mean{};
+  double StdDev{};
+  double Min{};
+  double Median{};
+};
+
+struct Measurement {
+  const Benchmark* Bench{};
+  uint64_t Iterations{};
+  uint64_t OpsPerSample{};
+  std::vector<double> Warmup{}; // ns/op of each discarded batch.
+  std::vector<double> Samples{};
+  Summary Stats{};
+};
+
+struct Config {
+  std::string Filter{};
+  size_t Samples{10};
+  size_t Warmup{3};
+  std::chrono::nanoseconds MinTime{std::chrono::milliseconds{20}};
+  std::optional<std::string> JSONPath{};
+};
+
+Summary summarize(std::vector<double> values) {
+  Summary summary{};
+  if (values.empty()) {
+    return summary;
+  }
+  std::sort(values.begin(), values.end());
+  double sum{0};
+  for (const double value : values) {
+    sum += value;
+  }
+  summary.Mean = sum / static_cast<double>(values.size());
+  double squares{0};
+  for (const double value : values) {
+    squares += (value - summary.Mean) * (value - summary.Mean);
+  }
+  summary.StdDev =
+      values.size() > 1
+          ? std::sqrt(squares / static_cast<double>(values.size() - 1))
+          : 0.0;
+  summary.Min = values.front();
+  const size_t mid{values.size() / 2};
+  summary.Median = values.size() % 2 ? values[mid]
+                                     : (values[mid - 1] + values[mid]) / 2;
+  return summary;
+}
+
+// timeBatch returns the wall time of one batch and the ops it performed.
+std::pair<std::chrono::nanoseconds, uint64_t>
+timeBatch(const Benchmark& bench, const uint64_t iterations) {
+  const auto start{std::chrono::steady_clock::now()};
+  const uint64_t ops{bench.Body(iterations)};
+  const auto elapsed{std::chrono::steady_clock::now() - start};
+  return {std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed), ops};
+}
+
+Measurement measure(const Benchmark& bench, const Config& config) {
+  Measurement m{.Bench = &bench};
+
+  // Grow the batch until it is long enough for the clock to resolve.
+  m.Iterations = 1;
+  while (true) {
+    const auto [elapsed, ops] = timeBatch(bench, m.Iterations);
+    m.OpsPerSample = ops;
+    if (elapsed >= config.MinTime || m.Iterations >= (uint64_t{1} << 40)) {
+      break;
+    }
+    m.Iterations *= 2;
+  }
+
+  const auto nsPerOp = [](const std::chrono::nanoseconds elapsed,
+                          const uint64_t ops) {
+    return static_cast<double>(elapsed.count()) /
+           static_cast<double>(std::max<uint64_t>(ops, 1));
+  };
+  for (size_t i = 0; i < config.Warmup; i++) {
+    const auto [elapsed, ops] = timeBatch(bench, m.Iterations);
+    m.Warmup.push_back(nsPerOp(elapsed, ops));
+  }
+  for (size_t i = 0; i < config.Samples; i++) {
+    const auto [elapsed, ops] = timeBatch(bench, m.Iterations);
+    m.Samples.push_back(nsPerOp(elapsed, ops));
+  }
+  m.Stats = summarize(m.Samples);
+  return m;
+}
+
+// Workloads.
+
+CPUState image(const std::string_view hex) {
+  const auto state{cpu::superopt::ParseImage(hex)};
+  if (!state) {
+    std::cerr << "cpu4bench: bad built-in image " << hex << '\n';
+    std::exit(EXIT_FAILURE);
+  }
+  return *state;
+}
+
+// repeatedOp fills memory with one instruction so every Cycle executes it.
+// Arguments point at the next instruction, so jumps and branches fall
+// through either way and StoreA rewrites an opcode with its own value.
+CPUState repeatedOp(const OpCode op) {
+  CPUState state{};
+  const auto raw{std::to_underlying(op)};
+  if (op == OpCode::Halt) {
+    return state;
+  }
+  for (uint8_t addr = 0; addr < cpu::MemSizeWords; addr += 2) {
+    uint8_t arg{static_cast<uint8_t>((addr + 2) & 0xF)};
+    if (op == OpCode::Mov || op == OpCode::Add || op == OpCode::Sub) {
+      arg = 0b0001; // A into B, A op B.
+    }
+    state.Store(uint4(raw), uint4(addr));
+    state.Store(uint4(arg), uint4(static_cast<uint8_t>(addr + 1)));
+  }
+  state.Registers[cpu::regID::A] = raw;
+  return state;
+}
+
+struct Workload {
+  std::string_view Name{};
+  std::string_view Image{};
+  uint64_t Budget{};
+};
+
+// The Run corpus. Looping workloads run to their budget; the others halt.
+constexpr std::array workloads{
+    // LoadAI 1; Add A, B; Jump 2.
+    Workload{"tight-loop", "2161820000000000", 4096},
+    // Jump, JumpZ and JumpNZ chained through every word pair.
+    Workload{"jump-heavy", "8294A6889AAC8E90", 4096},
+    // LoadAI 2; StoreA 5; Jump to word 5, the word just stored.
+    Workload{"self-modifying-loop", "2245800000000000", 4096},
+    // Counts B down from 3 and halts after 10 instructions.
+    Workload{"countdown", "21512371A6000000", 4096},
+    // Patches its own operands and halts after 11 instructions.
+    Workload{"self-modifying", "882049882561A200", 4096},
+    // The addNumbers program from test/Samples.cpp.
+    Workload{"samples-add", "2251254D614E0000", 4096},
+};
+
+std::vector<Benchmark> benchmarks() {
+  std::vector<Benchmark> list{};
+
+  list.push_back({"memory/load", [](const uint64_t n) {
+                    Memory mem{cpu::MemSizeWords};
+                    for (uint64_t i = 0; i < n; i++) {
+                      const uint4 value{mem.Load(nibble(i))};
+                      keep(value);
+                    }
+                    return n;
+                  }});
+  list.push_back({"memory/store", [](const uint64_t n) {
+                    Memory mem{cpu::MemSizeWords};
+                    for (uint64_t i = 0; i < n; i++) {
+                      mem.Store(nibble(i >> 4), nibble(i));
+                      keep(mem);
+                    }
+                    return n;
+                  }});
+  list.push_back({"memory/image", [](const uint64_t n) {
+                    Memory mem{cpu::MemSizeWords};
+                    for (uint64_t i = 0; i < n; i++) {
+                      mem.LoadImage(mem.DumpImage() + i);
+                      keep(mem);
+                    }
+                    return n;
+                  }});
+  // A fresh CPU per program, as corpus runners create them.
+  list.push_back({"cpu/construct", [state = image("21512371A6000000")](
+                                       const uint64_t n) {
+                    for (uint64_t i = 0; i < n; i++) {
+                      cpu::CPU cpu{state};
+                      keep(cpu);
+                    }
+                    return n;
+                  }});
+
+  for (const OpCode op : {OpCode::Add, OpCode::Sub}) {
+    for (const auto& [backend, backendName] :
+         {std::pair{alu::Backend::RippleCarry, "ripple"},
+          std::pair{alu::Backend::Table, "table"}}) {
+      list.push_back({"alu/" + std::string{cpu::OpCodeName(op)} + "/" +
+                          backendName,
+                      [op, backend](const uint64_t n) {
+                        cpu::Register result{};
+                        alu::ALU alu{result, backend};
+                        for (uint64_t i = 0; i < n; i++) {
+                          alu.DoOperation(nibble(i), nibble(i >> 4), op);
+                          keep(result);
+                        }
+                        return n;
+                      }});
+    }
+  }
+
+  for (uint8_t raw = 0; raw <= std::to_underlying(OpCode::JumpNZ); raw++) {
+    const auto op{static_cast<OpCode>(raw)};
+    list.push_back({"cycle/" + std::string{cpu::OpCodeName(op)},
+                    [state = repeatedOp(op)](const uint64_t n) {
+                      cpu::CPU cpu{state};
+                      for (uint64_t i = 0; i < n; i++) {
+                        cpu.Cycle();
+                      }
+                      keep(cpu);
+                      return n;
+                    }});
+  }
+
+  for (const Workload& workload : workloads) {
+    list.push_back({"run/" + std::string{workload.Name},
+                    [state = image(workload.Image),
+                     budget = workload.Budget](const uint64_t n) {
+                      cpu::CPU cpu{};
+                      uint64_t instructions{0};
+                      for (uint64_t i = 0; i < n; i++) {
+                        cpu.SetState(state);
+                        instructions += cpu.Run(budget).Cycles;
+                      }
+                      keep(cpu);
+                      return instructions;
+                    }});
+  }
+
+  // The pre-decoded interpreter with its superinstructions and without, so
+  // the difference is what fusion saves.
+  for (const Workload& workload : workloads) {
+    for (const bool fused : {true, false}) {
+      list.push_back({(fused ? "decoded/" : "unfused/") +
+                          std::string{workload.Name},
+                      [state = image(workload.Image), budget = workload.Budget,
+                       fused](const uint64_t n) {
+                        cpu::DecodedCPU cpu{
+                            state, fused ? cpu::AllFusions : cpu::FusionSet{}};
+                        uint64_t instructions{0};
+                        for (uint64_t i = 0; i < n; i++) {
+                          cpu.SetState(state);
+                          instructions += cpu.Run(budget);
+                        }
+                        keep(cpu);
+                        return instructions;
+                      }});
+    }
+  }
+
+  // Native code from the JIT. Each batch compiles its workload once, so
+  // this is steady-state speed; where the JIT is not built it interprets.
+  for (const Workload& workload : workloads) {
+    list.push_back({"jit/" + std::string{workload.Name},
+                    [state = image(workload.Image),
+                     budget = workload.Budget](const uint64_t n) {
+                      cpu::JitCPU cpu{state};
+                      uint64_t instructions{0};
+                      for (uint64_t i = 0; i < n; i++) {
+                        cpu.SetState(state);
+                        instructions += cpu.Run(budget).Cycles;
+                      }
+                      keep(cpu.GetState());
+                      return instructions;
+                    }});
+  }
+
+  // Packed-state stepping, bare and with every step traced to a discarding
+  // writer, so the difference is the recorder's cost.
+  for (const Workload& workload : workloads) {
+    list.push_back({"step/" + std::string{workload.Name},
+                    [initial = image(workload.Image),
+                     budget = workload.Budget](const uint64_t n) {
+                      uint64_t instructions{0};
+                      for (uint64_t i = 0; i < n; i++) {
+                        CPUState state{initial};
+                        instructions += cpu::RunFor(state, budget);
+                        keep(state);
+                      }
+                      return instructions;
+                    }});
+    list.push_back({"trace/" + std::string{workload.Name},
+                    [initial = image(workload.Image),
+                     budget = workload.Budget](const uint64_t n) {
+                      NullBuffer buffer{};
+                      std::ostream out{&buffer};
+                      cpu::TraceWriter writer{out};
+                      cpu::TraceRecorder recorder{writer, initial};
+                      uint64_t instructions{0};
+                      for (uint64_t i = 0; i < n; i++) {
+                        CPUState state{initial};
+                        recorder.Record(state);
+                        instructions += cpu::RunTraced(state, budget, recorder);
+                      }
+                      return instructions;
+                    }});
+  }
+  // Many machines interleaved on one thread by the coroutine executor. The
+  // difference from run/tight-loop is the cost of switching every slice.
+  for (const uint64_t slice : {8, 64, 512}) {
+    list.push_back({"async/slice-" + std::to_string(slice),
+                    [state = image("2161820000000000"),
+                     slice](const uint64_t n) {
+                      constexpr size_t machines{10000};
+                      const uint64_t budget{std::max<uint64_t>(
+                          (n + machines - 1) / machines, slice)};
+                      std::vector<cpu::CPU> cpus(machines, cpu::CPU{state});
+                      cpu::Executor executor{};
+                      for (cpu::CPU& cpu : cpus) {
+                        executor.Spawn(cpu.RunAsync(budget, slice));
+                      }
+                      executor.Run();
+                      keep(cpus);
+                      return budget * machines;
+                    }});
+  }
+
+  // A CPU echoing port 0 to port 1 while the host streams blocks of samples
+  // through the bus: In 0; Out 1; Jump 0.
+  list.push_back({"bus/echo", [state = image("B0C1800000000000")](
+                                  const uint64_t n) {
+                    cpu::DeviceBus bus{};
+                    cpu::CPU cpu{state};
+                    cpu.AttachBus(&bus);
+                    std::array<uint8_t, 256> block{};
+                    for (size_t i = 0; i < block.size(); i++) {
+                      block[i] = static_cast<uint8_t>(i & 0xF);
+                    }
+                    uint64_t samples{0};
+                    while (samples < n) {
+                      bus.Send(0, block);
+                      cpu.Run(UINT64_MAX);
+                      samples += bus.Receive(1, block);
+                    }
+                    keep(block);
+                    return samples;
+                  }});
+  return list;
+}
+
+// Reporting.
+
+void printTable(const std::vector<Measurement>& results) {
+  std::cout << std::left << std::setw(28) << "benchmark" << std::right
+            << std::setw(12) << "ns/op" << std::setw(10) << "+-cv%"
+            << std::setw(12) << "min" << std::setw(12) << "median"
+            << std::setw(14) << "Mops/s" << std::setw(12) << "warmup"
+            << '\n';
+  std::cout << std::fixed;
+  for (const Measurement& m : results) {
+    const Summary warmup{summarize(m.Warmup)};
+    const double cv{m.Stats.Mean > 0 ? 100 * m.Stats.StdDev / m.Stats.Mean
+                                     : 0.0};
+    std::cout << std::left << std::setw(28) << m.Bench->Name << std::right
+              << std::setprecision(3) << std::setw(12) << m.Stats.Mean
+              << std::setprecision(1) << std::setw(10) << cv
+              << std::setprecision(3) << std::setw(12) << m.Stats.Min
+              << std::setw(12) << m.Stats.Median << std::setprecision(1)
+              << std::setw(14)
+              << (m.Stats.Mean > 0 ? 1e3 / m.Stats.Mean : 0.0)
+              << std::setprecision(3) << std::setw(12) << warmup.Mean
+              << '\n';
+  }
+}
+
+void writeJSONArray(std::ostream& out, const std::vector<double>& values) {
+  out << '[';
+  for (size_t i = 0; i < values.size(); i++) {
+    out << (i ? ", " : "") << values[i];
+  }
+  out << ']';
+}
+
+void writeJSON(std::ostream& out, const Config& config,
+               const std::vector<Measurement>& results) {
+  out << std::setprecision(6) << std::defaultfloat;
+  out << "{\n"
+      << "  \"config\": {\"samples\": " << config.Samples
+      << ", \"warmup\": " << config.Warmup << ", \"min_time_ns\": "
+      << config.MinTime.count() << ", \"alu_backend\": \""
+      << (alu::DefaultBackend == alu::Backend::Table ? "table" : "ripple")
+#ifdef NDEBUG
+      << "\", \"assertions\": false},\n"
+#else
+      << "\", \"assertions\": true},\n"
+#endif
+      << "  \"benchmarks\": [\n";
+  for (size_t i = 0; i < results.size(); i++) {
+    const Measurement& m{results[i]};
+    out << "    {\"name\": \"" << m.Bench->Name
+        << "\", \"iterations\": " << m.Iterations
+        << ", \"ops_per_sample\": " << m.OpsPerSample
+        << ", \"ns_per_op\": {\"mean\": " << m.Stats.Mean
+        << ", \"stddev\": " << m.Stats.StdDev << ", \"min\": " << m.Stats.Min
+        << ", \"median\": " << m.Stats.Median << "}, \"ops_per_sec\": "
+        << (m.Stats.Mean > 0 ? 1e9 / m.Stats.Mean : 0.0)
+        << ", \"warmup_ns_per_op\": ";
+    writeJSONArray(out, m.Warmup);
+    out << ", \"samples_ns_per_op\": ";
+    writeJSONArray(out, m.Samples);
+    out << '}' << (i + 1 < results.size() ? "," : "") << '\n';
+  }
+  out << "  ]\n}\n";
+}
+
+void usage() {
+  std::cerr << "usage: cpu4bench [--filter TEXT] [--samples N] [--warmup N] "
+               "[--min-time-ms N]\n"
+               "                 [--json FILE|-]\n";
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  Config config{};
+
+  for (int i = 1; i < argc; i++) {
+    const std::string_view arg{argv[i]};
+    const bool hasValue{i + 1 < argc};
+    const std::string_view value{hasValue ? argv[i + 1] : ""};
+    bool ok{hasValue};
+
+    if (arg == "--filter") {
+      config.Filter = value;
+    } else if (arg == "--json") {
+      config.JSONPath = std::string{value};
+    } else if (arg == "--samples" || arg == "--warmup" ||
+               arg == "--min-time-ms") {
+      const auto number{ParseNumber(value)};
+      ok = ok && number.has_value();
+      if (ok && arg == "--samples") {
+        config.Samples = std::max<uint64_t>(*number, 1);
+      } else if (ok && arg == "--warmup") {
+        config.Warmup = *number;
+      } else if (ok) {
+        config.MinTime = std::chrono::milliseconds{*number};
+      }
+    } else {
+      ok = false;
+    }
+
+    if (!ok) {
+      std::cerr << "cpu4bench: bad argument: " << arg << '\n';
+      usage();
+      return EXIT_FAILURE;
+    }
+    i++;
+  }
+
+  const std::vector<Benchmark> all{benchmarks()};
+  std::vector<Measurement> results{};
+  for (const Benchmark& bench : all) {
+    if (bench.Name.find(config.Filter) != std::string::npos) {
+      results.push_back(measure(bench, config));
+    }
+  }
+  if (results.empty()) {
+    std::cerr << "cpu4bench: no benchmark matches " << config.Filter << '\n';
+    return EXIT_FAILURE;
+  }
+
+  // With JSON on stdout the table goes to stderr so the output stays valid.
+  if (config.JSONPath == "-") {
+    std::streambuf* const out{std::cout.rdbuf(std::cerr.rdbuf())};
+    printTable(results);
+    std::cout.rdbuf(out);
+    writeJSON(std::cout, config, results);
+  } else {
+    printTable(results);
+    if (config.JSONPath) {
+      std::ofstream file{*config.JSONPath};
+      writeJSON(file, config, results);
+      if (!file) {
+        std::cerr << "cpu4bench: cannot write " << *config.JSONPath << '\n';
+        return EXIT_FAILURE;
+      }
+    }
+  }
+  return EXIT_SUCCESS;
+}
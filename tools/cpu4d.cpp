@@ -0,0 +1,193 @@
+// cpu4d serves program runs to local clients over a Unix domain socket, or
+// loads such a server to measure it:
+//
+//   cpu4d serve SOCKET [--threads N] [--batch N] [--delay-us N]
+//                      [--in-flight N] [--budget N]
+//   cpu4d bench SOCKET [--clients N] [--requests N] [--window N] [--seed N]
+//
+// --batch and --delay-us trade latency for throughput: a batch goes to a
+// worker once it is full or its oldest request has waited --delay-us. bench
+// runs random images from each client with --window requests in flight and
+// reports throughput and the latency of each window.
+
+#include "CPUState.h"
+#include "CorpusRunner.h"
+#include "Daemon.h"
+
+#include "ToolUtils.h"
+
+#include <chrono>
+#include <csignal>
+#include <cstdint>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace {
+
+using cpu::tools::ParseNumber;
+
+cpu::daemon::Server* running{};
+
+void stopRunning(int) {
+  if (running != nullptr) {
+    running->Stop();
+  }
+}
+
+void usage() {
+  std::cerr << "usage: cpu4d serve SOCKET [--threads N] [--batch N] "
+               "[--delay-us N]\n"
+               "                          [--in-flight N] [--budget N]\n"
+               "       cpu4d bench SOCKET [--clients N] [--requests N] "
+               "[--window N] [--seed N]\n";
+}
+
+int serve(const cpu::daemon::ServerOptions& options) {
+  cpu::daemon::Server server{options};
+  if (!server.Listen()) {
+    std::cerr << "cpu4d: cannot listen on " << options.Path << '\n';
+    return EXIT_FAILURE;
+  }
+  running = &server;
+  std::signal(SIGINT, stopRunning);
+  std::signal(SIGTERM, stopRunning);
+  server.Serve();
+  running = nullptr;
+
+  const cpu::daemon::ServerStats stats{server.GetStats()};
+  std::cout << "connections: " << stats.Connections << '\n'
+            << "requests:    " << stats.Requests << '\n'
+            << "batches:     " << stats.Batches << '\n'
+            << "cycles:      " << stats.Cycles << '\n';
+  return EXIT_SUCCESS;
+}
+
+struct BenchOptions {
+  uint64_t Clients{4};
+  uint64_t Requests{100000}; // Per client.
+  uint64_t Window{256};
+  uint64_t Seed{1};
+};
+
+int bench(const std::string& path, const BenchOptions& options) {
+  using clock = std::chrono::steady_clock;
+  std::vector<cpu::LatencyHistogram> latencies(options.Clients);
+  std::vector<uint64_t> answered(options.Clients);
+
+  const auto start{clock::now()};
+  {
+    std::vector<std::jthread> clients{};
+    for (uint64_t c = 0; c < options.Clients; c++) {
+      clients.emplace_back([&, c] {
+        auto client{cpu::daemon::Client::Connect(path)};
+        if (!client) {
+          return;
+        }
+        // Random images (splitmix64).
+        uint64_t seed{options.Seed + c * 0x1000000};
+        std::vector<cpu::daemon::Request> window{};
+        for (uint64_t first = 0; first < options.Requests;
+             first += options.Window) {
+          window.clear();
+          for (uint64_t i = first;
+               i < std::min(first + options.Window, options.Requests); i++) {
+            cpu::daemon::Request request{.Id = i, .Budget = 4096};
+            request.Initial.Image = cpu::SplitMix64(seed);
+            window.push_back(request);
+          }
+          const auto sent{clock::now()};
+          const auto responses{client->Call(window, window.size())};
+          latencies[c].Record(static_cast<uint64_t>(
+              std::chrono::duration_cast<std::chrono::nanoseconds>(
+                  clock::now() - sent)
+                  .count()));
+          answered[c] += responses.size();
+          if (responses.size() != window.size()) {
+            return;
+          }
+        }
+      });
+    }
+  }
+  const double seconds{
+      std::chrono::duration<double>(clock::now() - start).count()};
+
+  cpu::LatencyHistogram latency{};
+  uint64_t total{0};
+  for (uint64_t c = 0; c < options.Clients; c++) {
+    latency.Merge(latencies[c]);
+    total += answered[c];
+  }
+  std::cout << std::fixed << std::setprecision(1)
+            << "requests:   " << total << '\n'
+            << "wall:       " << seconds * 1e3 << " ms\n"
+            << "throughput: "
+            << (seconds > 0 ? static_cast<double>(total) / seconds : 0)
+            << " requests/s\n"
+            << "window:     p50 " << latency.Percentile(0.5) << " ns, p99 "
+            << latency.Percentile(0.99) << " ns, max " << latency.Max()
+            << " ns\n";
+  return total == options.Clients * options.Requests ? EXIT_SUCCESS
+                                                     : EXIT_FAILURE;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  if (argc < 3) {
+    usage();
+    return EXIT_FAILURE;
+  }
+  const std::string_view mode{argv[1]};
+  cpu::daemon::ServerOptions server{.Path = argv[2]};
+  BenchOptions client{};
+
+  for (int i = 3; i < argc; i++) {
+    const std::string_view arg{argv[i]};
+    const auto number{i + 1 < argc ? ParseNumber(argv[i + 1]) : std::nullopt};
+    bool ok{number.has_value()};
+    if (ok && mode == "serve" && arg == "--threads") {
+      server.Threads = *number;
+    } else if (ok && mode == "serve" && arg == "--batch") {
+      server.MaxBatch = *number;
+    } else if (ok && mode == "serve" && arg == "--delay-us") {
+      server.MaxDelayMicros = *number;
+    } else if (ok && mode == "serve" && arg == "--in-flight") {
+      server.MaxInFlight = *number;
+    } else if (ok && mode == "serve" && arg == "--budget") {
+      server.Budget = *number;
+    } else if (ok && mode == "bench" && arg == "--clients") {
+      client.Clients = *number;
+    } else if (ok && mode == "bench" && arg == "--requests") {
+      client.Requests = *number;
+    } else if (ok && mode == "bench" && arg == "--window") {
+      client.Window = std::max<uint64_t>(*number, 1);
+    } else if (ok && mode == "bench" && arg == "--seed") {
+      client.Seed = *number;
+    } else {
+      ok = false;
+    }
+
+    if (!ok) {
+      std::cerr << "cpu4d: bad argument: " << arg << '\n';
+      usage();
+      return EXIT_FAILURE;
+    }
+    i++;
+  }
+
+  if (mode == "serve") {
+    return serve(server);
+  }
+  if (mode == "bench") {
+    return bench(server.Path, client);
+  }
+  usage();
+  return EXIT_FAILURE;
+}
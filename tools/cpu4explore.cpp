@@ -0,0 +1,107 @@
+// cpu4explore enumerates every state a program can reach from every value
+// of some of its words and reports how the runs end:
+//
+//   cpu4explore IMAGE [--word ADDR]... [--threads N] [--max-states N]
+//               [--top N]
+//
+// IMAGE is 16 hex digits, word 0 first. Each --word adds a word whose 16
+// values are tried in combination with the others. --max-states bounds the
+// visited set, and with it the memory used; --top lists that many of the
+// most common final states.
+
+#include "Explorer.h"
+#include "Superopt.h"
+
+#include "ToolUtils.h"
+
+#include <cstdint>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <optional>
+#include <string_view>
+#include <vector>
+
+namespace {
+
+using cpu::tools::ParseNumber;
+
+void usage() {
+  std::cerr << "usage: cpu4explore IMAGE [--word ADDR]... [--threads N] "
+               "[--max-states N]\n"
+               "                   [--top N]\n";
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  if (argc < 2) {
+    usage();
+    return EXIT_FAILURE;
+  }
+  const auto program{cpu::ParseImage(argv[1])};
+  if (!program) {
+    std::cerr << "cpu4explore: bad image: " << argv[1] << '\n';
+    return EXIT_FAILURE;
+  }
+
+  cpu::ExploreOptions options{};
+  std::vector<cpu::uint4> words{};
+  uint64_t top{10};
+  for (int i = 2; i < argc; i++) {
+    const std::string_view arg{argv[i]};
+    const auto number{i + 1 < argc ? ParseNumber(argv[i + 1]) : std::nullopt};
+    bool ok{number.has_value()};
+    if (ok && arg == "--word" && *number < cpu::MemSizeWords) {
+      words.push_back(cpu::uint4(static_cast<uint8_t>(*number)));
+    } else if (ok && arg == "--threads") {
+      options.Threads = *number;
+    } else if (ok && arg == "--max-states") {
+      options.MaxStates = *number;
+    } else if (ok && arg == "--top") {
+      top = *number;
+    } else {
+      ok = false;
+    }
+
+    if (!ok) {
+      std::cerr << "cpu4explore: bad argument: " << arg << '\n';
+      usage();
+      return EXIT_FAILURE;
+    }
+    i++;
+  }
+  if (words.size() > 8) {
+    std::cerr << "cpu4explore: at most 8 words may vary\n";
+    return EXIT_FAILURE;
+  }
+
+  const std::vector<cpu::CPUState> initial{cpu::EveryValue(*program, words)};
+  const cpu::ExploreReport report{cpu::Explore(initial, options)};
+
+  const double seconds{static_cast<double>(report.WallNanos) / 1e9};
+  std::cout << std::fixed << std::setprecision(1)
+            << "initial:    " << initial.size() << '\n'
+            << "states:     " << report.States
+            << (report.Truncated ? " (truncated)" : "") << '\n'
+            << "depth:      " << report.Depth << '\n'
+            << "halting:    " << report.Halting << '\n'
+            << "faulting:   " << report.Faulting << '\n'
+            << "looping:    " << report.Looping << '\n'
+            << "unresolved: " << report.Unresolved << '\n'
+            << "wall:       " << seconds * 1e3 << " ms\n"
+            << "throughput: "
+            << (seconds > 0 ? static_cast<double>(report.States) / seconds : 0)
+            << " states/s\n"
+            << "finals:     " << report.Finals.size() << " distinct\n";
+  for (size_t i = 0; i < report.Finals.size() && i < top; i++) {
+    const cpu::FinalState& final{report.Finals[i]};
+    std::cout << "  " << std::setw(10) << final.Count << "  "
+              << cpu::superopt::FormatImage(final.State) << " A=" << std::hex
+              << std::uppercase << +final.State.Registers[cpu::regID::A]
+              << " B=" << +final.State.Registers[cpu::regID::B]
+              << " PC=" << +final.State.Registers[cpu::regID::PC] << std::dec
+              << (final.State.Halted ? " halted" : " fault") << '\n';
+  }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,195 @@
+// cpu4fuzz checks the fast execution engines against the reference
+// interpreter with the coverage-guided differential fuzzer:
+//
+//   cpu4fuzz [--threads N] [--seconds N] [--programs N] [--budget N]
+//            [--seed N]
+//
+// Every thread runs its own fuzzer with its own seed until the time or the
+// programs run out, or a divergence turns up. Progress is reported every
+// second. Divergences are printed minimised and make the exit status
+// non-zero.
+
+#include "Fuzzer.h"
+#include "RunResult.h"
+#include "Superopt.h"
+
+#include "ToolUtils.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <optional>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace {
+
+using cpu::tools::ParseNumber;
+
+void usage() {
+  std::cerr << "usage: cpu4fuzz [--threads N] [--seconds N] [--programs N] "
+               "[--budget N]\n"
+               "                [--seed N]\n";
+}
+
+struct Options {
+  uint64_t Threads{};
+  uint64_t Seconds{10};
+  uint64_t Programs{}; // Zero runs until the time is up.
+  uint64_t Budget{64};
+  uint64_t Seed{1};
+};
+
+std::string_view statusName(const cpu::RunStatus status) {
+  switch (status) {
+  case cpu::RunStatus::Halted:
+    return "halted";
+  case cpu::RunStatus::BudgetExhausted:
+    return "budget exhausted";
+  case cpu::RunStatus::Looping:
+    return "looping";
+  case cpu::RunStatus::Fault:
+    return "fault";
+  case cpu::RunStatus::Blocked:
+    return "blocked";
+  }
+  return "unknown";
+}
+
+void printState(const cpu::CPUState& state) {
+  std::cout << cpu::superopt::FormatImage(state) << " A=" << std::hex
+            << std::uppercase << +state.Registers[cpu::regID::A]
+            << " B=" << +state.Registers[cpu::regID::B]
+            << " IS=" << +state.Registers[cpu::regID::IS]
+            << " PC=" << +state.Registers[cpu::regID::PC]
+            << " ALU=" << +state.ALUResult << " flags=" << +state.Flags
+            << std::dec << (state.Halted ? " halted" : "");
+}
+
+void printOutcome(const std::string_view name,
+                  const cpu::fuzz::Outcome& outcome) {
+  std::cout << "  " << name << statusName(outcome.Result.Status) << " after "
+            << outcome.Result.Cycles << " cycles, ";
+  printState(outcome.Final);
+  std::cout << '\n';
+}
+
+void printDivergence(const cpu::fuzz::Divergence& divergence) {
+  std::cout << "divergence in " << cpu::fuzz::EngineName(divergence.Failing)
+            << "\n  found:     ";
+  printState(divergence.Original);
+  std::cout << "\n  minimised: ";
+  printState(divergence.Input);
+  std::cout << '\n';
+  printOutcome("reference: ", divergence.Expected);
+  printOutcome("engine:    ", divergence.Actual);
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  Options options{};
+  for (int i = 1; i < argc; i++) {
+    const std::string_view arg{argv[i]};
+    const auto number{i + 1 < argc ? ParseNumber(argv[i + 1]) : std::nullopt};
+    bool ok{number.has_value()};
+    if (ok && arg == "--threads") {
+      options.Threads = *number;
+    } else if (ok && arg == "--seconds") {
+      options.Seconds = *number;
+    } else if (ok && arg == "--programs") {
+      options.Programs = *number;
+    } else if (ok && arg == "--budget") {
+      options.Budget = *number;
+    } else if (ok && arg == "--seed") {
+      options.Seed = *number;
+    } else {
+      ok = false;
+    }
+
+    if (!ok) {
+      std::cerr << "cpu4fuzz: bad argument: " << arg << '\n';
+      usage();
+      return EXIT_FAILURE;
+    }
+    i++;
+  }
+  const uint64_t threads{
+      options.Threads != 0
+          ? options.Threads
+          : std::max(1u, std::thread::hardware_concurrency())};
+
+  // Candidates run into unknown opcodes all the time.
+  std::streambuf* const stderrBuffer{std::cerr.rdbuf(nullptr)};
+
+  using clock = std::chrono::steady_clock;
+  const auto start{clock::now()};
+  const auto deadline{start + std::chrono::seconds{options.Seconds}};
+  std::atomic<uint64_t> programs{};
+  std::atomic<bool> stop{};
+  std::mutex resultsMutex{};
+  std::vector<cpu::fuzz::Divergence> divergences{};
+  cpu::fuzz::Coverage coverage{};
+  uint64_t cycles{0};
+
+  {
+    std::vector<std::jthread> workers{};
+    for (uint64_t t = 0; t < threads; t++) {
+      workers.emplace_back([&, t] {
+        cpu::fuzz::Fuzzer fuzzer{
+            {.Seed = options.Seed + t * 0x1000000, .Budget = options.Budget}};
+        constexpr uint64_t chunk{4096};
+        while (!stop.load(std::memory_order_relaxed)) {
+          const auto found{fuzzer.Run(chunk)};
+          const uint64_t total{programs.fetch_add(chunk) + chunk};
+          if (!found.empty() ||
+              (options.Programs != 0 && total >= options.Programs)) {
+            stop = true;
+          }
+          if (!found.empty()) {
+            const std::scoped_lock lock{resultsMutex};
+            divergences.insert(divergences.end(), found.begin(), found.end());
+          }
+        }
+        const std::scoped_lock lock{resultsMutex};
+        coverage.Merge(fuzzer.GetCoverage());
+        cycles += fuzzer.GetStats().Cycles;
+      });
+    }
+
+    uint64_t reported{0};
+    while (!stop) {
+      std::this_thread::sleep_for(std::chrono::seconds{1});
+      if (clock::now() >= deadline) {
+        stop = true;
+      }
+      const uint64_t total{programs.load()};
+      std::cout << "programs: " << total << " (" << total - reported
+                << "/s)\n"
+                << std::flush;
+      reported = total;
+    }
+  }
+  std::cerr.rdbuf(stderrBuffer);
+
+  const double seconds{
+      std::chrono::duration<double>(clock::now() - start).count()};
+  const uint64_t total{programs.load()};
+  std::cout << std::fixed << std::setprecision(1)
+            << "programs:    " << total << '\n'
+            << "cycles:      " << cycles << '\n'
+            << "throughput:  "
+            << (seconds > 0 ? static_cast<double>(total) / seconds : 0)
+            << " programs/s\n"
+            << "coverage:    " << coverage.Count() << " bits\n"
+            << "divergences: " << divergences.size() << '\n';
+  for (const cpu::fuzz::Divergence& divergence : divergences) {
+    printDivergence(divergence);
+  }
+  return divergences.empty() ? EXIT_SUCCESS : EXIT_FAILURE;
+}
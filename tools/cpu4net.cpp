@@ -0,0 +1,106 @@
+// cpu4net runs a torus of nodes with random programs and reports how fast
+// the network advances:
+//
+//   cpu4net [--width N] [--height N] [--epochs N] [--epoch-cycles N]
+//           [--threads N] [--seed N]
+//
+// The defaults give a million nodes. The final hash does not depend on
+// --threads, so runs at different thread counts check each other.
+
+#include "CPUState.h"
+#include "Network.h"
+
+#include "ToolUtils.h"
+
+#include <cstdint>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <optional>
+#include <string_view>
+
+namespace {
+
+using cpu::tools::ParseNumber;
+
+void usage() {
+  std::cerr << "usage: cpu4net [--width N] [--height N] [--epochs N] "
+               "[--epoch-cycles N]\n"
+               "               [--threads N] [--seed N]\n";
+}
+
+void printStats(const cpu::Network& network, const size_t links,
+                const cpu::NetworkStats& stats) {
+  const double seconds{static_cast<double>(stats.WallNanos) / 1e9};
+  const double rate{seconds > 0 ? 1 / seconds : 0};
+  std::cout << std::fixed << std::setprecision(1)
+            << "nodes:      " << network.Nodes() << ", links " << links
+            << '\n'
+            << "epochs:     " << stats.Epochs << '\n'
+            << "cycles:     " << stats.Cycles << '\n'
+            << "messages:   " << stats.Messages << '\n'
+            << "wall:       " << seconds * 1e3 << " ms\n"
+            << "throughput: "
+            << static_cast<double>(stats.Cycles) * rate / 1e6
+            << " Mcycles/s, "
+            << static_cast<double>(stats.Epochs) * rate << " epochs/s\n"
+            << "status:     running " << stats.Statuses[0] << ", blocked "
+            << stats.Statuses[1] << ", halted " << stats.Statuses[2]
+            << ", fault " << stats.Statuses[3] << '\n'
+            << "hash:       " << std::hex << network.Hash() << std::dec
+            << '\n';
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  cpu::NetworkOptions options{};
+  uint64_t width{1024};
+  uint64_t height{1024};
+  uint64_t epochs{16};
+  uint64_t seed{1};
+
+  for (int i = 1; i < argc; i++) {
+    const std::string_view arg{argv[i]};
+    const auto number{i + 1 < argc ? ParseNumber(argv[i + 1]) : std::nullopt};
+    bool ok{number.has_value()};
+    if (ok && arg == "--width") {
+      width = *number;
+    } else if (ok && arg == "--height") {
+      height = *number;
+    } else if (ok && arg == "--epochs") {
+      epochs = *number;
+    } else if (ok && arg == "--epoch-cycles") {
+      options.EpochCycles = *number;
+    } else if (ok && arg == "--threads") {
+      options.Threads = *number;
+    } else if (ok && arg == "--seed") {
+      seed = *number;
+    } else {
+      ok = false;
+    }
+
+    if (!ok) {
+      std::cerr << "cpu4net: bad argument: " << arg << '\n';
+      usage();
+      return EXIT_FAILURE;
+    }
+    i++;
+  }
+  if (width == 0 || height == 0) {
+    usage();
+    return EXIT_FAILURE;
+  }
+
+  const cpu::Topology topology{cpu::Topology::Torus(width, height)};
+  cpu::Network network{topology, cpu::CPUState{}, options};
+  for (size_t node = 0; node < network.Nodes(); node++) {
+    // Random images.
+    cpu::CPUState state{};
+    state.Image = cpu::SplitMix64(seed);
+    network.SetState(node, state);
+  }
+
+  printStats(network, topology.Links().size(), network.Run(epochs));
+  return EXIT_SUCCESS;
+}
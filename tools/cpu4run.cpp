@@ -0,0 +1,162 @@
+// cpu4run runs every program of a corpus across all cores and writes a
+// corpus of results in input order:
+//
+//   cpu4run programs.corpus results.corpus [--threads N] [--budget N]
+//           [--batch N] [--no-loop-check] [--generate N] [--seed N]
+//
+// --generate first overwrites the input with N random images, which is handy
+// for measuring throughput. At the end it reports throughput, the
+// utilisation of each worker thread and per-program latency percentiles.
+
+#include "CPUState.h"
+#include "Corpus.h"
+#include "CorpusRunner.h"
+#include "RunResult.h"
+
+#include "ToolUtils.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace {
+
+using cpu::tools::ParseNumber;
+
+// Names for the status line, indexed by RunStatus.
+constexpr std::array<std::string_view, cpu::RunStatusCount> statusNames{
+    "halted", "budget", "looping", "fault", "blocked"};
+
+void usage() {
+  std::cerr << "usage: cpu4run INPUT OUTPUT [--threads N] [--budget N] "
+               "[--batch N]\n"
+               "               [--no-loop-check] [--generate N] [--seed N]\n";
+}
+
+// generate writes count random images (splitmix64) as a corpus.
+bool generate(const std::string& path, const uint64_t count, uint64_t seed) {
+  cpu::CorpusWriter writer{path, count, 0};
+  for (uint64_t i = 0; i < count && writer.Good(); i++) {
+    cpu::CPUState state{};
+    state.Image = cpu::SplitMix64(seed);
+    writer.SetState(i, state);
+  }
+  return writer.Close();
+}
+
+void printReport(const cpu::CorpusReport& report) {
+  const double seconds{static_cast<double>(report.WallNanos) / 1e9};
+  const double rate{seconds > 0 ? 1 / seconds : 0};
+  std::cout << std::fixed << std::setprecision(1)
+            << "programs:   " << report.Programs << '\n'
+            << "cycles:     " << report.Cycles << '\n'
+            << "wall:       " << seconds * 1e3 << " ms\n"
+            << "throughput: " << static_cast<double>(report.Programs) * rate
+            << " programs/s, "
+            << static_cast<double>(report.Cycles) * rate / 1e6
+            << " Mcycles/s\n"
+            << "status:     ";
+  for (size_t status = 0; status < statusNames.size(); status++) {
+    std::cout << (status == 0 ? "" : ", ") << statusNames[status] << ' '
+              << report.Statuses[status];
+  }
+  std::cout << '\n'
+            << "latency:    p50 " << report.Latency.Percentile(0.5)
+            << " ns, p99 " << report.Latency.Percentile(0.99) << " ns, p99.9 "
+            << report.Latency.Percentile(0.999) << " ns, max "
+            << report.Latency.Max() << " ns\n\n"
+            << "thread  programs   batches  stolen  busy\n";
+  for (size_t i = 0; i < report.Workers.size(); i++) {
+    const auto& worker{report.Workers[i]};
+    const double busy{report.WallNanos == 0
+                          ? 0
+                          : 100.0 * static_cast<double>(worker.BusyNanos) /
+                                static_cast<double>(report.WallNanos)};
+    std::cout << std::setw(6) << i << std::setw(10) << worker.Programs
+              << std::setw(10) << worker.Batches << std::setw(8)
+              << worker.Stolen << std::setw(6) << busy << "%\n";
+  }
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  cpu::CorpusRunOptions options{};
+  std::vector<std::string> paths{};
+  std::optional<uint64_t> generateCount{};
+  uint64_t seed{1};
+
+  for (int i = 1; i < argc; i++) {
+    const std::string_view arg{argv[i]};
+    if (!arg.starts_with("--")) {
+      paths.emplace_back(arg);
+      continue;
+    }
+    if (arg == "--no-loop-check") {
+      options.Loops = cpu::LoopCheck::Off;
+      continue;
+    }
+
+    const auto number{i + 1 < argc ? ParseNumber(argv[i + 1]) : std::nullopt};
+    bool ok{number.has_value()};
+    if (ok && arg == "--threads") {
+      options.Threads = *number;
+    } else if (ok && arg == "--budget") {
+      options.Budget = *number;
+    } else if (ok && arg == "--batch") {
+      options.Batch = *number;
+    } else if (ok && arg == "--generate") {
+      generateCount = *number;
+    } else if (ok && arg == "--seed") {
+      seed = *number;
+    } else {
+      ok = false;
+    }
+
+    if (!ok) {
+      std::cerr << "cpu4run: bad argument: " << arg << '\n';
+      usage();
+      return EXIT_FAILURE;
+    }
+    i++;
+  }
+
+  if (paths.size() != 2) {
+    usage();
+    return EXIT_FAILURE;
+  }
+  if (generateCount && !generate(paths[0], *generateCount, seed)) {
+    std::cerr << "cpu4run: cannot write " << paths[0] << '\n';
+    return EXIT_FAILURE;
+  }
+
+  const auto input{cpu::CorpusReader::Open(paths[0])};
+  if (!input) {
+    std::cerr << "cpu4run: cannot read corpus " << paths[0] << '\n';
+    return EXIT_FAILURE;
+  }
+  const uint32_t columns{cpu::CorpusHeader::Results |
+                         (input->HasRegisters()
+                              ? uint32_t{cpu::CorpusHeader::Registers}
+                              : 0u)};
+  cpu::CorpusWriter output{paths[1], input->Size(), columns};
+  if (!output.Good()) {
+    std::cerr << "cpu4run: cannot write " << paths[1] << '\n';
+    return EXIT_FAILURE;
+  }
+
+  const cpu::CorpusReport report{cpu::RunCorpus(*input, output, options)};
+  if (!output.Close()) {
+    std::cerr << "cpu4run: cannot write " << paths[1] << '\n';
+    return EXIT_FAILURE;
+  }
+  printReport(report);
+  return EXIT_SUCCESS;
+}
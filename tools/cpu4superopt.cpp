@@ -0,0 +1,168 @@
+// cpu4superopt searches for the shortest (or fastest) program that matches a
+// target behaviour.
+//
+// The behaviour comes either from an existing image, run on every value of
+// its input words, or from explicit examples:
+//
+//   cpu4superopt --image 1E3F614D00000000 --in 0xE --in 0xF --out 0xD
+//   cpu4superopt --in 0xE --out-a --example 3:6 --example 5:10
+//
+// Example syntax is "in,in,...:out,out,...", outputs in --out order followed
+// by register A when --out-a is given.
+
+#include "Superopt.h"
+
+#include "ToolUtils.h"
+
+#include <cstdlib>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace {
+
+using cpu::tools::ParseNumber;
+
+using cpu::superopt::Example;
+using cpu::superopt::Metric;
+using cpu::superopt::Options;
+using cpu::superopt::Spec;
+
+void usage() {
+  std::cerr << "usage: cpu4superopt [--image HEX16] [--in ADDR]... "
+               "[--out ADDR]... [--out-a]\n"
+               "                    [--example IN,..:OUT,..]... "
+               "[--max-length N] [--max-cycles N]\n"
+               "                    [--metric size|cycles] [--threads N]\n";
+}
+
+std::optional<cpu::uint4> parseWord(const std::string_view text) {
+  const auto value{ParseNumber(text)};
+  if (!value || *value > 0xF) {
+    return std::nullopt;
+  }
+  return cpu::uint4(static_cast<uint8_t>(*value));
+}
+
+std::optional<std::vector<cpu::uint4>> parseWords(std::string_view text) {
+  std::vector<cpu::uint4> words{};
+  while (!text.empty()) {
+    const size_t comma{text.find(',')};
+    const auto word{parseWord(text.substr(0, comma))};
+    if (!word) {
+      return std::nullopt;
+    }
+    words.push_back(*word);
+    text = comma == std::string_view::npos ? "" : text.substr(comma + 1);
+  }
+  return words;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  Spec spec{};
+  Options options{};
+  std::optional<cpu::CPUState> image{};
+  std::vector<std::string_view> examples{};
+
+  for (int i = 1; i < argc; i++) {
+    const std::string_view arg{argv[i]};
+    const bool hasValue{i + 1 < argc};
+    const std::string_view value{hasValue ? argv[i + 1] : ""};
+    bool ok{hasValue};
+
+    if (arg == "--out-a") {
+      spec.CheckA = true;
+      continue;
+    }
+    if (arg == "--image") {
+      image = cpu::superopt::ParseImage(value);
+      ok = ok && image.has_value();
+    } else if (arg == "--in" || arg == "--out") {
+      const auto addr{parseWord(value)};
+      ok = ok && addr.has_value();
+      if (ok) {
+        (arg == "--in" ? spec.InputAddrs : spec.OutputAddrs).push_back(*addr);
+      }
+    } else if (arg == "--example") {
+      examples.push_back(value);
+    } else if (arg == "--max-length" || arg == "--max-cycles" ||
+               arg == "--threads") {
+      const auto number{ParseNumber(value)};
+      ok = ok && number.has_value();
+      if (ok && arg == "--max-length") {
+        options.MaxLength = *number;
+      } else if (ok && arg == "--max-cycles") {
+        options.MaxCycles = *number;
+      } else if (ok) {
+        options.Threads = *number;
+      }
+    } else if (arg == "--metric") {
+      ok = ok && (value == "size" || value == "cycles");
+      options.Goal = value == "cycles" ? Metric::Cycles : Metric::Size;
+    } else {
+      ok = false;
+    }
+
+    if (!ok) {
+      std::cerr << "cpu4superopt: bad argument: " << arg << '\n';
+      usage();
+      return EXIT_FAILURE;
+    }
+    i++;
+  }
+
+  if (spec.OutputAddrs.empty() && !spec.CheckA) {
+    std::cerr << "cpu4superopt: no outputs given\n";
+    usage();
+    return EXIT_FAILURE;
+  }
+
+  if (image) {
+    if (spec.InputAddrs.size() > 3) {
+      std::cerr << "cpu4superopt: at most 3 inputs can be derived from an "
+                   "image\n";
+      return EXIT_FAILURE;
+    }
+    spec = cpu::superopt::SpecFromImage(*image, spec.InputAddrs,
+                                        spec.OutputAddrs, spec.CheckA,
+                                        options.MaxCycles);
+  }
+  for (const std::string_view text : examples) {
+    const size_t colon{text.find(':')};
+    const auto inputs{parseWords(text.substr(0, colon))};
+    const auto outputs{colon == std::string_view::npos
+                           ? std::nullopt
+                           : parseWords(text.substr(colon + 1))};
+    const size_t numOutputs{spec.OutputAddrs.size() + (spec.CheckA ? 1 : 0)};
+    if (!inputs || !outputs || inputs->size() != spec.InputAddrs.size() ||
+        outputs->size() != numOutputs) {
+      std::cerr << "cpu4superopt: bad example: " << text << '\n';
+      return EXIT_FAILURE;
+    }
+    spec.Examples.push_back(Example{*inputs, *outputs});
+  }
+  if (spec.Examples.empty()) {
+    std::cerr << "cpu4superopt: no examples to match\n";
+    return EXIT_FAILURE;
+  }
+
+  const auto result{cpu::superopt::Search(spec, options)};
+  std::cout << "examples:  " << spec.Examples.size() << '\n'
+            << "evaluated: " << result.Evaluated << '\n'
+            << "pruned:    " << result.Pruned << '\n';
+  if (!result.Found) {
+    std::cout << "no program of length <= " << options.MaxLength
+              << " matches\n";
+    return EXIT_FAILURE;
+  }
+  std::cout << "length:    " << result.Length << '\n'
+            << "cycles:    " << result.Cycles << '\n'
+            << "image:     " << cpu::superopt::FormatImage(result.Program)
+            << "\n\n"
+            << cpu::superopt::Disassemble(result.Program, result.Length);
+  return EXIT_SUCCESS;
+}